@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Shape and stride arithmetic for NumPy-style broadcasting. Broadcasting is expressed as a strided view with zero
+// strides along broadcast dimensions, so the smaller operand is never copied.
+
+constexpr size_t c_maxTensorRank = 8;
+
+using TensorShape = std::vector<uint32_t>;
+
+inline void ValidateShape(const TensorShape &shape)
+{
+    if (shape.empty() || shape.size() > c_maxTensorRank)
+    {
+        throw std::invalid_argument("Tensor rank must be between 1 and " + std::to_string(c_maxTensorRank) + ".");
+    }
+    if (std::find(shape.begin(), shape.end(), 0u) != shape.end())
+    {
+        throw std::invalid_argument("Tensor dimensions must be non-zero.");
+    }
+}
+
+inline uint64_t ElementCount(const TensorShape &shape)
+{
+    uint64_t count = 1;
+    for (uint32_t size : shape)
+    {
+        count *= size;
+    }
+    return count;
+}
+
+// Aligns both shapes to the right; each pair of dimensions must be equal or one of them must be 1.
+inline std::optional<TensorShape> TryBroadcastShapes(const TensorShape &a, const TensorShape &b)
+{
+    size_t rank = std::max(a.size(), b.size());
+    TensorShape result(rank, 1);
+    for (size_t i = 0; i < rank; ++i)
+    {
+        uint32_t sizeA = i < rank - a.size() ? 1 : a[i - (rank - a.size())];
+        uint32_t sizeB = i < rank - b.size() ? 1 : b[i - (rank - b.size())];
+        if (sizeA != sizeB && sizeA != 1 && sizeB != 1)
+        {
+            return std::nullopt;
+        }
+        result[i] = std::max(sizeA, sizeB);
+    }
+    return result;
+}
+
+inline TensorShape BroadcastShapes(const TensorShape &a, const TensorShape &b)
+{
+    auto result = TryBroadcastShapes(a, b);
+    if (!result)
+    {
+        auto format = [](const TensorShape &shape) {
+            std::string text = "{";
+            for (size_t i = 0; i < shape.size(); ++i)
+            {
+                text += (i == 0 ? "" : ",") + std::to_string(shape[i]);
+            }
+            return text + "}";
+        };
+        throw std::invalid_argument("Shapes " + format(a) + " and " + format(b) + " cannot be broadcast together.");
+    }
+    return *result;
+}
+
+// Element strides of a densely packed tensor.
+inline std::vector<uint32_t> ContiguousStrides(const TensorShape &shape)
+{
+    std::vector<uint32_t> strides(shape.size(), 1);
+    for (size_t i = shape.size(); i-- > 1;)
+    {
+        strides[i - 1] = strides[i] * shape[i];
+    }
+    return strides;
+}
+
+// Strides that view a densely packed tensor of shape as target, with 0 for every dimension that is broadcast,
+// including leading dimensions that shape does not have.
+inline std::vector<uint32_t> BroadcastStrides(const TensorShape &shape, const TensorShape &target)
+{
+    if (shape.size() > target.size())
+    {
+        throw std::invalid_argument("Cannot broadcast a tensor to a lower rank.");
+    }
+    std::vector<uint32_t> contiguous = ContiguousStrides(shape);
+    std::vector<uint32_t> strides(target.size(), 0);
+    size_t offset = target.size() - shape.size();
+    for (size_t i = 0; i < shape.size(); ++i)
+    {
+        if (shape[i] == target[offset + i])
+        {
+            strides[offset + i] = contiguous[i];
+        }
+        else if (shape[i] != 1)
+        {
+            throw std::invalid_argument("Tensor cannot be broadcast to the target shape.");
+        }
+    }
+    return strides;
+}
+
+// Iteration order for a binary broadcast into a dense output: size-1 dimensions are dropped and neighbours that are
+// contiguous in both operands are merged, so the innermost run is as long as possible. The innermost strides are
+// 1 for a packed operand and 0 for one broadcast along the run.
+struct BroadcastPlan
+{
+    std::vector<size_t> sizes;
+    std::vector<size_t> stridesA;
+    std::vector<size_t> stridesB;
+    uint64_t elementCount = 1;
+};
+
+inline BroadcastPlan PlanBroadcast(const TensorShape &a, const TensorShape &b, const TensorShape &result)
+{
+    std::vector<uint32_t> fullStridesA = BroadcastStrides(a, result);
+    std::vector<uint32_t> fullStridesB = BroadcastStrides(b, result);
+
+    BroadcastPlan plan;
+    plan.elementCount = ElementCount(result);
+    for (size_t d = 0; d < result.size(); ++d)
+    {
+        size_t size = result[d];
+        if (size == 1)
+        {
+            continue;
+        }
+        if (!plan.sizes.empty() && plan.stridesA.back() == fullStridesA[d] * size &&
+            plan.stridesB.back() == fullStridesB[d] * size)
+        {
+            plan.sizes.back() *= size;
+            plan.stridesA.back() = fullStridesA[d];
+            plan.stridesB.back() = fullStridesB[d];
+            continue;
+        }
+        plan.sizes.push_back(size);
+        plan.stridesA.push_back(fullStridesA[d]);
+        plan.stridesB.push_back(fullStridesB[d]);
+    }
+    if (plan.sizes.empty())
+    {
+        plan.sizes = {1};
+        plan.stridesA = {0};
+        plan.stridesB = {0};
+    }
+    return plan;
+}
+
+// Calls run(outputOffset, offsetA, offsetB, count) for every contiguous run of output elements in [begin, end), so
+// disjoint ranges can be processed by different threads.
+template <typename Function>
+void ForEachBroadcastRun(const BroadcastPlan &plan, uint64_t begin, uint64_t end, Function &&run)
+{
+    size_t rank = plan.sizes.size();
+    std::vector<size_t> index(rank, 0);
+    size_t offsetA = 0, offsetB = 0;
+
+    // Position the index on begin, innermost dimension first.
+    uint64_t remaining = begin;
+    for (size_t d = rank; d-- > 0;)
+    {
+        index[d] = static_cast<size_t>(remaining % plan.sizes[d]);
+        remaining /= plan.sizes[d];
+        offsetA += index[d] * plan.stridesA[d];
+        offsetB += index[d] * plan.stridesB[d];
+    }
+
+    size_t inner = rank - 1;
+    for (uint64_t offset = begin; offset < end;)
+    {
+        size_t count = static_cast<size_t>(std::min<uint64_t>(plan.sizes[inner] - index[inner], end - offset));
+        run(static_cast<size_t>(offset), offsetA, offsetB, count);
+        offset += count;
+
+        // Advance past the run, carrying into the outer dimensions.
+        offsetA += count * plan.stridesA[inner];
+        offsetB += count * plan.stridesB[inner];
+        index[inner] += count;
+        for (size_t d = inner; d > 0 && index[d] == plan.sizes[d]; --d)
+        {
+            offsetA -= plan.stridesA[d] * index[d];
+            offsetB -= plan.stridesB[d] * index[d];
+            index[d] = 0;
+            offsetA += plan.stridesA[d - 1];
+            offsetB += plan.stridesB[d - 1];
+            ++index[d - 1];
+        }
+    }
+}
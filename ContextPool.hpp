@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Pool of per-thread working state, such as a command list with its allocators or scratch buffers. A thread leases a
+// context for the duration of one call and has it to itself; contexts are created through a factory when every
+// existing one is leased, so the pool grows to the number of threads that call at once. The mutex is only held to
+// hand contexts out and take them back.
+//
+// Like the other bookkeeping classes this does not depend on D3D12, so it can be driven by fake contexts.
+template <typename Context> class ContextPool
+{
+  public:
+    using Factory = std::function<std::unique_ptr<Context>()>;
+
+    explicit ContextPool(Factory factory = {}) : m_factory(std::move(factory))
+    {
+    }
+
+    ContextPool(const ContextPool &) = delete;
+    ContextPool &operator=(const ContextPool &) = delete;
+
+    // Exclusive use of one context, returned to the pool when the lease is destroyed.
+    class Lease
+    {
+      public:
+        Lease() = default;
+        Lease(Lease &&other) noexcept
+            : m_pool(std::exchange(other.m_pool, nullptr)), m_context(std::exchange(other.m_context, nullptr))
+        {
+        }
+        Lease &operator=(Lease &&other) noexcept
+        {
+            if (this != &other)
+            {
+                Reset();
+                m_pool = std::exchange(other.m_pool, nullptr);
+                m_context = std::exchange(other.m_context, nullptr);
+            }
+            return *this;
+        }
+        ~Lease()
+        {
+            Reset();
+        }
+
+        explicit operator bool() const
+        {
+            return m_context != nullptr;
+        }
+        Context &operator*() const
+        {
+            return *m_context;
+        }
+        Context *operator->() const
+        {
+            return m_context;
+        }
+
+        void Reset()
+        {
+            if (m_pool)
+            {
+                m_pool->Return(m_context);
+            }
+            m_pool = nullptr;
+            m_context = nullptr;
+        }
+
+      private:
+        friend class ContextPool;
+        Lease(ContextPool *pool, Context *context) : m_pool(pool), m_context(context)
+        {
+        }
+
+        ContextPool *m_pool = nullptr;
+        Context *m_context = nullptr;
+    };
+
+    // The most recently returned context, whose memory is most likely still in cache, or a new one.
+    Lease Acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_idle.empty())
+            {
+                Context *context = m_idle.back();
+                m_idle.pop_back();
+                return Lease(this, context);
+            }
+        }
+
+        // Contexts can be expensive to create, so the factory runs without the lock.
+        std::unique_ptr<Context> created = m_factory();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_contexts.push_back(std::move(created));
+        return Lease(this, m_contexts.back().get());
+    }
+
+    // Number of contexts created so far, leased or idle.
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_contexts.size();
+    }
+
+    // Calls function on every idle context. Leased contexts are skipped; they belong to the threads using them.
+    template <typename Function> void ForEachIdle(Function &&function)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Context *context : m_idle)
+        {
+            function(*context);
+        }
+    }
+
+    // Destroys every idle context.
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (Context *context : m_idle)
+        {
+            for (auto it = m_contexts.begin(); it != m_contexts.end(); ++it)
+            {
+                if (it->get() == context)
+                {
+                    m_contexts.erase(it);
+                    break;
+                }
+            }
+        }
+        m_idle.clear();
+    }
+
+  private:
+    void Return(Context *context)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idle.push_back(context);
+    }
+
+    Factory m_factory;
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<Context>> m_contexts;
+    std::vector<Context *> m_idle;
+};
@@ -0,0 +1,813 @@
+#include "CpuBackend.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+
+#include "Trace.hpp"
+
+namespace
+{
+// Work is split into chunks of at least this many elements so per-chunk overhead stays small.
+constexpr uint64_t c_minChunkElements = 16 * 1024;
+// Runs are processed in blocks this long so a non-linear activation is applied while the block is still in L1.
+constexpr size_t c_blockElements = 4096;
+
+// GEMM blocking. A block of c_gemmRowBlock rows of a by c_gemmDepthBlock is packed once and stays in L2 while it meets
+// every panel of the c_gemmColumnBlock columns of b, and each packed c_gemmDepthBlock x tileColumns panel of b stays in
+// L1 while every tile of rows passes over it. Both row and column blocks are multiples of every kernel's tile.
+constexpr size_t c_gemmDepthBlock = 256;
+constexpr size_t c_gemmRowBlock = 96;
+constexpr size_t c_gemmColumnBlock = 512;
+// GEMMs with fewer floating-point operations than this run on the calling thread.
+constexpr uint64_t c_minParallelGemmFlops = 1 << 22;
+
+using ActivationRunFunction = void (*)(float *data, size_t count, float alpha, float scale);
+
+template <Activation Act> void ActivationRun(float *data, size_t count, float alpha, float scale)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        data[i] = scale * ActivationFunction<Act>::Apply(data[i], alpha);
+    }
+}
+
+bool IsFloatType(TensorDataType type)
+{
+    return type == TensorDataType::Float32 || type == TensorDataType::Float16;
+}
+
+// A matrix read through strides, so the transposed and the plain layout are packed by the same loop.
+struct StridedMatrix
+{
+    const float *data = nullptr;
+    size_t rowStride = 0;
+    size_t columnStride = 0;
+
+    float At(size_t row, size_t column) const
+    {
+        return data[row * rowStride + column * columnStride];
+    }
+};
+
+// Copies rows [row, row + rows) and columns [column, column + columns) of a, scaled by alpha, into panels of tile rows
+// that hold tile elements for each column in turn. Rows past the end of the last panel are zero.
+void PackRowPanels(const StridedMatrix &a, size_t row, size_t rows, size_t column, size_t columns, size_t tile,
+                   float alpha, float *out)
+{
+    for (size_t panel = 0; panel < rows; panel += tile)
+    {
+        size_t valid = std::min(tile, rows - panel);
+        for (size_t k = 0; k < columns; ++k)
+        {
+            for (size_t r = 0; r < tile; ++r)
+            {
+                *out++ = r < valid ? alpha * a.At(row + panel + r, column + k) : 0.0f;
+            }
+        }
+    }
+}
+
+// The same for b in panels of tile columns that hold tile elements for each row in turn.
+void PackColumnPanels(const StridedMatrix &b, size_t row, size_t rows, size_t column, size_t columns, size_t tile,
+                      float *out)
+{
+    for (size_t panel = 0; panel < columns; panel += tile)
+    {
+        size_t valid = std::min(tile, columns - panel);
+        for (size_t k = 0; k < rows; ++k)
+        {
+            for (size_t c = 0; c < tile; ++c)
+            {
+                *out++ = c < valid ? b.At(row + k, column + panel + c) : 0.0f;
+            }
+        }
+    }
+}
+
+size_t RoundUp(size_t value, size_t multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+} // namespace
+
+CpuBackend::CpuBackend(const CpuBackendOptions &options)
+    : m_simdLevel(std::min(DetectSimdLevel(), options.maxSimdLevel)), m_binaryKernels(BinaryKernels(m_simdLevel)),
+      m_conversions(ConversionKernels(m_simdLevel)), m_matrixKernels(MatrixKernels(m_simdLevel)),
+      m_minParallelElements(options.minParallelElements),
+      m_capacityPolicy(options.tensorCapacity), m_threadPool(options.threadCount),
+      m_scratch([]() { return std::make_unique<Scratch>(); }),
+      m_residencyEnabled(options.memoryBudget != ResidencyManager::c_unlimited),
+      m_spillDirectory(options.spillDirectory), m_residency(options.memoryBudget)
+{
+    if (m_residencyEnabled && m_spillDirectory.empty())
+    {
+        m_spillDirectory = std::filesystem::temp_directory_path().string();
+    }
+}
+
+CpuBackend::ResidentTensors::ResidentTensors(CpuBackend &backend, const std::vector<TensorHandle> &reads,
+                                             const std::vector<TensorHandle> &writes)
+{
+    if (!backend.m_residencyEnabled)
+    {
+        return;
+    }
+    m_backend = &backend;
+    m_tensors = reads;
+    m_tensors.insert(m_tensors.end(), writes.begin(), writes.end());
+
+    std::lock_guard<std::mutex> lock(backend.m_residencyMutex);
+    ResidencyManager &residency = backend.m_residency;
+    std::vector<TensorHandle> spilled = residency.Pin(m_tensors);
+    try
+    {
+        uint64_t incoming = 0;
+        for (TensorHandle handle : spilled)
+        {
+            incoming += residency.Bytes(handle);
+        }
+        backend.MakeRoom(incoming);
+
+        for (TensorHandle handle : spilled)
+        {
+            // A tensor the call only writes needs its storage, not its old contents.
+            CpuTensor &tensor = backend.m_tensors.Get(handle);
+            bool read = std::find(reads.begin(), reads.end(), handle) != reads.end();
+            size_t bytes = static_cast<size_t>(tensor.spill ? tensor.spill->Size() : 0);
+            TRACE_SPAN(read ? "PageIn" : "Discard", tensor.name, bytes);
+            tensor.data.reserve(static_cast<size_t>(tensor.capacity.Bytes()));
+            if (read && bytes != 0)
+            {
+                tensor.data.assign(tensor.spill->Data(), tensor.spill->Data() + bytes);
+            }
+            else
+            {
+                tensor.data.assign(bytes, 0);
+            }
+            tensor.spill.reset();
+            residency.MarkResident(handle, read);
+        }
+    }
+    catch (...)
+    {
+        residency.Unpin(m_tensors, 0);
+        throw;
+    }
+}
+
+CpuBackend::ResidentTensors::~ResidentTensors()
+{
+    if (!m_backend)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_backend->m_residencyMutex);
+    ResidencyManager &residency = m_backend->m_residency;
+    for (TensorHandle handle : m_tensors)
+    {
+        const CpuTensor *tensor = m_backend->m_tensors.Find(handle);
+        if (tensor && residency.IsResident(handle))
+        {
+            residency.Resize(handle, ResidentBytes(*tensor));
+        }
+    }
+    residency.Unpin(m_tensors, 0);
+    try
+    {
+        m_backend->MakeRoom(0);
+    }
+    catch (const std::exception &)
+    {
+        // The spill file could not be written; the tensors stay in memory, over budget, until the next call.
+    }
+}
+
+void CpuBackend::TrackTensor(TensorHandle tensor)
+{
+    if (m_residencyEnabled)
+    {
+        std::lock_guard<std::mutex> lock(m_residencyMutex);
+        if (!m_residency.Contains(tensor))
+        {
+            m_residency.Add(tensor, 0);
+        }
+    }
+}
+
+void CpuBackend::MakeRoom(uint64_t incoming)
+{
+    ResidencyManager::EvictionPlan plan = m_residency.PlanEviction(incoming);
+    for (TensorHandle handle : plan.victims)
+    {
+        CpuTensor &tensor = m_tensors.Get(handle);
+        TRACE_SPAN("Spill", tensor.name, tensor.data.size());
+        if (!tensor.data.empty())
+        {
+            tensor.spill = MappedFile::CreateTemporary(m_spillDirectory, tensor.data.size());
+            memcpy(tensor.spill->MutableData(), tensor.data.data(), tensor.data.size());
+        }
+        std::vector<uint8_t>().swap(tensor.data);
+        m_residency.MarkEvicted(handle);
+    }
+}
+
+std::string CpuBackend::Name() const
+{
+    return std::string("CPU (") + SimdLevelName(m_simdLevel) + ", " + std::to_string(m_threadPool.ThreadCount()) +
+           " threads)";
+}
+
+TensorHandle CpuBackend::CreateTensor(const std::string &name, const TensorShape &shape, TensorDataType type)
+{
+    ValidateShape(shape);
+    StoragePrecision precision = StoragePrecision::Float32;
+    size_t elementSize = DataTypeSize(type);
+    if (type == TensorDataType::Float32)
+    {
+        precision = GetStoragePrecision(name);
+        elementSize = StoragePrecisionSize(precision);
+    }
+    else if (type == TensorDataType::Float16)
+    {
+        precision = StoragePrecision::Float16;
+    }
+
+    auto [handle, tensor] = m_tensors.FindOrCreate(name, [&]() {
+        CpuTensor created;
+        created.name = name;
+        return created;
+    });
+    TrackTensor(handle);
+    if (tensor->shape != shape || tensor->type != type || tensor->precision != precision)
+    {
+        ResidentTensors resident(*this, {}, {handle});
+        tensor->mapping.reset();
+        tensor->view = nullptr;
+        tensor->shape = shape;
+        tensor->type = type;
+        tensor->precision = precision;
+
+        // Within capacity the storage is reused, so reshaping between request sizes does not allocate.
+        size_t bytes = static_cast<size_t>(ElementCount(shape) * elementSize);
+        if (tensor->capacity.Reserve(bytes, m_capacityPolicy))
+        {
+            std::vector<uint8_t> storage;
+            storage.reserve(static_cast<size_t>(tensor->capacity.Bytes()));
+            tensor->data.swap(storage);
+        }
+        tensor->data.assign(bytes, 0);
+    }
+    return handle;
+}
+
+TensorHandle CpuBackend::FindTensor(const std::string &name) const
+{
+    return m_tensors.Find(name);
+}
+
+TensorShape CpuBackend::GetTensorShape(TensorHandle handle) const
+{
+    return m_tensors.Get(handle).shape;
+}
+
+TensorDataType CpuBackend::GetTensorType(TensorHandle handle) const
+{
+    return m_tensors.Get(handle).type;
+}
+
+void CpuBackend::ReleaseTensor(TensorHandle tensor)
+{
+    // Ops run synchronously, so nothing can still be using the tensor.
+    if (m_residencyEnabled)
+    {
+        std::lock_guard<std::mutex> lock(m_residencyMutex);
+        m_residency.Remove(tensor);
+    }
+    m_tensors.Erase(tensor);
+}
+
+TensorHandle CpuBackend::LoadTensor(const std::string &name, const TensorFile &file, const TensorFileEntry &entry)
+{
+    // A view needs the contents in the storage the tensor would have, aligned for the kernels that read them in
+    // place. Float32 tensors in reduced-precision storage and misaligned contents are copied.
+    const uint8_t *data = file.Data(entry);
+    bool storedAsIs = entry.type != TensorDataType::Float32 || GetStoragePrecision(name) == StoragePrecision::Float32;
+    if (!storedAsIs || reinterpret_cast<uintptr_t>(data) % DataTypeSize(entry.type) != 0)
+    {
+        return TensorBackend::LoadTensor(name, file, entry);
+    }
+
+    ValidateShape(entry.shape);
+    auto [handle, tensor] = m_tensors.FindOrCreate(name, [&]() {
+        CpuTensor created;
+        created.name = name;
+        return created;
+    });
+    TrackTensor(handle);
+    ResidentTensors resident(*this, {}, {handle});
+    tensor->shape = entry.shape;
+    tensor->type = entry.type;
+    tensor->precision = entry.type == TensorDataType::Float16 ? StoragePrecision::Float16 : StoragePrecision::Float32;
+    tensor->data = {};
+    tensor->capacity = {};
+    tensor->mapping = file.Mapping();
+    tensor->view = data;
+    return handle;
+}
+
+uint8_t *CpuBackend::WritableBytes(CpuTensor &tensor)
+{
+    if (tensor.view)
+    {
+        size_t bytes = static_cast<size_t>(ElementCount(tensor.shape) * DataTypeSize(tensor.type));
+        tensor.capacity.Reserve(bytes, m_capacityPolicy);
+        tensor.data.assign(tensor.view, tensor.view + bytes);
+        tensor.mapping.reset();
+        tensor.view = nullptr;
+    }
+    return tensor.data.data();
+}
+
+void CpuBackend::ParallelFor(uint64_t count, const std::function<void(uint64_t, uint64_t)> &function)
+{
+    ParallelFor(count, c_minChunkElements, count >= m_minParallelElements, function);
+}
+
+void CpuBackend::ParallelFor(uint64_t count, uint64_t grain, bool parallel,
+                             const std::function<void(uint64_t, uint64_t)> &function)
+{
+    // The pool runs one loop at a time. Concurrent calls each already have a thread of their own, so a call that
+    // finds the pool taken runs its loop inline rather than queueing behind the other.
+    std::unique_lock<std::mutex> lock(m_threadPoolMutex, std::defer_lock);
+    if (!parallel || !lock.try_lock())
+    {
+        function(0, count);
+    }
+    else
+    {
+        m_threadPool.ParallelFor(count, grain, function);
+    }
+}
+
+void CpuBackend::Decode(const CpuTensor &tensor, float *out, uint64_t count)
+{
+    const uint8_t *in = Bytes(tensor);
+    ParallelFor(count, [&](uint64_t begin, uint64_t end) {
+        size_t length = static_cast<size_t>(end - begin);
+        switch (tensor.precision)
+        {
+        case StoragePrecision::Float16:
+            m_conversions.halfToFloat(reinterpret_cast<const uint16_t *>(in) + begin, out + begin, length);
+            break;
+        case StoragePrecision::BFloat16:
+            m_conversions.bfloat16ToFloat(reinterpret_cast<const uint16_t *>(in) + begin, out + begin, length);
+            break;
+        case StoragePrecision::Int8:
+            m_conversions.int8ToFloat(reinterpret_cast<const int8_t *>(in) + begin, out + begin, length,
+                                      tensor.scale);
+            break;
+        default:
+            memcpy(out + begin, reinterpret_cast<const float *>(in) + begin, length * sizeof(float));
+            break;
+        }
+    });
+}
+
+void CpuBackend::Encode(const float *in, uint64_t count, CpuTensor &tensor)
+{
+    if (tensor.precision == StoragePrecision::Int8)
+    {
+        std::mutex mutex;
+        float maxAbs = 0.0f;
+        ParallelFor(count, [&](uint64_t begin, uint64_t end) {
+            float chunkMax = m_conversions.maxAbs(in + begin, static_cast<size_t>(end - begin));
+            std::lock_guard<std::mutex> lock(mutex);
+            maxAbs = std::max(maxAbs, chunkMax);
+        });
+        tensor.scale = maxAbs > 0.0f ? maxAbs / 127.0f : 1.0f;
+    }
+
+    uint8_t *out = WritableBytes(tensor);
+    ParallelFor(count, [&](uint64_t begin, uint64_t end) {
+        size_t length = static_cast<size_t>(end - begin);
+        switch (tensor.precision)
+        {
+        case StoragePrecision::Float16:
+            m_conversions.floatToHalf(in + begin, reinterpret_cast<uint16_t *>(out) + begin, length);
+            break;
+        case StoragePrecision::BFloat16:
+            m_conversions.floatToBFloat16(in + begin, reinterpret_cast<uint16_t *>(out) + begin, length);
+            break;
+        case StoragePrecision::Int8:
+            m_conversions.floatToInt8(in + begin, reinterpret_cast<int8_t *>(out) + begin, length, tensor.scale);
+            break;
+        default:
+            memcpy(reinterpret_cast<float *>(out) + begin, in + begin, length * sizeof(float));
+            break;
+        }
+    });
+}
+
+const float *CpuBackend::ReadFloats(const CpuTensor &tensor, std::vector<float> &scratch)
+{
+    if (tensor.precision == StoragePrecision::Float32)
+    {
+        return reinterpret_cast<const float *>(Bytes(tensor));
+    }
+    scratch.resize(static_cast<size_t>(ElementCount(tensor.shape)));
+    Decode(tensor, scratch.data(), scratch.size());
+    return scratch.data();
+}
+
+void CpuBackend::SetTensorData(TensorHandle handle, const void *data, size_t size)
+{
+    CpuTensor &tensor = m_tensors.Get(handle);
+    bool whole = size >= ElementCount(tensor.shape) * DataTypeSize(tensor.type);
+    ResidentTensors resident(*this, whole ? std::vector<TensorHandle>() : std::vector<TensorHandle>{handle},
+                             whole ? std::vector<TensorHandle>{handle} : std::vector<TensorHandle>());
+    ScopedPhase phase(m_phaseTimes, Phase::Upload);
+    TRACE_SPAN("Upload", tensor.name, size);
+
+    if (tensor.type == TensorDataType::Float32 && tensor.precision != StoragePrecision::Float32)
+    {
+        Encode(static_cast<const float *>(data), std::min<uint64_t>(size / sizeof(float), ElementCount(tensor.shape)),
+               tensor);
+    }
+    else
+    {
+        uint8_t *storage = WritableBytes(tensor);
+        memcpy(storage, data, std::min(size, tensor.data.size()));
+    }
+}
+
+void CpuBackend::GetTensorData(TensorHandle handle, const TensorShape &shape, TensorDataType type, void *data,
+                               size_t size)
+{
+    CpuTensor &tensor = m_tensors.Get(handle);
+    if (type != tensor.type)
+    {
+        throw std::invalid_argument("GetTensorData type does not match tensor " + tensor.name + ".");
+    }
+    if (!shape.empty() && shape != tensor.shape)
+    {
+        throw std::invalid_argument("GetTensorData shape does not match tensor " + tensor.name + ".");
+    }
+    if (size > ElementCount(tensor.shape) * DataTypeSize(type))
+    {
+        throw std::invalid_argument("GetTensorData size is larger than tensor " + tensor.name + ".");
+    }
+    // Tensors already live in host memory, so there is no readback.
+    ResidentTensors resident(*this, {handle});
+    ScopedPhase phase(m_phaseTimes, Phase::HostCopy);
+    TRACE_SPAN("HostCopy", tensor.name, size);
+    if (type == TensorDataType::Float32 && tensor.precision != StoragePrecision::Float32)
+    {
+        Decode(tensor, static_cast<float *>(data), size / sizeof(float));
+    }
+    else
+    {
+        memcpy(data, Bytes(tensor), size);
+    }
+}
+
+SubmissionTicket CpuBackend::ElementWise(const ElementWiseDesc &desc, TensorHandle src0, TensorHandle src1,
+                                         TensorHandle dst)
+{
+    CpuTensor &a = m_tensors.Get(src0);
+    CpuTensor &b = m_tensors.Get(src1);
+    CpuTensor &c = m_tensors.Get(dst);
+    if (!IsFloatType(a.type) || !IsFloatType(b.type) || !IsFloatType(c.type))
+    {
+        throw std::invalid_argument("The CPU backend only runs element-wise ops on float32 and float16 tensors.");
+    }
+    if (BroadcastShapes(a.shape, b.shape) != c.shape)
+    {
+        throw std::invalid_argument("Broadcast result shape does not match tensor " + c.name + ".");
+    }
+    ResidentTensors resident(*this, {src0, src1}, {dst});
+
+    // ReLU and LeakyReLU are folded into the SIMD kernel as a slope for negative values; the other activations run
+    // over each block right after the kernel wrote it.
+    BinaryRunFunction binary = m_binaryKernels[static_cast<size_t>(desc.op)];
+    ActivationRunFunction activation = nullptr;
+    float slope = 1.0f;
+    float kernelScale = desc.scale;
+    switch (desc.activation)
+    {
+    case Activation::None:
+        break;
+    case Activation::Relu:
+        slope = 0.0f;
+        break;
+    case Activation::LeakyRelu:
+        slope = desc.alpha;
+        break;
+    default:
+        activation = VisitActivation<BinaryOp::Add>(desc.activation, [](auto, auto act) -> ActivationRunFunction {
+            return &ActivationRun<decltype(act)::value>;
+        });
+        kernelScale = 1.0f;
+        break;
+    }
+
+    ScopedPhase phase(m_phaseTimes, Phase::Dispatch);
+    TRACE_SPAN("Dispatch", c.name, ElementCount(c.shape) * StoragePrecisionSize(c.precision));
+
+    // Operands in reduced-precision storage are decoded up front and the result encoded afterwards. The output is
+    // made writable first: if it is also an operand, dropping its view must not leave the operand pointing at pages
+    // that were unmapped.
+    ContextPool<Scratch>::Lease scratch = m_scratch.Acquire();
+    float *dataC = reinterpret_cast<float *>(WritableBytes(c));
+    const float *dataA = ReadFloats(a, scratch->buffers[0]);
+    const float *dataB = ReadFloats(b, scratch->buffers[1]);
+    if (c.precision != StoragePrecision::Float32)
+    {
+        scratch->buffers[2].resize(static_cast<size_t>(ElementCount(c.shape)));
+        dataC = scratch->buffers[2].data();
+    }
+    BroadcastPlan plan = PlanBroadcast(a.shape, b.shape, c.shape);
+    size_t strideA = plan.stridesA.back();
+    size_t strideB = plan.stridesB.back();
+
+    auto body = [&](uint64_t begin, uint64_t end) {
+        TRACE_VERBOSE_SPAN("ElementWiseChunk", c.name, (end - begin) * sizeof(float));
+        ForEachBroadcastRun(plan, begin, end, [&](size_t offset, size_t offsetA, size_t offsetB, size_t count) {
+            for (size_t i = 0; i < count; i += c_blockElements)
+            {
+                size_t block = std::min(c_blockElements, count - i);
+                binary(dataA + offsetA + i * strideA, strideA, dataB + offsetB + i * strideB, strideB,
+                       dataC + offset + i, block, slope, kernelScale);
+                if (activation)
+                {
+                    activation(dataC + offset + i, block, desc.alpha, desc.scale);
+                }
+            }
+        });
+    };
+
+    ParallelFor(plan.elementCount, body);
+
+    if (c.precision != StoragePrecision::Float32)
+    {
+        Encode(dataC, plan.elementCount, c);
+    }
+    return {};
+}
+
+SubmissionTicket CpuBackend::Gemm(const GemmDesc &desc, TensorHandle srcA, TensorHandle srcB, TensorHandle srcBias,
+                                  TensorHandle dst)
+{
+    if (dst == srcA || dst == srcB || dst == srcBias)
+    {
+        throw std::invalid_argument("The GEMM output must not be one of its operands.");
+    }
+    CpuTensor &a = m_tensors.Get(srcA);
+    CpuTensor &b = m_tensors.Get(srcB);
+    CpuTensor *bias = srcBias ? &m_tensors.Get(srcBias) : nullptr;
+    CpuTensor &c = m_tensors.Get(dst);
+    if (!IsFloatType(a.type) || !IsFloatType(b.type) || (bias && !IsFloatType(bias->type)) || !IsFloatType(c.type))
+    {
+        throw std::invalid_argument("The CPU backend only runs GEMMs on float32 and float16 tensors.");
+    }
+    GemmShape shape = PlanGemm(desc, a.shape, b.shape, bias ? bias->shape : TensorShape(), c.shape);
+    ResidentTensors resident(*this, {srcA, srcB, srcBias}, {dst});
+
+    ScopedPhase phase(m_phaseTimes, Phase::Dispatch);
+    TRACE_SPAN("Dispatch", c.name, ElementCount(c.shape) * StoragePrecisionSize(c.precision));
+
+    ContextPool<Scratch>::Lease scratch = m_scratch.Acquire();
+    float *dataC = reinterpret_cast<float *>(WritableBytes(c));
+    const float *dataA = ReadFloats(a, scratch->buffers[0]);
+    const float *dataB = ReadFloats(b, scratch->buffers[1]);
+    const float *dataBias = bias ? ReadFloats(*bias, scratch->buffers[3]) : nullptr;
+    if (c.precision != StoragePrecision::Float32)
+    {
+        scratch->buffers[2].resize(static_cast<size_t>(ElementCount(c.shape)));
+        dataC = scratch->buffers[2].data();
+    }
+
+    size_t rows = shape.rows;
+    size_t columns = shape.columns;
+    size_t depth = shape.depth;
+    size_t rank = c.shape.size();
+    std::vector<uint32_t> biasStrides = bias ? BroadcastStrides(bias->shape, c.shape) : std::vector<uint32_t>();
+    size_t tileRows = m_matrixKernels.tileRows;
+    size_t tileColumns = m_matrixKernels.tileColumns;
+
+    // Every (matrix, row block, column block) is an independent task that packs its own operands, so threads share
+    // nothing but the inputs. Packing b again for every row block costs one pass over it per c_gemmRowBlock rows.
+    uint64_t rowBlocks = (rows + c_gemmRowBlock - 1) / c_gemmRowBlock;
+    uint64_t columnBlocks = (columns + c_gemmColumnBlock - 1) / c_gemmColumnBlock;
+    auto body = [&](uint64_t begin, uint64_t end) {
+        TRACE_VERBOSE_SPAN("GemmChunk", c.name, (end - begin) * c_gemmRowBlock * c_gemmColumnBlock * sizeof(float));
+        size_t depthBlock = std::min(depth, c_gemmDepthBlock);
+        std::unique_ptr<float[]> packedA(new float[RoundUp(std::min(rows, c_gemmRowBlock), tileRows) * depthBlock]);
+        std::unique_ptr<float[]> packedB(
+            new float[RoundUp(std::min(columns, c_gemmColumnBlock), tileColumns) * depthBlock]);
+
+        for (uint64_t task = begin; task < end; ++task)
+        {
+            size_t matrix = static_cast<size_t>(task / (rowBlocks * columnBlocks));
+            size_t row = static_cast<size_t>(task / columnBlocks % rowBlocks) * c_gemmRowBlock;
+            size_t column = static_cast<size_t>(task % columnBlocks) * c_gemmColumnBlock;
+            size_t blockRows = std::min(c_gemmRowBlock, rows - row);
+            size_t blockColumns = std::min(c_gemmColumnBlock, columns - column);
+
+            StridedMatrix matrixA{dataA + matrix * rows * depth, desc.transposeA ? 1 : depth,
+                                  desc.transposeA ? rows : 1};
+            StridedMatrix matrixB{dataB + matrix * depth * columns, desc.transposeB ? 1 : columns,
+                                  desc.transposeB ? depth : 1};
+            float *block = dataC + matrix * rows * columns + row * columns + column;
+
+            // The block starts out as the scaled bias, and every depth block adds its products to it.
+            size_t biasOffset = 0;
+            for (size_t d = rank - 2, remainder = matrix; bias && d-- > 0; remainder /= c.shape[d])
+            {
+                biasOffset += remainder % c.shape[d] * biasStrides[d];
+            }
+            for (size_t i = 0; i < blockRows; ++i)
+            {
+                float *out = block + i * columns;
+                if (!bias)
+                {
+                    std::fill_n(out, blockColumns, 0.0f);
+                    continue;
+                }
+                const float *biasRow = dataBias + biasOffset + (row + i) * biasStrides[rank - 2];
+                for (size_t j = 0; j < blockColumns; ++j)
+                {
+                    out[j] = desc.beta * biasRow[(column + j) * biasStrides[rank - 1]];
+                }
+            }
+
+            for (size_t k = 0; k < depth; k += c_gemmDepthBlock)
+            {
+                size_t blockDepth = std::min(c_gemmDepthBlock, depth - k);
+                PackRowPanels(matrixA, row, blockRows, k, blockDepth, tileRows, desc.alpha, packedA.get());
+                PackColumnPanels(matrixB, k, blockDepth, column, blockColumns, tileColumns, packedB.get());
+                for (size_t j = 0; j < blockColumns; j += tileColumns)
+                {
+                    for (size_t i = 0; i < blockRows; i += tileRows)
+                    {
+                        m_matrixKernels.gemmTile(packedA.get() + i * blockDepth, packedB.get() + j * blockDepth,
+                                                 blockDepth, block + i * columns + j, columns,
+                                                 std::min(tileRows, blockRows - i),
+                                                 std::min(tileColumns, blockColumns - j));
+                    }
+                }
+            }
+        }
+    };
+    ParallelFor(shape.batch * rowBlocks * columnBlocks, 1, shape.Flops() >= c_minParallelGemmFlops, body);
+
+    if (c.precision != StoragePrecision::Float32)
+    {
+        Encode(dataC, ElementCount(c.shape), c);
+    }
+    return {};
+}
+
+SubmissionTicket CpuBackend::Reduce(const ReduceDesc &desc, TensorHandle src, TensorHandle dst)
+{
+    if (dst == src)
+    {
+        throw std::invalid_argument("The reduction output must not be its input.");
+    }
+    CpuTensor &x = m_tensors.Get(src);
+    CpuTensor &y = m_tensors.Get(dst);
+    if (!IsFloatType(x.type) || !IsFloatType(y.type))
+    {
+        throw std::invalid_argument("The CPU backend only runs reductions on float32 and float16 tensors.");
+    }
+    if (ReduceOutputShape(desc, x.shape) != y.shape)
+    {
+        throw std::invalid_argument("Reduction result shape does not match tensor " + y.name + ".");
+    }
+    ResidentTensors resident(*this, {src}, {dst});
+
+    ScopedPhase phase(m_phaseTimes, Phase::Dispatch);
+    TRACE_SPAN("Dispatch", y.name, ElementCount(x.shape) * StoragePrecisionSize(x.precision));
+
+    ContextPool<Scratch>::Lease scratch = m_scratch.Acquire();
+    float *dataY = reinterpret_cast<float *>(WritableBytes(y));
+    const float *dataX = ReadFloats(x, scratch->buffers[0]);
+    if (y.precision != StoragePrecision::Float32)
+    {
+        scratch->buffers[2].resize(static_cast<size_t>(ElementCount(y.shape)));
+        dataY = scratch->buffers[2].data();
+    }
+
+    size_t reduced = x.shape[desc.axis];
+    size_t inner = static_cast<size_t>(ElementCount(TensorShape(x.shape.begin() + desc.axis + 1, x.shape.end())));
+    uint64_t outer = ElementCount(y.shape) / inner;
+    float meanScale = desc.op == ReduceOp::Mean ? 1.0f / static_cast<float>(reduced) : 1.0f;
+    bool parallel = ElementCount(x.shape) >= m_minParallelElements;
+
+    if (inner == 1)
+    {
+        // Reducing the innermost axis: every output is a horizontal reduction over a contiguous run.
+        float (*run)(const float *, size_t) = desc.op == ReduceOp::Max ? m_matrixKernels.max : m_matrixKernels.sum;
+        ParallelFor(outer, std::max<uint64_t>(1, c_minChunkElements / reduced), parallel,
+                    [&](uint64_t begin, uint64_t end) {
+                        for (uint64_t o = begin; o < end; ++o)
+                        {
+                            dataY[o] = meanScale * run(dataX + o * reduced, reduced);
+                        }
+                    });
+    }
+    else
+    {
+        // Reducing an outer axis: each block of an output row is combined with the matching block of every reduced
+        // row by the element-wise kernel while it stays in L1, and the mean's division is folded into the last pass.
+        BinaryRunFunction combine = m_binaryKernels[static_cast<size_t>(
+            desc.op == ReduceOp::Max ? BinaryOp::Maximum : BinaryOp::Add)];
+        uint64_t blocksPerRow = (inner + c_blockElements - 1) / c_blockElements;
+        uint64_t grain = std::max<uint64_t>(1, c_minChunkElements / (std::min(inner, c_blockElements) * reduced));
+        ParallelFor(outer * blocksPerRow, grain, parallel, [&](uint64_t begin, uint64_t end) {
+            for (uint64_t item = begin; item < end; ++item)
+            {
+                size_t o = static_cast<size_t>(item / blocksPerRow);
+                size_t start = static_cast<size_t>(item % blocksPerRow) * c_blockElements;
+                size_t count = std::min(c_blockElements, inner - start);
+                float *out = dataY + o * inner + start;
+                const float *in = dataX + o * reduced * inner + start;
+                memcpy(out, in, count * sizeof(float));
+                for (size_t r = 1; r < reduced; ++r)
+                {
+                    combine(out, 1, in + r * inner, 1, out, count, 1.0f, r + 1 == reduced ? meanScale : 1.0f);
+                }
+            }
+        });
+    }
+
+    if (y.precision != StoragePrecision::Float32)
+    {
+        Encode(dataY, ElementCount(y.shape), y);
+    }
+    return {};
+}
+
+SubmissionTicket CpuBackend::ExecuteGraph(const TensorGraph &graph)
+{
+    if (graph.OutputNodes().empty())
+    {
+        throw std::invalid_argument("TensorGraph has no outputs.");
+    }
+
+    std::vector<TensorHandle> inputs;
+    std::vector<TensorHandle> outputs;
+    for (const std::string &name : graph.InputNames())
+    {
+        inputs.push_back(RequireTensor(name));
+    }
+    for (const std::string &name : graph.OutputNames())
+    {
+        outputs.push_back(RequireTensor(name));
+    }
+    ResidentTensors resident(*this, inputs, outputs);
+
+    ScopedPhase phase(m_phaseTimes, Phase::Dispatch);
+    TRACE_SPAN("Dispatch", graph.OutputNames()[0]);
+
+    std::unordered_map<std::string, HostTensor> hostTensors;
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        const std::string &name = graph.InputNames()[i];
+        CpuTensor &tensor = m_tensors.Get(inputs[i]);
+        if (!IsFloatType(tensor.type))
+        {
+            throw std::invalid_argument("The CPU backend only runs graphs on float32 and float16 tensors.");
+        }
+        HostTensor &input = hostTensors[name];
+        input = HostTensor{tensor.shape, std::vector<float>(static_cast<size_t>(ElementCount(tensor.shape)))};
+        Decode(tensor, input.data.data(), input.data.size());
+    }
+
+    RunGraphOnCpu(graph, hostTensors);
+
+    for (size_t i = 0; i < outputs.size(); ++i)
+    {
+        const std::string &name = graph.OutputNames()[i];
+        CpuTensor &tensor = m_tensors.Get(outputs[i]);
+        const HostTensor &result = hostTensors[name];
+        if (!IsFloatType(tensor.type) || result.shape != tensor.shape)
+        {
+            throw std::invalid_argument("TensorGraph result shape does not match tensor " + name + ".");
+        }
+        Encode(result.data.data(), result.data.size(), tensor);
+    }
+    return {};
+}
+
+void CpuBackend::FreeResources()
+{
+    if (m_residencyEnabled)
+    {
+        std::lock_guard<std::mutex> lock(m_residencyMutex);
+        m_residency.Clear();
+    }
+    m_tensors.Clear();
+    m_scratch.Clear();
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ContextPool.hpp"
+#include "CpuKernels.hpp"
+#include "ResidencyManager.hpp"
+#include "TensorBackend.hpp"
+#include "TensorCapacity.hpp"
+#include "TensorFile.hpp"
+#include "TensorTable.hpp"
+#include "ThreadPool.hpp"
+
+struct CpuBackendOptions
+{
+    // Worker threads including the caller; 0 uses every hardware thread.
+    size_t threadCount = 0;
+
+    // Caps the instruction set used by the kernels, e.g. to compare against the scalar path.
+    SimdLevel maxSimdLevel = SimdLevel::Avx512;
+
+    // Ops on fewer elements than this run on the calling thread only.
+    uint64_t minParallelElements = 1 << 16;
+
+    // How tensors reshaped by CreateTensor keep, grow and give back their storage.
+    CapacityPolicy tensorCapacity;
+
+    // Bytes of tensor storage kept in memory, the way a device's memory budget limits the DirectML processor. When
+    // tensors would exceed it, those no call is using are spilled to files in spillDirectory, least recently used
+    // first, and read back in when a call next uses them. Views of loaded files count as nothing, since their pages
+    // belong to the file. Unlimited by default, which skips the bookkeeping altogether.
+    uint64_t memoryBudget = ResidencyManager::c_unlimited;
+
+    // Where spilled tensors are written; empty uses the system's temporary directory.
+    std::string spillDirectory;
+};
+
+// Host-memory implementation of TensorBackend for machines without a usable DirectML adapter. Element-wise ops,
+// GEMMs and reductions run float32 SIMD kernels split across a thread pool; graphs execute synchronously on the
+// calling thread. GEMMs are cache-blocked: packed blocks of a stay in L2 and packed panels of b in L1 while a
+// register-tiled micro-kernel (see MatrixKernelTable) accumulates each tile of the output.
+// Float16 tensors and float32 tensors in reduced-precision storage are converted to float32 around each op.
+//
+// Calls may come from several threads at once. Tensors live in a TensorTable, each call decodes into scratch
+// buffers of its own, and a call that finds the thread pool busy with another call's loop runs its loop inline.
+//
+// Tensors loaded from a file in the format they are stored in are views of the file's mapped pages, so loading a
+// weight set copies nothing; a view is copied into storage of its own when the tensor is first written.
+//
+// With a memory budget (see CpuBackendOptions) the backend also simulates a device that runs out of memory: the same
+// ResidencyManager policy the DirectML processor follows decides which tensors to spill and when.
+class CpuBackend : public TensorBackend
+{
+  public:
+    explicit CpuBackend(const CpuBackendOptions &options = {});
+
+    using TensorBackend::ElementWise;
+    using TensorBackend::Gemm;
+    using TensorBackend::GetTensorData;
+    using TensorBackend::Reduce;
+    using TensorBackend::SetTensorData;
+
+    std::string Name() const override;
+
+    TensorHandle CreateTensor(const std::string &name, const TensorShape &shape, TensorDataType type) override;
+    TensorHandle FindTensor(const std::string &name) const override;
+    TensorShape GetTensorShape(TensorHandle tensor) const override;
+    TensorDataType GetTensorType(TensorHandle tensor) const override;
+    void ReleaseTensor(TensorHandle tensor) override;
+
+    void SetTensorData(TensorHandle tensor, const void *data, size_t size) override;
+    void GetTensorData(TensorHandle tensor, const TensorShape &shape, TensorDataType type, void *data,
+                       size_t size) override;
+
+    SubmissionTicket ElementWise(const ElementWiseDesc &desc, TensorHandle src0, TensorHandle src1,
+                                 TensorHandle dst) override;
+    SubmissionTicket Gemm(const GemmDesc &desc, TensorHandle a, TensorHandle b, TensorHandle bias,
+                          TensorHandle dst) override;
+    SubmissionTicket Reduce(const ReduceDesc &desc, TensorHandle src, TensorHandle dst) override;
+    SubmissionTicket ExecuteGraph(const TensorGraph &graph) override;
+
+    void FreeResources() override;
+
+    bool SupportsConcurrentCalls() const override
+    {
+        return true;
+    }
+
+    SimdLevel GetSimdLevel() const
+    {
+        return m_simdLevel;
+    }
+
+    ResidencyStats GetResidencyStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_residencyMutex);
+        return m_residency.GetStats();
+    }
+
+  protected:
+    TensorHandle LoadTensor(const std::string &name, const TensorFile &file, const TensorFileEntry &entry) override;
+
+  private:
+    struct CpuTensor
+    {
+        std::string name;
+        TensorShape shape;
+        TensorDataType type = TensorDataType::Unknown;
+        StoragePrecision precision = StoragePrecision::Float32; // Float16 tensors are always Float16.
+        float scale = 1.0f;                                     // Int8 storage only.
+        std::vector<uint8_t> data;                              // Sized to the shape; reserved to the capacity.
+        TensorCapacity capacity;
+
+        // Set instead of data while the tensor is a view of a loaded file.
+        std::shared_ptr<MappedFile> mapping;
+        const uint8_t *view = nullptr;
+
+        // Holds the contents instead of data while the tensor is spilled.
+        std::shared_ptr<MappedFile> spill;
+    };
+
+    // Keeps the tensors one call uses in memory from construction to destruction, reading spilled ones back in first.
+    // Tensors the call only writes are given fresh storage instead. On destruction their sizes are updated, since the
+    // call may have reshaped them or copied a view, and tensors are spilled until the rest fit the budget again.
+    class ResidentTensors
+    {
+      public:
+        ResidentTensors(CpuBackend &backend, const std::vector<TensorHandle> &reads,
+                        const std::vector<TensorHandle> &writes = {});
+        ~ResidentTensors();
+
+        ResidentTensors(const ResidentTensors &) = delete;
+        ResidentTensors &operator=(const ResidentTensors &) = delete;
+
+      private:
+        CpuBackend *m_backend = nullptr; // Null when the backend has no budget.
+        std::vector<TensorHandle> m_tensors;
+    };
+
+    // Float32 copies of reduced-precision operands and results, leased by one call at a time.
+    struct Scratch
+    {
+        std::vector<float> buffers[4];
+    };
+
+    // The tensor's contents in its storage precision: the mapped pages it views, or data.
+    static const uint8_t *Bytes(const CpuTensor &tensor)
+    {
+        return tensor.view ? tensor.view : tensor.data.data();
+    }
+    // data, after copying the mapped pages into it if the tensor is a view.
+    uint8_t *WritableBytes(CpuTensor &tensor);
+
+    // Runs function over [0, count) on the calling thread, or split across the pool when count is large and the pool
+    // is not already running a loop for another call.
+    void ParallelFor(uint64_t count, const std::function<void(uint64_t, uint64_t)> &function);
+    // The same for loops whose items are not elements: chunks of at least grain items, split only if parallel.
+    void ParallelFor(uint64_t count, uint64_t grain, bool parallel,
+                     const std::function<void(uint64_t, uint64_t)> &function);
+
+    // Converts count elements between float32 and the tensor's storage, split across the pool when large.
+    void Decode(const CpuTensor &tensor, float *out, uint64_t count);
+    void Encode(const float *in, uint64_t count, CpuTensor &tensor);
+
+    // Bytes the tensor holds in memory, for the residency budget.
+    static uint64_t ResidentBytes(const CpuTensor &tensor)
+    {
+        return tensor.view ? 0 : tensor.capacity.Bytes();
+    }
+    // Starts tracking the residency of a tensor that was just created, if there is a budget.
+    void TrackTensor(TensorHandle tensor);
+    // Spills idle tensors until incoming more bytes fit the budget. Called with m_residencyMutex held.
+    void MakeRoom(uint64_t incoming);
+
+    // Float32 contents of a float32 or float16 tensor: the data itself when stored as float32, otherwise decoded into
+    // scratch.
+    const float *ReadFloats(const CpuTensor &tensor, std::vector<float> &scratch);
+
+    SimdLevel m_simdLevel;
+    const BinaryRunFunction *m_binaryKernels;
+    const ConversionKernelTable &m_conversions;
+    const MatrixKernelTable &m_matrixKernels;
+    uint64_t m_minParallelElements;
+    CapacityPolicy m_capacityPolicy;
+    ThreadPool m_threadPool;
+    std::mutex m_threadPoolMutex;
+    TensorTable<CpuTensor> m_tensors;
+    ContextPool<Scratch> m_scratch;
+
+    // Guards the residency bookkeeping and serializes spilling and reading back, so a tensor is never spilled while a
+    // call is pinning it.
+    bool m_residencyEnabled = false;
+    std::string m_spillDirectory;
+    mutable std::mutex m_residencyMutex;
+    ResidencyManager m_residency;
+};
@@ -0,0 +1,239 @@
+#include "CpuKernelsImpl.hpp"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace
+{
+struct ScalarVector
+{
+    using Type = float;
+    static constexpr size_t c_width = 1;
+
+    static Type Load(const float *p)
+    {
+        return *p;
+    }
+    static void Store(float *p, Type v)
+    {
+        *p = v;
+    }
+    static Type Set(float x)
+    {
+        return x;
+    }
+    static Type Add(Type a, Type b)
+    {
+        return a + b;
+    }
+    static Type Subtract(Type a, Type b)
+    {
+        return a - b;
+    }
+    static Type Multiply(Type a, Type b)
+    {
+        return a * b;
+    }
+    static Type Divide(Type a, Type b)
+    {
+        return a / b;
+    }
+    static Type Max(Type a, Type b)
+    {
+        return a > b ? a : b;
+    }
+    static Type Min(Type a, Type b)
+    {
+        return a < b ? a : b;
+    }
+    static Type MultiplyAdd(Type a, Type b, Type c)
+    {
+        return a * b + c;
+    }
+};
+
+struct ScalarConversion
+{
+    static constexpr size_t c_width = 1;
+
+    static void FloatToHalf(const float *in, uint16_t *out)
+    {
+        *out = ScalarFloatToHalf(*in);
+    }
+    static void HalfToFloat(const uint16_t *in, float *out)
+    {
+        *out = ScalarHalfToFloat(*in);
+    }
+    static void FloatToBFloat16(const float *in, uint16_t *out)
+    {
+        *out = ScalarFloatToBFloat16(*in);
+    }
+    static void BFloat16ToFloat(const uint16_t *in, float *out)
+    {
+        *out = ScalarBFloat16ToFloat(*in);
+    }
+    static float MaxAbs(const float *in, size_t count)
+    {
+        float result = 0.0f;
+        for (size_t i = 0; i < count; ++i)
+        {
+            float value = in[i] < 0.0f ? -in[i] : in[i];
+            result = value > result ? value : result;
+        }
+        return result;
+    }
+    static void FloatToInt8(const float *in, int8_t *out, float inverseScale)
+    {
+        *out = ScalarFloatToInt8(*in, inverseScale);
+    }
+    static void Int8ToFloat(const int8_t *in, float *out, float scale)
+    {
+        *out = static_cast<float>(*in) * scale;
+    }
+};
+
+#if defined(__x86_64__) || defined(_M_X64)
+bool HostSupports(SimdLevel level)
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool f16c = (info[2] & (1 << 29)) != 0;
+    if (!osxsave)
+    {
+        return false;
+    }
+    // The OS must save the YMM (and for AVX-512 the ZMM and opmask) registers across context switches.
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    if (level == SimdLevel::Avx2)
+    {
+        return fma && f16c && (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    }
+    return (info[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+#else
+    __builtin_cpu_init();
+    if (level == SimdLevel::Avx2)
+    {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+    }
+    return __builtin_cpu_supports("avx512f");
+#endif
+}
+#endif
+} // namespace
+
+const BinaryRunFunction *ScalarBinaryKernels()
+{
+    return BinaryKernelTable<ScalarVector>();
+}
+
+const ConversionKernelTable &ScalarConversionKernels()
+{
+    return ConversionKernelTableFor<ScalarConversion>();
+}
+
+const MatrixKernelTable &ScalarMatrixKernels()
+{
+    return MatrixKernelTableFor<ScalarVector>();
+}
+
+SimdLevel DetectSimdLevel()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    if (HostSupports(SimdLevel::Avx512))
+    {
+        return SimdLevel::Avx512;
+    }
+    if (HostSupports(SimdLevel::Avx2))
+    {
+        return SimdLevel::Avx2;
+    }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    return SimdLevel::Neon;
+#endif
+    return SimdLevel::Scalar;
+}
+
+const char *SimdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::Neon:
+        return "NEON";
+    case SimdLevel::Avx2:
+        return "AVX2";
+    case SimdLevel::Avx512:
+        return "AVX-512";
+    default:
+        return "scalar";
+    }
+}
+
+const BinaryRunFunction *BinaryKernels(SimdLevel level)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    if (level == SimdLevel::Avx512)
+    {
+        return Avx512BinaryKernels();
+    }
+    if (level == SimdLevel::Avx2)
+    {
+        return Avx2BinaryKernels();
+    }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    if (level == SimdLevel::Neon)
+    {
+        return NeonBinaryKernels();
+    }
+#endif
+    return ScalarBinaryKernels();
+}
+
+const ConversionKernelTable &ConversionKernels(SimdLevel level)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    if (level == SimdLevel::Avx512)
+    {
+        return Avx512ConversionKernels();
+    }
+    if (level == SimdLevel::Avx2)
+    {
+        return Avx2ConversionKernels();
+    }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    if (level == SimdLevel::Neon)
+    {
+        return NeonConversionKernels();
+    }
+#endif
+    return ScalarConversionKernels();
+}
+
+const MatrixKernelTable &MatrixKernels(SimdLevel level)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    if (level == SimdLevel::Avx512)
+    {
+        return Avx512MatrixKernels();
+    }
+    if (level == SimdLevel::Avx2)
+    {
+        return Avx2MatrixKernels();
+    }
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    if (level == SimdLevel::Neon)
+    {
+        return NeonMatrixKernels();
+    }
+#endif
+    return ScalarMatrixKernels();
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Float32 and storage conversion kernels for the CPU backend. Each instruction set has its own translation unit
+// compiled with the matching compiler flags, and the best one the host supports is picked at runtime. Those
+// translation units include only this header, <cstring> for memcpy and the intrinsics headers, so no inline standard
+// library code is compiled with wider instructions than the host may have.
+
+enum class SimdLevel : uint32_t
+{
+    Scalar,
+    Neon,
+    Avx2,
+    Avx512,
+};
+
+// Computes out[i] = scale * (max(v, 0) + slope * min(v, 0)) with v = op(a[i * strideA], b[i * strideB]), which covers
+// no activation (slope 1), ReLU (slope 0) and LeakyReLU (slope alpha). strideA and strideB are 0 or 1.
+using BinaryRunFunction = void (*)(const float *a, size_t strideA, const float *b, size_t strideB, float *out,
+                                   size_t count, float slope, float scale);
+
+// Kernel tables are indexed by BinaryOp: add, subtract, multiply, divide, maximum, minimum.
+constexpr size_t c_binaryKernelCount = 6;
+
+const BinaryRunFunction *ScalarBinaryKernels();
+#if defined(__aarch64__) || defined(_M_ARM64)
+const BinaryRunFunction *NeonBinaryKernels();
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+const BinaryRunFunction *Avx2BinaryKernels();
+const BinaryRunFunction *Avx512BinaryKernels();
+#endif
+
+// Conversions between float32 and the reduced-precision formats tensors can be stored in. Float16 and bfloat16 round
+// to nearest even; int8 stores round(x / scale) clamped to [-127, 127] for a per-tensor scale.
+struct ConversionKernelTable
+{
+    void (*floatToHalf)(const float *in, uint16_t *out, size_t count);
+    void (*halfToFloat)(const uint16_t *in, float *out, size_t count);
+    void (*floatToBFloat16)(const float *in, uint16_t *out, size_t count);
+    void (*bfloat16ToFloat)(const uint16_t *in, float *out, size_t count);
+    float (*maxAbs)(const float *in, size_t count);
+    void (*floatToInt8)(const float *in, int8_t *out, size_t count, float scale);
+    void (*int8ToFloat)(const int8_t *in, float *out, size_t count, float scale);
+};
+
+const ConversionKernelTable &ScalarConversionKernels();
+#if defined(__aarch64__) || defined(_M_ARM64)
+const ConversionKernelTable &NeonConversionKernels();
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+const ConversionKernelTable &Avx2ConversionKernels();
+const ConversionKernelTable &Avx512ConversionKernels();
+#endif
+
+// The GEMM micro-kernel and the reductions along a contiguous run.
+//
+// gemmTile computes a tileRows x tileColumns block of c from packed panels: packedA holds tileRows elements of a for
+// each step along the depth, packedB tileColumns elements of b, so both are read front to back while the block stays
+// in registers. The block is added to c, whose rows are ldc apart; only its first rows x columns elements are written.
+struct MatrixKernelTable
+{
+    size_t tileRows;
+    size_t tileColumns;
+    void (*gemmTile)(const float *packedA, const float *packedB, size_t depth, float *c, size_t ldc, size_t rows,
+                     size_t columns);
+    float (*sum)(const float *in, size_t count);
+    float (*max)(const float *in, size_t count);
+};
+
+const MatrixKernelTable &ScalarMatrixKernels();
+#if defined(__aarch64__) || defined(_M_ARM64)
+const MatrixKernelTable &NeonMatrixKernels();
+#endif
+#if defined(__x86_64__) || defined(_M_X64)
+const MatrixKernelTable &Avx2MatrixKernels();
+const MatrixKernelTable &Avx512MatrixKernels();
+#endif
+
+// The widest instruction set supported by both the host and this build.
+SimdLevel DetectSimdLevel();
+const char *SimdLevelName(SimdLevel level);
+// Kernels for level, falling back to narrower ones the build does not have.
+const BinaryRunFunction *BinaryKernels(SimdLevel level);
+const ConversionKernelTable &ConversionKernels(SimdLevel level);
+const MatrixKernelTable &MatrixKernels(SimdLevel level);
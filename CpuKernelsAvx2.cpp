@@ -0,0 +1,133 @@
+// Compiled with AVX2, FMA and F16C enabled; only called after DetectSimdLevel has confirmed host support.
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include "CpuKernelsImpl.hpp"
+
+#include <immintrin.h>
+
+namespace
+{
+struct Avx2Vector
+{
+    using Type = __m256;
+    static constexpr size_t c_width = 8;
+
+    static Type Load(const float *p)
+    {
+        return _mm256_loadu_ps(p);
+    }
+    static void Store(float *p, Type v)
+    {
+        _mm256_storeu_ps(p, v);
+    }
+    static Type Set(float x)
+    {
+        return _mm256_set1_ps(x);
+    }
+    static Type Add(Type a, Type b)
+    {
+        return _mm256_add_ps(a, b);
+    }
+    static Type Subtract(Type a, Type b)
+    {
+        return _mm256_sub_ps(a, b);
+    }
+    static Type Multiply(Type a, Type b)
+    {
+        return _mm256_mul_ps(a, b);
+    }
+    static Type Divide(Type a, Type b)
+    {
+        return _mm256_div_ps(a, b);
+    }
+    static Type Max(Type a, Type b)
+    {
+        return _mm256_max_ps(a, b);
+    }
+    static Type Min(Type a, Type b)
+    {
+        return _mm256_min_ps(a, b);
+    }
+    static Type MultiplyAdd(Type a, Type b, Type c)
+    {
+        return _mm256_fmadd_ps(a, b, c);
+    }
+};
+
+struct Avx2Conversion
+{
+    static constexpr size_t c_width = 8;
+
+    static void FloatToHalf(const float *in, uint16_t *out)
+    {
+        __m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(in), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), half);
+    }
+    static void HalfToFloat(const uint16_t *in, float *out)
+    {
+        _mm256_storeu_ps(out, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in))));
+    }
+    static void FloatToBFloat16(const float *in, uint16_t *out)
+    {
+        __m256i bits = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in));
+        __m256i odd = _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1));
+        __m256i rounded = _mm256_add_epi32(bits, _mm256_add_epi32(odd, _mm256_set1_epi32(0x7fff)));
+        rounded = _mm256_srli_epi32(rounded, 16);
+        __m256i quietNan = _mm256_or_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(0x40));
+        __m256i isNan = _mm256_cmpgt_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0x7fffffff)),
+                                           _mm256_set1_epi32(0x7f800000));
+        __m256i result = _mm256_blendv_epi8(rounded, quietNan, isNan);
+        // Every lane holds a 16-bit value, so the unsigned saturating pack only narrows.
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(result), _mm256_extracti128_si256(result, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), packed);
+    }
+    static void BFloat16ToFloat(const uint16_t *in, float *out)
+    {
+        __m256i wide = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_slli_epi32(wide, 16));
+    }
+    static float MaxAbs(const float *in, size_t count)
+    {
+        __m256 signMask = _mm256_set1_ps(-0.0f);
+        __m256 result = _mm256_setzero_ps();
+        for (size_t i = 0; i < count; i += c_width)
+        {
+            result = _mm256_max_ps(result, _mm256_andnot_ps(signMask, _mm256_loadu_ps(in + i)));
+        }
+        __m128 half = _mm_max_ps(_mm256_castps256_ps128(result), _mm256_extractf128_ps(result, 1));
+        half = _mm_max_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_max_ss(half, _mm_shuffle_ps(half, half, 1));
+        return _mm_cvtss_f32(half);
+    }
+    static void FloatToInt8(const float *in, int8_t *out, float inverseScale)
+    {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(in), _mm256_set1_ps(inverseScale));
+        v = _mm256_min_ps(_mm256_max_ps(v, _mm256_set1_ps(-127.0f)), _mm256_set1_ps(127.0f));
+        __m256i values = _mm256_cvtps_epi32(v);
+        __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out), _mm_packs_epi16(packed, packed));
+    }
+    static void Int8ToFloat(const int8_t *in, float *out, float scale)
+    {
+        __m256i values = _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(in)));
+        _mm256_storeu_ps(out, _mm256_mul_ps(_mm256_cvtepi32_ps(values), _mm256_set1_ps(scale)));
+    }
+};
+} // namespace
+
+const BinaryRunFunction *Avx2BinaryKernels()
+{
+    return BinaryKernelTable<Avx2Vector>();
+}
+
+const ConversionKernelTable &Avx2ConversionKernels()
+{
+    return ConversionKernelTableFor<Avx2Conversion>();
+}
+
+const MatrixKernelTable &Avx2MatrixKernels()
+{
+    return MatrixKernelTableFor<Avx2Vector>();
+}
+
+#endif
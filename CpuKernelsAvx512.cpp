@@ -0,0 +1,125 @@
+// Compiled with AVX-512F enabled; only called after DetectSimdLevel has confirmed host support.
+#if defined(__x86_64__) || defined(_M_X64)
+
+#include "CpuKernelsImpl.hpp"
+
+#include <immintrin.h>
+
+namespace
+{
+struct Avx512Vector
+{
+    using Type = __m512;
+    static constexpr size_t c_width = 16;
+
+    static Type Load(const float *p)
+    {
+        return _mm512_loadu_ps(p);
+    }
+    static void Store(float *p, Type v)
+    {
+        _mm512_storeu_ps(p, v);
+    }
+    static Type Set(float x)
+    {
+        return _mm512_set1_ps(x);
+    }
+    static Type Add(Type a, Type b)
+    {
+        return _mm512_add_ps(a, b);
+    }
+    static Type Subtract(Type a, Type b)
+    {
+        return _mm512_sub_ps(a, b);
+    }
+    static Type Multiply(Type a, Type b)
+    {
+        return _mm512_mul_ps(a, b);
+    }
+    static Type Divide(Type a, Type b)
+    {
+        return _mm512_div_ps(a, b);
+    }
+    static Type Max(Type a, Type b)
+    {
+        return _mm512_max_ps(a, b);
+    }
+    static Type Min(Type a, Type b)
+    {
+        return _mm512_min_ps(a, b);
+    }
+    static Type MultiplyAdd(Type a, Type b, Type c)
+    {
+        return _mm512_fmadd_ps(a, b, c);
+    }
+};
+
+struct Avx512Conversion
+{
+    static constexpr size_t c_width = 16;
+
+    static void FloatToHalf(const float *in, uint16_t *out)
+    {
+        __m256i half = _mm512_cvtps_ph(_mm512_loadu_ps(in), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), half);
+    }
+    static void HalfToFloat(const uint16_t *in, float *out)
+    {
+        _mm512_storeu_ps(out, _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in))));
+    }
+    static void FloatToBFloat16(const float *in, uint16_t *out)
+    {
+        __m512i bits = _mm512_loadu_si512(in);
+        __m512i odd = _mm512_and_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(1));
+        __m512i rounded = _mm512_add_epi32(bits, _mm512_add_epi32(odd, _mm512_set1_epi32(0x7fff)));
+        rounded = _mm512_srli_epi32(rounded, 16);
+        __m512i quietNan = _mm512_or_si512(_mm512_srli_epi32(bits, 16), _mm512_set1_epi32(0x40));
+        __mmask16 isNan = _mm512_cmpgt_epu32_mask(_mm512_and_si512(bits, _mm512_set1_epi32(0x7fffffff)),
+                                                  _mm512_set1_epi32(0x7f800000));
+        __m512i result = _mm512_mask_blend_epi32(isNan, rounded, quietNan);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm512_cvtepi32_epi16(result));
+    }
+    static void BFloat16ToFloat(const uint16_t *in, float *out)
+    {
+        __m512i wide = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in)));
+        _mm512_storeu_si512(out, _mm512_slli_epi32(wide, 16));
+    }
+    static float MaxAbs(const float *in, size_t count)
+    {
+        __m512 result = _mm512_setzero_ps();
+        for (size_t i = 0; i < count; i += c_width)
+        {
+            result = _mm512_max_ps(result, _mm512_abs_ps(_mm512_loadu_ps(in + i)));
+        }
+        return _mm512_reduce_max_ps(result);
+    }
+    static void FloatToInt8(const float *in, int8_t *out, float inverseScale)
+    {
+        __m512 v = _mm512_mul_ps(_mm512_loadu_ps(in), _mm512_set1_ps(inverseScale));
+        v = _mm512_min_ps(_mm512_max_ps(v, _mm512_set1_ps(-127.0f)), _mm512_set1_ps(127.0f));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm512_cvtsepi32_epi8(_mm512_cvtps_epi32(v)));
+    }
+    static void Int8ToFloat(const int8_t *in, float *out, float scale)
+    {
+        __m512i values = _mm512_cvtepi8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in)));
+        _mm512_storeu_ps(out, _mm512_mul_ps(_mm512_cvtepi32_ps(values), _mm512_set1_ps(scale)));
+    }
+};
+} // namespace
+
+const BinaryRunFunction *Avx512BinaryKernels()
+{
+    return BinaryKernelTable<Avx512Vector>();
+}
+
+const ConversionKernelTable &Avx512ConversionKernels()
+{
+    return ConversionKernelTableFor<Avx512Conversion>();
+}
+
+const MatrixKernelTable &Avx512MatrixKernels()
+{
+    return MatrixKernelTableFor<Avx512Vector>();
+}
+
+#endif
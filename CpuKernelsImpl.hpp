@@ -0,0 +1,398 @@
+#pragma once
+
+#include "CpuKernels.hpp"
+
+#include <cstring>
+
+// Kernel bodies shared by every instruction set. Each CpuKernels*.cpp includes this header and instantiates
+// BinaryKernelTable, ConversionKernelTableFor and MatrixKernelTableFor with types of its own declared in an anonymous
+// namespace, so every instantiation has internal linkage and is compiled with that file's flags only.
+//
+// V provides: Type, c_width, Load, Store, Set, Add, Subtract, Multiply, Divide, Max, Min, and MultiplyAdd(a, b, c)
+// for a * b + c, fused where the instruction set has it.
+//
+// C converts c_width elements per call: FloatToHalf, HalfToFloat, FloatToBFloat16, BFloat16ToFloat, FloatToInt8 and
+// Int8ToFloat, plus MaxAbs over the whole vectors at the start of a range. Remainders use the scalar conversions.
+
+namespace
+{
+template <typename V, size_t Op> typename V::Type ApplyBinary(typename V::Type a, typename V::Type b)
+{
+    switch (Op)
+    {
+    case 0:
+        return V::Add(a, b);
+    case 1:
+        return V::Subtract(a, b);
+    case 2:
+        return V::Multiply(a, b);
+    case 3:
+        return V::Divide(a, b);
+    case 4:
+        return V::Max(a, b);
+    default:
+        return V::Min(a, b);
+    }
+}
+
+template <typename V> typename V::Type ApplyLinearActivation(typename V::Type x, float slope, float scale)
+{
+    typename V::Type zero = V::Set(0.0f);
+    typename V::Type y = V::Add(V::Max(x, zero), V::Multiply(V::Set(slope), V::Min(x, zero)));
+    return V::Multiply(V::Set(scale), y);
+}
+
+float ScalarBinary(size_t op, float a, float b)
+{
+    switch (op)
+    {
+    case 0:
+        return a + b;
+    case 1:
+        return a - b;
+    case 2:
+        return a * b;
+    case 3:
+        return a / b;
+    case 4:
+        return a > b ? a : b;
+    default:
+        return a < b ? a : b;
+    }
+}
+
+float ScalarLinearActivation(float x, float slope, float scale)
+{
+    return scale * ((x > 0.0f ? x : 0.0f) + slope * (x < 0.0f ? x : 0.0f));
+}
+
+template <typename V, size_t Op, bool PackedA, bool PackedB>
+void BinaryRun(const float *a, const float *b, float *out, size_t count, float slope, float scale)
+{
+    typename V::Type broadcastA = V::Set(a[0]);
+    typename V::Type broadcastB = V::Set(b[0]);
+
+    size_t i = 0;
+    for (; i + V::c_width <= count; i += V::c_width)
+    {
+        typename V::Type va = PackedA ? V::Load(a + i) : broadcastA;
+        typename V::Type vb = PackedB ? V::Load(b + i) : broadcastB;
+        V::Store(out + i, ApplyLinearActivation<V>(ApplyBinary<V, Op>(va, vb), slope, scale));
+    }
+    for (; i < count; ++i)
+    {
+        float value = ScalarBinary(Op, a[PackedA ? i : 0], b[PackedB ? i : 0]);
+        out[i] = ScalarLinearActivation(value, slope, scale);
+    }
+}
+
+template <typename V, size_t Op>
+void BinaryRunStrided(const float *a, size_t strideA, const float *b, size_t strideB, float *out, size_t count,
+                      float slope, float scale)
+{
+    if (strideA != 0 && strideB != 0)
+    {
+        BinaryRun<V, Op, true, true>(a, b, out, count, slope, scale);
+    }
+    else if (strideA != 0)
+    {
+        BinaryRun<V, Op, true, false>(a, b, out, count, slope, scale);
+    }
+    else if (strideB != 0)
+    {
+        BinaryRun<V, Op, false, true>(a, b, out, count, slope, scale);
+    }
+    else
+    {
+        BinaryRun<V, Op, false, false>(a, b, out, count, slope, scale);
+    }
+}
+
+template <typename V> const BinaryRunFunction *BinaryKernelTable()
+{
+    static const BinaryRunFunction kernels[c_binaryKernelCount] = {
+        &BinaryRunStrided<V, 0>, &BinaryRunStrided<V, 1>, &BinaryRunStrided<V, 2>,
+        &BinaryRunStrided<V, 3>, &BinaryRunStrided<V, 4>, &BinaryRunStrided<V, 5>,
+    };
+    return kernels;
+}
+
+uint32_t FloatBits(float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+float BitsFloat(uint32_t bits)
+{
+    float x;
+    memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+uint16_t ScalarFloatToHalf(float x)
+{
+    uint32_t bits = FloatBits(x);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    bits &= 0x7fffffff;
+
+    uint32_t half;
+    if (bits >= 0x47800000) // 65536 and up, infinity and NaN.
+    {
+        half = bits > 0x7f800000 ? 0x7e00 : 0x7c00;
+    }
+    else if (bits < 0x38800000) // Half subnormals: adding 0.5 rounds the value to a multiple of 2^-24.
+    {
+        half = FloatBits(BitsFloat(bits) + 0.5f) - 0x3f000000;
+    }
+    else
+    {
+        // Rebias the exponent and round the dropped 13 mantissa bits to nearest even. A carry into the exponent
+        // rounds values just below 65536 up to infinity.
+        uint32_t odd = (bits >> 13) & 1;
+        half = (bits - ((127 - 15) << 23) + 0xfff + odd) >> 13;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+float ScalarHalfToFloat(uint16_t half)
+{
+    uint32_t bits = static_cast<uint32_t>(half & 0x7fff) << 13;
+    uint32_t exponent = bits & 0x0f800000;
+    bits += (127 - 15) << 23;
+    if (exponent == 0x0f800000) // Infinity and NaN.
+    {
+        bits += (128 - 16) << 23;
+    }
+    else if (exponent == 0) // Zero and subnormals.
+    {
+        bits = FloatBits(BitsFloat(bits + (1 << 23)) - BitsFloat(113 << 23));
+    }
+    return BitsFloat(bits | static_cast<uint32_t>(half & 0x8000) << 16);
+}
+
+uint16_t ScalarFloatToBFloat16(float x)
+{
+    uint32_t bits = FloatBits(x);
+    if ((bits & 0x7fffffff) > 0x7f800000)
+    {
+        return static_cast<uint16_t>((bits >> 16) | 0x40); // Keep NaNs quiet instead of rounding them to infinity.
+    }
+    return static_cast<uint16_t>((bits + 0x7fff + ((bits >> 16) & 1)) >> 16);
+}
+
+float ScalarBFloat16ToFloat(uint16_t x)
+{
+    return BitsFloat(static_cast<uint32_t>(x) << 16);
+}
+
+int8_t ScalarFloatToInt8(float x, float inverseScale)
+{
+    // Clamped in the order the vector max and min instructions use, which also sends NaN to -127.
+    float v = x * inverseScale;
+    v = v > -127.0f ? v : -127.0f;
+    v = v < 127.0f ? v : 127.0f;
+    // Adding and subtracting 1.5 * 2^23 rounds to nearest even, like the vector conversions.
+    v = (v + 12582912.0f) - 12582912.0f;
+    return static_cast<int8_t>(v);
+}
+
+template <typename C> void FloatToHalfRun(const float *in, uint16_t *out, size_t count)
+{
+    size_t i = 0;
+    for (; i + C::c_width <= count; i += C::c_width)
+    {
+        C::FloatToHalf(in + i, out + i);
+    }
+    for (; i < count; ++i)
+    {
+        out[i] = ScalarFloatToHalf(in[i]);
+    }
+}
+
+template <typename C> void HalfToFloatRun(const uint16_t *in, float *out, size_t count)
+{
+    size_t i = 0;
+    for (; i + C::c_width <= count; i += C::c_width)
+    {
+        C::HalfToFloat(in + i, out + i);
+    }
+    for (; i < count; ++i)
+    {
+        out[i] = ScalarHalfToFloat(in[i]);
+    }
+}
+
+template <typename C> void FloatToBFloat16Run(const float *in, uint16_t *out, size_t count)
+{
+    size_t i = 0;
+    for (; i + C::c_width <= count; i += C::c_width)
+    {
+        C::FloatToBFloat16(in + i, out + i);
+    }
+    for (; i < count; ++i)
+    {
+        out[i] = ScalarFloatToBFloat16(in[i]);
+    }
+}
+
+template <typename C> void BFloat16ToFloatRun(const uint16_t *in, float *out, size_t count)
+{
+    size_t i = 0;
+    for (; i + C::c_width <= count; i += C::c_width)
+    {
+        C::BFloat16ToFloat(in + i, out + i);
+    }
+    for (; i < count; ++i)
+    {
+        out[i] = ScalarBFloat16ToFloat(in[i]);
+    }
+}
+
+template <typename C> float MaxAbsRun(const float *in, size_t count)
+{
+    size_t vectorCount = count - count % C::c_width;
+    float result = C::MaxAbs(in, vectorCount);
+    for (size_t i = vectorCount; i < count; ++i)
+    {
+        float value = in[i] < 0.0f ? -in[i] : in[i];
+        result = value > result ? value : result;
+    }
+    return result;
+}
+
+template <typename C> void FloatToInt8Run(const float *in, int8_t *out, size_t count, float scale)
+{
+    float inverseScale = 1.0f / scale;
+    size_t i = 0;
+    for (; i + C::c_width <= count; i += C::c_width)
+    {
+        C::FloatToInt8(in + i, out + i, inverseScale);
+    }
+    for (; i < count; ++i)
+    {
+        out[i] = ScalarFloatToInt8(in[i], inverseScale);
+    }
+}
+
+template <typename C> void Int8ToFloatRun(const int8_t *in, float *out, size_t count, float scale)
+{
+    size_t i = 0;
+    for (; i + C::c_width <= count; i += C::c_width)
+    {
+        C::Int8ToFloat(in + i, out + i, scale);
+    }
+    for (; i < count; ++i)
+    {
+        out[i] = static_cast<float>(in[i]) * scale;
+    }
+}
+
+template <typename C> const ConversionKernelTable &ConversionKernelTableFor()
+{
+    static const ConversionKernelTable kernels = {
+        &FloatToHalfRun<C>,  &HalfToFloatRun<C>, &FloatToBFloat16Run<C>, &BFloat16ToFloatRun<C>,
+        &MaxAbsRun<C>,       &FloatToInt8Run<C>, &Int8ToFloatRun<C>,
+    };
+    return kernels;
+}
+
+// Six rows by two vectors keeps twelve accumulators, the two rows of b and a broadcast element of a in registers on
+// every instruction set, which needs 15 of AVX2's 16 vector registers.
+constexpr size_t c_gemmTileRows = 6;
+
+template <typename V>
+void GemmTile(const float *packedA, const float *packedB, size_t depth, float *c, size_t ldc, size_t rows,
+              size_t columns)
+{
+    constexpr size_t width = V::c_width;
+    typename V::Type sums[c_gemmTileRows][2];
+    for (size_t r = 0; r < c_gemmTileRows; ++r)
+    {
+        sums[r][0] = V::Set(0.0f);
+        sums[r][1] = V::Set(0.0f);
+    }
+    for (size_t k = 0; k < depth; ++k)
+    {
+        typename V::Type b0 = V::Load(packedB);
+        typename V::Type b1 = V::Load(packedB + width);
+        for (size_t r = 0; r < c_gemmTileRows; ++r)
+        {
+            typename V::Type a = V::Set(packedA[r]);
+            sums[r][0] = V::MultiplyAdd(a, b0, sums[r][0]);
+            sums[r][1] = V::MultiplyAdd(a, b1, sums[r][1]);
+        }
+        packedA += c_gemmTileRows;
+        packedB += 2 * width;
+    }
+
+    if (rows == c_gemmTileRows && columns == 2 * width)
+    {
+        for (size_t r = 0; r < c_gemmTileRows; ++r)
+        {
+            float *row = c + r * ldc;
+            V::Store(row, V::Add(V::Load(row), sums[r][0]));
+            V::Store(row + width, V::Add(V::Load(row + width), sums[r][1]));
+        }
+        return;
+    }
+    // Edge blocks go through memory so that nothing outside c is touched.
+    float block[c_gemmTileRows][2 * width];
+    for (size_t r = 0; r < c_gemmTileRows; ++r)
+    {
+        V::Store(block[r], sums[r][0]);
+        V::Store(block[r] + width, sums[r][1]);
+    }
+    for (size_t r = 0; r < rows; ++r)
+    {
+        for (size_t j = 0; j < columns; ++j)
+        {
+            c[r * ldc + j] += block[r][j];
+        }
+    }
+}
+
+// Four independent accumulators hide the latency of the adds and the comparisons.
+template <typename V, bool Max> float ReduceRun(const float *in, size_t count)
+{
+    constexpr size_t width = V::c_width;
+    typename V::Type initial = V::Set(Max ? BitsFloat(0xff800000) : 0.0f); // -infinity for max
+    typename V::Type partial[4] = {initial, initial, initial, initial};
+    auto combine = [](typename V::Type x, typename V::Type y) { return Max ? V::Max(x, y) : V::Add(x, y); };
+
+    size_t i = 0;
+    for (; i + 4 * width <= count; i += 4 * width)
+    {
+        for (size_t p = 0; p < 4; ++p)
+        {
+            partial[p] = combine(partial[p], V::Load(in + i + p * width));
+        }
+    }
+    for (; i + width <= count; i += width)
+    {
+        partial[0] = combine(partial[0], V::Load(in + i));
+    }
+
+    float lanes[width];
+    V::Store(lanes, combine(combine(partial[0], partial[1]), combine(partial[2], partial[3])));
+    float result = lanes[0];
+    for (size_t lane = 1; lane < width; ++lane)
+    {
+        result = Max ? (lanes[lane] > result ? lanes[lane] : result) : result + lanes[lane];
+    }
+    for (; i < count; ++i)
+    {
+        result = Max ? (in[i] > result ? in[i] : result) : result + in[i];
+    }
+    return result;
+}
+
+template <typename V> const MatrixKernelTable &MatrixKernelTableFor()
+{
+    static const MatrixKernelTable kernels = {
+        c_gemmTileRows, 2 * V::c_width, &GemmTile<V>, &ReduceRun<V, false>, &ReduceRun<V, true>,
+    };
+    return kernels;
+}
+} // namespace
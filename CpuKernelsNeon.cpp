@@ -0,0 +1,126 @@
+// NEON is part of the AArch64 baseline, so this file needs no extra compiler flags.
+#if defined(__aarch64__) || defined(_M_ARM64)
+
+#include "CpuKernelsImpl.hpp"
+
+#include <arm_neon.h>
+
+namespace
+{
+struct NeonVector
+{
+    using Type = float32x4_t;
+    static constexpr size_t c_width = 4;
+
+    static Type Load(const float *p)
+    {
+        return vld1q_f32(p);
+    }
+    static void Store(float *p, Type v)
+    {
+        vst1q_f32(p, v);
+    }
+    static Type Set(float x)
+    {
+        return vdupq_n_f32(x);
+    }
+    static Type Add(Type a, Type b)
+    {
+        return vaddq_f32(a, b);
+    }
+    static Type Subtract(Type a, Type b)
+    {
+        return vsubq_f32(a, b);
+    }
+    static Type Multiply(Type a, Type b)
+    {
+        return vmulq_f32(a, b);
+    }
+    static Type Divide(Type a, Type b)
+    {
+        return vdivq_f32(a, b);
+    }
+    static Type Max(Type a, Type b)
+    {
+        return vmaxq_f32(a, b);
+    }
+    static Type Min(Type a, Type b)
+    {
+        return vminq_f32(a, b);
+    }
+    static Type MultiplyAdd(Type a, Type b, Type c)
+    {
+        return vfmaq_f32(c, a, b);
+    }
+};
+
+struct NeonConversion
+{
+    static constexpr size_t c_width = 4;
+
+    static void FloatToHalf(const float *in, uint16_t *out)
+    {
+        vst1_u16(out, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(in))));
+    }
+    static void HalfToFloat(const uint16_t *in, float *out)
+    {
+        vst1q_f32(out, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(in))));
+    }
+    static void FloatToBFloat16(const float *in, uint16_t *out)
+    {
+        uint32x4_t bits = vreinterpretq_u32_f32(vld1q_f32(in));
+        uint32x4_t odd = vandq_u32(vshrq_n_u32(bits, 16), vdupq_n_u32(1));
+        uint32x4_t rounded = vaddq_u32(bits, vaddq_u32(odd, vdupq_n_u32(0x7fff)));
+        uint32x4_t quietNan = vorrq_u32(bits, vdupq_n_u32(0x400000));
+        uint32x4_t isNan = vcgtq_u32(vandq_u32(bits, vdupq_n_u32(0x7fffffff)), vdupq_n_u32(0x7f800000));
+        vst1_u16(out, vshrn_n_u32(vbslq_u32(isNan, quietNan, rounded), 16));
+    }
+    static void BFloat16ToFloat(const uint16_t *in, float *out)
+    {
+        vst1q_u32(reinterpret_cast<uint32_t *>(out), vshll_n_u16(vld1_u16(in), 16));
+    }
+    static float MaxAbs(const float *in, size_t count)
+    {
+        float32x4_t result = vdupq_n_f32(0.0f);
+        for (size_t i = 0; i < count; i += c_width)
+        {
+            result = vmaxq_f32(result, vabsq_f32(vld1q_f32(in + i)));
+        }
+        return vmaxvq_f32(result);
+    }
+    static void FloatToInt8(const float *in, int8_t *out, float inverseScale)
+    {
+        float32x4_t v = vmulq_f32(vld1q_f32(in), vdupq_n_f32(inverseScale));
+        v = vminq_f32(vmaxq_f32(v, vdupq_n_f32(-127.0f)), vdupq_n_f32(127.0f));
+        int16x4_t narrow = vqmovn_s32(vcvtnq_s32_f32(v));
+        int8x8_t bytes = vqmovn_s16(vcombine_s16(narrow, narrow));
+        int32_t packed = vget_lane_s32(vreinterpret_s32_s8(bytes), 0);
+        memcpy(out, &packed, sizeof(packed));
+    }
+    static void Int8ToFloat(const int8_t *in, float *out, float scale)
+    {
+        int32_t packed;
+        memcpy(&packed, in, sizeof(packed));
+        int16x8_t wide = vmovl_s8(vreinterpret_s8_s32(vdup_n_s32(packed)));
+        float32x4_t values = vcvtq_f32_s32(vmovl_s16(vget_low_s16(wide)));
+        vst1q_f32(out, vmulq_f32(values, vdupq_n_f32(scale)));
+    }
+};
+} // namespace
+
+const BinaryRunFunction *NeonBinaryKernels()
+{
+    return BinaryKernelTable<NeonVector>();
+}
+
+const ConversionKernelTable &NeonConversionKernels()
+{
+    return ConversionKernelTableFor<NeonConversion>();
+}
+
+const MatrixKernelTable &NeonMatrixKernels()
+{
+    return MatrixKernelTableFor<NeonVector>();
+}
+
+#endif
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "TensorTable.hpp"
+
+// Pending uploads and operator dispatches recorded in deferred execution mode. Commands are kept as closures that
+// record into a command list when the stream is replayed, which lets the stream drop work that turns out to be dead
+// before anything is recorded: an upload whose tensor is uploaded again whole, or fully overwritten by a dispatch,
+// before any dispatch reads it.
+class DeferredStream
+{
+  public:
+    using RecordFunction = std::function<void()>;
+
+    // whole is false for an upload that covers only part of the tensor, which keeps earlier uploads of the rest.
+    void Upload(TensorHandle tensor, bool whole, RecordFunction record)
+    {
+        if (whole)
+        {
+            DropUnreadUploads(tensor);
+        }
+        m_unreadUploads[tensor].push_back(m_commands.size());
+        m_commands.push_back({std::move(record), true});
+    }
+
+    // Dispatches are assumed to overwrite every element of their outputs.
+    void Dispatch(const std::vector<TensorHandle> &reads, const std::vector<TensorHandle> &writes,
+                  RecordFunction record)
+    {
+        for (TensorHandle tensor : reads)
+        {
+            m_unreadUploads.erase(tensor);
+        }
+        for (TensorHandle tensor : writes)
+        {
+            DropUnreadUploads(tensor);
+        }
+        m_commands.push_back({std::move(record), true});
+    }
+
+    bool Empty() const
+    {
+        return m_commands.empty();
+    }
+
+    size_t PendingCount() const
+    {
+        return m_commands.size();
+    }
+
+    uint64_t DroppedCount() const
+    {
+        return m_dropped;
+    }
+
+    // Records every live command in order and clears the stream.
+    void Replay()
+    {
+        // Swap out first so that a record function which triggers a nested flush sees an empty stream.
+        std::vector<Command> commands;
+        commands.swap(m_commands);
+        m_unreadUploads.clear();
+
+        for (auto &command : commands)
+        {
+            if (command.live)
+            {
+                command.record();
+            }
+        }
+    }
+
+    void Clear()
+    {
+        m_commands.clear();
+        m_unreadUploads.clear();
+    }
+
+  private:
+    void DropUnreadUploads(TensorHandle tensor)
+    {
+        auto it = m_unreadUploads.find(tensor);
+        if (it == m_unreadUploads.end())
+        {
+            return;
+        }
+        for (size_t index : it->second)
+        {
+            m_commands[index].live = false;
+            ++m_dropped;
+        }
+        m_unreadUploads.erase(it);
+    }
+
+    struct Command
+    {
+        RecordFunction record;
+        bool live;
+    };
+
+    std::vector<Command> m_commands;
+    // Indices of each tensor's uploads that no dispatch has read yet.
+    std::unordered_map<TensorHandle, std::vector<size_t>> m_unreadUploads;
+    uint64_t m_dropped = 0;
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Cost model for placing ops on one of several devices. It only sees profiles and byte counts, not backends, so
+// routing and sharding decisions can be exercised with simulated devices of any speed.
+
+// Measured or assumed speed of one device. An op is estimated to take
+//   dispatchSeconds + computeBytes / computeBytesPerSecond + transferBytes / transferBytesPerSecond
+// where computeBytes are the bytes the op reads and writes and transferBytes the operands not yet on the device.
+struct DeviceProfile
+{
+    double dispatchSeconds = 50e-6;
+    double computeBytesPerSecond = 10e9;
+    double transferBytesPerSecond = 8e9;
+};
+
+// Rows [begin, end) of the split axis run on device. A single-device route has one shard covering every row.
+struct RouteShard
+{
+    size_t device = 0;
+    uint64_t begin = 0;
+    uint64_t end = 0;
+};
+
+struct Route
+{
+    std::vector<RouteShard> shards;
+    double estimatedSeconds = 0.0;
+};
+
+class DeviceRouter
+{
+  public:
+    size_t AddDevice(const DeviceProfile &profile)
+    {
+        m_profiles.push_back(profile);
+        return m_profiles.size() - 1;
+    }
+
+    size_t DeviceCount() const
+    {
+        return m_profiles.size();
+    }
+
+    DeviceProfile &Profile(size_t device)
+    {
+        return m_profiles.at(device);
+    }
+    const DeviceProfile &Profile(size_t device) const
+    {
+        return m_profiles.at(device);
+    }
+
+    double EstimateSeconds(size_t device, uint64_t computeBytes, uint64_t transferBytes) const
+    {
+        const DeviceProfile &profile = m_profiles.at(device);
+        return profile.dispatchSeconds + static_cast<double>(computeBytes) / profile.computeBytesPerSecond +
+               static_cast<double>(transferBytes) / profile.transferBytesPerSecond;
+    }
+
+    // Picks where an op runs. transferBytes[d] is what has to be moved before it can run on device d. An op whose
+    // output has rowCount rows along a splittable axis may be sharded so every device finishes at the same time;
+    // it is only sharded when that beats the best single device and every shard gets at least minShardBytes.
+    Route RouteOp(uint64_t computeBytes, const std::vector<uint64_t> &transferBytes, uint64_t rowCount = 1,
+                  uint64_t minShardBytes = 0) const
+    {
+        if (m_profiles.empty())
+        {
+            throw std::invalid_argument("DeviceRouter has no devices.");
+        }
+        if (transferBytes.size() != m_profiles.size())
+        {
+            throw std::invalid_argument("DeviceRouter needs the transfer bytes of every device.");
+        }
+
+        Route best;
+        best.estimatedSeconds = INFINITY;
+        for (size_t d = 0; d < m_profiles.size(); ++d)
+        {
+            double seconds = EstimateSeconds(d, computeBytes, transferBytes[d]);
+            if (seconds < best.estimatedSeconds)
+            {
+                best.shards = {{d, 0, rowCount}};
+                best.estimatedSeconds = seconds;
+            }
+        }
+
+        Route sharded = Shard(computeBytes, transferBytes, rowCount, minShardBytes);
+        return sharded.estimatedSeconds < best.estimatedSeconds ? sharded : best;
+    }
+
+  private:
+    // Shares of the rows that make every device finish at the same time T, where device d takes
+    // dispatchSeconds + share * perByteSeconds * computeBytes. Devices whose share would be too small to be worth a
+    // shard are dropped one at a time, slowest first.
+    Route Shard(uint64_t computeBytes, const std::vector<uint64_t> &transferBytes, uint64_t rowCount,
+                uint64_t minShardBytes) const
+    {
+        Route route;
+        route.estimatedSeconds = INFINITY;
+        if (m_profiles.size() < 2 || rowCount < 2 || computeBytes == 0)
+        {
+            return route;
+        }
+
+        double bytes = static_cast<double>(computeBytes);
+        std::vector<size_t> devices;
+        std::vector<double> perByteSeconds;
+        for (size_t d = 0; d < m_profiles.size(); ++d)
+        {
+            // Operands that are not on the device yet move in proportion to the share it gets.
+            const DeviceProfile &profile = m_profiles[d];
+            devices.push_back(d);
+            perByteSeconds.push_back(1.0 / profile.computeBytesPerSecond +
+                                     static_cast<double>(transferBytes[d]) / bytes / profile.transferBytesPerSecond);
+        }
+
+        while (devices.size() >= 2)
+        {
+            double rate = 0.0;
+            double overhead = 0.0;
+            for (size_t i = 0; i < devices.size(); ++i)
+            {
+                double secondsPerShare = perByteSeconds[i] * bytes;
+                rate += 1.0 / secondsPerShare;
+                overhead += m_profiles[devices[i]].dispatchSeconds / secondsPerShare;
+            }
+            double finish = (1.0 + overhead) / rate;
+
+            std::vector<double> shares(devices.size());
+            size_t smallest = 0;
+            for (size_t i = 0; i < devices.size(); ++i)
+            {
+                shares[i] = (finish - m_profiles[devices[i]].dispatchSeconds) / (perByteSeconds[i] * bytes);
+                if (shares[i] < shares[smallest])
+                {
+                    smallest = i;
+                }
+            }
+
+            double smallestRows = shares[smallest] * static_cast<double>(rowCount);
+            if (smallestRows >= 1.0 && shares[smallest] * bytes >= static_cast<double>(minShardBytes))
+            {
+                double cumulative = 0.0;
+                uint64_t begin = 0;
+                for (size_t i = 0; i < devices.size(); ++i)
+                {
+                    cumulative += shares[i];
+                    uint64_t end = i + 1 == devices.size()
+                                       ? rowCount
+                                       : std::min<uint64_t>(rowCount, std::llround(cumulative * rowCount));
+                    if (end > begin)
+                    {
+                        route.shards.push_back({devices[i], begin, end});
+                        begin = end;
+                    }
+                }
+                // Rounding can leave every row to one device, which is not a sharded route.
+                route.estimatedSeconds = route.shards.size() >= 2 ? finish : INFINITY;
+                return route;
+            }
+
+            devices.erase(devices.begin() + smallest);
+            perByteSeconds.erase(perByteSeconds.begin() + smallest);
+        }
+        return route;
+    }
+
+    std::vector<DeviceProfile> m_profiles;
+};
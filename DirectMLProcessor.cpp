@@ -4,6 +4,7 @@
 #include <dxcore.h>
 #include <dxcore_interface.h>
 #include <iostream>
+#include <unordered_set>
 
 #pragma warning(                                                                                                       \
     disable : 4238) // References to temporary classes are okay because they are only used as function parameters.
@@ -12,9 +13,86 @@ using Microsoft::WRL::ComPtr;
 
 DirectMLProcessor::~DirectMLProcessor()
 {
+    // Operators the prewarm threads have not started on are left for the next run.
+    m_stopPrewarm = true;
+    try
+    {
+        WaitForPrewarm();
+        SaveStartupProfile();
+    }
+    catch (...)
+    {
+    }
+
+    // Resources referenced by in-flight submissions must outlive them.
+    if (m_fence)
+    {
+        try
+        {
+            WaitForIdle();
+        }
+        catch (...)
+        {
+        }
+    }
+}
+
+namespace
+{
+// The driver description of adapter, tagged with the feature levels it supports.
+std::string AdapterDescription(IDXCoreAdapter *adapter)
+{
+    size_t descriptionSize;
+    THROW_IF_FAILED(adapter->GetPropertySize(DXCoreAdapterProperty::DriverDescription, &descriptionSize));
+
+    std::string adapterDescription(descriptionSize, '\0');
+    THROW_IF_FAILED(
+        adapter->GetProperty(DXCoreAdapterProperty::DriverDescription, descriptionSize, adapterDescription.data()));
+
+    // Remove trailing null terminator written by DXCore.
+    while (!adapterDescription.empty() && adapterDescription.back() == '\0')
+    {
+        adapterDescription.pop_back();
+    }
+
+    if (adapter->IsAttributeSupported(DXCORE_ADAPTER_ATTRIBUTE_D3D12_CORE_COMPUTE))
+    {
+        adapterDescription += " (CORE_COMPUTE)";
+    }
+    if (adapter->IsAttributeSupported(DXCORE_ADAPTER_ATTRIBUTE_D3D12_GENERIC_ML))
+    {
+        adapterDescription += " (GENERIC_ML)";
+    }
+    return adapterDescription;
+}
+
+uint64_t AdapterDriverVersion(IDXCoreAdapter *adapter)
+{
+    uint64_t driverVersion = 0;
+    THROW_IF_FAILED(adapter->GetProperty(DXCoreAdapterProperty::DriverVersion, sizeof(driverVersion), &driverVersion));
+    return driverVersion;
+}
+
+// The adapter a startup profile recorded, or null if it is gone or its driver has changed since.
+ComPtr<IDXCoreAdapter> OpenProfiledAdapter(const AdapterProfile &profile)
+{
+    ComPtr<IDXCoreAdapterFactory> adapterFactory;
+    THROW_IF_FAILED(DXCoreCreateAdapterFactory(IID_PPV_ARGS(adapterFactory.GetAddressOf())));
+
+    LUID luid{profile.luidLowPart, profile.luidHighPart};
+    ComPtr<IDXCoreAdapter> adapter;
+    if (FAILED(adapterFactory->GetAdapterByLuid(luid, IID_PPV_ARGS(adapter.GetAddressOf()))) || !adapter->IsValid() ||
+        AdapterDescription(adapter.Get()) != profile.description ||
+        AdapterDriverVersion(adapter.Get()) != profile.driverVersion)
+    {
+        return nullptr;
+    }
+    return adapter;
 }
+} // namespace
 
-std::tuple<Microsoft::WRL::ComPtr<IDXCoreAdapter>, D3D_FEATURE_LEVEL> SelectAdapter(std::string_view adapterNameFilter)
+std::tuple<Microsoft::WRL::ComPtr<IDXCoreAdapter>, D3D_FEATURE_LEVEL, std::string> SelectAdapter(
+    std::string_view adapterNameFilter)
 {
     using Microsoft::WRL::ComPtr;
 
@@ -58,28 +136,7 @@ std::tuple<Microsoft::WRL::ComPtr<IDXCoreAdapter>, D3D_FEATURE_LEVEL> SelectAdap
     {
         ComPtr<IDXCoreAdapter> adapter;
         THROW_IF_FAILED(adapterList->GetAdapter(i, adapter.GetAddressOf()));
-
-        size_t descriptionSize;
-        THROW_IF_FAILED(adapter->GetPropertySize(DXCoreAdapterProperty::DriverDescription, &descriptionSize));
-
-        std::string adapterDescription(descriptionSize, '\0');
-        THROW_IF_FAILED(
-            adapter->GetProperty(DXCoreAdapterProperty::DriverDescription, descriptionSize, adapterDescription.data()));
-
-        // Remove trailing null terminator written by DXCore.
-        while (!adapterDescription.empty() && adapterDescription.back() == '\0')
-        {
-            adapterDescription.pop_back();
-        }
-
-        if (adapter->IsAttributeSupported(DXCORE_ADAPTER_ATTRIBUTE_D3D12_CORE_COMPUTE))
-        {
-            adapterDescription += " (CORE_COMPUTE)";
-        }
-        if (adapter->IsAttributeSupported(DXCORE_ADAPTER_ATTRIBUTE_D3D12_GENERIC_ML))
-        {
-            adapterDescription += " (GENERIC_ML)";
-        }
+        std::string adapterDescription = AdapterDescription(adapter.Get());
 
         adapters.push_back(adapter);
         adapterDescriptions.push_back(adapterDescription);
@@ -101,12 +158,41 @@ std::tuple<Microsoft::WRL::ComPtr<IDXCoreAdapter>, D3D_FEATURE_LEVEL> SelectAdap
     }
     std::cout << "Selected adapter: " << adapterDescriptions[*firstAdapterMatchingNameFilter]
               << " index: " << *firstAdapterMatchingNameFilter << std::endl;
-    return {adapters[*firstAdapterMatchingNameFilter], featureLevel};
+    return {adapters[*firstAdapterMatchingNameFilter], featureLevel,
+            adapterDescriptions[*firstAdapterMatchingNameFilter]};
 }
 
-void DirectMLProcessor::InitializeDirectML(std::string adapterNameFilter)
+void DirectMLProcessor::InitializeDirectML(std::string adapterNameFilter, const DirectMLProcessorOptions &options)
 {
-    auto [adapter, featureLevel] = SelectAdapter(adapterNameFilter);
+    // A profile recorded for the same filter names the adapter to open, which saves enumerating and sorting all of
+    // them, and the capabilities to assume, which saves the feature queries.
+    StartupProfile loadedProfile;
+    std::optional<AdapterProfile> profiledAdapter;
+    m_startupProfilePath = options.startupProfilePath;
+    if (!m_startupProfilePath.empty() && loadedProfile.Load(m_startupProfilePath) && loadedProfile.Adapter() &&
+        loadedProfile.Adapter()->nameFilter == adapterNameFilter)
+    {
+        profiledAdapter = loadedProfile.Adapter();
+    }
+
+    ComPtr<IDXCoreAdapter> adapter = profiledAdapter ? OpenProfiledAdapter(*profiledAdapter) : nullptr;
+    D3D_FEATURE_LEVEL featureLevel;
+    std::string adapterName;
+    if (adapter)
+    {
+        featureLevel = static_cast<D3D_FEATURE_LEVEL>(profiledAdapter->featureLevel);
+        adapterName = profiledAdapter->description;
+        std::cout << "Selected adapter from the startup profile: " << adapterName << std::endl;
+    }
+    else
+    {
+        // The adapter is gone or its driver changed, so its operators are compiled on demand again.
+        profiledAdapter.reset();
+        loadedProfile.Clear();
+        std::tie(adapter, featureLevel, adapterName) = SelectAdapter(adapterNameFilter);
+    }
+    m_adapterName = adapterName;
+    m_adapter = adapter;
     std::cout << "FeatureLevel: " << featureLevel << std::endl;
     Microsoft::WRL::ComPtr<ID3D12Device> d3d12Device;
     THROW_IF_FAILED(D3D12CreateDevice(adapter.Get(), featureLevel, IID_PPV_ARGS(&d3d12Device)));
@@ -131,16 +217,81 @@ void DirectMLProcessor::InitializeDirectML(std::string adapterNameFilter)
     THROW_IF_FAILED(
         m_d3D12Device->CreateCommandQueue(&commandQueueDesc, IID_PPV_ARGS(m_commandQueue.ReleaseAndGetAddressOf())));
 
-    THROW_IF_FAILED(m_d3D12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
-                                                          IID_PPV_ARGS(m_commandAllocator.ReleaseAndGetAddressOf())));
+    // One fence per queue; every submission signals the next value on its timeline.
+    THROW_IF_FAILED(m_d3D12Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(m_fence.ReleaseAndGetAddressOf())));
+
+    // Streams move chunks on a copy queue with a fence of its own, so transfers overlap dispatches. Devices without
+    // one stream through the compute queue.
+    D3D12_COMMAND_QUEUE_DESC copyQueueDesc{};
+    copyQueueDesc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+    if (SUCCEEDED(m_d3D12Device->CreateCommandQueue(&copyQueueDesc,
+                                                    IID_PPV_ARGS(m_copyQueue.ReleaseAndGetAddressOf()))))
+    {
+        THROW_IF_FAILED(
+            m_d3D12Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(m_copyFence.ReleaseAndGetAddressOf())));
+    }
+
+    // Command lists, allocators and upload rings belong to recording contexts, created as threads first need them.
+    m_uploadRingSize = options.uploadRingSize;
+    m_descriptorRingSize = std::max(options.descriptorRingSize, 1u);
+    m_descriptorSize = m_d3D12Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+    m_tensorHeapPageSize = options.tensorHeapPageSize;
+    m_capacityPolicy = options.tensorCapacity;
+    m_bucketOperatorShapes = options.bucketOperatorShapes;
+
+    // Until the adapter is first asked for its budget, nothing is evicted.
+    m_residencyEnabled = options.memoryBudget != ResidencyManager::c_unlimited;
+    m_followAdapterBudget = options.memoryBudget == 0;
+    m_residency.SetBudget(m_followAdapterBudget ? ResidencyManager::c_unlimited : options.memoryBudget);
+    m_evictionDirectory = options.evictionDirectory;
+
+    // GPU timestamps for traced dispatches. Not every device supports them on this queue, in which case dispatches
+    // are traced on the CPU side only.
+    D3D12_QUERY_HEAP_DESC timestampHeapDesc{D3D12_QUERY_HEAP_TYPE_TIMESTAMP, c_timestampCount, 0};
+    if (SUCCEEDED(m_commandQueue->GetTimestampFrequency(&m_timestampFrequency)) &&
+        SUCCEEDED(m_d3D12Device->CreateQueryHeap(&timestampHeapDesc,
+                                                 IID_PPV_ARGS(m_timestampHeap.ReleaseAndGetAddressOf()))))
+    {
+        THROW_IF_FAILED(m_d3D12Device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK), D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(c_timestampCount * sizeof(uint64_t)), D3D12_RESOURCE_STATE_COPY_DEST,
+            nullptr, IID_PPV_ARGS(m_timestampReadback.ReleaseAndGetAddressOf())));
+        D3D12_RANGE emptyRange{0, 0};
+        THROW_IF_FAILED(m_timestampReadback->Map(0, &emptyRange, reinterpret_cast<void **>(&m_timestampData)));
+        for (uint32_t index = 0; index < c_timestampCount; index += 2)
+        {
+            m_freeTimestamps.push_back(index);
+        }
+    }
 
-    THROW_IF_FAILED(m_d3D12Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator.Get(),
-                                                     nullptr, IID_PPV_ARGS(m_commandList.ReleaseAndGetAddressOf())));
+    // Readback buffers are pooled by size and stay mapped for their whole lifetime; the per-read Map/Unmap only
+    // marks which range the CPU reads.
+    m_readbackPool = ReadbackPool<ReadbackBuffer>(
+        [this](uint64_t capacity) {
+            ReadbackBuffer buffer;
+            THROW_IF_FAILED(m_d3D12Device->CreateCommittedResource(
+                &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK), D3D12_HEAP_FLAG_NONE,
+                &CD3DX12_RESOURCE_DESC::Buffer(capacity), D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+                IID_PPV_ARGS(buffer.resource.GetAddressOf())));
+            D3D12_RANGE emptyRange{0, 0};
+            void *mappedData{};
+            THROW_IF_FAILED(buffer.resource->Map(0, &emptyRange, &mappedData));
+            return buffer;
+        },
+        c_minReadbackBucketSize, options.maxCachedReadbackBytes);
 
     DML_FEATURE_QUERY_TENSOR_DATA_TYPE_SUPPORT fp16Query = {DML_TENSOR_DATA_TYPE_FLOAT16};
     DML_FEATURE_DATA_TENSOR_DATA_TYPE_SUPPORT fp16Supported = {};
-    THROW_IF_FAILED(m_dmlDevice->CheckFeatureSupport(DML_FEATURE_TENSOR_DATA_TYPE_SUPPORT, sizeof(fp16Query),
-                                                     &fp16Query, sizeof(fp16Supported), &fp16Supported));
+    if (profiledAdapter)
+    {
+        fp16Supported.IsSupported = profiledAdapter->float16Supported;
+    }
+    else
+    {
+        THROW_IF_FAILED(m_dmlDevice->CheckFeatureSupport(DML_FEATURE_TENSOR_DATA_TYPE_SUPPORT, sizeof(fp16Query),
+                                                         &fp16Query, sizeof(fp16Supported), &fp16Supported));
+    }
+    m_float16Supported = fp16Supported.IsSupported;
     if (fp16Supported.IsSupported)
     {
         std::wcout << L"FP16 is supported." << std::endl;
@@ -152,8 +303,15 @@ void DirectMLProcessor::InitializeDirectML(std::string adapterNameFilter)
 
     DML_FEATURE_QUERY_TENSOR_DATA_TYPE_SUPPORT int8Query = {DML_TENSOR_DATA_TYPE_INT8};
     DML_FEATURE_DATA_TENSOR_DATA_TYPE_SUPPORT int8Supported = {};
-    THROW_IF_FAILED(m_dmlDevice->CheckFeatureSupport(DML_FEATURE_TENSOR_DATA_TYPE_SUPPORT, sizeof(int8Query),
-                                                     &int8Query, sizeof(int8Supported), &int8Supported));
+    if (profiledAdapter)
+    {
+        int8Supported.IsSupported = profiledAdapter->int8Supported;
+    }
+    else
+    {
+        THROW_IF_FAILED(m_dmlDevice->CheckFeatureSupport(DML_FEATURE_TENSOR_DATA_TYPE_SUPPORT, sizeof(int8Query),
+                                                         &int8Query, sizeof(int8Supported), &int8Supported));
+    }
     if (int8Supported.IsSupported)
     {
         std::wcout << L"INT8 is supported." << std::endl;
@@ -167,329 +325,2503 @@ void DirectMLProcessor::InitializeDirectML(std::string adapterNameFilter)
     //     DML_TENSOR_DATA_TYPE type = static_cast<DML_TENSOR_DATA_TYPE>(i);
     //     std::cout << "Enum value: " << type << std::endl;
     // }
+
+    if (m_startupProfilePath.empty())
+    {
+        return;
+    }
+    AdapterProfile adapterProfile;
+    adapterProfile.nameFilter = adapterNameFilter;
+    adapterProfile.description = adapterName;
+    adapterProfile.driverVersion = AdapterDriverVersion(adapter.Get());
+    LUID luid{};
+    THROW_IF_FAILED(adapter->GetProperty(DXCoreAdapterProperty::InstanceLuid, sizeof(luid), &luid));
+    adapterProfile.luidHighPart = luid.HighPart;
+    adapterProfile.luidLowPart = luid.LowPart;
+    adapterProfile.featureLevel = static_cast<uint32_t>(featureLevel);
+    adapterProfile.float16Supported = fp16Supported.IsSupported;
+    adapterProfile.int8Supported = int8Supported.IsSupported;
+    m_startupProfile.SetAdapter(adapterProfile);
+
+    // The profile is rebuilt from what compiles in this run, so operators that no longer compile drop out of it.
+    // Prewarming more operators than the cache holds would only evict the first ones again; the rest are kept for
+    // the next run.
+    const std::vector<OperatorRecipe> &recipes = loadedProfile.Operators();
+    size_t prewarmCount = std::min(recipes.size(), m_operatorCache.GetStats().capacity);
+    m_prewarmRecipes.assign(recipes.begin(), recipes.begin() + prewarmCount);
+    for (size_t i = prewarmCount; i < recipes.size(); ++i)
+    {
+        m_startupProfile.AddOperator(recipes[i]);
+    }
+    uint32_t threadCount = static_cast<uint32_t>(std::min<size_t>(options.prewarmThreadCount, prewarmCount));
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        m_prewarmThreads.emplace_back([this]() { Prewarm(); });
+    }
 }
 
-void DirectMLProcessor::CloseExecuteResetWait()
+std::unique_ptr<DirectMLProcessor::RecordingContext> DirectMLProcessor::CreateRecordingContext()
 {
-    THROW_IF_FAILED(m_commandList->Close());
+    auto context = std::make_unique<RecordingContext>();
+
+    // A ring of command allocators lets several submissions be in flight while the next one is recorded.
+    for (size_t i = 0; i < c_commandAllocatorCount; ++i)
+    {
+        ComPtr<ID3D12CommandAllocator> commandAllocator;
+        THROW_IF_FAILED(m_d3D12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+                                                              IID_PPV_ARGS(commandAllocator.GetAddressOf())));
+        context->allocators.Add(commandAllocator);
+    }
+    THROW_IF_FAILED(m_d3D12Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT,
+                                                     context->allocators.Current().Get(), nullptr,
+                                                     IID_PPV_ARGS(context->commandList.GetAddressOf())));
 
-    ID3D12CommandList *commandLists[] = {m_commandList.Get()};
-    m_commandQueue->ExecuteCommandLists(ARRAYSIZE(commandLists), commandLists);
+    // The command recorder records dispatches into an existing command list. Each context has its own, so recording
+    // never needs a lock.
+    THROW_IF_FAILED(m_dmlDevice->CreateCommandRecorder(IID_PPV_ARGS(context->commandRecorder.GetAddressOf())));
 
-    ComPtr<ID3D12Fence> d3D12Fence;
-    THROW_IF_FAILED(m_d3D12Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(d3D12Fence.GetAddressOf())));
+    // The context's uploads are staged through one persistently mapped ring instead of an UPLOAD heap per tensor.
+    THROW_IF_FAILED(m_d3D12Device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(m_uploadRingSize), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+        IID_PPV_ARGS(context->uploadBuffer.GetAddressOf())));
+    D3D12_RANGE emptyRange{0, 0};
+    THROW_IF_FAILED(context->uploadBuffer->Map(0, &emptyRange, reinterpret_cast<void **>(&context->uploadRingData)));
+    context->uploadRing = UploadRing(m_uploadRingSize);
 
-    wil::unique_handle fenceEventHandle(::CreateEvent(nullptr, true, false, nullptr));
-    THROW_LAST_ERROR_IF_NULL(fenceEventHandle);
+    // Dispatches take their descriptors from one heap per context, so the command list never switches heaps.
+    D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc{};
+    descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    descriptorHeapDesc.NumDescriptors = m_descriptorRingSize;
+    descriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+    THROW_IF_FAILED(m_d3D12Device->CreateDescriptorHeap(
+        &descriptorHeapDesc, IID_PPV_ARGS(context->binding.descriptorHeap.GetAddressOf())));
+    context->descriptorRing = UploadRing(m_descriptorRingSize);
+    return context;
+}
 
-    THROW_IF_FAILED(m_commandQueue->Signal(d3D12Fence.Get(), 1));
-    THROW_IF_FAILED(d3D12Fence->SetEventOnCompletion(1, fenceEventHandle.get()));
+std::unique_ptr<DirectMLProcessor::CopyContext> DirectMLProcessor::CreateCopyContext()
+{
+    auto context = std::make_unique<CopyContext>();
+    for (size_t i = 0; i < c_commandAllocatorCount; ++i)
+    {
+        ComPtr<ID3D12CommandAllocator> commandAllocator;
+        THROW_IF_FAILED(m_d3D12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY,
+                                                              IID_PPV_ARGS(commandAllocator.GetAddressOf())));
+        context->allocators.Add(commandAllocator);
+    }
+    THROW_IF_FAILED(m_d3D12Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY,
+                                                     context->allocators.Current().Get(), nullptr,
+                                                     IID_PPV_ARGS(context->commandList.GetAddressOf())));
+    return context;
+}
 
-    ::WaitForSingleObjectEx(fenceEventHandle.get(), INFINITE, FALSE);
+DirectMLProcessor::RecordingContext &DirectMLProcessor::AcquireContext(ContextLease &lease)
+{
+    if (m_deferredContext)
+    {
+        return *m_deferredContext;
+    }
+    lease = m_contexts.Acquire();
+    return *lease;
+}
 
-    THROW_IF_FAILED(m_commandAllocator->Reset());
-    THROW_IF_FAILED(m_commandList->Reset(m_commandAllocator.Get(), nullptr));
+SubmissionTicket DirectMLProcessor::Submit()
+{
+    if (m_deferredContext)
+    {
+        return Submit(*m_deferredContext);
+    }
+    // Every immediate call has submitted its own work already.
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return {m_timeline.LastSubmittedValue()};
 }
 
-void DirectMLProcessor::SetTensorData(std::string name, uint32_t *shapes, DML_TENSOR_DATA_TYPE type, const void *data,
-                                      size_t size)
+SubmissionTicket DirectMLProcessor::Submit(RecordingContext &context)
 {
-    std::cout << "Enter SetTensorData " << name << std::endl;
+    TRACE_SPAN("Submit");
 
-    ComPtr<ID3D12Resource> tensorResource, uploadBuffer;
-    if (m_tensorInfoMap.find(name) == m_tensorInfoMap.end())
+    for (const GpuSpan &span : context.openGpuSpans)
     {
-        std::cout << "Tensor " << name << " not found" << std::endl;
-        m_tensorInfoMap[name] = new TensorInfo();
-        m_tensorInfoMap[name]->dimensions = {shapes[0], shapes[1], shapes[2], shapes[3]};
-        m_tensorInfoMap[name]->elementCount = shapes[0] * shapes[1] * shapes[2] * shapes[3];
-        m_tensorInfoMap[name]->desc = {type, m_tensorInfoMap[name]->dimensions};
-        std::wcout << "Tensor Buffer Size: " << m_tensorInfoMap[name]->desc.totalTensorSizeInBytes << std::endl;
+        context.commandList->ResolveQueryData(m_timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, span.timestampIndex,
+                                              2, m_timestampReadback.Get(), span.timestampIndex * sizeof(uint64_t));
+    }
+    THROW_IF_FAILED(context.commandList->Close());
 
-        THROW_IF_FAILED(m_d3D12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(m_tensorInfoMap[name]->desc.totalTensorSizeInBytes,
-                                           D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
-            D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(tensorResource.GetAddressOf())));
-        m_tensorInfoMap[name]->resource = tensorResource;
+    // Command lists are recorded in parallel but handed to the queue one at a time, so each signals the fence value
+    // that follows the previous submission's.
+    uint64_t fenceValue;
+    SubmissionTicket ticket;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        ID3D12CommandList *commandLists[] = {context.commandList.Get()};
+        m_commandQueue->ExecuteCommandLists(ARRAYSIZE(commandLists), commandLists);
 
-        THROW_IF_FAILED(m_d3D12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(m_tensorInfoMap[name]->desc.totalTensorSizeInBytes),
-            D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(uploadBuffer.GetAddressOf())));
-        m_tensorInfoMap[name]->uploadResource = uploadBuffer;
+        fenceValue = m_timeline.NextFenceValue();
+        THROW_IF_FAILED(m_commandQueue->Signal(m_fence.Get(), fenceValue));
+        for (std::shared_ptr<void> &object : context.keepAlive)
+        {
+            m_timeline.KeepAlive(std::move(object));
+        }
+        ticket = m_timeline.Advance();
+
+        if (!context.openGpuSpans.empty())
+        {
+            m_timeline.Then(ticket, [this, spans = std::move(context.openGpuSpans)]() { ReportGpuSpans(spans); });
+        }
     }
-    else
+    context.keepAlive.clear();
+    context.openGpuSpans.clear();
+    context.bufferStates.clear();
+    context.descriptorRing.Commit(fenceValue);
+
+    // Staging regions allocated since the last commit are read by this submission, unless they belong to deferred
+    // uploads that have not been recorded yet; those are committed by the submission that replays them.
+    if (!m_replayingPendingStream && m_pendingStream.Empty())
     {
-        std::cout << "Tensor " << name << " already exists" << std::endl;
-        tensorResource = m_tensorInfoMap[name]->resource;
-        uploadBuffer = m_tensorInfoMap[name]->uploadResource;
+        context.uploadRing.Commit(fenceValue);
     }
 
-    D3D12_SUBRESOURCE_DATA tensorSubresourceData{};
-    tensorSubresourceData.pData = data;
-    tensorSubresourceData.RowPitch = static_cast<LONG_PTR>(size);
-    tensorSubresourceData.SlicePitch = tensorSubresourceData.RowPitch;
+    // The next allocator in the ring may still be used by an older submission.
+    context.allocators.Rotate(fenceValue);
+    WaitForFenceValue(context.allocators.CurrentRetireValue());
 
-    // Upload the input tensor to the GPU.
-    ::UpdateSubresources(m_commandList.Get(), tensorResource.Get(), uploadBuffer.Get(), 0, 0, 1,
-                         &tensorSubresourceData);
+    ID3D12CommandAllocator *commandAllocator = context.allocators.Current().Get();
+    THROW_IF_FAILED(commandAllocator->Reset());
+    THROW_IF_FAILED(context.commandList->Reset(commandAllocator, nullptr));
 
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(tensorResource.Get(),
-                                                                            D3D12_RESOURCE_STATE_COPY_DEST,
-                                                                            D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+    return ticket;
 }
 
-void DirectMLProcessor::GetTensorData(std::string name, uint32_t *shapes, DML_TENSOR_DATA_TYPE type, void *data,
-                                      size_t size)
+SubmissionTicket DirectMLProcessor::SubmitCopy(CopyContext &context, uint64_t computeFenceValue)
 {
-    std::cout << "Enter GetTensorData " << name << std::endl;
+    THROW_IF_FAILED(context.commandList->Close());
 
-    if (m_tensorInfoMap.find(name) == m_tensorInfoMap.end())
+    SubmissionTicket ticket;
     {
-        std::cout << "Tensor " << name << " not found" << std::endl;
-        return;
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        // The wait is queued on the GPU, so the copy queue holds back only this list and whatever follows it.
+        if (computeFenceValue != 0)
+        {
+            THROW_IF_FAILED(m_copyQueue->Wait(m_fence.Get(), computeFenceValue));
+        }
+        ID3D12CommandList *commandLists[] = {context.commandList.Get()};
+        m_copyQueue->ExecuteCommandLists(ARRAYSIZE(commandLists), commandLists);
+        THROW_IF_FAILED(m_copyQueue->Signal(m_copyFence.Get(), m_copyTimeline.NextFenceValue()));
+        ticket = m_copyTimeline.Advance();
     }
-    // The output buffer now contains the result of the identity operator,
-    // so read it back if you want the CPU to access it.
-    ComPtr<ID3D12Resource> readbackBuffer;
-    THROW_IF_FAILED(m_d3D12Device->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK), D3D12_HEAP_FLAG_NONE,
-        &CD3DX12_RESOURCE_DESC::Buffer(m_tensorInfoMap[name]->desc.totalTensorSizeInBytes),
-        D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(readbackBuffer.GetAddressOf())));
 
-    m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_tensorInfoMap[name]->resource.Get(),
-                                                                            D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-                                                                            D3D12_RESOURCE_STATE_COPY_SOURCE));
+    context.allocators.Rotate(ticket.fenceValue);
+    WaitForCopyFenceValue(context.allocators.CurrentRetireValue());
 
-    m_commandList->CopyResource(readbackBuffer.Get(), m_tensorInfoMap[name]->resource.Get());
-
-    CloseExecuteResetWait();
+    ID3D12CommandAllocator *commandAllocator = context.allocators.Current().Get();
+    THROW_IF_FAILED(commandAllocator->Reset());
+    THROW_IF_FAILED(context.commandList->Reset(commandAllocator, nullptr));
+    return ticket;
+}
 
-    D3D12_RANGE tensorBufferRange{0, static_cast<SIZE_T>(m_tensorInfoMap[name]->desc.totalTensorSizeInBytes)};
-    FLOAT *outputBufferData{};
-    THROW_IF_FAILED(readbackBuffer->Map(0, &tensorBufferRange, reinterpret_cast<void **>(&outputBufferData)));
+void DirectMLProcessor::WaitForCopyFenceValue(uint64_t fenceValue)
+{
+    if (m_copyFence->GetCompletedValue() < fenceValue)
+    {
+        TRACE_SPAN("FenceWait");
+        THROW_IF_FAILED(m_copyFence->SetEventOnCompletion(fenceValue, nullptr));
+    }
+}
 
-    memcpy(data, outputBufferData, size);
+void DirectMLProcessor::WaitForFenceValue(uint64_t fenceValue)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        if (fenceValue > m_timeline.LastSubmittedValue())
+        {
+            throw std::logic_error("Waiting on a fence value that was never submitted.");
+        }
+    }
 
-    D3D12_RANGE emptyRange{0, 0};
-    readbackBuffer->Unmap(0, &emptyRange);
+    if (m_fence->GetCompletedValue() < fenceValue)
+    {
+        // Without an event SetEventOnCompletion blocks until the fence is reached, so any number of threads can wait
+        // at once without sharing one.
+        TRACE_SPAN("FenceWait");
+        THROW_IF_FAILED(m_fence->SetEventOnCompletion(fenceValue, nullptr));
+    }
+    RetireCompleted();
 }
 
-bool DirectMLProcessor::CanBroadcast(const dml::TensorDimensions &a, const dml::TensorDimensions &b)
+void DirectMLProcessor::RetireCompleted()
 {
-    if (a != b)
+    std::vector<std::function<void()>> due;
     {
-        return (a[0] % b[0] == 0) && (a[1] % b[1] == 0) && (a[2] % b[2] == 0) && (a[3] % b[3] == 0);
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        due = m_timeline.Retire(m_fence->GetCompletedValue());
     }
-    else
+    for (auto &continuation : due)
     {
-        return true;
+        continuation();
     }
 }
 
-dml::Expression DirectMLProcessor::ReshapeAndBroadcastTensor(dml::Expression originalTensor,
-                                                             const dml::TensorDimensions &targetShape)
+void DirectMLProcessor::ReportGpuSpans(const std::vector<GpuSpan> &spans)
 {
+    // Map GPU ticks onto the CPU clock the tracer uses. steady_clock is based on QueryPerformanceCounter, so the
+    // calibration's QPC value converts to the same nanosecond scale.
+    UINT64 gpuCalibration = 0, cpuCalibration = 0;
+    THROW_IF_FAILED(m_commandQueue->GetClockCalibration(&gpuCalibration, &cpuCalibration));
+    LARGE_INTEGER qpcFrequency;
+    ::QueryPerformanceFrequency(&qpcFrequency);
+    uint64_t frequency = static_cast<uint64_t>(qpcFrequency.QuadPart);
+    uint64_t cpuCalibrationNs =
+        cpuCalibration / frequency * 1000000000ull + cpuCalibration % frequency * 1000000000ull / frequency;
+
+    auto toCpuNs = [&](uint64_t ticks) {
+        double offset = static_cast<double>(static_cast<int64_t>(ticks - gpuCalibration)) * 1e9 /
+                        static_cast<double>(m_timestampFrequency);
+        return static_cast<uint64_t>(static_cast<int64_t>(cpuCalibrationNs) + static_cast<int64_t>(offset));
+    };
+
+    for (const GpuSpan &span : spans)
+    {
+        const uint64_t *ticks = m_timestampData + span.timestampIndex;
+        Tracer::RecordSpan(span.name, "", span.bytes, toCpuNs(ticks[0]), toCpuNs(ticks[1]), TraceTrack::Gpu);
+    }
 
-    const auto &originalShape = originalTensor.GetOutputDesc().sizes;
-
-    // Step 1: Reshape the original tensor if necessary
-    dml::Expression reshapedTensor = originalTensor;
-    if (originalShape.size() != targetShape.size())
+    std::lock_guard<std::mutex> lock(m_timestampMutex);
+    for (const GpuSpan &span : spans)
     {
-        // Pad the original shape with 1s to match the target shape's rank
-        dml::TensorDimensions paddedShape(targetShape.size(), 1);
-        std::copy(originalShape.rbegin(), originalShape.rend(), paddedShape.rbegin());
-        reshapedTensor = dml::Reinterpret(originalTensor, paddedShape, dml::NullOpt);
+        m_freeTimestamps.push_back(span.timestampIndex);
     }
+}
+
+void DirectMLProcessor::Wait(const SubmissionTicket &ticket)
+{
+    ScopedPhase phase(m_phaseTimes, Phase::Dispatch);
+    WaitForFenceValue(ticket.fenceValue);
+}
 
-    // Step 2: Broadcast the reshaped tensor
-    dml::TensorDimensions repeats(targetShape.size(), 1);
-    for (size_t i = 0; i < targetShape.size(); ++i)
+bool DirectMLProcessor::IsComplete(const SubmissionTicket &ticket)
+{
+    RetireCompleted();
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return m_timeline.IsComplete(ticket);
+}
+
+void DirectMLProcessor::Then(const SubmissionTicket &ticket, std::function<void()> continuation)
+{
+    RetireCompleted();
     {
-        if (reshapedTensor.GetOutputDesc().sizes[i] == 1 && targetShape[i] != 1)
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        if (!m_timeline.IsComplete(ticket))
         {
-            repeats[i] = targetShape[i];
+            m_timeline.Then(ticket, std::move(continuation));
+            return;
         }
     }
+    continuation();
+}
 
-    return dml::Tile(reshapedTensor, repeats);
+void DirectMLProcessor::WaitForIdle()
+{
+    uint64_t lastSubmitted;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        lastSubmitted = m_timeline.LastSubmittedValue();
+    }
+    WaitForFenceValue(lastSubmitted);
 }
 
-void DirectMLProcessor::ElementWiseAddBcast(std::string src0, std::string src1, std::string dst)
+void DirectMLProcessor::SetExecutionMode(ExecutionMode mode)
 {
-    if (m_tensorInfoMap.find(src0) == m_tensorInfoMap.end() || m_tensorInfoMap.find(src1) == m_tensorInfoMap.end() ||
-        m_tensorInfoMap.find(dst) == m_tensorInfoMap.end())
+    if (mode == m_executionMode)
     {
-        std::cout << "Tensor not found" << std::endl;
         return;
     }
-
-    dml::Graph graph(m_dmlDevice.Get());
-    dml::Expression input = dml::InputTensor(graph, 0, m_tensorInfoMap[src0]->desc);
-    dml::Expression input2;
-    if (m_tensorInfoMap[src0]->dimensions != m_tensorInfoMap[src1]->dimensions)
+    // Anything staged or recorded while deferred is submitted before switching, so no pending work is lost. Deferred
+    // work is recorded into one context for as long as the mode lasts.
+    if (m_deferredContext)
     {
-        assert(CanBroadcast(m_tensorInfoMap[src0]->dimensions, m_tensorInfoMap[src1]->dimensions));
-        std::cout << "Tensor shapes do not match, might need Broadcasting" << std::endl;
-        input2 = ReshapeAndBroadcastTensor(dml::InputTensor(graph, 1, m_tensorInfoMap[src1]->desc),
-                                           m_tensorInfoMap[src0]->dimensions);
+        ReplayPendingStream();
+        Submit(*m_deferredContext);
+        m_deferredContext.Reset();
     }
-    else
+    m_executionMode = mode;
+    if (mode == ExecutionMode::Deferred)
     {
-        input2 = dml::InputTensor(graph, 1, m_tensorInfoMap[src1]->desc);
+        // Deferred calls come from one thread, so the prewarm threads must be done by then.
+        WaitForPrewarm();
+        m_deferredContext = m_contexts.Acquire();
     }
-    dml::Expression output = dml::Add(input, input2);
-
-    ComPtr<IDMLCompiledOperator> dmlCompiledOperator;
-    DML_EXECUTION_FLAGS executionFlags = DML_EXECUTION_FLAG_ALLOW_HALF_PRECISION_COMPUTATION;
-    dmlCompiledOperator.Attach(graph.Compile(executionFlags, {output}).Detach());
-
-    ComPtr<IDMLOperatorInitializer> dmlOpInitializer;
-    IDMLCompiledOperator *dmlCompiledOperators[] = {dmlCompiledOperator.Get()};
-    THROW_IF_FAILED(m_dmlDevice->CreateOperatorInitializer(ARRAYSIZE(dmlCompiledOperators), dmlCompiledOperators,
-                                                           IID_PPV_ARGS(dmlOpInitializer.GetAddressOf())));
-
-    DML_BINDING_PROPERTIES initializeBindingProperties = dmlOpInitializer->GetBindingProperties();
-    DML_BINDING_PROPERTIES executeBindingProperties = dmlCompiledOperator->GetBindingProperties();
-    UINT descriptorCount =
-        std::max(initializeBindingProperties.RequiredDescriptorCount, executeBindingProperties.RequiredDescriptorCount);
-
-    // Create descriptor heaps.
-    ComPtr<ID3D12DescriptorHeap> descriptorHeap;
-
-    D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc{};
-    descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-    descriptorHeapDesc.NumDescriptors = descriptorCount;
-    descriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-    THROW_IF_FAILED(
-        m_d3D12Device->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(descriptorHeap.GetAddressOf())));
-
-    // Set the descriptor heap(s).
-    ID3D12DescriptorHeap *d3D12DescriptorHeaps[] = {descriptorHeap.Get()};
-    m_commandList->SetDescriptorHeaps(ARRAYSIZE(d3D12DescriptorHeaps), d3D12DescriptorHeaps);
-
-    // Create a binding table over the descriptor heap we just created.
-    DML_BINDING_TABLE_DESC dmlBindingTableDesc{};
-    dmlBindingTableDesc.Dispatchable = dmlOpInitializer.Get();
-    dmlBindingTableDesc.CPUDescriptorHandle = descriptorHeap->GetCPUDescriptorHandleForHeapStart();
-    dmlBindingTableDesc.GPUDescriptorHandle = descriptorHeap->GetGPUDescriptorHandleForHeapStart();
-    dmlBindingTableDesc.SizeInDescriptors = descriptorCount;
+}
 
-    ComPtr<IDMLBindingTable> dmlBindingTable;
-    THROW_IF_FAILED(
-        m_dmlDevice->CreateBindingTable(&dmlBindingTableDesc, IID_PPV_ARGS(dmlBindingTable.GetAddressOf())));
+SubmissionTicket DirectMLProcessor::Flush()
+{
+    if (!m_deferredContext || m_pendingStream.Empty())
+    {
+        return {};
+    }
+    ReplayPendingStream();
+    return Submit(*m_deferredContext);
+}
 
-    UINT64 temporaryResourceSize =
-        std::max(initializeBindingProperties.TemporaryResourceSize, executeBindingProperties.TemporaryResourceSize);
+void DirectMLProcessor::ReplayPendingStream()
+{
+    m_replayingPendingStream = true;
+    auto resetReplaying = wil::scope_exit([this]() { m_replayingPendingStream = false; });
+    m_pendingStream.Replay();
+}
 
-    ComPtr<ID3D12Resource> temporaryBuffer;
-    if (temporaryResourceSize != 0)
+UINT64 DirectMLProcessor::AllocateUpload(RecordingContext &context, UINT64 size)
+{
+    for (;;)
     {
-        THROW_IF_FAILED(m_d3D12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(temporaryResourceSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
-            D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(temporaryBuffer.GetAddressOf())));
+        context.uploadRing.Retire(m_fence->GetCompletedValue());
+        if (auto offset = context.uploadRing.Allocate(size, c_uploadAlignment))
+        {
+            return *offset;
+        }
 
-        if (initializeBindingProperties.TemporaryResourceSize != 0)
+        // Make sure everything staged so far is submitted, then wait for the oldest region to retire.
+        if (!m_pendingStream.Empty())
         {
-            DML_BUFFER_BINDING bufferBinding{temporaryBuffer.Get(), 0, temporaryResourceSize};
-            DML_BINDING_DESC bindingDesc{DML_BINDING_TYPE_BUFFER, &bufferBinding};
-            dmlBindingTable->BindTemporaryResource(&bindingDesc);
+            Flush();
+        }
+        else if (context.uploadRing.HasUncommitted())
+        {
+            Submit(context);
+        }
+
+        uint64_t oldestFenceValue = context.uploadRing.OldestPendingFenceValue();
+        if (oldestFenceValue == 0)
+        {
+            throw std::logic_error("Upload does not fit in the upload ring.");
         }
+        WaitForFenceValue(oldestFenceValue);
     }
+}
 
-    UINT64 persistentResourceSize = executeBindingProperties.PersistentResourceSize;
-    std::wcout << L"presistentResourceSize: " << L' ' << persistentResourceSize << std::endl;
-    ComPtr<ID3D12Resource> persistentBuffer;
-    if (persistentResourceSize != 0)
+void DirectMLProcessor::Record(const std::vector<TensorHandle> &reads, const std::vector<TensorHandle> &writes,
+                               DeferredStream::RecordFunction record)
+{
+    if (m_executionMode == ExecutionMode::Deferred)
     {
-        THROW_IF_FAILED(m_d3D12Device->CreateCommittedResource(
-            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
-            &CD3DX12_RESOURCE_DESC::Buffer(persistentResourceSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
-            D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(persistentBuffer.GetAddressOf())));
-
-        // The persistent resource should be bound as the output to the IDMLOperatorInitializer.
-        DML_BUFFER_BINDING bufferBinding{persistentBuffer.Get(), 0, persistentResourceSize};
-        DML_BINDING_DESC bindingDesc{DML_BINDING_TYPE_BUFFER, &bufferBinding};
-        dmlBindingTable->BindOutputs(1, &bindingDesc);
+        m_pendingStream.Dispatch(reads, writes, std::move(record));
     }
+    else
+    {
+        record();
+    }
+}
 
-    // The command recorder is a stateless object that records Dispatches into an existing Direct3D 12 command list.
-    ComPtr<IDMLCommandRecorder> dmlCommandRecorder;
-    THROW_IF_FAILED(m_dmlDevice->CreateCommandRecorder(IID_PPV_ARGS(dmlCommandRecorder.GetAddressOf())));
-
-    // Record execution of the operator initializer.
-    dmlCommandRecorder->RecordDispatch(m_commandList.Get(), dmlOpInitializer.Get(), dmlBindingTable.Get());
-
-    // Close the Direct3D 12 command list, and submit it for execution as you would any other command list. You could
-    // in principle record the execution into the same command list as the initialization, but you need only to
-    // Initialize once, and typically you want to Execute an operator more frequently than that.
-    CloseExecuteResetWait();
+void DirectMLProcessor::TransitionTensor(RecordingContext &context, TensorInfo &tensor, D3D12_RESOURCE_STATES state,
+                                         std::vector<D3D12_RESOURCE_BARRIER> &barriers)
+{
+    TransitionBuffer(context, tensor.buffer->resource.Get(), state, barriers);
+}
 
-    //
-    // Bind and execute the operator on the GPU.
-    //
+void DirectMLProcessor::TransitionBuffer(RecordingContext &context, ID3D12Resource *resource,
+                                         D3D12_RESOURCE_STATES state, std::vector<D3D12_RESOURCE_BARRIER> &barriers)
+{
+    auto [it, firstUse] = context.bufferStates.try_emplace(resource);
+    BufferState &buffer = it->second;
+    if (firstUse)
+    {
+        // Every buffer is in COMMON when a command list starts, and the first use promotes it without a barrier.
+        buffer.state = state;
+    }
+    else if (buffer.state != state)
+    {
+        barriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource, buffer.state, state));
+        buffer.state = state;
+        buffer.uavDirty = false;
+    }
+    else if (state == D3D12_RESOURCE_STATE_UNORDERED_ACCESS && buffer.uavDirty)
+    {
+        // A previous dispatch in this command list wrote the buffer.
+        barriers.push_back(CD3DX12_RESOURCE_BARRIER::UAV(resource));
+        buffer.uavDirty = false;
+    }
+}
 
-    m_commandList->SetDescriptorHeaps(ARRAYSIZE(d3D12DescriptorHeaps), d3D12DescriptorHeaps);
+void DirectMLProcessor::FlushBarriers(RecordingContext &context, std::vector<D3D12_RESOURCE_BARRIER> &barriers)
+{
+    if (!barriers.empty())
+    {
+        context.commandList->ResourceBarrier(static_cast<UINT>(barriers.size()), barriers.data());
+        barriers.clear();
+    }
+}
 
-    // Reset the binding table to bind for the operator we want to execute (it was previously used to bind for the
-    // initializer).
+TensorHandle DirectMLProcessor::CreateTensor(const std::string &name, const TensorShape &shape, TensorDataType type)
+{
+    return CreateTensor(name, shape, type, false);
+}
 
-    dmlBindingTableDesc.Dispatchable = dmlCompiledOperator.Get();
+TensorHandle DirectMLProcessor::CreateTensor(const std::string &name, const TensorShape &shape, TensorDataType type,
+                                             bool dedicated)
+{
+    ValidateShape(shape);
+    auto create = [&]() {
+        TensorInfo created{};
+        created.name = name;
+        created.dedicated = dedicated;
+        DescribeTensor(created, shape, type);
+        TRACE_VERBOSE_INSTANT("CreateTensor", name, created.desc.totalTensorSizeInBytes);
+
+        created.capacity.Reserve(RequiredStorage(created), m_capacityPolicy);
+        AllocateTensorStorage(created);
+        return created;
+    };
+    auto [handle, tensor] = m_tensors.FindOrCreate(name, create);
+
+    StoragePrecision precision =
+        type == TensorDataType::Float32 ? GetStoragePrecision(name) : StoragePrecision::Float32;
+    if (!std::equal(tensor->dimensions.begin(), tensor->dimensions.end(), shape.begin(), shape.end()) ||
+        tensor->hostType != type || tensor->precision != precision)
+    {
+        ResidentTensors resident(*this, {}, {handle});
+        ResizeTensor(*tensor, shape, type);
+    }
+    TrackTensor(handle, *tensor);
+    return handle;
+}
 
-    THROW_IF_FAILED(dmlBindingTable->Reset(&dmlBindingTableDesc));
+void DirectMLProcessor::DescribeTensor(TensorInfo &tensor, const TensorShape &shape, TensorDataType type)
+{
+    tensor.dimensions = dml::TensorDimensions(shape.begin(), shape.end());
+    tensor.elementCount = static_cast<uint32_t>(ElementCount(shape));
+    tensor.hostType = type;
+    tensor.precision = type == TensorDataType::Float32 ? GetStoragePrecision(tensor.name) : StoragePrecision::Float32;
+    DML_TENSOR_DATA_TYPE storageType = tensor.precision == StoragePrecision::Float16
+                                           ? DML_TENSOR_DATA_TYPE_FLOAT16
+                                           : static_cast<DML_TENSOR_DATA_TYPE>(type);
+    tensor.desc = {storageType, tensor.dimensions};
+}
 
-    if (temporaryResourceSize != 0)
+UINT64 DirectMLProcessor::RequiredStorage(const TensorInfo &tensor) const
+{
+    if (!m_bucketOperatorShapes)
     {
-        DML_BUFFER_BINDING bufferBinding{temporaryBuffer.Get(), 0, temporaryResourceSize};
-        DML_BINDING_DESC bindingDesc{DML_BINDING_TYPE_BUFFER, &bufferBinding};
-        dmlBindingTable->BindTemporaryResource(&bindingDesc);
+        return tensor.desc.totalTensorSizeInBytes;
     }
+    TensorShape padded = PaddedShape(TensorShape(tensor.dimensions.begin(), tensor.dimensions.end()));
+    return dml::TensorDesc(tensor.desc.dataType, dml::TensorDimensions(padded.begin(), padded.end()))
+        .totalTensorSizeInBytes;
+}
 
-    if (persistentResourceSize != 0)
+void DirectMLProcessor::ResizeTensor(TensorInfo &tensor, const TensorShape &shape, TensorDataType type)
+{
+    // Deferred commands read the tensor's description and storage when they are recorded.
+    Flush();
+    DescribeTensor(tensor, shape, type);
+    if (!tensor.capacity.Reserve(RequiredStorage(tensor), m_capacityPolicy))
     {
-        DML_BUFFER_BINDING bufferBinding{persistentBuffer.Get(), 0, persistentResourceSize};
-        DML_BINDING_DESC bindingDesc{DML_BINDING_TYPE_BUFFER, &bufferBinding};
-        dmlBindingTable->BindPersistentResource(&bindingDesc);
+        return;
     }
 
-    // Create tensor buffers for output/readback of the tensor elements.
-
-    DML_BUFFER_BINDING inputBufferBinding{m_tensorInfoMap[src0]->resource.Get(), 0,
-                                          m_tensorInfoMap[src0]->desc.totalTensorSizeInBytes};
-    DML_BINDING_DESC inputBindingDesc{DML_BINDING_TYPE_BUFFER, &inputBufferBinding};
+    TRACE_VERBOSE_INSTANT("ResizeTensor", tensor.name, tensor.capacity.Bytes());
+    TensorInfo released{};
+    released.buffer = std::move(tensor.buffer);
+    released.page = std::exchange(tensor.page, nullptr);
+    released.allocation = std::exchange(tensor.allocation, {});
+    AllocateTensorStorage(tensor);
+    ReleaseTensorStorageAfterSubmitted(std::move(released));
+}
 
-    DML_BUFFER_BINDING inputBufferBinding2{m_tensorInfoMap[src1]->resource.Get(), 0,
-                                           m_tensorInfoMap[src1]->desc.totalTensorSizeInBytes};
-    DML_BINDING_DESC inputBindingDesc2{DML_BINDING_TYPE_BUFFER, &inputBufferBinding2};
+TensorHandle DirectMLProcessor::FindTensor(const std::string &name) const
+{
+    return m_tensors.Find(name);
+}
 
-    DML_BINDING_DESC inputBindingDescs[] = {inputBindingDesc, inputBindingDesc2};
-    dmlBindingTable->BindInputs(2, inputBindingDescs);
-    std::cout << "Binding inputs" << std::endl;
+TensorShape DirectMLProcessor::GetTensorShape(TensorHandle handle) const
+{
+    const TensorInfo &tensor = m_tensors.Get(handle);
+    return TensorShape(tensor.dimensions.begin(), tensor.dimensions.end());
+}
 
-    DML_BUFFER_BINDING outputBufferBinding{m_tensorInfoMap[dst]->resource.Get(), 0,
-                                           m_tensorInfoMap[dst]->desc.totalTensorSizeInBytes};
-    DML_BINDING_DESC outputBindingDesc{DML_BINDING_TYPE_BUFFER, &outputBufferBinding};
-    dmlBindingTable->BindOutputs(1, &outputBindingDesc);
-    std::cout << "Binding outputs" << std::endl;
+TensorDataType DirectMLProcessor::GetTensorType(TensorHandle handle) const
+{
+    return m_tensors.Get(handle).hostType;
+}
 
-    // Record execution of the compiled operator.
-    dmlCommandRecorder->RecordDispatch(m_commandList.Get(), dmlCompiledOperator.Get(), dmlBindingTable.Get());
-    std::cout << "Record Dispatch" << std::endl;
+void DirectMLProcessor::ReleaseTensor(TensorHandle handle)
+{
+    // Deferred commands point at the tensor, so they are recorded and submitted before it goes.
+    Flush();
+    if (m_residencyEnabled)
+    {
+        std::lock_guard<std::mutex> lock(m_residencyMutex);
+        m_residency.Remove(handle);
+    }
+    std::optional<TensorInfo> erased = m_tensors.Erase(handle);
+    if (erased)
+    {
+        ReleaseTensorStorageAfterSubmitted(std::move(*erased));
+    }
+}
 
-    CloseExecuteResetWait();
-    std::wcout << "Exit ElementWiseAddBcast" << std::endl;
+void DirectMLProcessor::ReleaseTensorStorageAfterSubmitted(TensorInfo tensor)
+{
+    // Work already submitted may still read or write the storage, so it is freed once that work has finished.
+    SubmissionTicket lastSubmitted;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        lastSubmitted = {m_timeline.LastSubmittedValue()};
+    }
+    auto released = std::make_shared<TensorInfo>(std::move(tensor));
+    Then(lastSubmitted, [this, released]() { ReleaseTensorStorage(*released); });
+}
+
+DirectMLProcessor::ResidentTensors::ResidentTensors(DirectMLProcessor &processor,
+                                                    const std::vector<TensorHandle> &reads,
+                                                    const std::vector<TensorHandle> &writes)
+{
+    if (!processor.m_residencyEnabled)
+    {
+        return;
+    }
+    m_processor = &processor;
+    m_tensors = reads;
+    m_tensors.insert(m_tensors.end(), writes.begin(), writes.end());
+
+    std::lock_guard<std::mutex> lock(processor.m_residencyMutex);
+    ResidencyManager &residency = processor.m_residency;
+    std::vector<TensorHandle> evicted = residency.Pin(m_tensors);
+    try
+    {
+        uint64_t incoming = 0;
+        for (TensorHandle handle : evicted)
+        {
+            incoming += residency.Bytes(handle);
+        }
+        processor.MakeRoom(incoming);
+
+        for (TensorHandle handle : evicted)
+        {
+            bool read = std::find(reads.begin(), reads.end(), handle) != reads.end();
+            processor.PageInTensor(handle, processor.m_tensors.Get(handle), read);
+        }
+    }
+    catch (...)
+    {
+        residency.Unpin(m_tensors, processor.LastUseFenceValue());
+        throw;
+    }
+}
+
+DirectMLProcessor::ResidentTensors::~ResidentTensors()
+{
+    if (!m_processor)
+    {
+        return;
+    }
+    uint64_t fenceValue = m_processor->LastUseFenceValue();
+    std::lock_guard<std::mutex> lock(m_processor->m_residencyMutex);
+    m_processor->m_residency.Unpin(m_tensors, fenceValue);
+}
+
+uint64_t DirectMLProcessor::LastUseFenceValue()
+{
+    bool staged = m_executionMode == ExecutionMode::Deferred && !m_pendingStream.Empty();
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    return staged ? m_timeline.NextFenceValue() : m_timeline.LastSubmittedValue();
+}
+
+void DirectMLProcessor::TrackTensor(TensorHandle handle, const TensorInfo &tensor)
+{
+    if (!m_residencyEnabled)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_residencyMutex);
+    if (!m_residency.Contains(handle))
+    {
+        m_residency.Add(handle, tensor.capacity.Bytes());
+    }
+    else if (m_residency.IsResident(handle))
+    {
+        m_residency.Resize(handle, tensor.capacity.Bytes());
+    }
+
+    // The tensor's storage is allocated already, so it is the other tensors that make room for it.
+    std::vector<TensorHandle> pinned = {handle};
+    m_residency.Pin(pinned);
+    try
+    {
+        MakeRoom(0);
+    }
+    catch (...)
+    {
+        m_residency.Unpin(pinned, LastUseFenceValue());
+        throw;
+    }
+    m_residency.Unpin(pinned, LastUseFenceValue());
+}
+
+void DirectMLProcessor::MakeRoom(uint64_t incoming)
+{
+    RefreshMemoryBudget();
+    ResidencyManager::EvictionPlan plan = m_residency.PlanEviction(incoming);
+    if (plan.victims.empty())
+    {
+        return;
+    }
+
+    // Staged commands may still use the victims. Once they are submitted, the plan's fence value covers them.
+    if (m_executionMode == ExecutionMode::Deferred)
+    {
+        Flush();
+    }
+    WaitForFenceValue(plan.fenceValue);
+    for (TensorHandle handle : plan.victims)
+    {
+        EvictTensor(handle, m_tensors.Get(handle));
+    }
+}
+
+void DirectMLProcessor::RefreshMemoryBudget()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (!m_followAdapterBudget || now - m_memoryBudgetQueryTime < c_memoryBudgetQueryInterval)
+    {
+        return;
+    }
+    m_memoryBudgetQueryTime = now;
+
+    DXCoreAdapterMemoryBudgetNodeSegmentGroup segmentGroup{0, DXCoreSegmentGroup::Local};
+    DXCoreAdapterMemoryBudget budget{};
+    if (!m_adapter->IsQueryStateSupported(DXCoreAdapterState::AdapterMemoryBudget) ||
+        FAILED(m_adapter->QueryState(DXCoreAdapterState::AdapterMemoryBudget, &segmentGroup, &budget)))
+    {
+        return;
+    }
+
+    // The budget covers everything the process holds on the device. Heap pages count as tensor memory, since the
+    // blocks freed in them are reused by the next tensors, and tensors get whatever the rest leaves.
+    TensorHeapStats heap = GetTensorHeapStats();
+    uint64_t tensorMemory = heap.reservedBytes + heap.dedicatedBytes;
+    uint64_t otherUsage = budget.currentUsage > tensorMemory ? budget.currentUsage - tensorMemory : 0;
+    m_residency.SetBudget(budget.budget > otherUsage ? budget.budget - otherUsage : 0);
+}
+
+void DirectMLProcessor::EvictTensor(TensorHandle handle, TensorInfo &tensor)
+{
+    UINT64 size = tensor.desc.totalTensorSizeInBytes;
+    TRACE_SPAN("Evict", tensor.name, size);
+
+    // Only the logical contents are kept; the padding past them is undefined anyway.
+    ReadbackPool<ReadbackBuffer>::Entry readback = ReadbackTensor(tensor);
+    D3D12_RANGE tensorBufferRange{0, static_cast<SIZE_T>(size)};
+    void *contents{};
+    THROW_IF_FAILED(readback.buffer.resource->Map(0, &tensorBufferRange, &contents));
+    auto release = wil::scope_exit([&]() {
+        D3D12_RANGE emptyRange{0, 0};
+        readback.buffer.resource->Unmap(0, &emptyRange);
+        ReleaseReadback(std::move(readback));
+    });
+    if (m_evictionDirectory.empty())
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(contents);
+        tensor.evictedContents.assign(bytes, bytes + size);
+    }
+    else
+    {
+        tensor.evictedFile = MappedFile::CreateTemporary(m_evictionDirectory, size);
+        memcpy(tensor.evictedFile->MutableData(), contents, static_cast<size_t>(size));
+    }
+
+    // The readback waited for the last submission that used the tensor, and no call can use it before paging it in.
+    ReleaseTensorStorage(tensor);
+    m_residency.MarkEvicted(handle);
+}
+
+void DirectMLProcessor::PageInTensor(TensorHandle handle, TensorInfo &tensor, bool restore)
+{
+    const uint8_t *contents = tensor.evictedFile ? tensor.evictedFile->Data() : tensor.evictedContents.data();
+    UINT64 size = tensor.evictedFile ? tensor.evictedFile->Size() : tensor.evictedContents.size();
+    TRACE_SPAN(restore ? "PageIn" : "Discard", tensor.name, size);
+    AllocateTensorStorage(tensor);
+
+    if (restore && size != 0)
+    {
+        ContextLease lease;
+        RecordingContext &context = AcquireContext(lease);
+
+        // Recorded straight into the command list, after anything staged before it, like an oversized upload.
+        if (m_executionMode == ExecutionMode::Deferred && !m_pendingStream.Empty())
+        {
+            Flush();
+        }
+        std::vector<D3D12_RESOURCE_BARRIER> barriers;
+        TransitionTensor(context, tensor, D3D12_RESOURCE_STATE_COPY_DEST, barriers);
+        FlushBarriers(context, barriers);
+
+        UINT64 chunkSize = std::max<UINT64>(context.uploadRing.Capacity() / 2, c_uploadAlignment);
+        for (UINT64 copied = 0; copied < size;)
+        {
+            UINT64 bytes = std::min(chunkSize, size - copied);
+            UINT64 uploadOffset = AllocateUpload(context, bytes);
+            memcpy(context.uploadRingData + uploadOffset, contents + copied, static_cast<size_t>(bytes));
+            context.commandList->CopyBufferRegion(tensor.buffer->resource.Get(), tensor.offset + copied,
+                                                  context.uploadBuffer.Get(), uploadOffset, bytes);
+            copied += bytes;
+        }
+        if (m_executionMode == ExecutionMode::Immediate)
+        {
+            Submit(context);
+        }
+    }
+
+    std::vector<uint8_t>().swap(tensor.evictedContents);
+    tensor.evictedFile.reset();
+    m_residency.MarkResident(handle, restore);
+}
+
+void DirectMLProcessor::SetTensorData(TensorHandle handle, const void *data, size_t size)
+{
+    TensorInfo *tensor = &m_tensors.Get(handle);
+    ScopedPhase phase(m_phaseTimes, Phase::Upload);
+    TRACE_SPAN("Upload", tensor->name, size);
+
+    // Converted uploads shrink by the storage-to-host size ratio.
+    UINT64 storageSize = size;
+    if (tensor->precision != StoragePrecision::Float32)
+    {
+        storageSize = size / sizeof(float) * StoragePrecisionSize(tensor->precision);
+    }
+    UINT64 copySize = std::min<UINT64>(storageSize, tensor->desc.totalTensorSizeInBytes);
+    bool whole = copySize == tensor->desc.totalTensorSizeInBytes;
+    ResidentTensors resident(*this, whole ? std::vector<TensorHandle>() : std::vector<TensorHandle>{handle},
+                             whole ? std::vector<TensorHandle>{handle} : std::vector<TensorHandle>());
+
+    ContextLease lease;
+    RecordingContext &context = AcquireContext(lease);
+    UINT64 chunkSize = std::max<UINT64>(context.uploadRing.Capacity() / 2, c_uploadAlignment);
+
+    // Small uploads are staged in the ring right away, so the caller's buffer can be reused, and only the copy is
+    // deferred.
+    if (m_executionMode == ExecutionMode::Deferred && copySize <= chunkSize)
+    {
+        UINT64 uploadOffset = AllocateUpload(context, copySize);
+        StageUpload(*tensor, data, 0, copySize, context.uploadRingData + uploadOffset);
+
+        m_pendingStream.Upload(handle, whole, [this, &context, tensor, uploadOffset, copySize]() {
+            std::vector<D3D12_RESOURCE_BARRIER> barriers;
+            TransitionTensor(context, *tensor, D3D12_RESOURCE_STATE_COPY_DEST, barriers);
+            FlushBarriers(context, barriers);
+            context.commandList->CopyBufferRegion(tensor->buffer->resource.Get(), tensor->offset,
+                                                  context.uploadBuffer.Get(), uploadOffset, copySize);
+        });
+        return;
+    }
+
+    // Oversized uploads are streamed through the ring in chunks and recorded immediately, after anything staged
+    // before them.
+    if (m_executionMode == ExecutionMode::Deferred && !m_pendingStream.Empty())
+    {
+        Flush();
+    }
+
+    std::vector<D3D12_RESOURCE_BARRIER> barriers;
+    TransitionTensor(context, *tensor, D3D12_RESOURCE_STATE_COPY_DEST, barriers);
+    FlushBarriers(context, barriers);
+
+    // Upload the input tensor to the GPU.
+    for (UINT64 copied = 0; copied < copySize;)
+    {
+        UINT64 bytes = std::min(chunkSize, copySize - copied);
+        UINT64 uploadOffset = AllocateUpload(context, bytes);
+        StageUpload(*tensor, data, copied, bytes, context.uploadRingData + uploadOffset);
+        context.commandList->CopyBufferRegion(tensor->buffer->resource.Get(), tensor->offset + copied,
+                                              context.uploadBuffer.Get(), uploadOffset, bytes);
+        copied += bytes;
+    }
+
+    // The context goes back to the pool after this call and may be taken by another thread, so the copy is
+    // submitted now; the queue still runs it before any later op on the tensor.
+    if (m_executionMode == ExecutionMode::Immediate)
+    {
+        Submit(context);
+    }
+}
+
+void DirectMLProcessor::StageUpload(const TensorInfo &tensor, const void *data, UINT64 storageOffset, UINT64 bytes,
+                                    uint8_t *destination)
+{
+    if (tensor.precision == StoragePrecision::Float16)
+    {
+        const float *source = static_cast<const float *>(data) + storageOffset / sizeof(uint16_t);
+        m_conversions->floatToHalf(source, reinterpret_cast<uint16_t *>(destination),
+                                   static_cast<size_t>(bytes / sizeof(uint16_t)));
+    }
+    else
+    {
+        memcpy(destination, static_cast<const uint8_t *>(data) + storageOffset, static_cast<size_t>(bytes));
+    }
+}
+
+StoragePrecision DirectMLProcessor::ResolveStoragePrecision(StoragePrecision requested) const
+{
+    if (requested == StoragePrecision::Float32 || !m_float16Supported)
+    {
+        return StoragePrecision::Float32;
+    }
+    return StoragePrecision::Float16;
+}
+
+ReadbackPool<ReadbackBuffer>::Entry DirectMLProcessor::ReadbackTensor(TensorInfo &tensor)
+{
+    ContextLease lease;
+    RecordingContext &context = AcquireContext(lease);
+
+    // Everything staged so far goes into the same submission as the readback.
+    if (m_executionMode == ExecutionMode::Deferred)
+    {
+        ReplayPendingStream();
+    }
+    ScopedPhase phase(m_phaseTimes, Phase::Readback);
+    TRACE_SPAN("Readback", {}, tensor.desc.totalTensorSizeInBytes);
+
+    ReadbackPool<ReadbackBuffer>::Entry readback;
+    {
+        std::lock_guard<std::mutex> lock(m_readbackMutex);
+        readback = m_readbackPool.Acquire(tensor.desc.totalTensorSizeInBytes);
+    }
+
+    std::vector<D3D12_RESOURCE_BARRIER> barriers;
+    TransitionTensor(context, tensor, D3D12_RESOURCE_STATE_COPY_SOURCE, barriers);
+    FlushBarriers(context, barriers);
+
+    // Pooled buffers are rounded up to their bucket size, so copy only the tensor's bytes.
+    context.commandList->CopyBufferRegion(readback.buffer.resource.Get(), 0, tensor.buffer->resource.Get(),
+                                          tensor.offset, tensor.desc.totalTensorSizeInBytes);
+
+    Wait(Submit(context));
+    return readback;
+}
+
+void DirectMLProcessor::ReleaseReadback(ReadbackPool<ReadbackBuffer>::Entry readback)
+{
+    std::lock_guard<std::mutex> lock(m_readbackMutex);
+    m_readbackPool.Release(std::move(readback));
+}
+
+void DirectMLProcessor::GetTensorData(TensorHandle handle, const TensorShape &shape, TensorDataType type, void *data,
+                                      size_t size)
+{
+    TensorInfo *tensor = &m_tensors.Get(handle);
+    if (type != tensor->hostType)
+    {
+        throw std::invalid_argument("GetTensorData type does not match tensor " + tensor->name + ".");
+    }
+    if (!shape.empty() && !std::equal(tensor->dimensions.begin(), tensor->dimensions.end(), shape.begin(), shape.end()))
+    {
+        throw std::invalid_argument("GetTensorData shape does not match tensor " + tensor->name + ".");
+    }
+    if (size > uint64_t(tensor->elementCount) * DataTypeSize(type))
+    {
+        throw std::invalid_argument("GetTensorData size is larger than tensor " + tensor->name + ".");
+    }
+
+    ResidentTensors resident(*this, {handle});
+    ReadbackPool<ReadbackBuffer>::Entry readback = ReadbackTensor(*tensor);
+    ScopedPhase phase(m_phaseTimes, Phase::HostCopy);
+    TRACE_SPAN("HostCopy", tensor->name, size);
+
+    size_t storageSize = size;
+    if (tensor->precision != StoragePrecision::Float32)
+    {
+        storageSize = size / sizeof(float) * StoragePrecisionSize(tensor->precision);
+    }
+    D3D12_RANGE tensorBufferRange{0, static_cast<SIZE_T>(storageSize)};
+    void *outputBufferData{};
+    THROW_IF_FAILED(readback.buffer.resource->Map(0, &tensorBufferRange, &outputBufferData));
+
+    if (tensor->precision == StoragePrecision::Float16)
+    {
+        m_conversions->halfToFloat(static_cast<const uint16_t *>(outputBufferData), static_cast<float *>(data),
+                                   size / sizeof(float));
+    }
+    else
+    {
+        memcpy(data, outputBufferData, size);
+    }
+
+    D3D12_RANGE emptyRange{0, 0};
+    readback.buffer.resource->Unmap(0, &emptyRange);
+    ReleaseReadback(std::move(readback));
+}
+
+TensorView DirectMLProcessor::MapTensorData(TensorHandle handle)
+{
+    TensorInfo *tensor = &m_tensors.Get(handle);
+    ResidentTensors resident(*this, {handle});
+    auto readback = std::make_shared<ReadbackPool<ReadbackBuffer>::Entry>(ReadbackTensor(*tensor));
+
+    SIZE_T sizeInBytes = static_cast<SIZE_T>(tensor->desc.totalTensorSizeInBytes);
+    D3D12_RANGE tensorBufferRange{0, sizeInBytes};
+    void *outputBufferData{};
+    THROW_IF_FAILED(readback->buffer.resource->Map(0, &tensorBufferRange, &outputBufferData));
+
+    // The buffer is handed back to the pool when the caller drops the view, so no host copy is made.
+    ReadbackLease lease([this, readback]() {
+        D3D12_RANGE emptyRange{0, 0};
+        readback->buffer.resource->Unmap(0, &emptyRange);
+        ReleaseReadback(std::move(*readback));
+    });
+    return TensorView(outputBufferData, sizeInBytes, std::move(lease));
+}
+
+void DirectMLProcessor::BroadcastOperands(dml::Expression &a, dml::Expression &b)
+{
+    dml::TensorDimensions shapeA = a.GetOutputDesc().sizes;
+    dml::TensorDimensions shapeB = b.GetOutputDesc().sizes;
+    if (shapeA == shapeB)
+    {
+        return;
+    }
+
+    TensorShape target =
+        BroadcastShapes(TensorShape(shapeA.begin(), shapeA.end()), TensorShape(shapeB.begin(), shapeB.end()));
+    dml::TensorDimensions targetShape(target.begin(), target.end());
+    if (shapeA != targetShape)
+    {
+        a = BroadcastTo(a, targetShape);
+    }
+    if (shapeB != targetShape)
+    {
+        b = BroadcastTo(b, targetShape);
+    }
+}
+
+void DirectMLProcessor::AllocateTensorStorage(TensorInfo &tensor)
+{
+    UINT64 size = tensor.capacity.Bytes();
+
+    // Buffers are created in COMMON, the state every command list assumes a buffer starts in.
+    if (tensor.dedicated || size > m_tensorHeapPageSize / 4)
+    {
+        tensor.buffer = std::make_shared<TrackedBuffer>();
+        THROW_IF_FAILED(m_d3D12Device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+            D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(tensor.buffer->resource.GetAddressOf())));
+        tensor.offset = 0;
+        tensor.page = nullptr;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_tensorHeapMutex);
+    for (auto &page : m_tensorHeapPages)
+    {
+        if (auto allocation = page->allocator.Allocate(size))
+        {
+            tensor.buffer = page->buffer;
+            tensor.offset = allocation->offset;
+            tensor.page = page.get();
+            tensor.allocation = *allocation;
+            return;
+        }
+    }
+
+    // No page has room; add one. The whole heap is covered by a single placed buffer.
+    auto page = std::make_unique<TensorHeapPage>();
+    CD3DX12_HEAP_DESC heapDesc(m_tensorHeapPageSize, D3D12_HEAP_TYPE_DEFAULT, 0, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS);
+    THROW_IF_FAILED(m_d3D12Device->CreateHeap(&heapDesc, IID_PPV_ARGS(page->heap.GetAddressOf())));
+
+    page->buffer = std::make_shared<TrackedBuffer>();
+    THROW_IF_FAILED(m_d3D12Device->CreatePlacedResource(
+        page->heap.Get(), 0,
+        &CD3DX12_RESOURCE_DESC::Buffer(m_tensorHeapPageSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+        D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(page->buffer->resource.GetAddressOf())));
+    page->allocator = TlsfAllocator(m_tensorHeapPageSize, c_tensorAlignment);
+
+    auto allocation = page->allocator.Allocate(size);
+    if (!allocation)
+    {
+        throw std::logic_error("Tensor does not fit in an empty heap page.");
+    }
+    tensor.buffer = page->buffer;
+    tensor.offset = allocation->offset;
+    tensor.page = page.get();
+    tensor.allocation = *allocation;
+    m_tensorHeapPages.push_back(std::move(page));
+}
+
+void DirectMLProcessor::ReleaseTensorStorage(TensorInfo &tensor)
+{
+    if (tensor.page != nullptr)
+    {
+        std::lock_guard<std::mutex> lock(m_tensorHeapMutex);
+        tensor.page->allocator.Free(tensor.allocation);
+        tensor.page = nullptr;
+        tensor.allocation = {};
+    }
+    tensor.buffer.reset();
+    tensor.offset = 0;
+}
+
+TensorHeapStats DirectMLProcessor::GetTensorHeapStats() const
+{
+    TensorHeapStats stats;
+    m_tensors.ForEach([&](TensorHandle, const TensorInfo &tensor) {
+        if (tensor.page == nullptr && tensor.buffer)
+        {
+            ++stats.dedicatedCount;
+            stats.dedicatedBytes += tensor.capacity.Bytes();
+        }
+    });
+
+    // Taken after the table's lock is released; tensor creation takes them in the opposite order.
+    std::lock_guard<std::mutex> lock(m_tensorHeapMutex);
+    uint64_t freeBytes = 0;
+    for (const auto &page : m_tensorHeapPages)
+    {
+        TlsfAllocator::Stats pageStats = page->allocator.GetStats();
+        ++stats.pageCount;
+        stats.reservedBytes += pageStats.capacity;
+        stats.usedBytes += pageStats.usedBytes;
+        stats.allocationCount += pageStats.allocationCount;
+        stats.freeBlockCount += pageStats.freeBlockCount;
+        stats.largestFreeBlock = std::max(stats.largestFreeBlock, pageStats.largestFreeBlock);
+        freeBytes += pageStats.freeBytes;
+    }
+    stats.fragmentation =
+        freeBytes == 0 ? 0.0 : 1.0 - static_cast<double>(stats.largestFreeBlock) / static_cast<double>(freeBytes);
+    return stats;
+}
+
+dml::Expression DirectMLProcessor::BroadcastTo(dml::Expression tensor, const dml::TensorDimensions &targetShape)
+{
+    // A zero-stride view over the original data; unlike dml::Tile this never materializes the broadcast tensor.
+    dml::TensorDimensions shape = tensor.GetOutputDesc().sizes;
+    std::vector<uint32_t> strides =
+        BroadcastStrides(TensorShape(shape.begin(), shape.end()), TensorShape(targetShape.begin(), targetShape.end()));
+    return dml::Reinterpret(tensor, targetShape, dml::TensorStrides(strides.begin(), strides.end()));
+}
+
+std::shared_ptr<CompiledOperator> DirectMLProcessor::InitializeOperator(RecordingContext &context,
+                                                                         ComPtr<IDMLCompiledOperator> compiledOperator)
+{
+    auto op = std::make_shared<CompiledOperator>();
+    op->compiledOperator = compiledOperator;
+
+    ComPtr<IDMLOperatorInitializer> dmlOpInitializer;
+    IDMLCompiledOperator *dmlCompiledOperators[] = {compiledOperator.Get()};
+    THROW_IF_FAILED(m_dmlDevice->CreateOperatorInitializer(ARRAYSIZE(dmlCompiledOperators), dmlCompiledOperators,
+                                                           IID_PPV_ARGS(dmlOpInitializer.GetAddressOf())));
+
+    DML_BINDING_PROPERTIES initializeBindingProperties = dmlOpInitializer->GetBindingProperties();
+    DML_BINDING_PROPERTIES executeBindingProperties = compiledOperator->GetBindingProperties();
+    op->descriptorCount = executeBindingProperties.RequiredDescriptorCount;
+
+    // The initializer's descriptors are only needed until initialization has run, which is waited for below.
+    D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc{};
+    descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    descriptorHeapDesc.NumDescriptors = std::max(initializeBindingProperties.RequiredDescriptorCount, 1u);
+    descriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+    ComPtr<ID3D12DescriptorHeap> descriptorHeap;
+    THROW_IF_FAILED(
+        m_d3D12Device->CreateDescriptorHeap(&descriptorHeapDesc, IID_PPV_ARGS(descriptorHeap.GetAddressOf())));
+
+    ID3D12DescriptorHeap *d3D12DescriptorHeaps[] = {descriptorHeap.Get()};
+    context.commandList->SetDescriptorHeaps(ARRAYSIZE(d3D12DescriptorHeaps), d3D12DescriptorHeaps);
+
+    // Create a binding table over the descriptor heap we just created.
+    DML_BINDING_TABLE_DESC dmlBindingTableDesc{};
+    dmlBindingTableDesc.Dispatchable = dmlOpInitializer.Get();
+    dmlBindingTableDesc.CPUDescriptorHandle = descriptorHeap->GetCPUDescriptorHandleForHeapStart();
+    dmlBindingTableDesc.GPUDescriptorHandle = descriptorHeap->GetGPUDescriptorHandleForHeapStart();
+    dmlBindingTableDesc.SizeInDescriptors = descriptorHeapDesc.NumDescriptors;
+
+    ComPtr<IDMLBindingTable> bindingTable;
+    THROW_IF_FAILED(m_dmlDevice->CreateBindingTable(&dmlBindingTableDesc, IID_PPV_ARGS(bindingTable.GetAddressOf())));
+
+    op->temporaryResourceSize =
+        std::max(initializeBindingProperties.TemporaryResourceSize, executeBindingProperties.TemporaryResourceSize);
+    if (op->temporaryResourceSize != 0)
+    {
+        THROW_IF_FAILED(m_d3D12Device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(op->temporaryResourceSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+            D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(op->temporaryBuffer.GetAddressOf())));
+
+        if (initializeBindingProperties.TemporaryResourceSize != 0)
+        {
+            DML_BUFFER_BINDING bufferBinding{op->temporaryBuffer.Get(), 0, op->temporaryResourceSize};
+            DML_BINDING_DESC bindingDesc{DML_BINDING_TYPE_BUFFER, &bufferBinding};
+            bindingTable->BindTemporaryResource(&bindingDesc);
+        }
+    }
+
+    op->persistentResourceSize = executeBindingProperties.PersistentResourceSize;
+    if (op->persistentResourceSize != 0)
+    {
+        THROW_IF_FAILED(m_d3D12Device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT), D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(op->persistentResourceSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS),
+            D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(op->persistentBuffer.GetAddressOf())));
+
+        // The persistent resource should be bound as the output to the IDMLOperatorInitializer.
+        DML_BUFFER_BINDING bufferBinding{op->persistentBuffer.Get(), 0, op->persistentResourceSize};
+        DML_BINDING_DESC bindingDesc{DML_BINDING_TYPE_BUFFER, &bufferBinding};
+        bindingTable->BindOutputs(1, &bindingDesc);
+    }
+
+    // Record execution of the operator initializer. This only happens once per cached operator.
+    context.commandRecorder->RecordDispatch(context.commandList.Get(), dmlOpInitializer.Get(), bindingTable.Get());
+    Wait(Submit(context));
+
+    return op;
+}
+
+OperatorBinding &DirectMLProcessor::BindingFor(RecordingContext &context, const CompiledOperator &op)
+{
+    UINT count = std::max(op.descriptorCount, 1u);
+    ResetBinding(op, AllocateDescriptors(context, count), count, context.binding);
+    return context.binding;
+}
+
+UINT64 DirectMLProcessor::AllocateDescriptors(RecordingContext &context, UINT count)
+{
+    for (;;)
+    {
+        context.descriptorRing.Retire(m_fence->GetCompletedValue());
+        if (auto first = context.descriptorRing.Allocate(count, 1))
+        {
+            return *first;
+        }
+
+        // The open command list's dispatches hold the rest of the heap; submit them and wait for the oldest range.
+        if (context.descriptorRing.HasUncommitted())
+        {
+            Submit(context);
+        }
+        uint64_t oldestFenceValue = context.descriptorRing.OldestPendingFenceValue();
+        if (oldestFenceValue == 0)
+        {
+            throw std::logic_error("Operator needs more descriptors than the descriptor ring holds.");
+        }
+        WaitForFenceValue(oldestFenceValue);
+    }
+}
+
+void DirectMLProcessor::CreateBinding(const CompiledOperator &op, OperatorBinding &binding)
+{
+    // The descriptor heap is owned by the binding, so its binding table stays valid across calls.
+    D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc{};
+    descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+    descriptorHeapDesc.NumDescriptors = std::max(op.descriptorCount, 1u);
+    descriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+    THROW_IF_FAILED(m_d3D12Device->CreateDescriptorHeap(&descriptorHeapDesc,
+                                                        IID_PPV_ARGS(binding.descriptorHeap.ReleaseAndGetAddressOf())));
+    binding.bindingTable.Reset();
+    ResetBinding(op, 0, descriptorHeapDesc.NumDescriptors, binding);
+}
+
+void DirectMLProcessor::ResetBinding(const CompiledOperator &op, UINT64 firstDescriptor, UINT count,
+                                     OperatorBinding &binding)
+{
+    DML_BINDING_TABLE_DESC dmlBindingTableDesc{};
+    dmlBindingTableDesc.Dispatchable = op.compiledOperator.Get();
+    dmlBindingTableDesc.CPUDescriptorHandle = CD3DX12_CPU_DESCRIPTOR_HANDLE(
+        binding.descriptorHeap->GetCPUDescriptorHandleForHeapStart(), static_cast<INT>(firstDescriptor),
+        m_descriptorSize);
+    dmlBindingTableDesc.GPUDescriptorHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(
+        binding.descriptorHeap->GetGPUDescriptorHandleForHeapStart(), static_cast<INT>(firstDescriptor),
+        m_descriptorSize);
+    dmlBindingTableDesc.SizeInDescriptors = count;
+
+    // Resetting only rewrites the descriptors of the new range, so dispatches already recorded through the table's
+    // earlier ranges are unaffected.
+    if (binding.bindingTable)
+    {
+        THROW_IF_FAILED(binding.bindingTable->Reset(&dmlBindingTableDesc));
+    }
+    else
+    {
+        THROW_IF_FAILED(m_dmlDevice->CreateBindingTable(&dmlBindingTableDesc,
+                                                        IID_PPV_ARGS(binding.bindingTable.GetAddressOf())));
+    }
+
+    if (op.temporaryResourceSize != 0)
+    {
+        DML_BUFFER_BINDING bufferBinding{op.temporaryBuffer.Get(), 0, op.temporaryResourceSize};
+        DML_BINDING_DESC bindingDesc{DML_BINDING_TYPE_BUFFER, &bufferBinding};
+        binding.bindingTable->BindTemporaryResource(&bindingDesc);
+    }
+    if (op.persistentResourceSize != 0)
+    {
+        DML_BUFFER_BINDING bufferBinding{op.persistentBuffer.Get(), 0, op.persistentResourceSize};
+        DML_BINDING_DESC bindingDesc{DML_BINDING_TYPE_BUFFER, &bufferBinding};
+        binding.bindingTable->BindPersistentResource(&bindingDesc);
+    }
+}
+
+void DirectMLProcessor::DispatchOperator(RecordingContext &context, const std::shared_ptr<CompiledOperator> &opPtr,
+                                         const std::vector<TensorInfo *> &inputs,
+                                         const std::vector<TensorInfo *> &outputs)
+{
+    CompiledOperator &op = *opPtr;
+    OperatorBinding &binding = BindingFor(context, op);
+    BindOperator(context, op, binding, inputs, outputs);
+
+    // Bracket the dispatch with GPU timestamps while tracing. Pairs are reused once ReportGpuSpans has read them.
+    uint32_t timestampIndex = c_timestampCount;
+#if HELLO_DML_TRACE_LEVEL >= 1
+    if (Tracer::IsEnabled() && m_timestampHeap)
+    {
+        std::lock_guard<std::mutex> lock(m_timestampMutex);
+        if (!m_freeTimestamps.empty())
+        {
+            timestampIndex = m_freeTimestamps.back();
+            m_freeTimestamps.pop_back();
+        }
+    }
+    if (timestampIndex != c_timestampCount)
+    {
+        context.commandList->EndQuery(m_timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampIndex);
+    }
+#endif
+
+    // Record execution of the compiled operator.
+    context.commandRecorder->RecordDispatch(context.commandList.Get(), op.compiledOperator.Get(),
+                                            binding.bindingTable.Get());
+
+    if (timestampIndex != c_timestampCount)
+    {
+        context.commandList->EndQuery(m_timestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, timestampIndex + 1);
+        uint64_t bytes = 0;
+        for (const auto &tensor : outputs)
+        {
+            bytes += tensor->desc.totalTensorSizeInBytes;
+        }
+        context.openGpuSpans.push_back({op.traceName, timestampIndex, bytes});
+    }
+
+    // Keep the operator alive even if it is evicted from the cache before this submission retires.
+    context.keepAlive.push_back(opPtr);
+}
+
+void DirectMLProcessor::BindOperator(RecordingContext &context, const CompiledOperator &op, OperatorBinding &binding,
+                                     const std::vector<TensorInfo *> &inputs, const std::vector<TensorInfo *> &outputs)
+{
+    std::vector<D3D12_RESOURCE_BARRIER> barriers;
+    for (const auto &tensor : inputs)
+    {
+        TransitionTensor(context, *tensor, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, barriers);
+    }
+    for (const auto &tensor : outputs)
+    {
+        TransitionTensor(context, *tensor, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, barriers);
+    }
+    // Dispatches of one operator share its temporary buffer, so a later one in the same list waits for the earlier.
+    if (op.temporaryResourceSize != 0)
+    {
+        TransitionBuffer(context, op.temporaryBuffer.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, barriers);
+        context.bufferStates[op.temporaryBuffer.Get()].uavDirty = true;
+    }
+    FlushBarriers(context, barriers);
+
+    ID3D12DescriptorHeap *d3D12DescriptorHeaps[] = {binding.descriptorHeap.Get()};
+    context.commandList->SetDescriptorHeaps(ARRAYSIZE(d3D12DescriptorHeaps), d3D12DescriptorHeaps);
+
+    std::vector<DML_BUFFER_BINDING> bufferBindings;
+    bufferBindings.reserve(inputs.size() + outputs.size());
+    std::vector<DML_BINDING_DESC> bindingDescs;
+    bindingDescs.reserve(inputs.size() + outputs.size());
+
+    for (const auto &tensor : inputs)
+    {
+        bufferBindings.push_back({tensor->buffer->resource.Get(), tensor->offset, tensor->capacity.Bytes()});
+        bindingDescs.push_back({DML_BINDING_TYPE_BUFFER, &bufferBindings.back()});
+    }
+    binding.bindingTable->BindInputs(static_cast<UINT>(inputs.size()), bindingDescs.data());
+
+    for (const auto &tensor : outputs)
+    {
+        bufferBindings.push_back({tensor->buffer->resource.Get(), tensor->offset, tensor->capacity.Bytes()});
+        bindingDescs.push_back({DML_BINDING_TYPE_BUFFER, &bufferBindings.back()});
+        context.bufferStates[tensor->buffer->resource.Get()].uavDirty = true;
+    }
+    binding.bindingTable->BindOutputs(static_cast<UINT>(outputs.size()), bindingDescs.data() + inputs.size());
+}
+
+namespace
+{
+template <BinaryOp Op> dml::Expression BinaryExpression(dml::Expression a, dml::Expression b)
+{
+    switch (Op)
+    {
+    case BinaryOp::Add:
+        return dml::Add(a, b);
+    case BinaryOp::Subtract:
+        return dml::Subtract(a, b);
+    case BinaryOp::Multiply:
+        return dml::Multiply(a, b);
+    case BinaryOp::Divide:
+        return dml::Divide(a, b);
+    case BinaryOp::Maximum:
+        return dml::Max(a, b);
+    case BinaryOp::Minimum:
+        return dml::Min(a, b);
+    }
+    throw std::invalid_argument("Unknown element-wise operator.");
+}
+
+template <Activation Act> dml::Expression ActivationExpression(dml::Expression x, float alpha)
+{
+    switch (Act)
+    {
+    case Activation::None:
+        return x;
+    case Activation::Relu:
+        return dml::ActivationRelu(x);
+    case Activation::LeakyRelu:
+        return dml::ActivationLeakyRelu(x, alpha);
+    case Activation::Sigmoid:
+        return dml::ActivationSigmoid(x);
+    case Activation::Tanh:
+        return dml::ActivationTanh(x);
+    case Activation::Gelu:
+        return dml::ActivationGelu(x);
+    }
+    throw std::invalid_argument("Unknown activation.");
+}
+
+template <Activation Act> dml::FusedActivation FusedActivationFor(float alpha)
+{
+    switch (Act)
+    {
+    case Activation::Relu:
+        return dml::FusedActivation::Relu();
+    case Activation::LeakyRelu:
+        return dml::FusedActivation::LeakyRelu(alpha);
+    case Activation::Sigmoid:
+        return dml::FusedActivation::Sigmoid();
+    case Activation::Tanh:
+        return dml::FusedActivation::Tanh();
+    default:
+        return dml::FusedActivation::None();
+    }
+}
+
+// DML_ELEMENT_WISE_ADD1 is the only binary operator with a FusedActivation field, and GELU is not a fusable
+// activation. Every other combination becomes a short chain inside the same dml::Graph, which still compiles to a
+// single operator and a single dispatch.
+template <BinaryOp Op, Activation Act>
+dml::Expression FusedElementWiseExpression(dml::Expression a, dml::Expression b, float alpha, float scale)
+{
+    dml::Expression result;
+    if constexpr (Op == BinaryOp::Add && Act != Activation::None && Act != Activation::Gelu)
+    {
+        result = dml::Add(a, b, FusedActivationFor<Act>(alpha));
+    }
+    else
+    {
+        result = ActivationExpression<Act>(BinaryExpression<Op>(a, b), alpha);
+    }
+    if (scale != 1.0f)
+    {
+        result = dml::Identity(result, DML_SCALE_BIAS{scale, 0.0f});
+    }
+    return result;
+}
+} // namespace
+
+SubmissionTicket DirectMLProcessor::ElementWise(const ElementWiseDesc &desc, TensorHandle src0, TensorHandle src1,
+                                                TensorHandle dst)
+{
+    return RunDispatch(PrepareElementWise(desc, src0, src1, dst));
+}
+
+SubmissionTicket DirectMLProcessor::ExecuteGraph(const TensorGraph &graph)
+{
+    return RunDispatch(PrepareGraph(graph));
+}
+
+SubmissionTicket DirectMLProcessor::Gemm(const GemmDesc &desc, TensorHandle srcA, TensorHandle srcB,
+                                         TensorHandle srcBias, TensorHandle dst)
+{
+    return RunDispatch(PrepareGemm(desc, srcA, srcB, srcBias, dst));
+}
+
+SubmissionTicket DirectMLProcessor::Reduce(const ReduceDesc &desc, TensorHandle src, TensorHandle dst)
+{
+    return RunDispatch(PrepareReduce(desc, src, dst));
+}
+
+DirectMLProcessor::PreparedDispatch DirectMLProcessor::PrepareElementWise(const ElementWiseDesc &desc,
+                                                                          TensorHandle src0, TensorHandle src1,
+                                                                          TensorHandle dst)
+{
+    TensorInfo *a = &m_tensors.Get(src0);
+    TensorInfo *b = &m_tensors.Get(src1);
+    TensorInfo *c = &m_tensors.Get(dst);
+    if (a->desc.dataType != b->desc.dataType || a->desc.dataType != c->desc.dataType)
+    {
+        throw std::invalid_argument("Element-wise tensors must be stored with the same data type.");
+    }
+
+    TensorShape shapeA(a->dimensions.begin(), a->dimensions.end());
+    TensorShape shapeB(b->dimensions.begin(), b->dimensions.end());
+    TensorShape outputShape = BroadcastShapes(shapeA, shapeB);
+    if (!std::equal(outputShape.begin(), outputShape.end(), c->dimensions.begin(), c->dimensions.end()))
+    {
+        throw std::invalid_argument("Broadcast result shape does not match tensor " + c->name + ".");
+    }
+
+    DML_EXECUTION_FLAGS executionFlags = DML_EXECUTION_FLAG_ALLOW_HALF_PRECISION_COMPUTATION;
+
+    // The operator is compiled for padded shapes, which every tensor's storage holds, so sizes in the same bucket
+    // share it.
+    size_t paddingAxis = m_bucketOperatorShapes ? PaddingAxisFromRight(outputShape) : 0;
+    PreparedDispatch dispatch;
+    OperatorKey &key = dispatch.key;
+    key.kind = OperatorKind::ElementWise;
+    key.inputDimensions.push_back(PadShape(shapeA, paddingAxis));
+    key.inputDimensions.push_back(PadShape(shapeB, paddingAxis));
+    key.outputDimensions.push_back(PadShape(outputShape, paddingAxis));
+    key.dataType = static_cast<uint32_t>(a->desc.dataType);
+    key.executionFlags = static_cast<uint32_t>(executionFlags);
+    key.signature = desc.Signature();
+
+    dispatch.recipe = [desc, c](const OperatorKey &key) {
+        OperatorRecipe recipe{key};
+        recipe.elementWise = desc;
+        recipe.outputNames = {c->name};
+        return recipe;
+    };
+    dispatch.reads = {src0, src1};
+    dispatch.writes = {dst};
+    dispatch.inputs = {a, b};
+    dispatch.outputs = {c};
+    dispatch.traceName = c->name;
+    dispatch.traceBytes = c->desc.totalTensorSizeInBytes;
+    return dispatch;
+}
+
+DirectMLProcessor::PreparedDispatch DirectMLProcessor::PrepareGraph(const TensorGraph &graph)
+{
+    if (graph.OutputNodes().empty())
+    {
+        throw std::invalid_argument("TensorGraph has no outputs.");
+    }
+
+    PreparedDispatch dispatch;
+    for (const std::string &name : graph.InputNames())
+    {
+        dispatch.reads.push_back(RequireTensor(name));
+        dispatch.inputs.push_back(&m_tensors.Get(dispatch.reads.back()));
+    }
+    for (const std::string &name : graph.OutputNames())
+    {
+        dispatch.writes.push_back(RequireTensor(name));
+        dispatch.outputs.push_back(&m_tensors.Get(dispatch.writes.back()));
+    }
+    const std::vector<TensorInfo *> &inputs = dispatch.inputs;
+    const std::vector<TensorInfo *> &outputs = dispatch.outputs;
+
+    DML_TENSOR_DATA_TYPE dataType = inputs.empty() ? outputs[0]->desc.dataType : inputs[0]->desc.dataType;
+    DML_EXECUTION_FLAGS executionFlags = DML_EXECUTION_FLAG_ALLOW_HALF_PRECISION_COMPUTATION;
+
+    OperatorKey &key = dispatch.key;
+    key.kind = OperatorKind::Graph;
+    key.signature = graph.Signature();
+    key.dataType = static_cast<uint32_t>(dataType);
+    key.executionFlags = static_cast<uint32_t>(executionFlags);
+    for (const auto &tensor : inputs)
+    {
+        if (tensor->desc.dataType != dataType)
+        {
+            throw std::invalid_argument("All TensorGraph tensors must have the same data type.");
+        }
+        key.inputDimensions.emplace_back(tensor->dimensions.begin(), tensor->dimensions.end());
+    }
+    for (const auto &tensor : outputs)
+    {
+        key.outputDimensions.emplace_back(tensor->dimensions.begin(), tensor->dimensions.end());
+    }
+
+    // The whole graph becomes one compiled operator; intermediate values only ever live in DirectML's temporary
+    // resource. The recipe is only built on a cache miss, while the graph is still alive.
+    dispatch.recipe = [&graph](const OperatorKey &key) {
+        OperatorRecipe recipe{key};
+        recipe.nodes = graph.Nodes();
+        recipe.outputNodes = graph.OutputNodes();
+        recipe.outputNames = graph.OutputNames();
+        return recipe;
+    };
+    dispatch.traceName = graph.OutputNames()[0];
+    return dispatch;
+}
+
+DirectMLProcessor::PreparedDispatch DirectMLProcessor::PrepareGemm(const GemmDesc &desc, TensorHandle srcA,
+                                                                   TensorHandle srcB, TensorHandle srcBias,
+                                                                   TensorHandle dst)
+{
+    if (dst == srcA || dst == srcB || dst == srcBias)
+    {
+        throw std::invalid_argument("The GEMM output must not be one of its operands.");
+    }
+    PreparedDispatch dispatch;
+    dispatch.reads = {srcA, srcB};
+    if (srcBias)
+    {
+        dispatch.reads.push_back(srcBias);
+    }
+    TensorInfo *c = &m_tensors.Get(dst);
+
+    OperatorKey &key = dispatch.key;
+    key.kind = OperatorKind::Gemm;
+    for (TensorHandle handle : dispatch.reads)
+    {
+        TensorInfo *input = &m_tensors.Get(handle);
+        if (input->desc.dataType != c->desc.dataType)
+        {
+            throw std::invalid_argument("GEMM tensors must be stored with the same data type.");
+        }
+        dispatch.inputs.push_back(input);
+        key.inputDimensions.emplace_back(input->dimensions.begin(), input->dimensions.end());
+    }
+    key.outputDimensions.emplace_back(c->dimensions.begin(), c->dimensions.end());
+    PlanGemm(desc, key.inputDimensions[0], key.inputDimensions[1], srcBias ? key.inputDimensions[2] : TensorShape(),
+             key.outputDimensions[0]);
+    key.dataType = static_cast<uint32_t>(c->desc.dataType);
+    key.executionFlags = static_cast<uint32_t>(DML_EXECUTION_FLAG_ALLOW_HALF_PRECISION_COMPUTATION);
+    key.signature = desc.Signature();
+
+    dispatch.recipe = [desc, c](const OperatorKey &key) {
+        OperatorRecipe recipe{key};
+        recipe.gemm = desc;
+        recipe.outputNames = {c->name};
+        return recipe;
+    };
+    dispatch.writes = {dst};
+    dispatch.outputs = {c};
+    dispatch.traceName = c->name;
+    dispatch.traceBytes = c->desc.totalTensorSizeInBytes;
+    return dispatch;
+}
+
+DirectMLProcessor::PreparedDispatch DirectMLProcessor::PrepareReduce(const ReduceDesc &desc, TensorHandle src,
+                                                                     TensorHandle dst)
+{
+    if (dst == src)
+    {
+        throw std::invalid_argument("The reduction output must not be its input.");
+    }
+    TensorInfo *x = &m_tensors.Get(src);
+    TensorInfo *y = &m_tensors.Get(dst);
+    if (x->desc.dataType != y->desc.dataType)
+    {
+        throw std::invalid_argument("Reduction tensors must be stored with the same data type.");
+    }
+    TensorShape inputShape(x->dimensions.begin(), x->dimensions.end());
+    TensorShape outputShape(y->dimensions.begin(), y->dimensions.end());
+    if (ReduceOutputShape(desc, inputShape) != outputShape)
+    {
+        throw std::invalid_argument("Reduction result shape does not match tensor " + y->name + ".");
+    }
+
+    PreparedDispatch dispatch;
+    OperatorKey &key = dispatch.key;
+    key.kind = OperatorKind::Reduce;
+    key.inputDimensions.push_back(inputShape);
+    key.outputDimensions.push_back(outputShape);
+    key.dataType = static_cast<uint32_t>(x->desc.dataType);
+    key.executionFlags = static_cast<uint32_t>(DML_EXECUTION_FLAG_ALLOW_HALF_PRECISION_COMPUTATION);
+    key.signature = desc.Signature();
+
+    dispatch.recipe = [desc, y](const OperatorKey &key) {
+        OperatorRecipe recipe{key};
+        recipe.reduce = desc;
+        recipe.outputNames = {y->name};
+        return recipe;
+    };
+    dispatch.reads = {src};
+    dispatch.writes = {dst};
+    dispatch.inputs = {x};
+    dispatch.outputs = {y};
+    dispatch.traceName = y->name;
+    dispatch.traceBytes = x->desc.totalTensorSizeInBytes;
+    return dispatch;
+}
+
+SubmissionTicket DirectMLProcessor::RunDispatch(const PreparedDispatch &dispatch)
+{
+    ResidentTensors resident(*this, dispatch.reads, dispatch.writes);
+    ContextLease lease;
+    RecordingContext &context = AcquireContext(lease);
+    std::shared_ptr<CompiledOperator> op =
+        GetOrCompileOperator(dispatch.key, context, [&]() { return dispatch.recipe(dispatch.key); });
+
+    ScopedPhase phase(m_phaseTimes, Phase::Dispatch);
+    TRACE_SPAN("Dispatch", dispatch.traceName, dispatch.traceBytes);
+    Record(dispatch.reads, dispatch.writes,
+           [this, &context, op, inputs = dispatch.inputs, outputs = dispatch.outputs]() {
+               DispatchOperator(context, op, inputs, outputs);
+           });
+
+    if (m_executionMode == ExecutionMode::Deferred)
+    {
+        return {};
+    }
+
+    // The queue executes in order, so a later GetTensorData on an output waits for this submission implicitly.
+    return Submit(context);
+}
+
+std::shared_ptr<CompiledOperator> DirectMLProcessor::GetOrCompileOperator(
+    const OperatorKey &key, RecordingContext &context, const std::function<OperatorRecipe()> &recipe)
+{
+    std::unique_lock<std::mutex> lock(m_operatorCacheMutex);
+    for (;;)
+    {
+        if (std::shared_ptr<CompiledOperator> op = m_operatorCache.Find(key))
+        {
+            return op;
+        }
+        auto compiling = m_compilingOperators.find(key);
+        if (compiling == m_compilingOperators.end())
+        {
+            break;
+        }
+        std::shared_future<std::shared_ptr<CompiledOperator>> future = compiling->second;
+        lock.unlock();
+        try
+        {
+            return future.get();
+        }
+        catch (...)
+        {
+            // The thread that compiled it reports its own error; this one compiles again and reports what it gets.
+        }
+        lock.lock();
+    }
+
+    std::promise<std::shared_ptr<CompiledOperator>> promise;
+    m_compilingOperators.emplace(key, promise.get_future().share());
+    lock.unlock();
+
+    OperatorRecipe compiledRecipe;
+    std::shared_ptr<CompiledOperator> op;
+    try
+    {
+        compiledRecipe = recipe();
+        op = CompileOperator(context, compiledRecipe);
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception());
+        lock.lock();
+        m_compilingOperators.erase(key);
+        throw;
+    }
+
+    lock.lock();
+    m_operatorCache.Insert(key, op);
+    m_compilingOperators.erase(key);
+    lock.unlock();
+    promise.set_value(op);
+
+    if (!m_startupProfilePath.empty())
+    {
+        std::lock_guard<std::mutex> profileLock(m_startupProfileMutex);
+        m_startupProfile.AddOperator(std::move(compiledRecipe));
+    }
+    return op;
+}
+
+std::shared_ptr<CompiledOperator> DirectMLProcessor::CompileOperator(RecordingContext &context,
+                                                                      const OperatorRecipe &recipe)
+{
+    // Every tensor is described by the key alone, so operators from a startup profile compile without the tensors
+    // they were first compiled for.
+    const OperatorKey &key = recipe.key;
+    auto dataType = static_cast<DML_TENSOR_DATA_TYPE>(key.dataType);
+    auto executionFlags = static_cast<DML_EXECUTION_FLAGS>(key.executionFlags);
+    const std::string &traceTensor = recipe.outputNames.empty() ? std::string() : recipe.outputNames[0];
+
+    dml::Graph dmlGraph(m_dmlDevice.Get());
+    std::vector<dml::Expression> inputs;
+    for (const auto &dimensions : key.inputDimensions)
+    {
+        dml::TensorDesc desc(dataType, dml::TensorDimensions(dimensions.begin(), dimensions.end()));
+        inputs.push_back(dml::InputTensor(dmlGraph, static_cast<uint32_t>(inputs.size()), desc));
+    }
+
+    std::vector<dml::Expression> results;
+    if (key.kind == OperatorKind::ElementWise)
+    {
+        const ElementWiseDesc &desc = recipe.elementWise;
+        dml::Expression input = inputs[0];
+        dml::Expression input2 = inputs[1];
+        BroadcastOperands(input, input2);
+        results.push_back(VisitElementWise(desc, [&](auto binaryOp, auto activation) {
+            return FusedElementWiseExpression<decltype(binaryOp)::value, decltype(activation)::value>(
+                input, input2, desc.alpha, desc.scale);
+        }));
+    }
+    else if (key.kind == OperatorKind::Gemm)
+    {
+        // DML_OPERATOR_GEMM takes 4D tensors, so matrices and single batches are viewed with leading dimensions of 1.
+        // The output is bound as a plain buffer, which holds the 4D result as it is.
+        auto as4D = [](const dml::Expression &x) {
+            dml::TensorDimensions sizes = x.GetOutputDesc().sizes;
+            sizes.insert(sizes.begin(), 4 - sizes.size(), 1u);
+            return dml::Reinterpret(x, sizes, dml::NullOpt);
+        };
+        const GemmDesc &desc = recipe.gemm;
+        const std::vector<uint32_t> &outputDimensions = key.outputDimensions[0];
+        dml::TensorDimensions outputSizes(outputDimensions.begin(), outputDimensions.end());
+        outputSizes.insert(outputSizes.begin(), 4 - outputSizes.size(), 1u);
+
+        dml::Optional<dml::Expression> bias;
+        if (inputs.size() == 3)
+        {
+            bias = BroadcastTo(as4D(inputs[2]), outputSizes);
+        }
+        results.push_back(dml::Gemm(as4D(inputs[0]), as4D(inputs[1]), bias,
+                                    desc.transposeA ? DML_MATRIX_TRANSFORM_TRANSPOSE : DML_MATRIX_TRANSFORM_NONE,
+                                    desc.transposeB ? DML_MATRIX_TRANSFORM_TRANSPOSE : DML_MATRIX_TRANSFORM_NONE,
+                                    desc.alpha, desc.beta));
+    }
+    else if (key.kind == OperatorKind::Reduce)
+    {
+        uint32_t axes[] = {recipe.reduce.axis};
+        DML_REDUCE_FUNCTION function = recipe.reduce.op == ReduceOp::Sum    ? DML_REDUCE_FUNCTION_SUM
+                                       : recipe.reduce.op == ReduceOp::Mean ? DML_REDUCE_FUNCTION_AVERAGE
+                                                                            : DML_REDUCE_FUNCTION_MAX;
+        results.push_back(dml::Reduce(inputs[0], function, axes));
+    }
+    else
+    {
+        const std::vector<GraphNode> &nodes = recipe.nodes;
+        std::vector<dml::Expression> values(nodes.size());
+
+        for (size_t i = 0; i < nodes.size(); ++i)
+        {
+            const GraphNode &node = nodes[i];
+            switch (node.op)
+            {
+            case GraphOp::Input:
+                values[i] = inputs[node.inputIndex];
+                break;
+            case GraphOp::Add:
+            case GraphOp::Subtract:
+            case GraphOp::Multiply:
+            case GraphOp::Divide:
+            case GraphOp::Maximum:
+            case GraphOp::Minimum: {
+                dml::Expression a = values[node.inputs[0]];
+                dml::Expression b = values[node.inputs[1]];
+                BroadcastOperands(a, b);
+                values[i] = node.op == GraphOp::Add        ? dml::Add(a, b)
+                            : node.op == GraphOp::Subtract ? dml::Subtract(a, b)
+                            : node.op == GraphOp::Multiply ? dml::Multiply(a, b)
+                            : node.op == GraphOp::Divide   ? dml::Divide(a, b)
+                            : node.op == GraphOp::Maximum  ? dml::Max(a, b)
+                                                           : dml::Min(a, b);
+                break;
+            }
+            case GraphOp::Relu:
+                values[i] = dml::ActivationRelu(values[node.inputs[0]]);
+                break;
+            case GraphOp::LeakyRelu:
+                values[i] = dml::ActivationLeakyRelu(values[node.inputs[0]], node.alpha);
+                break;
+            case GraphOp::Sigmoid:
+                values[i] = dml::ActivationSigmoid(values[node.inputs[0]]);
+                break;
+            case GraphOp::Tanh:
+                values[i] = dml::ActivationTanh(values[node.inputs[0]]);
+                break;
+            case GraphOp::ReduceSum:
+            case GraphOp::ReduceMean:
+            case GraphOp::ReduceMax: {
+                uint32_t axes[] = {node.axis};
+                DML_REDUCE_FUNCTION function = node.op == GraphOp::ReduceSum    ? DML_REDUCE_FUNCTION_SUM
+                                               : node.op == GraphOp::ReduceMean ? DML_REDUCE_FUNCTION_AVERAGE
+                                                                                : DML_REDUCE_FUNCTION_MAX;
+                values[i] = dml::Reduce(values[node.inputs[0]], function, axes);
+                break;
+            }
+            }
+        }
+
+        for (size_t i = 0; i < recipe.outputNodes.size(); ++i)
+        {
+            dml::Expression result = values[recipe.outputNodes[i]];
+            if (nodes[recipe.outputNodes[i]].op == GraphOp::Input)
+            {
+                // An output has to be produced by an operator, even when it just forwards an input.
+                result = dml::Identity(result);
+            }
+            const std::vector<uint32_t> &outputDimensions = key.outputDimensions[i];
+            if (result.GetOutputDesc().sizes != dml::TensorDimensions(outputDimensions.begin(), outputDimensions.end()))
+            {
+                throw std::invalid_argument("TensorGraph result shape does not match tensor " +
+                                            recipe.outputNames[i] + ".");
+            }
+            results.push_back(result);
+        }
+    }
+
+    ComPtr<IDMLCompiledOperator> dmlCompiledOperator;
+    {
+        ScopedPhase phase(m_phaseTimes, Phase::Compile);
+        TRACE_SPAN("Compile", traceTensor);
+        dmlCompiledOperator.Attach(dmlGraph.Compile(executionFlags, results).Detach());
+    }
+    ScopedPhase phase(m_phaseTimes, Phase::Initialize);
+    TRACE_SPAN("Initialize", traceTensor);
+    std::shared_ptr<CompiledOperator> compiled = InitializeOperator(context, dmlCompiledOperator);
+    compiled->traceName = key.kind == OperatorKind::ElementWise ? "ElementWise"
+                          : key.kind == OperatorKind::Gemm      ? "Gemm"
+                          : key.kind == OperatorKind::Reduce    ? "Reduce"
+                                                                : "Graph";
+    return compiled;
+}
+
+void DirectMLProcessor::Prewarm()
+{
+    ContextLease lease;
+    while (!m_stopPrewarm)
+    {
+        size_t index = m_prewarmNext++;
+        if (index >= m_prewarmRecipes.size())
+        {
+            break;
+        }
+        const OperatorRecipe &recipe = m_prewarmRecipes[index];
+        try
+        {
+            if (!lease)
+            {
+                lease = m_contexts.Acquire();
+            }
+            TRACE_SPAN("Prewarm", recipe.outputNames.empty() ? std::string() : recipe.outputNames[0]);
+            GetOrCompileOperator(recipe.key, *lease, [&]() { return recipe; });
+        }
+        catch (const std::exception &e)
+        {
+            // Left out of the next profile. A call that needs the operator compiles it and sees the error itself.
+            std::cout << "Prewarming an operator failed (" << e.what() << ").\n";
+        }
+    }
+}
+
+void DirectMLProcessor::WaitForPrewarm()
+{
+    std::lock_guard<std::mutex> lock(m_prewarmMutex);
+    for (std::thread &thread : m_prewarmThreads)
+    {
+        thread.join();
+    }
+    m_prewarmThreads.clear();
+}
+
+bool DirectMLProcessor::SaveStartupProfile()
+{
+    if (m_startupProfilePath.empty())
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_startupProfileMutex);
+    // Operators the prewarm threads have not started on stay in the profile; the others are in it once compiled.
+    for (size_t i = std::min(m_prewarmNext.load(), m_prewarmRecipes.size()); i < m_prewarmRecipes.size(); ++i)
+    {
+        m_startupProfile.AddOperator(m_prewarmRecipes[i]);
+    }
+    return m_startupProfile.Save(m_startupProfilePath);
+}
+
+namespace
+{
+// The queues a StreamEvent can refer to.
+constexpr uint32_t c_computeQueue = 0;
+constexpr uint32_t c_copyQueue = 1;
+
+// The latest fence value among the waits on queue, or 0 if there are none.
+uint64_t LatestWait(const std::vector<StreamEvent> &waits, uint32_t queue)
+{
+    uint64_t latest = 0;
+    for (const StreamEvent &wait : waits)
+    {
+        if (wait.queue == queue)
+        {
+            latest = std::max(latest, wait.fenceValue);
+        }
+    }
+    return latest;
+}
+} // namespace
+
+// Every buffer set has two input tensors and an output tensor of one chunk, an upload buffer both inputs are staged
+// in and a readback buffer. The tensors have buffers of their own: on a shared heap page the copy queue would write
+// one slot's region of the same resource the compute queue is dispatching on for another. Transfers are recorded into
+// a copy list leased for the stream and submitted one stage at a time, and each queue only waits on the other for the
+// events the scheduler passes in.
+class DirectMLProcessor::QueueStreamStages : public StreamStages
+{
+  public:
+    QueueStreamStages(DirectMLProcessor &processor, const ElementWiseDesc &desc, const float *a, const float *b,
+                      float *out, uint64_t chunkElements, uint32_t bufferCount)
+        : m_processor(processor), m_desc(desc), m_a(a), m_b(b), m_out(out),
+          m_copyContext(processor.m_copyContexts.Acquire())
+    {
+        TensorShape shape{static_cast<uint32_t>(chunkElements)};
+        for (uint32_t i = 0; i < bufferCount; ++i)
+        {
+            Slot slot;
+            slot.a = UniqueTensor(processor, processor.CreateTensor("", shape, TensorDataType::Float32, true));
+            slot.b = UniqueTensor(processor, processor.CreateTensor("", shape, TensorDataType::Float32, true));
+            slot.out = UniqueTensor(processor, processor.CreateTensor("", shape, TensorDataType::Float32, true));
+
+            UINT64 bytes = processor.m_tensors.Get(slot.a).desc.totalTensorSizeInBytes;
+            slot.inputStride = (bytes + c_uploadAlignment - 1) & ~(c_uploadAlignment - 1);
+            THROW_IF_FAILED(processor.m_d3D12Device->CreateCommittedResource(
+                &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
+                &CD3DX12_RESOURCE_DESC::Buffer(slot.inputStride * 2), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+                IID_PPV_ARGS(slot.upload.GetAddressOf())));
+            D3D12_RANGE emptyRange{0, 0};
+            THROW_IF_FAILED(slot.upload->Map(0, &emptyRange, reinterpret_cast<void **>(&slot.uploadData)));
+            THROW_IF_FAILED(processor.m_d3D12Device->CreateCommittedResource(
+                &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK), D3D12_HEAP_FLAG_NONE,
+                &CD3DX12_RESOURCE_DESC::Buffer(bytes), D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+                IID_PPV_ARGS(slot.readback.GetAddressOf())));
+            m_slots.push_back(std::move(slot));
+        }
+    }
+
+    ~QueueStreamStages()
+    {
+        // A stream that failed part way may still have stages in flight on the buffers about to be released.
+        try
+        {
+            m_processor.WaitForCopyFenceValue(m_lastCopy);
+            m_processor.WaitForFenceValue(m_lastCompute);
+        }
+        catch (...)
+        {
+        }
+    }
+
+    StreamEvent Run(StreamStage stage, const StreamChunk &chunk, const std::vector<StreamEvent> &waits) override
+    {
+        Slot &slot = m_slots[chunk.slot];
+        TensorInfo &a = m_processor.m_tensors.Get(slot.a);
+        TensorInfo &b = m_processor.m_tensors.Get(slot.b);
+        TensorInfo &out = m_processor.m_tensors.Get(slot.out);
+        ID3D12GraphicsCommandList *commandList = m_copyContext->commandList.Get();
+
+        // The last chunk may be shorter; the elements past it are computed on stale data and never read back.
+        UINT64 bytes = chunk.count * StoragePrecisionSize(a.precision);
+        switch (stage)
+        {
+        case StreamStage::Upload: {
+            {
+                ScopedPhase phase(m_processor.m_phaseTimes, Phase::Upload);
+                TRACE_SPAN("Upload", {}, bytes * 2);
+                m_processor.StageUpload(a, m_a + chunk.offset, 0, bytes, slot.uploadData);
+                m_processor.StageUpload(b, m_b + chunk.offset, 0, bytes, slot.uploadData + slot.inputStride);
+            }
+            commandList->CopyBufferRegion(a.buffer->resource.Get(), a.offset, slot.upload.Get(), 0, bytes);
+            commandList->CopyBufferRegion(b.buffer->resource.Get(), b.offset, slot.upload.Get(), slot.inputStride,
+                                          bytes);
+            return SubmitCopy(waits);
+        }
+        case StreamStage::Compute: {
+            // Queued on the GPU ahead of the dispatch, which is submitted next.
+            if (uint64_t copyFenceValue = LatestWait(waits, c_copyQueue))
+            {
+                std::lock_guard<std::mutex> lock(m_processor.m_queueMutex);
+                THROW_IF_FAILED(m_processor.m_commandQueue->Wait(m_processor.m_copyFence.Get(), copyFenceValue));
+            }
+            m_lastCompute = m_processor.ElementWise(m_desc, slot.a.Get(), slot.b.Get(), slot.out.Get()).fenceValue;
+            return {c_computeQueue, m_lastCompute};
+        }
+        default:
+            commandList->CopyBufferRegion(slot.readback.Get(), 0, out.buffer->resource.Get(), out.offset, bytes);
+            return SubmitCopy(waits);
+        }
+    }
+
+    void Wait(const StreamEvent &event) override
+    {
+        if (event.queue == c_copyQueue)
+        {
+            m_processor.WaitForCopyFenceValue(event.fenceValue);
+        }
+        else
+        {
+            m_processor.WaitForFenceValue(event.fenceValue);
+        }
+    }
+
+    void Finish(const StreamChunk &chunk) override
+    {
+        Slot &slot = m_slots[chunk.slot];
+        const TensorInfo &out = m_processor.m_tensors.Get(slot.out);
+        UINT64 bytes = chunk.count * StoragePrecisionSize(out.precision);
+        ScopedPhase phase(m_processor.m_phaseTimes, Phase::HostCopy);
+        TRACE_SPAN("HostCopy", {}, bytes);
+
+        D3D12_RANGE readRange{0, static_cast<SIZE_T>(bytes)};
+        void *data{};
+        THROW_IF_FAILED(slot.readback->Map(0, &readRange, &data));
+        if (out.precision == StoragePrecision::Float16)
+        {
+            m_processor.m_conversions->halfToFloat(static_cast<const uint16_t *>(data), m_out + chunk.offset,
+                                                   static_cast<size_t>(chunk.count));
+        }
+        else
+        {
+            memcpy(m_out + chunk.offset, data, static_cast<size_t>(bytes));
+        }
+        D3D12_RANGE emptyRange{0, 0};
+        slot.readback->Unmap(0, &emptyRange);
+    }
+
+  private:
+    struct Slot
+    {
+        UniqueTensor a;
+        UniqueTensor b;
+        UniqueTensor out;
+        ComPtr<ID3D12Resource> upload; // a's chunk at offset 0, b's at inputStride.
+        uint8_t *uploadData = nullptr;
+        UINT64 inputStride = 0;
+        ComPtr<ID3D12Resource> readback;
+    };
+
+    StreamEvent SubmitCopy(const std::vector<StreamEvent> &waits)
+    {
+        m_lastCopy = m_processor.SubmitCopy(*m_copyContext, LatestWait(waits, c_computeQueue)).fenceValue;
+        return {c_copyQueue, m_lastCopy};
+    }
+
+    DirectMLProcessor &m_processor;
+    const ElementWiseDesc &m_desc;
+    const float *m_a;
+    const float *m_b;
+    float *m_out;
+    ContextPool<CopyContext>::Lease m_copyContext;
+    std::vector<Slot> m_slots;
+    uint64_t m_lastCopy = 0;
+    uint64_t m_lastCompute = 0;
+};
+
+void DirectMLProcessor::StreamElementWise(const ElementWiseDesc &desc, const float *a, const float *b, float *out,
+                                          uint64_t count, const StreamOptions &options)
+{
+    // Deferred dispatches are not submitted as they are issued, so the compute queue could not wait on them.
+    if (m_executionMode == ExecutionMode::Deferred || !m_copyQueue)
+    {
+        TensorBackend::StreamElementWise(desc, a, b, out, count, options);
+        return;
+    }
+    if (count == 0)
+    {
+        return;
+    }
+
+    uint64_t chunkElements = StreamChunkElements(count, options);
+    TRACE_SPAN("Stream", {}, count * sizeof(float));
+    StreamScheduler scheduler(count, chunkElements, options.bufferCount);
+    QueueStreamStages stages(*this, desc, a, b, out, chunkElements, options.bufferCount);
+    scheduler.Run(stages);
+}
+
+// The command list is recorded against the storage the plan's tensors have at the time, and every replay executes it
+// again. Buffers decay to COMMON when a command list completes, so each execution starts from the states the
+// recording assumed. Each op has a binding of its own, since a binding's descriptors must not be rewritten while a
+// list that dispatches through them may still run.
+class DirectMLProcessor::RecordedPlan : public ExecutionPlan
+{
+  public:
+    RecordedPlan(DirectMLProcessor &processor, const PlanCapture &capture);
+    ~RecordedPlan() override;
+
+  protected:
+    std::shared_future<void> Run(const std::vector<const void *> &inputs, const std::vector<void *> &outputs) override;
+
+  private:
+    // An upload or readback: where its data sits in the plan's buffer, and the bytes of storage it covers.
+    struct Transfer
+    {
+        const PlanStep *step = nullptr;
+        UINT64 offset = 0;
+        UINT64 bytes = 0;
+        StoragePrecision precision = StoragePrecision::Float32;
+    };
+
+    // The storage and shape a tensor had when the list was recorded.
+    struct BoundTensor
+    {
+        TensorHandle handle;
+        std::weak_ptr<TrackedBuffer> buffer;
+        UINT64 offset = 0;
+        UINT64 capacity = 0;
+        dml::TensorDimensions dimensions;
+        StoragePrecision precision = StoragePrecision::Float32;
+    };
+
+    PreparedDispatch Prepare(const PlanStep &step);
+    // Compiles the operators, lays out the transfers and records the command list. Called with the tensors resident.
+    void Record();
+    bool IsStale() const;
+
+    DirectMLProcessor &m_processor;
+    std::mutex m_mutex;
+
+    // Tensors whose contents a replay reads, and tensors it overwrites whole before reading them.
+    std::vector<TensorHandle> m_reads;
+    std::vector<TensorHandle> m_writes;
+
+    ComPtr<ID3D12CommandAllocator> m_allocator;
+    RecordingContext m_context; // Only its command list, command recorder and buffer states are used.
+    std::vector<std::shared_ptr<CompiledOperator>> m_operators;
+    std::vector<OperatorBinding> m_bindings;
+    std::vector<BoundTensor> m_bound;
+
+    std::vector<Transfer> m_uploads;
+    std::vector<Transfer> m_readbacks;
+    ComPtr<ID3D12Resource> m_uploadBuffer;
+    ComPtr<ID3D12Resource> m_readbackBuffer;
+    UINT64 m_uploadBufferSize = 0;
+    UINT64 m_readbackBufferSize = 0;
+    uint8_t *m_uploadData = nullptr;
+    const uint8_t *m_readbackData = nullptr;
+
+    uint64_t m_fenceValue = 0; // Of the last replay.
+};
+
+DirectMLProcessor::RecordedPlan::RecordedPlan(DirectMLProcessor &processor, const PlanCapture &capture)
+    : ExecutionPlan(capture), m_processor(processor)
+{
+    // A tensor's first use in the plan decides whether a replay needs its contents paged in.
+    std::unordered_set<TensorHandle> seen;
+    for (const PlanStep &step : Steps())
+    {
+        for (TensorHandle handle : step.reads)
+        {
+            if (seen.insert(handle).second)
+            {
+                m_reads.push_back(handle);
+            }
+        }
+        for (TensorHandle handle : step.writes)
+        {
+            const TensorInfo &tensor = processor.m_tensors.Get(handle);
+            bool whole = step.kind != PlanStepKind::Upload ||
+                         step.size >= uint64_t(tensor.elementCount) * DataTypeSize(tensor.hostType);
+            if (seen.insert(handle).second)
+            {
+                (whole ? m_writes : m_reads).push_back(handle);
+            }
+        }
+    }
+
+    THROW_IF_FAILED(processor.m_d3D12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT,
+                                                                    IID_PPV_ARGS(m_allocator.GetAddressOf())));
+    THROW_IF_FAILED(processor.m_d3D12Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_allocator.Get(),
+                                                               nullptr,
+                                                               IID_PPV_ARGS(m_context.commandList.GetAddressOf())));
+    THROW_IF_FAILED(m_context.commandList->Close());
+    THROW_IF_FAILED(
+        processor.m_dmlDevice->CreateCommandRecorder(IID_PPV_ARGS(m_context.commandRecorder.GetAddressOf())));
+
+    // Nothing is overwritten yet, so every tensor keeps its contents.
+    std::vector<TensorHandle> tensors = m_reads;
+    tensors.insert(tensors.end(), m_writes.begin(), m_writes.end());
+    ResidentTensors resident(processor, tensors);
+    Record();
+}
+
+DirectMLProcessor::RecordedPlan::~RecordedPlan()
+{
+    // The command list and buffers are in use until the last replay has finished.
+    try
+    {
+        m_processor.WaitForFenceValue(m_fenceValue);
+    }
+    catch (...)
+    {
+    }
+}
+
+DirectMLProcessor::PreparedDispatch DirectMLProcessor::RecordedPlan::Prepare(const PlanStep &step)
+{
+    switch (step.kind)
+    {
+    case PlanStepKind::ElementWise:
+        return m_processor.PrepareElementWise(step.elementWise, step.reads[0], step.reads[1], step.writes[0]);
+    case PlanStepKind::Gemm: {
+        TensorHandle bias = step.reads.size() > 2 ? step.reads[2] : TensorHandle();
+        return m_processor.PrepareGemm(step.gemm, step.reads[0], step.reads[1], bias, step.writes[0]);
+    }
+    case PlanStepKind::Reduce:
+        return m_processor.PrepareReduce(step.reduce, step.reads[0], step.writes[0]);
+    case PlanStepKind::Graph:
+        return m_processor.PrepareGraph(*step.graph);
+    default:
+        throw std::logic_error("Plan step is not an op.");
+    }
+}
+
+void DirectMLProcessor::RecordedPlan::Record()
+{
+    TRACE_SPAN("RecordPlan");
+    DirectMLProcessor &processor = m_processor;
+
+    // The list may still be running from the last replay.
+    processor.WaitForFenceValue(m_fenceValue);
+
+    // Operators are compiled on a context of the processor, since initializing one submits work of its own.
+    std::vector<PreparedDispatch> dispatches;
+    std::vector<std::shared_ptr<CompiledOperator>> operators;
+    {
+        ContextLease lease;
+        RecordingContext &context = processor.AcquireContext(lease);
+        for (const PlanStep &step : Steps())
+        {
+            if (step.kind == PlanStepKind::Upload || step.kind == PlanStepKind::Readback)
+            {
+                continue;
+            }
+            dispatches.push_back(Prepare(step));
+            const PreparedDispatch &dispatch = dispatches.back();
+            operators.push_back(
+                processor.GetOrCompileOperator(dispatch.key, context, [&]() { return dispatch.recipe(dispatch.key); }));
+        }
+    }
+
+    // Transfers cover the same bytes of storage as SetTensorData and GetTensorData would.
+    m_uploads.clear();
+    m_readbacks.clear();
+    UINT64 uploadSize = 0;
+    UINT64 readbackSize = 0;
+    for (const PlanStep &step : Steps())
+    {
+        if (step.kind != PlanStepKind::Upload && step.kind != PlanStepKind::Readback)
+        {
+            continue;
+        }
+        bool upload = step.kind == PlanStepKind::Upload;
+        const TensorInfo &tensor = processor.m_tensors.Get(upload ? step.writes[0] : step.reads[0]);
+        Transfer transfer;
+        transfer.step = &step;
+        transfer.precision = tensor.precision;
+        UINT64 storageSize = step.size;
+        if (tensor.precision != StoragePrecision::Float32)
+        {
+            storageSize = step.size / sizeof(float) * StoragePrecisionSize(tensor.precision);
+        }
+        transfer.bytes = std::min<UINT64>(storageSize, tensor.desc.totalTensorSizeInBytes);
+        UINT64 &size = upload ? uploadSize : readbackSize;
+        transfer.offset = size;
+        size += (transfer.bytes + c_uploadAlignment - 1) & ~(c_uploadAlignment - 1);
+        (upload ? m_uploads : m_readbacks).push_back(transfer);
+    }
+
+    // The buffers only ever grow, and stay mapped for as long as the plan lives.
+    if (uploadSize > m_uploadBufferSize)
+    {
+        m_uploadBuffer.Reset();
+        THROW_IF_FAILED(processor.m_d3D12Device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(uploadSize), D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+            IID_PPV_ARGS(m_uploadBuffer.GetAddressOf())));
+        D3D12_RANGE emptyRange{0, 0};
+        THROW_IF_FAILED(m_uploadBuffer->Map(0, &emptyRange, reinterpret_cast<void **>(&m_uploadData)));
+        m_uploadBufferSize = uploadSize;
+    }
+    if (readbackSize > m_readbackBufferSize)
+    {
+        m_readbackBuffer.Reset();
+        THROW_IF_FAILED(processor.m_d3D12Device->CreateCommittedResource(
+            &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK), D3D12_HEAP_FLAG_NONE,
+            &CD3DX12_RESOURCE_DESC::Buffer(readbackSize), D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+            IID_PPV_ARGS(m_readbackBuffer.GetAddressOf())));
+        D3D12_RANGE readRange{0, static_cast<SIZE_T>(readbackSize)};
+        void *readbackData{};
+        THROW_IF_FAILED(m_readbackBuffer->Map(0, &readRange, &readbackData));
+        m_readbackData = static_cast<const uint8_t *>(readbackData);
+        m_readbackBufferSize = readbackSize;
+    }
+
+    m_bindings.clear();
+    m_bindings.resize(operators.size());
+    for (size_t i = 0; i < operators.size(); ++i)
+    {
+        processor.CreateBinding(*operators[i], m_bindings[i]);
+    }
+
+    THROW_IF_FAILED(m_allocator->Reset());
+    THROW_IF_FAILED(m_context.commandList->Reset(m_allocator.Get(), nullptr));
+    m_context.bufferStates.clear();
+    size_t uploadIndex = 0;
+    size_t readbackIndex = 0;
+    size_t dispatchIndex = 0;
+    for (const PlanStep &step : Steps())
+    {
+        std::vector<D3D12_RESOURCE_BARRIER> barriers;
+        switch (step.kind)
+        {
+        case PlanStepKind::Upload: {
+            const Transfer &upload = m_uploads[uploadIndex++];
+            TensorInfo &tensor = processor.m_tensors.Get(step.writes[0]);
+            processor.TransitionTensor(m_context, tensor, D3D12_RESOURCE_STATE_COPY_DEST, barriers);
+            processor.FlushBarriers(m_context, barriers);
+            if (upload.bytes != 0)
+            {
+                m_context.commandList->CopyBufferRegion(tensor.buffer->resource.Get(), tensor.offset,
+                                                        m_uploadBuffer.Get(), upload.offset, upload.bytes);
+            }
+            break;
+        }
+        case PlanStepKind::Readback: {
+            const Transfer &readback = m_readbacks[readbackIndex++];
+            TensorInfo &tensor = processor.m_tensors.Get(step.reads[0]);
+            processor.TransitionTensor(m_context, tensor, D3D12_RESOURCE_STATE_COPY_SOURCE, barriers);
+            processor.FlushBarriers(m_context, barriers);
+            if (readback.bytes != 0)
+            {
+                m_context.commandList->CopyBufferRegion(m_readbackBuffer.Get(), readback.offset,
+                                                        tensor.buffer->resource.Get(), tensor.offset, readback.bytes);
+            }
+            break;
+        }
+        default: {
+            const PreparedDispatch &dispatch = dispatches[dispatchIndex];
+            OperatorBinding &binding = m_bindings[dispatchIndex];
+            processor.BindOperator(m_context, *operators[dispatchIndex], binding, dispatch.inputs, dispatch.outputs);
+            m_context.commandRecorder->RecordDispatch(m_context.commandList.Get(),
+                                                      operators[dispatchIndex]->compiledOperator.Get(),
+                                                      binding.bindingTable.Get());
+            ++dispatchIndex;
+            break;
+        }
+        }
+    }
+    THROW_IF_FAILED(m_context.commandList->Close());
+    m_operators = std::move(operators);
+
+    m_bound.clear();
+    for (const std::vector<TensorHandle> *handles : {&m_reads, &m_writes})
+    {
+        for (TensorHandle handle : *handles)
+        {
+            const TensorInfo &tensor = processor.m_tensors.Get(handle);
+            m_bound.push_back({handle, tensor.buffer, tensor.offset, tensor.capacity.Bytes(), tensor.dimensions,
+                               tensor.precision});
+        }
+    }
+}
+
+bool DirectMLProcessor::RecordedPlan::IsStale() const
+{
+    for (const BoundTensor &bound : m_bound)
+    {
+        const TensorInfo &tensor = m_processor.m_tensors.Get(bound.handle);
+        if (bound.buffer.lock() != tensor.buffer || bound.offset != tensor.offset ||
+            bound.capacity != tensor.capacity.Bytes() || bound.dimensions != tensor.dimensions ||
+            bound.precision != tensor.precision)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::shared_future<void> DirectMLProcessor::RecordedPlan::Run(const std::vector<const void *> &inputs,
+                                                              const std::vector<void *> &outputs)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    DirectMLProcessor &processor = m_processor;
+    TRACE_SPAN("ReplayPlan");
+
+    ResidentTensors resident(processor, m_reads, m_writes);
+    if (IsStale())
+    {
+        Record();
+    }
+
+    {
+        ScopedPhase phase(processor.m_phaseTimes, Phase::Upload);
+        for (const Transfer &upload : m_uploads)
+        {
+            const TensorInfo &tensor = processor.m_tensors.Get(upload.step->writes[0]);
+            processor.StageUpload(tensor, inputs[upload.step->slot], 0, upload.bytes, m_uploadData + upload.offset);
+        }
+    }
+
+    // Work recorded before the replay runs ahead of it.
+    if (processor.m_deferredContext)
+    {
+        processor.ReplayPendingStream();
+        processor.Submit(*processor.m_deferredContext);
+    }
+
+    uint64_t fenceValue;
+    {
+        std::lock_guard<std::mutex> queueLock(processor.m_queueMutex);
+        ID3D12CommandList *commandLists[] = {m_context.commandList.Get()};
+        processor.m_commandQueue->ExecuteCommandLists(ARRAYSIZE(commandLists), commandLists);
+        fenceValue = processor.m_timeline.NextFenceValue();
+        THROW_IF_FAILED(processor.m_commandQueue->Signal(processor.m_fence.Get(), fenceValue));
+        processor.m_timeline.Advance();
+    }
+    m_fenceValue = fenceValue;
+
+    // The outputs are copied out before returning, so nothing writes to the caller's buffers once it has the future.
+    // Waiting here also frees the upload and readback buffers for the next replay.
+    {
+        ScopedPhase phase(processor.m_phaseTimes, Phase::Dispatch);
+        processor.WaitForFenceValue(fenceValue);
+    }
+    {
+        ScopedPhase phase(processor.m_phaseTimes, Phase::HostCopy);
+        for (const Transfer &readback : m_readbacks)
+        {
+            const uint8_t *source = m_readbackData + readback.offset;
+            void *destination = outputs[readback.step->slot];
+            if (readback.precision == StoragePrecision::Float16)
+            {
+                processor.m_conversions->halfToFloat(reinterpret_cast<const uint16_t *>(source),
+                                                     static_cast<float *>(destination),
+                                                     readback.bytes / sizeof(uint16_t));
+            }
+            else
+            {
+                memcpy(destination, source, readback.bytes);
+            }
+        }
+    }
+
+    std::promise<void> done;
+    done.set_value();
+    return done.get_future().share();
+}
+
+std::unique_ptr<ExecutionPlan> DirectMLProcessor::CreateExecutionPlan(const PlanCapture &capture)
+{
+    if (&capture.Backend() != this)
+    {
+        throw std::invalid_argument("The plan was captured on another backend.");
+    }
+    return std::make_unique<RecordedPlan>(*this, capture);
 }
 
 void DirectMLProcessor::FreeResources()
 {
-    for (auto &tensor : m_tensorInfoMap)
+    Flush();
+    WaitForIdle();
     {
-        tensor.second->resource.Reset();
-        tensor.second->uploadResource.Reset();
-        delete tensor.second;
+        std::lock_guard<std::mutex> lock(m_residencyMutex);
+        m_residency.Clear();
     }
-    m_tensorInfoMap.clear();
+    m_tensors.ForEach([this](TensorHandle, TensorInfo &tensor) { ReleaseTensorStorage(tensor); });
+    m_tensors.Clear();
 }
@@ -3,55 +3,588 @@
 #define NOMINMAX
 
 #include <d3dx12.h>
+#include <dxcore_interface.h>
 #include <dxgi1_4.h>
 #include <wil/resource.h>
 #include <stdexcept>
 #include <DirectML.h>
 #include <DirectMLX.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
 
+#include "BroadcastShape.hpp"
+#include "ContextPool.hpp"
+#include "CpuKernels.hpp"
+#include "DeferredStream.hpp"
+#include "ElementWise.hpp"
+#include "OperatorCache.hpp"
+#include "ReadbackPool.hpp"
+#include "ResidencyManager.hpp"
+#include "StartupProfile.hpp"
+#include "SubmissionTimeline.hpp"
+#include "TensorBackend.hpp"
+#include "TensorCapacity.hpp"
+#include "TensorFile.hpp"
+#include "TensorGraph.hpp"
+#include "TensorTable.hpp"
+#include "TlsfAllocator.hpp"
+#include "Trace.hpp"
+#include "UploadRing.hpp"
+
+// A device buffer tensors are bound from. Small tensors share the buffer of a heap page, so resource state is tracked
+// per buffer, by each command list that uses it (see BufferState).
+struct TrackedBuffer
+{
+    Microsoft::WRL::ComPtr<ID3D12Resource> resource;
+};
+
+// The state of a buffer as of the end of what one command list has recorded so far, used to skip redundant barriers.
+// uavDirty is set when a dispatch in the list wrote the buffer and a UAV barrier is due before the next access.
+struct BufferState
+{
+    D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_COMMON;
+    bool uavDirty = false;
+};
+
+// One large ID3D12Heap with a placed buffer spanning all of it. Tensors are suballocated from it and bound at an
+// offset into the buffer.
+struct TensorHeapPage
+{
+    Microsoft::WRL::ComPtr<ID3D12Heap> heap;
+    std::shared_ptr<TrackedBuffer> buffer;
+    TlsfAllocator allocator;
+};
+
+struct TensorHeapStats
+{
+    size_t pageCount = 0;
+    uint64_t reservedBytes = 0;
+    uint64_t usedBytes = 0;
+    uint64_t largestFreeBlock = 0;
+    uint32_t allocationCount = 0;
+    uint32_t freeBlockCount = 0;
+    size_t dedicatedCount = 0;
+    uint64_t dedicatedBytes = 0;
+    double fragmentation = 0.0;
+};
+
 struct TensorInfo
 {
-    uint64_t bufferSize;
+    std::string name;
     uint32_t elementCount;
     dml::TensorDimensions dimensions;
     dml::TensorDesc desc;
 
+    // Bytes of storage, at least the padded size of the shape (see PaddedShape). Ops bind all of it, and the logical
+    // elements are its prefix.
+    TensorCapacity capacity;
+
+    // The type callers read and write. Float32 tensors in float16 storage are converted on upload and readback.
+    TensorDataType hostType = TensorDataType::Unknown;
+    StoragePrecision precision = StoragePrecision::Float32;
+
+    // Either a region of a heap page or, for large tensors, a dedicated committed buffer at offset 0, of capacity
+    // bytes.
+    std::shared_ptr<TrackedBuffer> buffer;
+    UINT64 offset = 0;
+    TensorHeapPage *page = nullptr;
+    TlsfAllocator::Allocation allocation;
+    // Always given a committed buffer of its own, for tensors one queue copies into while another dispatches on the
+    // rest of a page (see QueueStreamStages).
+    bool dedicated = false;
+
+    // The contents of an evicted tensor, which has no storage meanwhile: in host memory, or in a file when the
+    // processor evicts to disk.
+    std::vector<uint8_t> evictedContents;
+    std::shared_ptr<MappedFile> evictedFile;
+};
+
+struct ReadbackBuffer
+{
     Microsoft::WRL::ComPtr<ID3D12Resource> resource;
-    Microsoft::WRL::ComPtr<ID3D12Resource> uploadResource;
 };
 
-class DirectMLProcessor
+enum class ExecutionMode
+{
+    // Every call is recorded and submitted before it returns. Calls may come from several threads at once; each
+    // records into a command list of its own.
+    Immediate,
+    // Uploads and ops are only staged; they are recorded and submitted together by Flush() or GetTensorData. Calls
+    // must come from one thread at a time.
+    Deferred,
+};
+
+// A compiled and initialized operator together with the temporary and persistent resources it runs with. Every
+// dispatch binds its tensors through descriptors of its own (see OperatorBinding), so the operator can be dispatched
+// from several threads at once, and several times in one command list.
+struct CompiledOperator
+{
+    Microsoft::WRL::ComPtr<IDMLCompiledOperator> compiledOperator;
+    Microsoft::WRL::ComPtr<ID3D12Resource> temporaryBuffer;
+    Microsoft::WRL::ComPtr<ID3D12Resource> persistentBuffer;
+    UINT64 temporaryResourceSize = 0;
+    UINT64 persistentResourceSize = 0;
+    UINT descriptorCount = 0;
+
+    // Name of the GPU span traced around each dispatch.
+    const char *traceName = "Dispatch";
+};
+
+// A binding table for a compiled operator over a range of descriptors in a shader-visible heap, with the operator's
+// temporary and persistent resources bound. The input and output buffers are bound for each dispatch.
+struct OperatorBinding
+{
+    Microsoft::WRL::ComPtr<ID3D12DescriptorHeap> descriptorHeap;
+    Microsoft::WRL::ComPtr<IDMLBindingTable> bindingTable;
+};
+
+struct DirectMLProcessorOptions
+{
+    // Size of the persistently mapped ring uploads are staged through. Every recording context, one per thread that
+    // calls at the same time, has a ring of its own. Uploads larger than half of it are streamed in chunks.
+    uint64_t uploadRingSize = 64ull << 20;
+
+    // Descriptors in each recording context's shader-visible heap. Every dispatch takes a range of them, retired
+    // with its submission like upload ring regions; a command list whose dispatches need more is submitted early.
+    uint32_t descriptorRingSize = 4096;
+
+    // Upper bound on idle readback buffers kept in the pool.
+    uint64_t maxCachedReadbackBytes = 256ull << 20;
+
+    // Size of each heap tensors are suballocated from. Tensors larger than a quarter of a page get a dedicated
+    // committed resource.
+    uint64_t tensorHeapPageSize = 64ull << 20;
+
+    // How tensors reshaped by CreateTensor keep, grow and give back their storage.
+    CapacityPolicy tensorCapacity;
+
+    // Compiles element-wise operators for padded shapes (see PaddingAxisFromRight), so requests whose sizes vary
+    // share a few compiled operators instead of compiling one per size. Storage is padded to match.
+    bool bucketOperatorShapes = true;
+
+    // File the startup profile is loaded from and saved to (see StartupProfile). If it recorded an adapter for the
+    // same name filter, that adapter is opened directly with the capabilities recorded for it, and the operators
+    // earlier runs compiled are compiled again on background threads while the processor starts serving calls. A
+    // missing or stale profile falls back to a cold start. Empty disables the profile.
+    std::string startupProfilePath;
+
+    // Threads that compile the operators of the startup profile.
+    uint32_t prewarmThreadCount = 2;
+
+    // Bytes of device memory tensors may hold. When more are needed, tensors no call is using are evicted, least
+    // recently used first, and paged back in when an op next uses them (see ResidencyManager). 0 follows the budget
+    // the adapter reports for local memory, less what the process holds there besides tensors, which the OS lowers
+    // when other processes need the memory; ResidencyManager::c_unlimited never evicts.
+    uint64_t memoryBudget = 0;
+
+    // Directory evicted tensors are written to. Empty keeps them in host memory.
+    std::string evictionDirectory;
+};
+
+// Runs tensor ops through DirectML on one adapter. In immediate mode any number of threads may call at once: each
+// call leases a recording context (a command list with its allocators, upload ring and descriptor heap) from a pool
+// and records into it without locks, tensors are looked up by handle without locks, and only the hand-off of finished
+// command lists to the shared queue, operator cache lookups and the allocators shared between tensors are serialized.
+// Different operators compile in parallel; a thread that needs one another thread is compiling waits for it.
+class DirectMLProcessor : public TensorBackend
 {
   public:
-    DirectMLProcessor(std::string adapterNameFilter = "NPU")
+    DirectMLProcessor(std::string adapterNameFilter = "NPU", const DirectMLProcessorOptions &options = {})
     {
-        InitializeDirectML(adapterNameFilter);
+        InitializeDirectML(adapterNameFilter, options);
     } // Constructor
 
     ~DirectMLProcessor(); // Destructor
 
-    void SetTensorData(std::string name, uint32_t *shapes, DML_TENSOR_DATA_TYPE type, const void *data, size_t size);
-    void GetTensorData(std::string name, uint32_t *shapes, DML_TENSOR_DATA_TYPE type, void *data, size_t size);
+    using TensorBackend::ElementWise;
+    using TensorBackend::Gemm;
+    using TensorBackend::GetTensorData;
+    using TensorBackend::Reduce;
+    using TensorBackend::SetTensorData;
+
+    std::string Name() const override
+    {
+        return m_adapterName;
+    }
+
+    bool ExecutesAsynchronously() const override
+    {
+        return true;
+    }
+
+    bool SupportsConcurrentCalls() const override
+    {
+        return m_executionMode == ExecutionMode::Immediate;
+    }
+
+    // Creating an existing tensor with another shape or type reshapes it, after flushing anything deferred. Its
+    // storage is kept while the padded shape fits its capacity; otherwise new storage is allocated and the old one
+    // freed once submitted work has finished with it. Contents are undefined after a reshape.
+    TensorHandle CreateTensor(const std::string &name, const TensorShape &shape, TensorDataType type) override;
+    TensorHandle FindTensor(const std::string &name) const override;
+    TensorShape GetTensorShape(TensorHandle tensor) const override;
+    TensorDataType GetTensorType(TensorHandle tensor) const override;
+    // Anything deferred is flushed first. The tensor's storage is reused once submitted work has finished with it.
+    void ReleaseTensor(TensorHandle tensor) override;
+
+    void SetTensorData(TensorHandle tensor, const void *data, size_t size) override;
+    void GetTensorData(TensorHandle tensor, const TensorShape &shape, TensorDataType type, void *data,
+                       size_t size) override;
+
+    // Reads a tensor back and returns a read-only view over the mapped readback memory instead of copying it out.
+    // The view holds the tensor in its storage format and must not outlive the processor.
+    TensorView MapTensorData(TensorHandle tensor);
+    TensorView MapTensorData(const std::string &name)
+    {
+        return MapTensorData(RequireTensor(name));
+    }
+
+    // dst = desc.scale * desc.activation(desc.op(src0, src1)) as one compiled operator, with NumPy broadcasting of
+    // src0 and src1. Compiled variants are cached per description and shapes.
+    SubmissionTicket ElementWise(const ElementWiseDesc &desc, TensorHandle src0, TensorHandle src1,
+                                 TensorHandle dst) override;
 
-    void ElementWiseAddBcast(std::string src0, std::string src1, std::string dst);
+    // Uploads and readbacks go through a copy queue, synchronized with the compute queue through fences, so the
+    // transfers of one chunk overlap the dispatches of its neighbours. While a stream runs, work other threads submit
+    // to the compute queue also waits for the chunk uploads ahead of it. Deferred mode, and devices without a copy
+    // queue, stream through the compute queue alone.
+    void StreamElementWise(const ElementWiseDesc &desc, const float *a, const float *b, float *out, uint64_t count,
+                           const StreamOptions &options) override;
 
-    void FreeResources();
+    // DML_OPERATOR_GEMM and DML_OPERATOR_REDUCE through the same compiled operator cache, keyed by the description and
+    // the exact shapes. A bias is broadcast to the output through zero strides rather than copied.
+    SubmissionTicket Gemm(const GemmDesc &desc, TensorHandle a, TensorHandle b, TensorHandle bias,
+                          TensorHandle dst) override;
+    SubmissionTicket Reduce(const ReduceDesc &desc, TensorHandle src, TensorHandle dst) override;
+
+    // Compiles the whole graph into one DirectML operator (cached by structure and shapes) and runs it as a single
+    // dispatch. Every input and output tensor must already exist.
+    SubmissionTicket ExecuteGraph(const TensorGraph &graph) override;
+
+    // Compiles the plan's operators and records its uploads, dispatches, barriers and readbacks into a command list
+    // once. A replay stages its inputs in an upload buffer of the plan's own and resubmits the list after anything
+    // recorded before it, then waits for its fence and copies the outputs out, so its future is already ready. The
+    // plan records the list again when one of its tensors has been reshaped, evicted or moved since.
+    std::unique_ptr<ExecutionPlan> CreateExecutionPlan(const PlanCapture &capture) override;
+
+    void FreeResources() override;
+
+    // Closes and submits everything recorded so far without waiting for it. The returned ticket covers every
+    // submission made so far and can be waited on, polled, or chained with Then().
+    SubmissionTicket Submit();
+
+    // Must not be called while other threads are using the processor.
+    void SetExecutionMode(ExecutionMode mode);
+    ExecutionMode GetExecutionMode() const
+    {
+        return m_executionMode;
+    }
+    // Records and submits everything staged in deferred mode as one command list.
+    SubmissionTicket Flush();
+    uint64_t GetDroppedCommandCount() const
+    {
+        return m_pendingStream.DroppedCount();
+    }
+    void Wait(const SubmissionTicket &ticket) override;
+    bool IsComplete(const SubmissionTicket &ticket);
+    // Continuations run on whichever thread observes the ticket's completion.
+    void Then(const SubmissionTicket &ticket, std::function<void()> continuation);
+    void WaitForIdle();
+
+    OperatorCacheStats GetOperatorCacheStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_operatorCacheMutex);
+        return m_operatorCache.GetStats();
+    }
+    void SetOperatorCacheCapacity(size_t capacity)
+    {
+        std::lock_guard<std::mutex> lock(m_operatorCacheMutex);
+        m_operatorCache.SetCapacity(capacity);
+    }
+
+    TensorHeapStats GetTensorHeapStats() const;
+
+    ResidencyStats GetResidencyStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_residencyMutex);
+        return m_residency.GetStats();
+    }
+
+    // Writes the adapter and every operator compiled so far to the startup profile. The destructor saves it too.
+    // Returns false if there is no profile or it could not be written.
+    bool SaveStartupProfile();
+    // Blocks until the operators of the startup profile have been compiled.
+    void WaitForPrewarm();
 
   private:
-    void InitializeDirectML(std::string adapterNameFilter);
-    void CloseExecuteResetWait();
+    // A dispatch bracketed by the timestamp pair at timestampIndex and timestampIndex + 1.
+    struct GpuSpan
+    {
+        const char *name;
+        uint32_t timestampIndex;
+        uint64_t bytes;
+    };
+
+    // Everything one thread needs to record and submit work without touching another thread's state.
+    struct RecordingContext
+    {
+        Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList;
+        AllocatorRing<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> allocators;
+        Microsoft::WRL::ComPtr<IDMLCommandRecorder> commandRecorder;
+
+        // Buffers used by the open command list. Buffers decay to COMMON when a command list completes and are
+        // promoted from COMMON implicitly on first use, so every list starts out with none.
+        std::unordered_map<ID3D12Resource *, BufferState> bufferStates;
+
+        // Descriptors the open command list's dispatches are bound through, each over a range of its own, and the
+        // binding table that is reset onto each range in turn.
+        OperatorBinding binding;
+        UploadRing descriptorRing; // In descriptors.
+
+        // Handed to the timeline when the open command list is submitted.
+        std::vector<std::shared_ptr<void>> keepAlive;
+        std::vector<GpuSpan> openGpuSpans;
+
+        Microsoft::WRL::ComPtr<ID3D12Resource> uploadBuffer;
+        uint8_t *uploadRingData = nullptr;
+        UploadRing uploadRing;
+    };
+    using ContextLease = ContextPool<RecordingContext>::Lease;
+
+    // A command list for the copy queue, which streaming records chunk transfers into.
+    struct CopyContext
+    {
+        Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> commandList;
+        AllocatorRing<Microsoft::WRL::ComPtr<ID3D12CommandAllocator>> allocators;
+    };
+
+    // Runs the stages of a stream on the copy and compute queues.
+    class QueueStreamStages;
+
+    // Replays the command list recorded for a captured ExecutionPlan.
+    class RecordedPlan;
+
+    // An op checked against its tensors: the key of the operator it runs, the recipe to compile that from on a cache
+    // miss, and the tensors it binds.
+    struct PreparedDispatch
+    {
+        OperatorKey key;
+        std::function<OperatorRecipe(const OperatorKey &)> recipe;
+        std::vector<TensorHandle> reads;
+        std::vector<TensorHandle> writes;
+        std::vector<TensorInfo *> inputs;
+        std::vector<TensorInfo *> outputs;
+        std::string traceName;
+        uint64_t traceBytes = 0;
+    };
+
+    // Keeps the tensors one call uses on the device from construction to destruction, paging evicted ones in first.
+    // Tensors the call only writes get storage without their old contents. Constructed before the call leases a
+    // recording context, since eviction and paging in submit work of their own. On destruction the tensors' last use
+    // is the submission that carries the call's work.
+    class ResidentTensors
+    {
+      public:
+        ResidentTensors(DirectMLProcessor &processor, const std::vector<TensorHandle> &reads,
+                        const std::vector<TensorHandle> &writes = {});
+        ~ResidentTensors();
+
+        ResidentTensors(const ResidentTensors &) = delete;
+        ResidentTensors &operator=(const ResidentTensors &) = delete;
+
+      private:
+        DirectMLProcessor *m_processor = nullptr; // Null when eviction is off.
+        std::vector<TensorHandle> m_tensors;
+    };
+
+    void InitializeDirectML(std::string adapterNameFilter, const DirectMLProcessorOptions &options);
+    std::unique_ptr<RecordingContext> CreateRecordingContext();
+    // The context a call records into: the deferred stream's while deferred, otherwise one leased for the call.
+    RecordingContext &AcquireContext(ContextLease &lease);
+    SubmissionTicket Submit(RecordingContext &context);
+    std::unique_ptr<CopyContext> CreateCopyContext();
+    // Submits the copy list once the compute queue has reached computeFenceValue. The ticket is on the copy fence.
+    SubmissionTicket SubmitCopy(CopyContext &context, uint64_t computeFenceValue);
+    void WaitForCopyFenceValue(uint64_t fenceValue);
+
+    // The cached operator for key, compiled from recipe() on a miss. An operator another thread is compiling is
+    // waited for rather than compiled twice.
+    std::shared_ptr<CompiledOperator> GetOrCompileOperator(const OperatorKey &key, RecordingContext &context,
+                                                           const std::function<OperatorRecipe()> &recipe);
+    std::shared_ptr<CompiledOperator> CompileOperator(RecordingContext &context, const OperatorRecipe &recipe);
+    // Body of the threads that compile the startup profile's operators.
+    void Prewarm();
+
+    dml::Expression BroadcastTo(dml::Expression tensor, const dml::TensorDimensions &targetShape);
+
+    std::shared_ptr<CompiledOperator> InitializeOperator(RecordingContext &context,
+                                                         Microsoft::WRL::ComPtr<IDMLCompiledOperator> compiledOperator);
+    // The context's binding table, reset onto a fresh range of its descriptors for one dispatch of op.
+    OperatorBinding &BindingFor(RecordingContext &context, const CompiledOperator &op);
+    // Index of the first of count descriptors in the context's heap, submitting the open command list and waiting
+    // for older dispatches to retire if the heap is full.
+    UINT64 AllocateDescriptors(RecordingContext &context, UINT count);
+    // Gives binding a descriptor heap and binding table of its own for op.
+    void CreateBinding(const CompiledOperator &op, OperatorBinding &binding);
+    // Points binding's table at count descriptors of its heap from firstDescriptor on, and binds op's temporary and
+    // persistent resources.
+    void ResetBinding(const CompiledOperator &op, UINT64 firstDescriptor, UINT count, OperatorBinding &binding);
+    void DispatchOperator(RecordingContext &context, const std::shared_ptr<CompiledOperator> &op,
+                          const std::vector<TensorInfo *> &inputs, const std::vector<TensorInfo *> &outputs);
+    // Transitions the tensors and op's temporary buffer for a dispatch and binds the tensors to binding's table,
+    // ready for the dispatch to be recorded.
+    void BindOperator(RecordingContext &context, const CompiledOperator &op, OperatorBinding &binding,
+                      const std::vector<TensorInfo *> &inputs, const std::vector<TensorInfo *> &outputs);
+
+    PreparedDispatch PrepareElementWise(const ElementWiseDesc &desc, TensorHandle src0, TensorHandle src1,
+                                        TensorHandle dst);
+    PreparedDispatch PrepareGemm(const GemmDesc &desc, TensorHandle a, TensorHandle b, TensorHandle bias,
+                                 TensorHandle dst);
+    PreparedDispatch PrepareReduce(const ReduceDesc &desc, TensorHandle src, TensorHandle dst);
+    // The recipe refers to graph, which must outlive the dispatch.
+    PreparedDispatch PrepareGraph(const TensorGraph &graph);
+    // Compiles the operator on a cache miss and records its dispatch, which is submitted unless deferred.
+    SubmissionTicket RunDispatch(const PreparedDispatch &dispatch);
+    void BroadcastOperands(dml::Expression &a, dml::Expression &b);
+    void Record(const std::vector<TensorHandle> &reads, const std::vector<TensorHandle> &writes,
+                DeferredStream::RecordFunction record);
+    void TransitionTensor(RecordingContext &context, TensorInfo &tensor, D3D12_RESOURCE_STATES state,
+                          std::vector<D3D12_RESOURCE_BARRIER> &barriers);
+    void TransitionBuffer(RecordingContext &context, ID3D12Resource *resource, D3D12_RESOURCE_STATES state,
+                          std::vector<D3D12_RESOURCE_BARRIER> &barriers);
+    void FlushBarriers(RecordingContext &context, std::vector<D3D12_RESOURCE_BARRIER> &barriers);
+    void WaitForFenceValue(uint64_t fenceValue);
+    void RetireCompleted();
+    void ReplayPendingStream();
+    UINT64 AllocateUpload(RecordingContext &context, UINT64 size);
+    ReadbackPool<ReadbackBuffer>::Entry ReadbackTensor(TensorInfo &tensor);
+    void ReleaseReadback(ReadbackPool<ReadbackBuffer>::Entry readback);
+
+    void ReportGpuSpans(const std::vector<GpuSpan> &spans);
+
+    // DirectML has no bfloat16 tensors, and int8 ops would ignore the per-tensor scale, so every reduced precision is
+    // stored as float16 when the device supports it.
+    StoragePrecision ResolveStoragePrecision(StoragePrecision requested) const override;
+    // Writes bytes of the tensor's storage starting at storageOffset, converting from the caller's host data.
+    void StageUpload(const TensorInfo &tensor, const void *data, UINT64 storageOffset, UINT64 bytes,
+                     uint8_t *destination);
+
+    // CreateTensor, with storage of its own rather than a region of a heap page when dedicated is set.
+    TensorHandle CreateTensor(const std::string &name, const TensorShape &shape, TensorDataType type, bool dedicated);
+    // Sets the shape, type and storage format of tensor.
+    void DescribeTensor(TensorInfo &tensor, const TensorShape &shape, TensorDataType type);
+    // Bytes of storage the tensor's shape needs, padded as operators compile it.
+    UINT64 RequiredStorage(const TensorInfo &tensor) const;
+    void ResizeTensor(TensorInfo &tensor, const TensorShape &shape, TensorDataType type);
+    void AllocateTensorStorage(TensorInfo &tensor);
+    void ReleaseTensorStorage(TensorInfo &tensor);
+    // Frees the storage of tensor once every submission so far has finished.
+    void ReleaseTensorStorageAfterSubmitted(TensorInfo tensor);
 
-    bool CanBroadcast(const dml::TensorDimensions &a, const dml::TensorDimensions &b);
-    dml::Expression ReshapeAndBroadcastTensor(dml::Expression originalTensor, const dml::TensorDimensions &targetShape);
+    // The fence value of the submission that carries work recorded so far: the next one while deferred work is
+    // staged, otherwise the last one.
+    uint64_t LastUseFenceValue();
+    // Starts tracking the residency of a tensor that was just created, or its new size after a reshape, and evicts
+    // other tensors if it took the budget.
+    void TrackTensor(TensorHandle handle, const TensorInfo &tensor);
+    // Evicts idle tensors until incoming more bytes fit the budget, waiting for the submissions that last used them.
+    // Called with m_residencyMutex held.
+    void MakeRoom(uint64_t incoming);
+    void RefreshMemoryBudget();
+    void EvictTensor(TensorHandle handle, TensorInfo &tensor);
+    // Allocates storage for an evicted tensor and, if restore, uploads its contents.
+    void PageInTensor(TensorHandle handle, TensorInfo &tensor, bool restore);
 
+    static constexpr size_t c_commandAllocatorCount = 3;
+    static constexpr UINT64 c_uploadAlignment = 256;
+    static constexpr uint64_t c_minReadbackBucketSize = 64 * 1024;
+    static constexpr uint64_t c_tensorAlignment = 256;
+    static constexpr uint32_t c_timestampCount = 1024;
+    static constexpr std::chrono::seconds c_memoryBudgetQueryInterval{1};
+
+    std::string m_adapterName;
+    Microsoft::WRL::ComPtr<IDXCoreAdapter> m_adapter;
+    bool m_float16Supported = false;
+    const ConversionKernelTable *m_conversions = &ConversionKernels(DetectSimdLevel());
     Microsoft::WRL::ComPtr<ID3D12Device> m_d3D12Device;
     Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_commandQueue;
-    Microsoft::WRL::ComPtr<ID3D12CommandAllocator> m_commandAllocator;
-    Microsoft::WRL::ComPtr<ID3D12GraphicsCommandList> m_commandList;
+    Microsoft::WRL::ComPtr<ID3D12Fence> m_fence;
     Microsoft::WRL::ComPtr<IDMLDevice> m_dmlDevice;
 
-    std::unordered_map<std::string, TensorInfo *> m_tensorInfoMap;
+    // Null if the device has no copy queue.
+    Microsoft::WRL::ComPtr<ID3D12CommandQueue> m_copyQueue;
+    Microsoft::WRL::ComPtr<ID3D12Fence> m_copyFence;
+
+    // Guards the queues and their timelines, so command lists recorded in parallel are executed and signalled one at
+    // a time and fence values follow submission order.
+    std::mutex m_queueMutex;
+    SubmissionTimeline m_timeline;
+    SubmissionTimeline m_copyTimeline;
+
+    TensorTable<TensorInfo> m_tensors;
+
+    // Guards the cache and the operators being compiled. Compilation runs without the lock; a thread that misses an
+    // operator someone else is compiling waits on its future, so a variant is compiled once.
+    mutable std::mutex m_operatorCacheMutex;
+    OperatorCache<CompiledOperator> m_operatorCache;
+    std::unordered_map<OperatorKey, std::shared_future<std::shared_ptr<CompiledOperator>>, OperatorKeyHash>
+        m_compilingOperators;
+
+    // What this run selected and compiled, saved for the next one. Empty path if there is no profile.
+    std::string m_startupProfilePath;
+    std::mutex m_startupProfileMutex;
+    StartupProfile m_startupProfile;
+
+    // Operators of the loaded profile, compiled by the prewarm threads in order. Recipes from m_prewarmNext on have
+    // not been started yet.
+    std::vector<OperatorRecipe> m_prewarmRecipes;
+    std::atomic<size_t> m_prewarmNext{0};
+    std::atomic<bool> m_stopPrewarm{false};
+    std::mutex m_prewarmMutex;
+    std::vector<std::thread> m_prewarmThreads;
+
+    uint64_t m_uploadRingSize = 0;
+    uint32_t m_descriptorRingSize = 0;
+    UINT m_descriptorSize = 0; // Increment between CBV/SRV/UAV descriptors.
+    ContextPool<RecordingContext> m_contexts{[this]() { return CreateRecordingContext(); }};
+    ContextPool<CopyContext> m_copyContexts{[this]() { return CreateCopyContext(); }};
+
+    ExecutionMode m_executionMode = ExecutionMode::Immediate;
+    DeferredStream m_pendingStream;
+    bool m_replayingPendingStream = false;
+    ContextLease m_deferredContext; // Held for as long as the processor is deferred.
+
+    std::mutex m_readbackMutex;
+    ReadbackPool<ReadbackBuffer> m_readbackPool;
+
+    CapacityPolicy m_capacityPolicy;
+    bool m_bucketOperatorShapes = true;
+
+    mutable std::mutex m_tensorHeapMutex;
+    uint64_t m_tensorHeapPageSize = 0;
+    std::vector<std::unique_ptr<TensorHeapPage>> m_tensorHeapPages;
+
+    // Guards the residency bookkeeping and serializes evicting and paging in, so a tensor is never evicted while a
+    // call is pinning it. Taken before any other lock of the processor.
+    bool m_residencyEnabled = true;
+    bool m_followAdapterBudget = true;
+    std::string m_evictionDirectory;
+    mutable std::mutex m_residencyMutex;
+    ResidencyManager m_residency;
+    std::chrono::steady_clock::time_point m_memoryBudgetQueryTime;
+
+    Microsoft::WRL::ComPtr<ID3D12QueryHeap> m_timestampHeap;
+    Microsoft::WRL::ComPtr<ID3D12Resource> m_timestampReadback;
+    const uint64_t *m_timestampData = nullptr;
+    uint64_t m_timestampFrequency = 0;
+    std::mutex m_timestampMutex;
+    std::vector<uint32_t> m_freeTimestamps; // First index of every unused timestamp pair.
 };
 ;
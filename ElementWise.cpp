@@ -0,0 +1,81 @@
+#include "ElementWise.hpp"
+
+#include <sstream>
+
+namespace
+{
+using RunFunction = void (*)(const float *a, size_t strideA, const float *b, size_t strideB, float *out, size_t count,
+                             float alpha, float scale);
+
+template <BinaryOp Op, Activation Act>
+void RunFused(const float *a, size_t strideA, const float *b, size_t strideB, float *out, size_t count, float alpha,
+              float scale)
+{
+    if (strideA != 0 && strideB != 0)
+    {
+        FusedElementWiseRun<Op, Act, 1, 1>(a, b, out, count, alpha, scale);
+    }
+    else if (strideA != 0)
+    {
+        FusedElementWiseRun<Op, Act, 1, 0>(a, b, out, count, alpha, scale);
+    }
+    else if (strideB != 0)
+    {
+        FusedElementWiseRun<Op, Act, 0, 1>(a, b, out, count, alpha, scale);
+    }
+    else
+    {
+        FusedElementWiseRun<Op, Act, 0, 0>(a, b, out, count, alpha, scale);
+    }
+}
+} // namespace
+
+std::string ElementWiseDesc::Signature() const
+{
+    std::ostringstream signature;
+    signature << static_cast<uint32_t>(op) << ':' << static_cast<uint32_t>(activation) << ':' << std::hexfloat
+              << alpha << ':' << scale;
+    return signature.str();
+}
+
+ElementWiseTraffic EstimateElementWiseTraffic(const ElementWiseDesc &desc, const TensorShape &a, const TensorShape &b,
+                                              size_t elementSize)
+{
+    uint64_t outputBytes = ElementCount(BroadcastShapes(a, b)) * elementSize;
+
+    ElementWiseTraffic traffic;
+    traffic.fusedBytes = (ElementCount(a) + ElementCount(b)) * elementSize + outputBytes;
+    traffic.unfusedBytes = traffic.fusedBytes;
+    if (desc.activation != Activation::None)
+    {
+        traffic.unfusedBytes += 2 * outputBytes;
+    }
+    if (desc.scale != 1.0f)
+    {
+        traffic.unfusedBytes += 2 * outputBytes;
+    }
+    return traffic;
+}
+
+HostTensor RunElementWiseOnCpu(const ElementWiseDesc &desc, const HostTensor &a, const HostTensor &b)
+{
+    if (a.data.size() != ElementCount(a.shape) || b.data.size() != ElementCount(b.shape))
+    {
+        throw std::invalid_argument("HostTensor data does not match its shape.");
+    }
+
+    HostTensor result;
+    result.shape = BroadcastShapes(a.shape, b.shape);
+    result.data.resize(ElementCount(result.shape));
+
+    BroadcastPlan plan = PlanBroadcast(a.shape, b.shape, result.shape);
+    RunFunction run = VisitElementWise(desc, [](auto op, auto activation) -> RunFunction {
+        return &RunFused<decltype(op)::value, decltype(activation)::value>;
+    });
+
+    ForEachBroadcastRun(plan, 0, plan.elementCount, [&](size_t offset, size_t offsetA, size_t offsetB, size_t count) {
+        run(a.data.data() + offsetA, plan.stridesA.back(), b.data.data() + offsetB, plan.stridesB.back(),
+            result.data.data() + offset, count, desc.alpha, desc.scale);
+    });
+    return result;
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "BroadcastShape.hpp"
+#include "TensorGraph.hpp"
+
+// Binary element-wise operators with an optional fused activation and output scale:
+//
+//     dst = scale * activation(op(src0, src1))
+//
+// Every (op, activation) pair is a separate template instantiation, both for the DirectML expression that
+// DirectMLProcessor compiles and for the CPU reference kernel below. VisitElementWise maps the runtime description
+// onto the matching instantiation.
+
+enum class BinaryOp : uint32_t
+{
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Maximum,
+    Minimum,
+};
+
+enum class Activation : uint32_t
+{
+    None,
+    Relu,
+    LeakyRelu,
+    Sigmoid,
+    Tanh,
+    Gelu,
+};
+
+struct ElementWiseDesc
+{
+    BinaryOp op = BinaryOp::Add;
+    Activation activation = Activation::None;
+    float alpha = 0.01f; // LeakyRelu
+    float scale = 1.0f;
+
+    // Part of the compiled operator cache key. Floats are written exactly, since they are compiled into the operator.
+    std::string Signature() const;
+};
+
+template <BinaryOp Op> struct BinaryFunction;
+
+template <> struct BinaryFunction<BinaryOp::Add>
+{
+    static float Apply(float a, float b)
+    {
+        return a + b;
+    }
+};
+
+template <> struct BinaryFunction<BinaryOp::Subtract>
+{
+    static float Apply(float a, float b)
+    {
+        return a - b;
+    }
+};
+
+template <> struct BinaryFunction<BinaryOp::Multiply>
+{
+    static float Apply(float a, float b)
+    {
+        return a * b;
+    }
+};
+
+template <> struct BinaryFunction<BinaryOp::Divide>
+{
+    static float Apply(float a, float b)
+    {
+        return a / b;
+    }
+};
+
+template <> struct BinaryFunction<BinaryOp::Maximum>
+{
+    static float Apply(float a, float b)
+    {
+        return a > b ? a : b;
+    }
+};
+
+template <> struct BinaryFunction<BinaryOp::Minimum>
+{
+    static float Apply(float a, float b)
+    {
+        return a < b ? a : b;
+    }
+};
+
+template <Activation Act> struct ActivationFunction;
+
+template <> struct ActivationFunction<Activation::None>
+{
+    static float Apply(float x, float)
+    {
+        return x;
+    }
+};
+
+template <> struct ActivationFunction<Activation::Relu>
+{
+    static float Apply(float x, float)
+    {
+        return x > 0.0f ? x : 0.0f;
+    }
+};
+
+template <> struct ActivationFunction<Activation::LeakyRelu>
+{
+    static float Apply(float x, float alpha)
+    {
+        return x < 0.0f ? alpha * x : x;
+    }
+};
+
+template <> struct ActivationFunction<Activation::Sigmoid>
+{
+    static float Apply(float x, float)
+    {
+        return 1.0f / (1.0f + std::exp(-x));
+    }
+};
+
+template <> struct ActivationFunction<Activation::Tanh>
+{
+    static float Apply(float x, float)
+    {
+        return std::tanh(x);
+    }
+};
+
+// The exact (erf) form, matching DML_OPERATOR_ACTIVATION_GELU.
+template <> struct ActivationFunction<Activation::Gelu>
+{
+    static float Apply(float x, float)
+    {
+        return 0.5f * x * (1.0f + std::erf(x * 0.70710678f));
+    }
+};
+
+template <BinaryOp Op, typename Function> decltype(auto) VisitActivation(Activation activation, Function &&function)
+{
+    using OpConstant = std::integral_constant<BinaryOp, Op>;
+    switch (activation)
+    {
+    case Activation::None:
+        return function(OpConstant(), std::integral_constant<Activation, Activation::None>());
+    case Activation::Relu:
+        return function(OpConstant(), std::integral_constant<Activation, Activation::Relu>());
+    case Activation::LeakyRelu:
+        return function(OpConstant(), std::integral_constant<Activation, Activation::LeakyRelu>());
+    case Activation::Sigmoid:
+        return function(OpConstant(), std::integral_constant<Activation, Activation::Sigmoid>());
+    case Activation::Tanh:
+        return function(OpConstant(), std::integral_constant<Activation, Activation::Tanh>());
+    case Activation::Gelu:
+        return function(OpConstant(), std::integral_constant<Activation, Activation::Gelu>());
+    }
+    throw std::invalid_argument("Unknown activation.");
+}
+
+// Calls function(op, activation) with both passed as std::integral_constant, so the body can instantiate templates
+// on them.
+template <typename Function> decltype(auto) VisitElementWise(const ElementWiseDesc &desc, Function &&function)
+{
+    switch (desc.op)
+    {
+    case BinaryOp::Add:
+        return VisitActivation<BinaryOp::Add>(desc.activation, function);
+    case BinaryOp::Subtract:
+        return VisitActivation<BinaryOp::Subtract>(desc.activation, function);
+    case BinaryOp::Multiply:
+        return VisitActivation<BinaryOp::Multiply>(desc.activation, function);
+    case BinaryOp::Divide:
+        return VisitActivation<BinaryOp::Divide>(desc.activation, function);
+    case BinaryOp::Maximum:
+        return VisitActivation<BinaryOp::Maximum>(desc.activation, function);
+    case BinaryOp::Minimum:
+        return VisitActivation<BinaryOp::Minimum>(desc.activation, function);
+    }
+    throw std::invalid_argument("Unknown element-wise operator.");
+}
+
+// Processes one contiguous run. StrideA/StrideB are 1 for a packed operand and 0 for one broadcast along the run;
+// with both known at compile time and no branches in the body the loop auto-vectorizes.
+template <BinaryOp Op, Activation Act, size_t StrideA, size_t StrideB>
+void FusedElementWiseRun(const float *a, const float *b, float *out, size_t count, float alpha, float scale)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        float value = BinaryFunction<Op>::Apply(a[i * StrideA], b[i * StrideB]);
+        out[i] = scale * ActivationFunction<Act>::Apply(value, alpha);
+    }
+}
+
+// Bytes moved through memory by the fused operator, and by the equivalent chain of separate passes (binary op, then
+// activation, then scale), each of which reads and writes the whole output.
+struct ElementWiseTraffic
+{
+    uint64_t fusedBytes = 0;
+    uint64_t unfusedBytes = 0;
+};
+
+ElementWiseTraffic EstimateElementWiseTraffic(const ElementWiseDesc &desc, const TensorShape &a, const TensorShape &b,
+                                              size_t elementSize);
+
+// Float32 reference implementation with NumPy broadcasting. Broadcast operands are read in place through zero
+// strides.
+HostTensor RunElementWiseOnCpu(const ElementWiseDesc &desc, const HostTensor &a, const HostTensor &b);
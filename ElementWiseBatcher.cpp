@@ -0,0 +1,235 @@
+#include "ElementWiseBatcher.hpp"
+
+#include "TensorCapacity.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+namespace
+{
+// Checked before the worker thread starts, so a constructor that throws has no thread to stop.
+const BatchingOptions &CheckBatchingOptions(const BatchingOptions &options)
+{
+    if (options.maxBatchElements == 0 || options.maxBatchElements > UINT32_MAX || options.maxBatchRequests == 0)
+    {
+        throw std::invalid_argument("Batches need room for at least one request and fewer than 2^32 elements.");
+    }
+    return options;
+}
+} // namespace
+
+ElementWiseBatcher::ElementWiseBatcher(TensorBackend &backend, const BatchingOptions &options)
+    : m_backend(backend), m_options(CheckBatchingOptions(options)), m_worker([this]() { WorkerLoop(); })
+{
+}
+
+ElementWiseBatcher::~ElementWiseBatcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    m_worker.join();
+}
+
+std::future<void> ElementWiseBatcher::Submit(const ElementWiseDesc &desc, const float *a, const float *b, float *out,
+                                             uint64_t count)
+{
+    if (count > UINT32_MAX)
+    {
+        throw std::invalid_argument("Batched requests must have fewer than 2^32 elements.");
+    }
+    Request request;
+    request.a = a;
+    request.b = b;
+    request.out = out;
+    request.count = count;
+    std::future<void> result = request.done.get_future();
+    if (count == 0)
+    {
+        request.done.set_value();
+        return result;
+    }
+
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::string signature = desc.Signature();
+        auto open = m_pending.find(signature);
+
+        // A request that would take the open batch past its element limit closes it and starts the next one, so only
+        // a single request is ever larger than maxBatchElements.
+        if (open != m_pending.end() && open->second.elements + count > m_options.maxBatchElements)
+        {
+            m_full.push_back(std::move(open->second));
+            m_pending.erase(open);
+            open = m_pending.end();
+            ++m_stats.fullBatches;
+            wake = true;
+        }
+        if (open == m_pending.end())
+        {
+            open = m_pending.emplace(signature, Batch{}).first;
+            open->second.desc = desc;
+            open->second.deadline = Clock::now() + m_options.maxDelay;
+            wake = true;
+        }
+
+        Batch &batch = open->second;
+        batch.elements += count;
+        batch.requests.push_back(std::move(request));
+        if (batch.elements >= m_options.maxBatchElements || batch.requests.size() >= m_options.maxBatchRequests)
+        {
+            m_full.push_back(std::move(batch));
+            m_pending.erase(open);
+            ++m_stats.fullBatches;
+            wake = true;
+        }
+    }
+    if (wake)
+    {
+        m_wake.notify_one();
+    }
+    return result;
+}
+
+void ElementWiseBatcher::Flush()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_flushRequested = true;
+    }
+    m_wake.notify_one();
+}
+
+BatchingStats ElementWiseBatcher::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void ElementWiseBatcher::WorkerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+        // Every full batch, every batch whose deadline has passed, and every batch at all when flushing or stopping.
+        std::vector<Batch> ready;
+        ready.swap(m_full);
+        bool drain = m_flushRequested || m_stopping;
+        m_flushRequested = false;
+        Clock::time_point now = Clock::now();
+        Clock::time_point nextDeadline = Clock::time_point::max();
+        for (auto it = m_pending.begin(); it != m_pending.end();)
+        {
+            if (drain || it->second.deadline <= now)
+            {
+                ready.push_back(std::move(it->second));
+                it = m_pending.erase(it);
+            }
+            else
+            {
+                nextDeadline = std::min(nextDeadline, it->second.deadline);
+                ++it;
+            }
+        }
+
+        if (ready.empty())
+        {
+            if (m_stopping)
+            {
+                return;
+            }
+            // Submit and Flush notify whenever a batch opens or fills, so waking up early or spuriously only costs a
+            // rescan.
+            if (nextDeadline == Clock::time_point::max())
+            {
+                m_wake.wait(lock);
+            }
+            else
+            {
+                m_wake.wait_until(lock, nextDeadline);
+            }
+            continue;
+        }
+
+        lock.unlock();
+        for (Batch &batch : ready)
+        {
+            Run(batch);
+        }
+        lock.lock();
+    }
+}
+
+void ElementWiseBatcher::Run(Batch &batch)
+{
+    // The elements past the last request are computed on whatever a previous batch left in the staging buffers and
+    // never copied out.
+    uint32_t padded = ShapeBucket(static_cast<uint32_t>(batch.elements));
+    size_t bytes = size_t(padded) * sizeof(float);
+    TRACE_SPAN("Batch", {}, 3 * uint64_t(bytes));
+    try
+    {
+        m_stagingA.resize(padded);
+        m_stagingB.resize(padded);
+        m_stagingOut.resize(padded);
+        uint64_t offset = 0;
+        for (const Request &request : batch.requests)
+        {
+            std::copy_n(request.a, request.count, m_stagingA.data() + offset);
+            std::copy_n(request.b, request.count, m_stagingB.data() + offset);
+            offset += request.count;
+        }
+
+        BatchTensors &tensors = TensorsFor(padded);
+        m_backend.SetTensorData(tensors.a, m_stagingA.data(), bytes);
+        m_backend.SetTensorData(tensors.b, m_stagingB.data(), bytes);
+        m_backend.Wait(m_backend.ElementWise(batch.desc, tensors.a, tensors.b, tensors.out));
+        m_backend.GetTensorData(tensors.out, {}, TensorDataType::Float32, m_stagingOut.data(), bytes);
+    }
+    catch (...)
+    {
+        for (Request &request : batch.requests)
+        {
+            request.done.set_exception(std::current_exception());
+        }
+        return;
+    }
+
+    // The stats count the batch before any of its futures is ready, so a caller that has waited on one sees it.
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.batches;
+        m_stats.requests += batch.requests.size();
+        m_stats.elements += batch.elements;
+        m_stats.paddedElements += padded;
+    }
+
+    uint64_t offset = 0;
+    for (Request &request : batch.requests)
+    {
+        std::copy_n(m_stagingOut.data() + offset, request.count, request.out);
+        offset += request.count;
+        request.done.set_value();
+    }
+}
+
+ElementWiseBatcher::BatchTensors &ElementWiseBatcher::TensorsFor(uint32_t elements)
+{
+    auto it = m_tensors.find(elements);
+    if (it == m_tensors.end())
+    {
+        TensorShape shape{elements};
+        BatchTensors tensors;
+        tensors.a = UniqueTensor(m_backend, m_backend.CreateTensor("", shape, TensorDataType::Float32));
+        tensors.b = UniqueTensor(m_backend, m_backend.CreateTensor("", shape, TensorDataType::Float32));
+        tensors.out = UniqueTensor(m_backend, m_backend.CreateTensor("", shape, TensorDataType::Float32));
+        it = m_tensors.emplace(elements, std::move(tensors)).first;
+    }
+    return it->second;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "ElementWise.hpp"
+#include "TensorBackend.hpp"
+
+struct BatchingOptions
+{
+    // A batch is dispatched as soon as it holds this many elements or requests. Larger requests run in a batch of
+    // their own.
+    uint64_t maxBatchElements = 1 << 16;
+    uint32_t maxBatchRequests = 1024;
+
+    // Longest a request waits for others to join its batch, counted from the first request of the batch. Zero
+    // dispatches whatever has queued up while the previous batch ran.
+    std::chrono::microseconds maxDelay{200};
+};
+
+struct BatchingStats
+{
+    uint64_t requests = 0;
+    uint64_t batches = 0;
+    uint64_t elements = 0;       // Elements the requests asked for.
+    uint64_t paddedElements = 0; // Elements dispatched, after rounding every batch up to its shape bucket.
+    uint64_t fullBatches = 0;    // Batches dispatched because they reached a size limit rather than the deadline.
+};
+
+// Packs many small independent element-wise requests with the same ElementWiseDesc into one contiguous tensor per
+// operand, runs a single op over them and scatters the results back. A request on a handful of elements otherwise
+// pays the fixed cost of an op, its uploads, fence waits and readback on its own; batched, that cost is shared by
+// every request in the batch, at the price of waiting up to maxDelay for the batch to fill.
+//
+// Requests may be submitted from any number of threads. One worker thread owns the backend's side: it packs a batch
+// into host staging buffers, uploads both operands, dispatches, reads the output back and copies each request's
+// slice out. Batches are rounded up to a ShapeBucket, so four sets of tensors and compiled operators per power of two
+// serve every batch size. Nothing else may use the backend concurrently unless it supports concurrent calls.
+//
+// The batch tensors are created with the backend's default storage precision. With Int8 storage the scale of a batch
+// follows its largest element, so a request is rounded according to the requests it shares a batch with.
+class ElementWiseBatcher
+{
+  public:
+    explicit ElementWiseBatcher(TensorBackend &backend, const BatchingOptions &options = {});
+
+    // Dispatches every pending request before returning.
+    ~ElementWiseBatcher();
+
+    ElementWiseBatcher(const ElementWiseBatcher &) = delete;
+    ElementWiseBatcher &operator=(const ElementWiseBatcher &) = delete;
+
+    // out = desc.scale * desc.activation(desc.op(a, b)) over count float32 elements of host memory, without
+    // broadcasting. a, b and out are read and written by the worker thread and must stay valid until the returned
+    // future is ready; it rethrows anything the backend threw for the batch. out may alias a or b.
+    std::future<void> Submit(const ElementWiseDesc &desc, const float *a, const float *b, float *out,
+                             uint64_t count);
+
+    // Dispatches every pending request without waiting for its deadline. Returns without waiting for the results.
+    void Flush();
+
+    BatchingStats GetStats() const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request
+    {
+        const float *a = nullptr;
+        const float *b = nullptr;
+        float *out = nullptr;
+        uint64_t count = 0;
+        std::promise<void> done;
+    };
+
+    struct Batch
+    {
+        ElementWiseDesc desc;
+        std::vector<Request> requests;
+        uint64_t elements = 0;
+        Clock::time_point deadline;
+    };
+
+    // Tensors for one padded batch size, kept for the lifetime of the batcher.
+    struct BatchTensors
+    {
+        UniqueTensor a;
+        UniqueTensor b;
+        UniqueTensor out;
+    };
+
+    void WorkerLoop();
+    void Run(Batch &batch);
+    BatchTensors &TensorsFor(uint32_t elements);
+
+    TensorBackend &m_backend;
+    BatchingOptions m_options;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::map<std::string, Batch> m_pending; // Open batches by ElementWiseDesc::Signature.
+    std::vector<Batch> m_full;              // Batches that reached a limit, oldest first.
+    bool m_flushRequested = false;
+    bool m_stopping = false;
+    BatchingStats m_stats;
+
+    // Only touched by the worker thread.
+    std::vector<float> m_stagingA;
+    std::vector<float> m_stagingB;
+    std::vector<float> m_stagingOut;
+    std::unordered_map<uint32_t, BatchTensors> m_tensors;
+
+    std::thread m_worker; // Last, so it starts after everything it uses.
+};
@@ -0,0 +1,147 @@
+#include "ExecutionPlan.hpp"
+
+#include "TensorBackend.hpp"
+
+#include <stdexcept>
+#include <string>
+
+void PlanCapture::CheckHostSize(TensorHandle tensor, size_t size, const char *call) const
+{
+    if (size > ElementCount(m_backend.GetTensorShape(tensor)) * DataTypeSize(m_backend.GetTensorType(tensor)))
+    {
+        throw std::invalid_argument(std::string(call) + " size is larger than the tensor.");
+    }
+}
+
+uint32_t PlanCapture::SetTensorData(TensorHandle tensor, size_t size)
+{
+    // Uploads are checked here rather than truncated, since every replay would truncate them alike.
+    CheckHostSize(tensor, size, "SetTensorData");
+
+    PlanStep step;
+    step.kind = PlanStepKind::Upload;
+    step.writes = {tensor};
+    step.slot = static_cast<uint32_t>(m_inputSizes.size());
+    step.size = size;
+    step.type = m_backend.GetTensorType(tensor);
+    m_steps.push_back(std::move(step));
+    m_inputSizes.push_back(size);
+    return m_steps.back().slot;
+}
+
+void PlanCapture::ElementWise(const ElementWiseDesc &desc, TensorHandle src0, TensorHandle src1, TensorHandle dst)
+{
+    if (BroadcastShapes(m_backend.GetTensorShape(src0), m_backend.GetTensorShape(src1)) !=
+        m_backend.GetTensorShape(dst))
+    {
+        throw std::invalid_argument("Broadcast result shape does not match the output tensor.");
+    }
+
+    PlanStep step;
+    step.kind = PlanStepKind::ElementWise;
+    step.reads = {src0, src1};
+    step.writes = {dst};
+    step.elementWise = desc;
+    m_steps.push_back(std::move(step));
+}
+
+void PlanCapture::Gemm(const GemmDesc &desc, TensorHandle a, TensorHandle b, TensorHandle bias, TensorHandle dst)
+{
+    if (dst == a || dst == b || dst == bias)
+    {
+        throw std::invalid_argument("The GEMM output must not be one of its operands.");
+    }
+    PlanGemm(desc, m_backend.GetTensorShape(a), m_backend.GetTensorShape(b),
+             bias ? m_backend.GetTensorShape(bias) : TensorShape(), m_backend.GetTensorShape(dst));
+
+    PlanStep step;
+    step.kind = PlanStepKind::Gemm;
+    step.reads = {a, b};
+    if (bias)
+    {
+        step.reads.push_back(bias);
+    }
+    step.writes = {dst};
+    step.gemm = desc;
+    m_steps.push_back(std::move(step));
+}
+
+void PlanCapture::Reduce(const ReduceDesc &desc, TensorHandle src, TensorHandle dst)
+{
+    if (dst == src)
+    {
+        throw std::invalid_argument("The reduction output must not be its input.");
+    }
+    if (ReduceOutputShape(desc, m_backend.GetTensorShape(src)) != m_backend.GetTensorShape(dst))
+    {
+        throw std::invalid_argument("Reduction result shape does not match the output tensor.");
+    }
+
+    PlanStep step;
+    step.kind = PlanStepKind::Reduce;
+    step.reads = {src};
+    step.writes = {dst};
+    step.reduce = desc;
+    m_steps.push_back(std::move(step));
+}
+
+void PlanCapture::ExecuteGraph(const TensorGraph &graph)
+{
+    if (graph.OutputNodes().empty())
+    {
+        throw std::invalid_argument("TensorGraph has no outputs.");
+    }
+
+    PlanStep step;
+    step.kind = PlanStepKind::Graph;
+    for (const std::string &name : graph.InputNames())
+    {
+        step.reads.push_back(m_backend.RequireTensor(name));
+    }
+    for (const std::string &name : graph.OutputNames())
+    {
+        step.writes.push_back(m_backend.RequireTensor(name));
+    }
+    step.graph = std::make_shared<const TensorGraph>(graph);
+    m_steps.push_back(std::move(step));
+}
+
+uint32_t PlanCapture::GetTensorData(TensorHandle tensor, size_t size)
+{
+    CheckHostSize(tensor, size, "GetTensorData");
+
+    PlanStep step;
+    step.kind = PlanStepKind::Readback;
+    step.reads = {tensor};
+    step.slot = static_cast<uint32_t>(m_outputSizes.size());
+    step.size = size;
+    step.type = m_backend.GetTensorType(tensor);
+    m_steps.push_back(std::move(step));
+    m_outputSizes.push_back(size);
+    return m_steps.back().slot;
+}
+
+std::shared_future<void> ExecutionPlan::ReplayAsync(const std::vector<const void *> &inputs,
+                                                    const std::vector<void *> &outputs)
+{
+    if (inputs.size() != m_inputSizes.size() || outputs.size() != m_outputSizes.size())
+    {
+        throw std::invalid_argument("ExecutionPlan replay needs " + std::to_string(m_inputSizes.size()) +
+                                    " inputs and " + std::to_string(m_outputSizes.size()) + " outputs.");
+    }
+    for (const void *input : inputs)
+    {
+        if (!input)
+        {
+            throw std::invalid_argument("ExecutionPlan replay input is null.");
+        }
+    }
+    for (void *output : outputs)
+    {
+        if (!output)
+        {
+            throw std::invalid_argument("ExecutionPlan replay output is null.");
+        }
+    }
+    return Run(inputs, outputs);
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "ElementWise.hpp"
+#include "MatrixOps.hpp"
+#include "TensorGraph.hpp"
+#include "TensorTable.hpp"
+
+class TensorBackend;
+enum class TensorDataType : uint32_t;
+
+enum class PlanStepKind : uint32_t
+{
+    Upload,
+    ElementWise,
+    Gemm,
+    Reduce,
+    Graph,
+    Readback,
+};
+
+// One captured call, with its tensors resolved to handles.
+struct PlanStep
+{
+    PlanStepKind kind = PlanStepKind::Upload;
+    std::vector<TensorHandle> reads; // A GEMM reads a, b and the bias if it has one.
+    std::vector<TensorHandle> writes;
+
+    // Uploads and readbacks: the host buffer's index among a replay's inputs or outputs, its size in bytes, and the
+    // type it holds.
+    uint32_t slot = 0;
+    size_t size = 0;
+    TensorDataType type{};
+
+    ElementWiseDesc elementWise;
+    GemmDesc gemm;
+    ReduceDesc reduce;
+    std::shared_ptr<const TensorGraph> graph;
+};
+
+// Captures a fixed sequence of uploads, ops and readbacks on existing tensors of one backend, to be compiled once into
+// an ExecutionPlan (see TensorBackend::CreateExecutionPlan) and replayed many times, much like a CUDA graph. Each call
+// is checked as it is captured, against the shapes and types the tensors have then, and throws std::invalid_argument
+// where the backend's own call would. Uploads and readbacks take no host pointer; each is given a slot, and every
+// replay passes one buffer per slot.
+class PlanCapture
+{
+  public:
+    explicit PlanCapture(const TensorBackend &backend) : m_backend(backend)
+    {
+    }
+
+    // Returns the input slot. size is in bytes of host data, as for TensorBackend::SetTensorData.
+    uint32_t SetTensorData(TensorHandle tensor, size_t size);
+    void ElementWise(const ElementWiseDesc &desc, TensorHandle src0, TensorHandle src1, TensorHandle dst);
+    // bias may be null.
+    void Gemm(const GemmDesc &desc, TensorHandle a, TensorHandle b, TensorHandle bias, TensorHandle dst);
+    void Reduce(const ReduceDesc &desc, TensorHandle src, TensorHandle dst);
+    // The graph is copied; its tensors are looked up by name now rather than on every replay.
+    void ExecuteGraph(const TensorGraph &graph);
+    // Returns the output slot.
+    uint32_t GetTensorData(TensorHandle tensor, size_t size);
+
+    const TensorBackend &Backend() const
+    {
+        return m_backend;
+    }
+    const std::vector<PlanStep> &Steps() const
+    {
+        return m_steps;
+    }
+    const std::vector<size_t> &InputSizes() const
+    {
+        return m_inputSizes;
+    }
+    const std::vector<size_t> &OutputSizes() const
+    {
+        return m_outputSizes;
+    }
+
+  private:
+    // Throws unless size bytes of host data fit the tensor.
+    void CheckHostSize(TensorHandle tensor, size_t size, const char *call) const;
+
+    const TensorBackend &m_backend;
+    std::vector<PlanStep> m_steps;
+    std::vector<size_t> m_inputSizes;
+    std::vector<size_t> m_outputSizes;
+};
+
+// A captured sequence compiled by a backend. Every replay copies new host inputs in, runs the same ops on the same
+// tensors and copies the outputs out; the DirectML processor resolves bindings and barriers once and resubmits the
+// command list it recorded. The plan's tensors must outlive it, and it must not outlive its backend. A tensor that
+// is reshaped or moved meanwhile is picked up by the next replay, at the cost of compiling the plan again.
+//
+// A plan replays one call at a time; concurrent replays of one plan wait for each other.
+class ExecutionPlan
+{
+  public:
+    virtual ~ExecutionPlan() = default;
+
+    ExecutionPlan(const ExecutionPlan &) = delete;
+    ExecutionPlan &operator=(const ExecutionPlan &) = delete;
+
+    const std::vector<PlanStep> &Steps() const
+    {
+        return m_steps;
+    }
+    size_t InputCount() const
+    {
+        return m_inputSizes.size();
+    }
+    size_t OutputCount() const
+    {
+        return m_outputSizes.size();
+    }
+
+    // Runs the plan with inputs[i] as the data of input slot i, writing output slot i to outputs[i]. The inputs may
+    // be reused once the call returns. The outputs are written by the time the future is ready and never after, so
+    // they may be freed then. The backends here copy them out before returning a future that is already ready.
+    std::shared_future<void> ReplayAsync(const std::vector<const void *> &inputs, const std::vector<void *> &outputs);
+
+    void Replay(const std::vector<const void *> &inputs, const std::vector<void *> &outputs)
+    {
+        ReplayAsync(inputs, outputs).get();
+    }
+
+  protected:
+    explicit ExecutionPlan(const PlanCapture &capture)
+        : m_steps(capture.Steps()), m_inputSizes(capture.InputSizes()), m_outputSizes(capture.OutputSizes())
+    {
+    }
+
+    // Called with buffers of the right count, none of them null.
+    virtual std::shared_future<void> Run(const std::vector<const void *> &inputs,
+                                         const std::vector<void *> &outputs) = 0;
+
+  private:
+    std::vector<PlanStep> m_steps;
+    std::vector<size_t> m_inputSizes;
+    std::vector<size_t> m_outputSizes;
+};
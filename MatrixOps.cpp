@@ -0,0 +1,159 @@
+#include "MatrixOps.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+std::string GemmDesc::Signature() const
+{
+    std::ostringstream signature;
+    signature << transposeA << ':' << transposeB << ':' << std::hexfloat << alpha << ':' << beta;
+    return signature.str();
+}
+
+TensorShape GemmOutputShape(const GemmDesc &desc, const TensorShape &a, const TensorShape &b)
+{
+    if (a.size() < 2 || a.size() > 4 || a.size() != b.size())
+    {
+        throw std::invalid_argument("GEMM operands must have the same rank, between 2 and 4.");
+    }
+    size_t rank = a.size();
+    if (!std::equal(a.begin(), a.end() - 2, b.begin()))
+    {
+        throw std::invalid_argument("GEMM operands must have the same batch dimensions.");
+    }
+
+    uint32_t rows = desc.transposeA ? a[rank - 1] : a[rank - 2];
+    uint32_t depthA = desc.transposeA ? a[rank - 2] : a[rank - 1];
+    uint32_t depthB = desc.transposeB ? b[rank - 1] : b[rank - 2];
+    uint32_t columns = desc.transposeB ? b[rank - 2] : b[rank - 1];
+    if (depthA != depthB)
+    {
+        throw std::invalid_argument("GEMM operands have different inner dimensions.");
+    }
+
+    TensorShape result(a.begin(), a.end() - 2);
+    result.push_back(rows);
+    result.push_back(columns);
+    return result;
+}
+
+GemmShape PlanGemm(const GemmDesc &desc, const TensorShape &a, const TensorShape &b, const TensorShape &bias,
+                   const TensorShape &dst)
+{
+    TensorShape result = GemmOutputShape(desc, a, b);
+    if (dst != result)
+    {
+        throw std::invalid_argument("GEMM result shape does not match the output tensor.");
+    }
+    if (!bias.empty() && TryBroadcastShapes(bias, dst) != dst)
+    {
+        throw std::invalid_argument("GEMM bias cannot be broadcast to the output shape.");
+    }
+
+    GemmShape shape;
+    shape.batch = ElementCount(TensorShape(dst.begin(), dst.end() - 2));
+    shape.rows = dst[dst.size() - 2];
+    shape.columns = dst.back();
+    shape.depth = desc.transposeA ? a[a.size() - 2] : a.back();
+    return shape;
+}
+
+TensorShape ReduceOutputShape(const ReduceDesc &desc, const TensorShape &shape)
+{
+    if (desc.axis >= shape.size())
+    {
+        throw std::invalid_argument("Reduction axis is out of range.");
+    }
+    TensorShape result = shape;
+    result[desc.axis] = 1;
+    return result;
+}
+
+HostTensor RunGemmOnCpu(const GemmDesc &desc, const HostTensor &a, const HostTensor &b, const HostTensor *bias)
+{
+    if (a.data.size() != ElementCount(a.shape) || b.data.size() != ElementCount(b.shape) ||
+        (bias && bias->data.size() != ElementCount(bias->shape)))
+    {
+        throw std::invalid_argument("HostTensor data does not match its shape.");
+    }
+
+    HostTensor result;
+    result.shape = GemmOutputShape(desc, a.shape, b.shape);
+    result.data.resize(ElementCount(result.shape));
+    GemmShape shape = PlanGemm(desc, a.shape, b.shape, bias ? bias->shape : TensorShape(), result.shape);
+
+    size_t matrix = size_t(shape.rows) * shape.columns;
+    std::vector<uint32_t> biasStrides = bias ? BroadcastStrides(bias->shape, result.shape) : std::vector<uint32_t>();
+    for (uint64_t n = 0; n < shape.batch; ++n)
+    {
+        const float *matrixA = a.data.data() + n * shape.rows * shape.depth;
+        const float *matrixB = b.data.data() + n * shape.depth * shape.columns;
+        for (uint32_t i = 0; i < shape.rows; ++i)
+        {
+            for (uint32_t j = 0; j < shape.columns; ++j)
+            {
+                double sum = 0.0;
+                for (uint32_t k = 0; k < shape.depth; ++k)
+                {
+                    float x = desc.transposeA ? matrixA[size_t(k) * shape.rows + i]
+                                              : matrixA[size_t(i) * shape.depth + k];
+                    float y = desc.transposeB ? matrixB[size_t(j) * shape.depth + k]
+                                              : matrixB[size_t(k) * shape.columns + j];
+                    sum += double(x) * y;
+                }
+                size_t offset = n * matrix + size_t(i) * shape.columns + j;
+                double value = desc.alpha * sum;
+                if (bias)
+                {
+                    // Walk the output index back through the broadcast strides of the bias.
+                    size_t biasOffset = 0;
+                    size_t remainder = offset;
+                    for (size_t d = result.shape.size(); d-- > 0;)
+                    {
+                        biasOffset += (remainder % result.shape[d]) * biasStrides[d];
+                        remainder /= result.shape[d];
+                    }
+                    value += double(desc.beta) * bias->data[biasOffset];
+                }
+                result.data[offset] = static_cast<float>(value);
+            }
+        }
+    }
+    return result;
+}
+
+HostTensor RunReduceOnCpu(const ReduceDesc &desc, const HostTensor &x)
+{
+    if (x.data.size() != ElementCount(x.shape))
+    {
+        throw std::invalid_argument("HostTensor data does not match its shape.");
+    }
+
+    HostTensor result;
+    result.shape = ReduceOutputShape(desc, x.shape);
+    result.data.resize(ElementCount(result.shape));
+
+    size_t reduced = x.shape[desc.axis];
+    size_t inner = static_cast<size_t>(ElementCount(TensorShape(x.shape.begin() + desc.axis + 1, x.shape.end())));
+    for (size_t o = 0; o < result.data.size() / inner; ++o)
+    {
+        for (size_t i = 0; i < inner; ++i)
+        {
+            const float *source = x.data.data() + o * reduced * inner + i;
+            double value = desc.op == ReduceOp::Max ? -std::numeric_limits<double>::infinity() : 0.0;
+            for (size_t r = 0; r < reduced; ++r)
+            {
+                double element = source[r * inner];
+                value = desc.op == ReduceOp::Max ? std::max(value, element) : value + element;
+            }
+            if (desc.op == ReduceOp::Mean)
+            {
+                value /= static_cast<double>(reduced);
+            }
+            result.data[o * inner + i] = static_cast<float>(value);
+        }
+    }
+    return result;
+}
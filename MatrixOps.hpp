@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "BroadcastShape.hpp"
+#include "TensorGraph.hpp"
+
+// Matrix multiplication and axis reductions:
+//
+//     dst = alpha * op(a) op(b) + beta * bias      op(x) = x, or x transposed
+//     dst = reduce(src) along one axis, which is kept with size 1
+//
+// GEMM operands are matrices in their last two dimensions, rank 2 to 4, with leading batch dimensions that must be
+// the same in a, b and dst. The bias is optional and broadcasts to dst, so a {1, N} row adds a bias per column.
+
+struct GemmDesc
+{
+    bool transposeA = false;
+    bool transposeB = false;
+    float alpha = 1.0f;
+    float beta = 1.0f; // Scales the bias; unused without one.
+
+    // Part of the compiled operator cache key. Floats are written exactly, since they are compiled into the operator.
+    std::string Signature() const;
+};
+
+enum class ReduceOp : uint32_t
+{
+    Sum,
+    Mean,
+    Max,
+};
+
+struct ReduceDesc
+{
+    ReduceOp op = ReduceOp::Sum;
+    uint32_t axis = 0;
+
+    std::string Signature() const
+    {
+        return std::to_string(static_cast<uint32_t>(op)) + ':' + std::to_string(axis);
+    }
+};
+
+// One GEMM as batch independent products of a rows x depth and a depth x columns matrix.
+struct GemmShape
+{
+    uint64_t batch = 1;
+    uint32_t rows = 0;
+    uint32_t columns = 0;
+    uint32_t depth = 0;
+
+    uint64_t Flops() const
+    {
+        return 2 * batch * rows * uint64_t(columns) * depth;
+    }
+};
+
+// The shape of dst for operands a and b. Throws std::invalid_argument if they cannot be multiplied.
+TensorShape GemmOutputShape(const GemmDesc &desc, const TensorShape &a, const TensorShape &b);
+
+// Checks every operand against the others; bias is empty when there is none.
+GemmShape PlanGemm(const GemmDesc &desc, const TensorShape &a, const TensorShape &b, const TensorShape &bias,
+                   const TensorShape &dst);
+
+// The shape of dst for a reduction of a tensor of the given shape. Throws std::invalid_argument if the axis is out of
+// range.
+TensorShape ReduceOutputShape(const ReduceDesc &desc, const TensorShape &shape);
+
+// Float32 reference implementations, plain loops in double precision against which the backends are checked. bias
+// may be null.
+HostTensor RunGemmOnCpu(const GemmDesc &desc, const HostTensor &a, const HostTensor &b, const HostTensor *bias);
+HostTensor RunReduceOnCpu(const ReduceDesc &desc, const HostTensor &x);
@@ -0,0 +1,496 @@
+#include "MultiDeviceBackend.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#include "Trace.hpp"
+
+namespace
+{
+uint64_t TensorBytes(const TensorShape &shape, TensorDataType type)
+{
+    return ElementCount(shape) * DataTypeSize(type);
+}
+
+// The axis element-wise outputs are sharded along: the first one that is not 1, so every shard is a contiguous
+// range of the tensor. Returns shape.size() if there is none.
+size_t ShardAxis(const TensorShape &shape)
+{
+    size_t axis = 0;
+    while (axis < shape.size() && shape[axis] == 1)
+    {
+        ++axis;
+    }
+    return axis;
+}
+
+template <typename F> double MinSeconds(int repeats, F &&function)
+{
+    double best = INFINITY;
+    for (int i = 0; i < repeats; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+} // namespace
+
+MultiDeviceBackend::MultiDeviceBackend(const MultiDeviceOptions &options) : m_options(options)
+{
+}
+
+size_t MultiDeviceBackend::AddDevice(std::unique_ptr<TensorBackend> device, const DeviceProfile &profile)
+{
+    if (m_tensors.Size() != 0)
+    {
+        throw std::runtime_error("Devices must be added before any tensor is created.");
+    }
+    m_devices.push_back(std::move(device));
+    m_stats.opsPerDevice.push_back(0);
+    return m_router.AddDevice(profile);
+}
+
+void MultiDeviceBackend::Calibrate(uint64_t probeBytes)
+{
+    if (m_tensors.Size() != 0)
+    {
+        throw std::runtime_error("Calibrate must run before any tensor is created.");
+    }
+
+    // Dispatch cost comes from a tiny op, throughput from a large one and transfer speed from a round trip of the
+    // large tensor. Every probe is warmed up first so operator compilation is not measured.
+    uint32_t smallElements = 256;
+    uint32_t largeElements = static_cast<uint32_t>(std::max<uint64_t>(probeBytes / sizeof(float), smallElements * 2));
+    std::vector<float> data(largeElements, 1.0f);
+
+    for (size_t d = 0; d < m_devices.size(); ++d)
+    {
+        TensorBackend &device = *m_devices[d];
+        auto opSeconds = [&](uint32_t elements) {
+            TensorShape shape = {1, 1, 1, elements};
+            size_t bytes = elements * sizeof(float);
+            std::string suffix = std::to_string(elements);
+            device.SetTensorData("probeA" + suffix, shape, TensorDataType::Float32, data.data(), bytes);
+            device.SetTensorData("probeB" + suffix, shape, TensorDataType::Float32, data.data(), bytes);
+            device.SetTensorData("probeC" + suffix, shape, TensorDataType::Float32, data.data(), bytes);
+            auto run = [&]() {
+                device.Wait(device.ElementWiseAddBcast("probeA" + suffix, "probeB" + suffix, "probeC" + suffix));
+            };
+            run();
+            return MinSeconds(3, run);
+        };
+
+        double smallSeconds = opSeconds(smallElements);
+        double largeSeconds = opSeconds(largeElements);
+        uint64_t largeBytes = uint64_t(largeElements) * sizeof(float);
+        TensorShape largeShape = {1, 1, 1, largeElements};
+        std::string largeName = "probeA" + std::to_string(largeElements);
+        double roundTripSeconds = MinSeconds(2, [&]() {
+            device.SetTensorData(largeName, largeShape, TensorDataType::Float32, data.data(), largeBytes);
+            device.GetTensorData(largeName, largeShape, TensorDataType::Float32, data.data(), largeBytes);
+        });
+        device.FreeResources();
+
+        DeviceProfile &profile = m_router.Profile(d);
+        profile.dispatchSeconds = smallSeconds;
+        profile.computeBytesPerSecond = 3.0 * largeBytes / std::max(largeSeconds - smallSeconds, 1e-9);
+        profile.transferBytesPerSecond = 2.0 * largeBytes / std::max(roundTripSeconds, 1e-9);
+    }
+}
+
+std::string MultiDeviceBackend::Name() const
+{
+    std::string name;
+    for (const auto &device : m_devices)
+    {
+        name += (name.empty() ? "" : " + ") + device->Name();
+    }
+    return name;
+}
+
+std::string MultiDeviceBackend::SliceName(const std::string &name, const Slice &slice)
+{
+    // Slices of anonymous tensors stay anonymous rather than sharing a name.
+    if (slice.whole || name.empty())
+    {
+        return name;
+    }
+    return name + "@" + std::to_string(slice.axis) + ":" + std::to_string(slice.begin) + "-" +
+           std::to_string(slice.end);
+}
+
+std::pair<size_t, size_t> MultiDeviceBackend::SliceRange(const RoutedTensor &tensor, const Slice &slice)
+{
+    if (slice.whole)
+    {
+        return {0, tensor.host.size()};
+    }
+    // Every axis before slice.axis is 1, so the rows are contiguous.
+    uint64_t rowBytes = DataTypeSize(tensor.type);
+    for (size_t i = slice.axis + 1; i < tensor.shape.size(); ++i)
+    {
+        rowBytes *= tensor.shape[i];
+    }
+    return {static_cast<size_t>(slice.begin * rowBytes), static_cast<size_t>((slice.end - slice.begin) * rowBytes)};
+}
+
+uint64_t MultiDeviceBackend::MissingBytes(const RoutedTensor &tensor, size_t device) const
+{
+    Slice whole;
+    whole.device = device;
+    if (std::find(tensor.copies.begin(), tensor.copies.end(), whole) != tensor.copies.end())
+    {
+        return 0;
+    }
+    // Contents that only live on other devices are read back before they are uploaded.
+    return tensor.host.size() * (tensor.hostValid ? 1 : 2);
+}
+
+void MultiDeviceBackend::ReadToHost(RoutedTensor &tensor)
+{
+    if (tensor.hostValid)
+    {
+        return;
+    }
+    TRACE_SPAN("Gather", tensor.name, tensor.host.size());
+
+    // Without a host copy the copies are exactly what the last op wrote: one whole tensor or shards covering it.
+    auto whole = std::find_if(tensor.copies.begin(), tensor.copies.end(), [](const Slice &s) { return s.whole; });
+    std::vector<Slice> sources = whole != tensor.copies.end() ? std::vector<Slice>{*whole} : tensor.copies;
+    for (const Slice &slice : sources)
+    {
+        auto [offset, bytes] = SliceRange(tensor, slice);
+        m_devices[slice.device]->GetTensorData(DeviceTensorFor(tensor, slice), {}, tensor.type,
+                                               tensor.host.data() + offset, bytes);
+        m_stats.transferredBytes += bytes;
+    }
+    tensor.hostValid = true;
+}
+
+TensorHandle MultiDeviceBackend::DeviceTensorFor(RoutedTensor &tensor, const Slice &slice)
+{
+    for (const DeviceTensor &allocated : tensor.allocated)
+    {
+        if (allocated.slice == slice)
+        {
+            return allocated.handle;
+        }
+    }
+
+    TensorShape shape = tensor.shape;
+    if (!slice.whole)
+    {
+        shape[slice.axis] = static_cast<uint32_t>(slice.end - slice.begin);
+    }
+    std::string deviceName = SliceName(tensor.name, slice);
+    TensorBackend &device = *m_devices[slice.device];
+    device.SetStoragePrecision(deviceName, GetStoragePrecision(tensor.name));
+    TensorHandle handle = device.CreateTensor(deviceName, shape, tensor.type);
+    tensor.allocated.push_back({slice, handle});
+    return handle;
+}
+
+TensorHandle MultiDeviceBackend::PrepareInput(RoutedTensor &tensor, const Slice &slice)
+{
+    TensorHandle deviceTensor = DeviceTensorFor(tensor, slice);
+    if (std::find(tensor.copies.begin(), tensor.copies.end(), slice) != tensor.copies.end())
+    {
+        return deviceTensor;
+    }
+
+    ReadToHost(tensor);
+    auto [offset, bytes] = SliceRange(tensor, slice);
+    TRACE_SPAN("Transfer", tensor.name, bytes);
+    m_devices[slice.device]->SetTensorData(deviceTensor, tensor.host.data() + offset, bytes);
+    tensor.copies.push_back(slice);
+    m_stats.transferredBytes += bytes;
+    return deviceTensor;
+}
+
+void MultiDeviceBackend::ReleaseDeviceTensors(RoutedTensor &tensor)
+{
+    for (const DeviceTensor &allocated : tensor.allocated)
+    {
+        m_devices[allocated.slice.device]->ReleaseTensor(allocated.handle);
+    }
+    tensor.allocated.clear();
+    tensor.copies.clear();
+}
+
+TensorHandle MultiDeviceBackend::CreateTensor(const std::string &name, const TensorShape &shape, TensorDataType type)
+{
+    if (m_devices.empty())
+    {
+        throw std::runtime_error("MultiDeviceBackend has no devices.");
+    }
+    ValidateShape(shape);
+
+    // A new tensor's contents are the zeroed host copy until a device writes it.
+    auto create = [&]() {
+        std::vector<uint8_t> host(static_cast<size_t>(TensorBytes(shape, type)));
+        return RoutedTensor{name, shape, type, std::move(host), true, {}, {}};
+    };
+    auto [handle, tensor] = m_tensors.FindOrCreate(name, create);
+    if (tensor->shape != shape || tensor->type != type)
+    {
+        // Device tensors of the old shape cannot be reused.
+        ReleaseDeviceTensors(*tensor);
+        *tensor = create();
+    }
+    return handle;
+}
+
+TensorHandle MultiDeviceBackend::FindTensor(const std::string &name) const
+{
+    return m_tensors.Find(name);
+}
+
+TensorShape MultiDeviceBackend::GetTensorShape(TensorHandle handle) const
+{
+    return m_tensors.Get(handle).shape;
+}
+
+TensorDataType MultiDeviceBackend::GetTensorType(TensorHandle handle) const
+{
+    return m_tensors.Get(handle).type;
+}
+
+void MultiDeviceBackend::ReleaseTensor(TensorHandle handle)
+{
+    if (std::optional<RoutedTensor> tensor = m_tensors.Erase(handle))
+    {
+        ReleaseDeviceTensors(*tensor);
+    }
+}
+
+void MultiDeviceBackend::SetTensorData(TensorHandle handle, const void *data, size_t size)
+{
+    RoutedTensor &tensor = m_tensors.Get(handle);
+    ScopedPhase phase(m_phaseTimes, Phase::Upload);
+    TRACE_SPAN("Upload", tensor.name, size);
+
+    if (size < tensor.host.size())
+    {
+        // Bytes the caller does not overwrite keep their current contents.
+        ReadToHost(tensor);
+    }
+
+    memcpy(tensor.host.data(), data, std::min(size, tensor.host.size()));
+    tensor.hostValid = true;
+    tensor.copies.clear();
+}
+
+void MultiDeviceBackend::GetTensorData(TensorHandle handle, const TensorShape &shape, TensorDataType type, void *data,
+                                       size_t size)
+{
+    RoutedTensor &tensor = m_tensors.Get(handle);
+    if (type != tensor.type)
+    {
+        throw std::invalid_argument("GetTensorData type does not match tensor " + tensor.name + ".");
+    }
+    if (!shape.empty() && shape != tensor.shape)
+    {
+        throw std::invalid_argument("GetTensorData shape does not match tensor " + tensor.name + ".");
+    }
+    if (size > tensor.host.size())
+    {
+        throw std::invalid_argument("GetTensorData size is larger than tensor " + tensor.name + ".");
+    }
+
+    ScopedPhase phase(m_phaseTimes, Phase::HostCopy);
+    TRACE_SPAN("HostCopy", tensor.name, size);
+    ReadToHost(tensor);
+    memcpy(data, tensor.host.data(), size);
+}
+
+SubmissionTicket MultiDeviceBackend::ElementWise(const ElementWiseDesc &desc, TensorHandle src0, TensorHandle src1,
+                                                 TensorHandle dst)
+{
+    RoutedTensor &a = m_tensors.Get(src0);
+    RoutedTensor &b = m_tensors.Get(src1);
+    RoutedTensor &c = m_tensors.Get(dst);
+    if (BroadcastShapes(a.shape, b.shape) != c.shape)
+    {
+        throw std::invalid_argument("Broadcast result shape does not match tensor " + c.name + ".");
+    }
+
+    ScopedPhase phase(m_phaseTimes, Phase::Dispatch);
+    TRACE_SPAN("Dispatch", c.name, c.host.size());
+
+    std::vector<uint64_t> transferBytes(m_devices.size());
+    for (size_t d = 0; d < m_devices.size(); ++d)
+    {
+        transferBytes[d] = MissingBytes(a, d) + MissingBytes(b, d);
+    }
+    size_t axis = ShardAxis(c.shape);
+    uint64_t rowCount = m_options.allowSharding && axis < c.shape.size() ? c.shape[axis] : 1;
+    uint64_t computeBytes = a.host.size() + b.host.size() + c.host.size();
+    Route route = m_router.RouteOp(computeBytes, transferBytes, rowCount, m_options.minShardBytes);
+
+    // Devices that return before finishing get their shards first so the synchronous ones overlap with them.
+    std::stable_sort(route.shards.begin(), route.shards.end(), [this](const RouteShard &x, const RouteShard &y) {
+        return m_devices[x.device]->ExecutesAsynchronously() > m_devices[y.device]->ExecutesAsynchronously();
+    });
+
+    std::vector<Slice> written;
+    for (const RouteShard &shard : route.shards)
+    {
+        Slice output;
+        output.device = shard.device;
+        if (route.shards.size() > 1)
+        {
+            output = Slice{shard.device, false, axis, shard.begin, shard.end};
+        }
+
+        // An operand is sliced along with the output unless it is broadcast along the split axis.
+        auto inputSlice = [&](const RoutedTensor &input) {
+            Slice slice;
+            slice.device = shard.device;
+            size_t offset = c.shape.size() - input.shape.size();
+            if (!output.whole && axis >= offset && input.shape[axis - offset] == c.shape[axis])
+            {
+                slice = Slice{shard.device, false, axis - offset, shard.begin, shard.end};
+            }
+            return slice;
+        };
+        TensorHandle deviceA = PrepareInput(a, inputSlice(a));
+        TensorHandle deviceB = PrepareInput(b, inputSlice(b));
+        TensorHandle deviceC = DeviceTensorFor(c, output);
+
+        m_devices[shard.device]->ElementWise(desc, deviceA, deviceB, deviceC);
+        m_stats.opsPerDevice[shard.device]++;
+        written.push_back(output);
+    }
+    if (written.size() > 1)
+    {
+        m_stats.shardedOps++;
+    }
+
+    c.hostValid = false;
+    c.copies = std::move(written);
+    return {};
+}
+
+SubmissionTicket MultiDeviceBackend::Gemm(const GemmDesc &desc, TensorHandle srcA, TensorHandle srcB,
+                                          TensorHandle srcBias, TensorHandle dst)
+{
+    if (dst == srcA || dst == srcB || dst == srcBias)
+    {
+        throw std::invalid_argument("The GEMM output must not be one of its operands.");
+    }
+    std::vector<RoutedTensor *> inputs = {&m_tensors.Get(srcA), &m_tensors.Get(srcB)};
+    if (srcBias)
+    {
+        inputs.push_back(&m_tensors.Get(srcBias));
+    }
+    RoutedTensor &c = m_tensors.Get(dst);
+    PlanGemm(desc, inputs[0]->shape, inputs[1]->shape, srcBias ? inputs[2]->shape : TensorShape(), c.shape);
+
+    ScopedPhase phase(m_phaseTimes, Phase::Dispatch);
+    TRACE_SPAN("Dispatch", c.name, c.host.size());
+    RunWhole(inputs, {&c}, [&](TensorBackend &device, const std::vector<TensorHandle> &in,
+                               const std::vector<TensorHandle> &out) {
+        device.Gemm(desc, in[0], in[1], srcBias ? in[2] : TensorHandle(), out[0]);
+    });
+    return {};
+}
+
+SubmissionTicket MultiDeviceBackend::Reduce(const ReduceDesc &desc, TensorHandle src, TensorHandle dst)
+{
+    if (dst == src)
+    {
+        throw std::invalid_argument("The reduction output must not be its input.");
+    }
+    RoutedTensor &x = m_tensors.Get(src);
+    RoutedTensor &y = m_tensors.Get(dst);
+    if (ReduceOutputShape(desc, x.shape) != y.shape)
+    {
+        throw std::invalid_argument("Reduction result shape does not match tensor " + y.name + ".");
+    }
+
+    ScopedPhase phase(m_phaseTimes, Phase::Dispatch);
+    TRACE_SPAN("Dispatch", y.name, x.host.size());
+    RunWhole({&x}, {&y}, [&](TensorBackend &device, const std::vector<TensorHandle> &in,
+                             const std::vector<TensorHandle> &out) { device.Reduce(desc, in[0], out[0]); });
+    return {};
+}
+
+SubmissionTicket MultiDeviceBackend::ExecuteGraph(const TensorGraph &graph)
+{
+    if (graph.OutputNodes().empty())
+    {
+        throw std::invalid_argument("TensorGraph has no outputs.");
+    }
+    std::vector<RoutedTensor *> inputs;
+    std::vector<RoutedTensor *> outputs;
+    for (const std::string &name : graph.InputNames())
+    {
+        inputs.push_back(&m_tensors.Get(RequireTensor(name)));
+    }
+    for (const std::string &name : graph.OutputNames())
+    {
+        outputs.push_back(&m_tensors.Get(RequireTensor(name)));
+    }
+
+    ScopedPhase phase(m_phaseTimes, Phase::Dispatch);
+    TRACE_SPAN("Dispatch", graph.OutputNames()[0]);
+
+    // The device finds the tensors by name; whole slices keep the tensor's name.
+    RunWhole(inputs, outputs, [&](TensorBackend &device, const std::vector<TensorHandle> &,
+                                  const std::vector<TensorHandle> &) { device.ExecuteGraph(graph); });
+    return {};
+}
+
+void MultiDeviceBackend::RunWhole(const std::vector<RoutedTensor *> &inputs, const std::vector<RoutedTensor *> &outputs,
+                                  const WholeOpFunction &run)
+{
+    uint64_t computeBytes = 0;
+    std::vector<uint64_t> transferBytes(m_devices.size());
+    for (RoutedTensor *tensor : inputs)
+    {
+        computeBytes += tensor->host.size();
+        for (size_t d = 0; d < m_devices.size(); ++d)
+        {
+            transferBytes[d] += MissingBytes(*tensor, d);
+        }
+    }
+    for (RoutedTensor *tensor : outputs)
+    {
+        computeBytes += tensor->host.size();
+    }
+    size_t device = m_router.RouteOp(computeBytes, transferBytes).shards[0].device;
+
+    Slice whole;
+    whole.device = device;
+    std::vector<TensorHandle> inputHandles;
+    std::vector<TensorHandle> outputHandles;
+    for (RoutedTensor *tensor : inputs)
+    {
+        inputHandles.push_back(PrepareInput(*tensor, whole));
+    }
+    for (RoutedTensor *tensor : outputs)
+    {
+        outputHandles.push_back(DeviceTensorFor(*tensor, whole));
+    }
+    run(*m_devices[device], inputHandles, outputHandles);
+    m_stats.opsPerDevice[device]++;
+
+    for (RoutedTensor *tensor : outputs)
+    {
+        tensor->hostValid = false;
+        tensor->copies = {whole};
+    }
+}
+
+void MultiDeviceBackend::FreeResources()
+{
+    for (auto &device : m_devices)
+    {
+        device->FreeResources();
+    }
+    m_tensors.Clear();
+}
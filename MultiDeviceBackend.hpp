@@ -0,0 +1,153 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "DeviceRouter.hpp"
+#include "TensorBackend.hpp"
+#include "TensorTable.hpp"
+
+struct MultiDeviceOptions
+{
+    // Element-wise ops may be split along their outermost non-unit axis across devices.
+    bool allowSharding = true;
+
+    // Smallest share of an op's bytes worth a shard of its own.
+    uint64_t minShardBytes = 1 << 20;
+};
+
+struct MultiDeviceStats
+{
+    std::vector<uint64_t> opsPerDevice; // Sharded ops count once on every device they ran on.
+    uint64_t shardedOps = 0;
+    uint64_t transferredBytes = 0; // Uploads to and readbacks from devices.
+};
+
+// Runs ops on several backends at once, for example an NPU, a GPU and the CPU. Each op is placed by a DeviceRouter
+// from the bytes it touches, the operands that would have to move, and each device's profile; large element-wise ops
+// can be sharded across devices. The authoritative copy of a tensor is either the host copy kept here or the device
+// copies the last op wrote, and operands move between devices through the host only when an op needs them.
+//
+// Ops return empty tickets; GetTensorData waits for the devices that hold the tensor.
+class MultiDeviceBackend : public TensorBackend
+{
+  public:
+    explicit MultiDeviceBackend(const MultiDeviceOptions &options = {});
+
+    using TensorBackend::ElementWise;
+    using TensorBackend::Gemm;
+    using TensorBackend::GetTensorData;
+    using TensorBackend::Reduce;
+    using TensorBackend::SetTensorData;
+
+    // Devices must be added before any tensor is created.
+    size_t AddDevice(std::unique_ptr<TensorBackend> device, const DeviceProfile &profile = {});
+    size_t DeviceCount() const
+    {
+        return m_devices.size();
+    }
+    TensorBackend &GetDevice(size_t device)
+    {
+        return *m_devices.at(device);
+    }
+    DeviceRouter &GetRouter()
+    {
+        return m_router;
+    }
+
+    // Replaces every device profile with one measured by running probe ops of up to probeBytes per tensor. Must run
+    // before any tensor is created; the devices' resources are freed afterwards.
+    void Calibrate(uint64_t probeBytes = 16 << 20);
+
+    const MultiDeviceStats &GetStats() const
+    {
+        return m_stats;
+    }
+
+    std::string Name() const override;
+
+    TensorHandle CreateTensor(const std::string &name, const TensorShape &shape, TensorDataType type) override;
+    TensorHandle FindTensor(const std::string &name) const override;
+    TensorShape GetTensorShape(TensorHandle tensor) const override;
+    TensorDataType GetTensorType(TensorHandle tensor) const override;
+    void ReleaseTensor(TensorHandle tensor) override;
+
+    void SetTensorData(TensorHandle tensor, const void *data, size_t size) override;
+    void GetTensorData(TensorHandle tensor, const TensorShape &shape, TensorDataType type, void *data,
+                       size_t size) override;
+
+    SubmissionTicket ElementWise(const ElementWiseDesc &desc, TensorHandle src0, TensorHandle src1,
+                                 TensorHandle dst) override;
+    SubmissionTicket Gemm(const GemmDesc &desc, TensorHandle a, TensorHandle b, TensorHandle bias,
+                          TensorHandle dst) override;
+    SubmissionTicket Reduce(const ReduceDesc &desc, TensorHandle src, TensorHandle dst) override;
+    SubmissionTicket ExecuteGraph(const TensorGraph &graph) override;
+
+    void FreeResources() override;
+
+  private:
+    // A copy of a tensor, or of rows [begin, end) along axis, held by one device.
+    struct Slice
+    {
+        size_t device = 0;
+        bool whole = true;
+        size_t axis = 0;
+        uint64_t begin = 0;
+        uint64_t end = 0;
+
+        bool operator==(const Slice &other) const
+        {
+            return device == other.device && whole == other.whole &&
+                   (whole || (axis == other.axis && begin == other.begin && end == other.end));
+        }
+    };
+
+    struct DeviceTensor
+    {
+        Slice slice;
+        TensorHandle handle;
+    };
+
+    struct RoutedTensor
+    {
+        std::string name;
+        TensorShape shape;
+        TensorDataType type = TensorDataType::Unknown;
+        std::vector<uint8_t> host;
+        bool hostValid = true;
+        std::vector<Slice> copies;           // Device copies that hold the current contents.
+        std::vector<DeviceTensor> allocated; // Device tensors created so far, current or not.
+    };
+
+    // Device tensors are named after the tensor and the slice, so per-name storage precision carries over.
+    static std::string SliceName(const std::string &name, const Slice &slice);
+    // Byte offset and size of a slice within the host copy.
+    static std::pair<size_t, size_t> SliceRange(const RoutedTensor &tensor, const Slice &slice);
+
+    // Bytes that would have to move before an op could read the whole tensor on device.
+    uint64_t MissingBytes(const RoutedTensor &tensor, size_t device) const;
+
+    void ReadToHost(RoutedTensor &tensor);
+    // The device tensor holding slice, created on first use.
+    TensorHandle DeviceTensorFor(RoutedTensor &tensor, const Slice &slice);
+    // Makes slice current on its device and returns the device tensor.
+    TensorHandle PrepareInput(RoutedTensor &tensor, const Slice &slice);
+    void ReleaseDeviceTensors(RoutedTensor &tensor);
+
+    using WholeOpFunction = std::function<void(TensorBackend &device, const std::vector<TensorHandle> &inputs,
+                                                const std::vector<TensorHandle> &outputs)>;
+    // Runs an op that is not sharded, such as a graph, a GEMM or a reduction, on the device the router picks for the
+    // bytes it touches. run gets the device and the device tensors holding the whole inputs, made current, and the
+    // whole outputs, which then hold the only current copies.
+    void RunWhole(const std::vector<RoutedTensor *> &inputs, const std::vector<RoutedTensor *> &outputs,
+                  const WholeOpFunction &run);
+
+    MultiDeviceOptions m_options;
+    DeviceRouter m_router;
+    std::vector<std::unique_ptr<TensorBackend>> m_devices;
+    TensorTable<RoutedTensor> m_tensors;
+    MultiDeviceStats m_stats;
+};
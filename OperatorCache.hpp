@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// The cache itself does not depend on D3D12 or DirectML so that the bookkeeping can be exercised against a fake
+// device. Data types and execution flags are stored as their underlying integer values.
+
+enum class OperatorKind : uint32_t
+{
+    ElementWise,
+    Graph,
+    Gemm,
+    Reduce,
+};
+
+struct OperatorKey
+{
+    OperatorKind kind = OperatorKind::ElementWise;
+    std::vector<std::vector<uint32_t>> inputDimensions;
+    std::vector<std::vector<uint32_t>> outputDimensions;
+    uint32_t dataType = 0;       // DML_TENSOR_DATA_TYPE
+    uint32_t executionFlags = 0; // DML_EXECUTION_FLAGS
+    std::string signature;       // Graph structure, fused element-wise variant, or GEMM or reduction description.
+
+    bool operator==(const OperatorKey &other) const
+    {
+        return kind == other.kind && dataType == other.dataType && executionFlags == other.executionFlags &&
+               inputDimensions == other.inputDimensions && outputDimensions == other.outputDimensions &&
+               signature == other.signature;
+    }
+    bool operator!=(const OperatorKey &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+struct OperatorKeyHash
+{
+    size_t operator()(const OperatorKey &key) const noexcept
+    {
+        size_t seed = std::hash<uint32_t>()(static_cast<uint32_t>(key.kind));
+        auto combine = [&seed](uint32_t value) {
+            seed ^= std::hash<uint32_t>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        };
+
+        combine(key.dataType);
+        combine(key.executionFlags);
+        for (const auto *tensors : {&key.inputDimensions, &key.outputDimensions})
+        {
+            combine(static_cast<uint32_t>(tensors->size()));
+            for (const auto &dimensions : *tensors)
+            {
+                combine(static_cast<uint32_t>(dimensions.size()));
+                for (uint32_t size : dimensions)
+                {
+                    combine(size);
+                }
+            }
+        }
+        seed ^= std::hash<std::string>()(key.signature) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+        return seed;
+    }
+};
+
+struct OperatorCacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t size = 0;
+    size_t capacity = 0;
+};
+
+// LRU cache of compiled and initialized operators. Entries are handed out as shared pointers so that work which is
+// still in flight can keep an evicted operator alive until it retires.
+template <typename Entry> class OperatorCache
+{
+  public:
+    using EntryPtr = std::shared_ptr<Entry>;
+
+    explicit OperatorCache(size_t capacity = 64) : m_capacity(capacity)
+    {
+    }
+
+    // Returns the cached entry for key, or creates it with factory() on a miss. factory must return something
+    // convertible to EntryPtr. If factory throws, the cache is left unchanged.
+    template <typename Factory> EntryPtr GetOrCreate(const OperatorKey &key, Factory &&factory)
+    {
+        auto it = m_index.find(key);
+        if (it != m_index.end())
+        {
+            ++m_hits;
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return it->second->second;
+        }
+
+        ++m_misses;
+        EntryPtr entry = factory();
+        m_lru.emplace_front(key, entry);
+        m_index.emplace(key, m_lru.begin());
+        EvictToCapacity();
+        return entry;
+    }
+
+    // Looks up key without creating it. Counts as a hit or miss.
+    EntryPtr Find(const OperatorKey &key)
+    {
+        auto it = m_index.find(key);
+        if (it == m_index.end())
+        {
+            ++m_misses;
+            return nullptr;
+        }
+        ++m_hits;
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return it->second->second;
+    }
+
+    // Adds entry as the most recently used, replacing any entry for key, for callers that create entries without
+    // holding on to the cache meanwhile. Does not count as a hit or miss.
+    void Insert(const OperatorKey &key, EntryPtr entry)
+    {
+        auto it = m_index.find(key);
+        if (it != m_index.end())
+        {
+            it->second->second = std::move(entry);
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            return;
+        }
+        m_lru.emplace_front(key, std::move(entry));
+        m_index.emplace(key, m_lru.begin());
+        EvictToCapacity();
+    }
+
+    bool Contains(const OperatorKey &key) const
+    {
+        return m_index.find(key) != m_index.end();
+    }
+
+    void SetCapacity(size_t capacity)
+    {
+        m_capacity = capacity;
+        EvictToCapacity();
+    }
+
+    void Clear()
+    {
+        m_index.clear();
+        m_lru.clear();
+    }
+
+    void ResetStats()
+    {
+        m_hits = m_misses = m_evictions = 0;
+    }
+
+    OperatorCacheStats GetStats() const
+    {
+        return {m_hits, m_misses, m_evictions, m_lru.size(), m_capacity};
+    }
+
+  private:
+    void EvictToCapacity()
+    {
+        while (m_lru.size() > m_capacity)
+        {
+            m_index.erase(m_lru.back().first);
+            m_lru.pop_back();
+            ++m_evictions;
+        }
+    }
+
+    using LruList = std::list<std::pair<OperatorKey, EntryPtr>>;
+
+    size_t m_capacity;
+    LruList m_lru;
+    std::unordered_map<OperatorKey, typename LruList::iterator, OperatorKeyHash> m_index;
+
+    uint64_t m_hits = 0;
+    uint64_t m_misses = 0;
+    uint64_t m_evictions = 0;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Wall time a backend has spent in each phase of its work, accumulated since the last reset. Callers that want a
+// per-call breakdown take the difference of two snapshots.
+enum class Phase : uint32_t
+{
+    Compile,    // Building and compiling operators.
+    Initialize, // Initializing compiled operators and their resources.
+    Upload,     // Moving caller data into tensors.
+    Dispatch,   // Recording and running ops, including waits on their completion.
+    Readback,   // Copying tensors to host-visible memory and waiting for the copy.
+    HostCopy,   // Copying host-visible memory into the caller's buffer.
+};
+
+constexpr size_t c_phaseCount = 6;
+
+inline const char *PhaseName(Phase phase)
+{
+    switch (phase)
+    {
+    case Phase::Compile:
+        return "compile";
+    case Phase::Initialize:
+        return "initialize";
+    case Phase::Upload:
+        return "upload";
+    case Phase::Dispatch:
+        return "dispatch";
+    case Phase::Readback:
+        return "readback";
+    case Phase::HostCopy:
+        return "host_copy";
+    }
+    return "unknown";
+}
+
+struct PhaseTimes
+{
+    double seconds[c_phaseCount] = {};
+
+    double &operator[](Phase phase)
+    {
+        return seconds[static_cast<size_t>(phase)];
+    }
+    double operator[](Phase phase) const
+    {
+        return seconds[static_cast<size_t>(phase)];
+    }
+
+    PhaseTimes operator-(const PhaseTimes &other) const
+    {
+        PhaseTimes difference;
+        for (size_t i = 0; i < c_phaseCount; ++i)
+        {
+            difference.seconds[i] = seconds[i] - other.seconds[i];
+        }
+        return difference;
+    }
+};
+
+// Running totals behind PhaseTimes that any number of threads can add to at once. Times are kept as integer
+// nanoseconds so they can be added atomically.
+class PhaseAccumulator
+{
+  public:
+    void Add(Phase phase, std::chrono::steady_clock::duration duration)
+    {
+        m_nanoseconds[static_cast<size_t>(phase)].fetch_add(
+            static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()),
+            std::memory_order_relaxed);
+    }
+
+    PhaseTimes Snapshot() const
+    {
+        PhaseTimes times;
+        for (size_t i = 0; i < c_phaseCount; ++i)
+        {
+            times.seconds[i] = static_cast<double>(m_nanoseconds[i].load(std::memory_order_relaxed)) * 1e-9;
+        }
+        return times;
+    }
+
+    void Reset()
+    {
+        for (auto &nanoseconds : m_nanoseconds)
+        {
+            nanoseconds.store(0, std::memory_order_relaxed);
+        }
+    }
+
+  private:
+    std::atomic<uint64_t> m_nanoseconds[c_phaseCount] = {};
+};
+
+// Adds the lifetime of the object to one phase. Scopes on one thread must not be nested, or the inner time is counted
+// twice; scopes on different threads each add their own time.
+class ScopedPhase
+{
+  public:
+    ScopedPhase(PhaseAccumulator &times, Phase phase)
+        : m_times(times), m_phase(phase), m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ScopedPhase()
+    {
+        m_times.Add(m_phase, std::chrono::steady_clock::now() - m_start);
+    }
+
+    ScopedPhase(const ScopedPhase &) = delete;
+    ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+  private:
+    PhaseAccumulator &m_times;
+    Phase m_phase;
+    std::chrono::steady_clock::time_point m_start;
+};
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Size-bucketed pool of readback buffers. Buffers are created through a factory, so the pool can be backed by
+// persistently mapped D3D12 READBACK resources or by plain host memory.
+template <typename Buffer> class ReadbackPool
+{
+  public:
+    using Factory = std::function<Buffer(uint64_t capacity)>;
+
+    struct Entry
+    {
+        Buffer buffer;
+        uint64_t capacity = 0;
+    };
+
+    struct Stats
+    {
+        uint64_t allocations = 0;
+        uint64_t reuses = 0;
+        uint64_t trims = 0;
+        uint64_t cachedBytes = 0;
+    };
+
+    explicit ReadbackPool(Factory factory = {}, uint64_t minBucketSize = 64 * 1024,
+                          uint64_t maxCachedBytes = 256ull << 20)
+        : m_factory(std::move(factory)), m_minBucketSize(minBucketSize), m_maxCachedBytes(maxCachedBytes)
+    {
+    }
+
+    // Buckets are powers of two no smaller than the minimum bucket size.
+    uint64_t BucketSize(uint64_t size) const
+    {
+        uint64_t bucket = m_minBucketSize;
+        while (bucket < size)
+        {
+            bucket <<= 1;
+        }
+        return bucket;
+    }
+
+    Entry Acquire(uint64_t size)
+    {
+        uint64_t bucket = BucketSize(size);
+        auto it = m_free.find(bucket);
+        if (it != m_free.end() && !it->second.empty())
+        {
+            Entry entry = std::move(it->second.back());
+            it->second.pop_back();
+            m_stats.cachedBytes -= bucket;
+            ++m_stats.reuses;
+            return entry;
+        }
+
+        ++m_stats.allocations;
+        return {m_factory(bucket), bucket};
+    }
+
+    // Returns a buffer to its bucket. If that would exceed the cache limit, buffers from the largest buckets are
+    // dropped first.
+    void Release(Entry entry)
+    {
+        m_stats.cachedBytes += entry.capacity;
+        m_free[entry.capacity].push_back(std::move(entry));
+
+        while (m_stats.cachedBytes > m_maxCachedBytes && !m_free.empty())
+        {
+            auto largest = std::prev(m_free.end());
+            if (largest->second.empty())
+            {
+                m_free.erase(largest);
+                continue;
+            }
+            m_stats.cachedBytes -= largest->first;
+            largest->second.pop_back();
+            ++m_stats.trims;
+        }
+    }
+
+    void Clear()
+    {
+        m_free.clear();
+        m_stats.cachedBytes = 0;
+    }
+
+    Stats GetStats() const
+    {
+        return m_stats;
+    }
+
+  private:
+    Factory m_factory;
+    uint64_t m_minBucketSize;
+    uint64_t m_maxCachedBytes;
+    std::map<uint64_t, std::vector<Entry>> m_free;
+    Stats m_stats;
+};
+
+// Returns a pooled buffer when it goes out of scope. Move-only.
+class ReadbackLease
+{
+  public:
+    ReadbackLease() = default;
+    explicit ReadbackLease(std::function<void()> release) : m_release(std::move(release))
+    {
+    }
+    ReadbackLease(ReadbackLease &&other) noexcept : m_release(std::move(other.m_release))
+    {
+        other.m_release = nullptr;
+    }
+    ReadbackLease &operator=(ReadbackLease &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            m_release = std::move(other.m_release);
+            other.m_release = nullptr;
+        }
+        return *this;
+    }
+    ReadbackLease(const ReadbackLease &) = delete;
+    ReadbackLease &operator=(const ReadbackLease &) = delete;
+
+    ~ReadbackLease()
+    {
+        Reset();
+    }
+
+    void Reset()
+    {
+        if (m_release)
+        {
+            auto release = std::move(m_release);
+            m_release = nullptr;
+            release();
+        }
+    }
+
+  private:
+    std::function<void()> m_release;
+};
+
+template <typename T> struct ReadOnlySpan
+{
+    const T *data = nullptr;
+    size_t size = 0;
+
+    const T *begin() const
+    {
+        return data;
+    }
+    const T *end() const
+    {
+        return data + size;
+    }
+    const T &operator[](size_t index) const
+    {
+        return data[index];
+    }
+};
+
+// Read-only view of a tensor's contents directly over mapped readback memory. The memory stays valid for as long as
+// the view (and its lease) is alive.
+class TensorView
+{
+  public:
+    TensorView() = default;
+    TensorView(const void *data, size_t sizeInBytes, ReadbackLease lease)
+        : m_data(data), m_sizeInBytes(sizeInBytes), m_lease(std::move(lease))
+    {
+    }
+
+    const void *Data() const
+    {
+        return m_data;
+    }
+
+    size_t SizeInBytes() const
+    {
+        return m_sizeInBytes;
+    }
+
+    template <typename T> ReadOnlySpan<T> As() const
+    {
+        return {static_cast<const T *>(m_data), m_sizeInBytes / sizeof(T)};
+    }
+
+    // Ends the lease early; the view is empty afterwards.
+    void Release()
+    {
+        m_lease.Reset();
+        m_data = nullptr;
+        m_sizeInBytes = 0;
+    }
+
+  private:
+    const void *m_data = nullptr;
+    size_t m_sizeInBytes = 0;
+    ReadbackLease m_lease;
+};
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "TensorTable.hpp"
+
+struct ResidencyStats
+{
+    uint64_t budget = 0;
+    uint64_t residentBytes = 0;
+    uint64_t evictedBytes = 0; // Held outside the device now.
+    size_t residentCount = 0;
+    size_t evictedCount = 0;
+
+    // Totals since the manager was created.
+    uint64_t evictions = 0;
+    uint64_t evictionBytes = 0;
+    uint64_t pageIns = 0;
+    uint64_t pageInBytes = 0;
+    uint64_t discards = 0; // Evicted tensors reallocated without their contents, because they were overwritten.
+};
+
+// Decides which tensors stay in device memory. It tracks the bytes of storage each tensor holds and the fence value
+// of the last submission that used it, and when resident tensors would exceed the budget picks the least recently
+// used ones that no call is using to evict. Moving contents out and back in is left to the owner, so the policy can be
+// driven by a simulated device and budget.
+//
+// A call pins its tensors for as long as it records or runs, pages in those that were evicted, and unpins them with
+// the fence value of the submission that used them. Backends that execute synchronously use fence value 0.
+//
+// Like the other bookkeeping classes this does not depend on D3D12 and is not synchronized; an owner called from
+// several threads guards it with a lock.
+class ResidencyManager
+{
+  public:
+    static constexpr uint64_t c_unlimited = std::numeric_limits<uint64_t>::max();
+
+    // Tensors to evict, least recently used first, and the fence value of the last submission that used any of them.
+    // They are idle once the fence has reached it.
+    struct EvictionPlan
+    {
+        std::vector<TensorHandle> victims;
+        uint64_t bytes = 0;
+        uint64_t fenceValue = 0;
+    };
+
+    explicit ResidencyManager(uint64_t budget = c_unlimited) : m_budget(budget)
+    {
+    }
+
+    void SetBudget(uint64_t budget)
+    {
+        m_budget = budget;
+    }
+    uint64_t Budget() const
+    {
+        return m_budget;
+    }
+
+    // Starts tracking a tensor whose storage of bytes was just allocated, as the most recently used.
+    void Add(TensorHandle tensor, uint64_t bytes)
+    {
+        auto [it, added] = m_entries.try_emplace(tensor);
+        if (!added)
+        {
+            throw std::logic_error("Tensor is already tracked for residency.");
+        }
+        it->second.bytes = bytes;
+        it->second.position = m_lru.insert(m_lru.begin(), tensor);
+        m_residentBytes += bytes;
+    }
+
+    // The tensor's storage was allocated again with bytes, resident, after a reshape. An evicted copy of its old
+    // contents is no longer needed.
+    void Resize(TensorHandle tensor, uint64_t bytes)
+    {
+        Entry &entry = Require(tensor);
+        if (!entry.resident)
+        {
+            MarkResident(tensor, false);
+        }
+        m_residentBytes = m_residentBytes - entry.bytes + bytes;
+        entry.bytes = bytes;
+    }
+
+    void Remove(TensorHandle tensor)
+    {
+        auto it = m_entries.find(tensor);
+        if (it == m_entries.end())
+        {
+            return;
+        }
+        if (it->second.resident)
+        {
+            m_lru.erase(it->second.position);
+            m_residentBytes -= it->second.bytes;
+        }
+        else
+        {
+            m_evictedBytes -= it->second.bytes;
+            --m_evictedCount;
+        }
+        m_entries.erase(it);
+    }
+
+    void Clear()
+    {
+        m_entries.clear();
+        m_lru.clear();
+        m_residentBytes = 0;
+        m_evictedBytes = 0;
+        m_evictedCount = 0;
+    }
+
+    bool Contains(TensorHandle tensor) const
+    {
+        return m_entries.find(tensor) != m_entries.end();
+    }
+
+    bool IsResident(TensorHandle tensor) const
+    {
+        auto it = m_entries.find(tensor);
+        return it != m_entries.end() && it->second.resident;
+    }
+
+    uint64_t Bytes(TensorHandle tensor) const
+    {
+        auto it = m_entries.find(tensor);
+        return it == m_entries.end() ? 0 : it->second.bytes;
+    }
+
+    // Keeps tensors from being evicted until they are unpinned, and makes the resident ones the most recently used.
+    // Returns those of them that are evicted, once each, for the caller to page in before using them. A tensor may be
+    // pinned by several calls, or several times by one; untracked handles are ignored.
+    std::vector<TensorHandle> Pin(const std::vector<TensorHandle> &tensors)
+    {
+        std::vector<TensorHandle> evicted;
+        for (TensorHandle tensor : tensors)
+        {
+            auto it = m_entries.find(tensor);
+            if (it == m_entries.end())
+            {
+                continue;
+            }
+            Entry &entry = it->second;
+            ++entry.pins;
+            if (entry.resident)
+            {
+                m_lru.splice(m_lru.begin(), m_lru, entry.position);
+            }
+            else if (std::find(evicted.begin(), evicted.end(), tensor) == evicted.end())
+            {
+                evicted.push_back(tensor);
+            }
+        }
+        return evicted;
+    }
+
+    // Releases pins taken by Pin, recording fenceValue as the tensors' last use.
+    void Unpin(const std::vector<TensorHandle> &tensors, uint64_t fenceValue)
+    {
+        for (TensorHandle tensor : tensors)
+        {
+            auto it = m_entries.find(tensor);
+            if (it == m_entries.end() || it->second.pins == 0)
+            {
+                continue;
+            }
+            --it->second.pins;
+            it->second.lastUseFenceValue = std::max(it->second.lastUseFenceValue, fenceValue);
+        }
+    }
+
+    // The tensors to evict so that incoming more bytes fit within the budget. Pinned tensors are never chosen, nor ones
+    // that hold no storage, so when the pinned tensors alone exceed the budget the plan frees less than needed and the
+    // caller runs over it.
+    EvictionPlan PlanEviction(uint64_t incoming) const
+    {
+        EvictionPlan plan;
+        uint64_t required = m_residentBytes + incoming;
+        if (required <= m_budget)
+        {
+            return plan;
+        }
+        uint64_t excess = required - m_budget;
+        for (auto it = m_lru.rbegin(); it != m_lru.rend() && plan.bytes < excess; ++it)
+        {
+            const Entry &entry = m_entries.at(*it);
+            if (entry.pins != 0 || entry.bytes == 0)
+            {
+                continue;
+            }
+            plan.victims.push_back(*it);
+            plan.bytes += entry.bytes;
+            plan.fenceValue = std::max(plan.fenceValue, entry.lastUseFenceValue);
+        }
+        return plan;
+    }
+
+    // The owner has moved the tensor's contents out of device memory and freed its storage.
+    void MarkEvicted(TensorHandle tensor)
+    {
+        Entry &entry = Require(tensor);
+        if (!entry.resident)
+        {
+            return;
+        }
+        if (entry.pins != 0)
+        {
+            throw std::logic_error("A pinned tensor cannot be evicted.");
+        }
+        m_lru.erase(entry.position);
+        entry.resident = false;
+        m_residentBytes -= entry.bytes;
+        m_evictedBytes += entry.bytes;
+        ++m_evictedCount;
+        ++m_evictions;
+        m_evictionBytes += entry.bytes;
+    }
+
+    // The owner has allocated the tensor's storage again, and restored its contents unless it is about to be
+    // overwritten whole.
+    void MarkResident(TensorHandle tensor, bool restored)
+    {
+        Entry &entry = Require(tensor);
+        if (entry.resident)
+        {
+            return;
+        }
+        entry.resident = true;
+        entry.position = m_lru.insert(m_lru.begin(), tensor);
+        m_evictedBytes -= entry.bytes;
+        --m_evictedCount;
+        m_residentBytes += entry.bytes;
+        if (restored)
+        {
+            ++m_pageIns;
+            m_pageInBytes += entry.bytes;
+        }
+        else
+        {
+            ++m_discards;
+        }
+    }
+
+    ResidencyStats GetStats() const
+    {
+        ResidencyStats stats;
+        stats.budget = m_budget;
+        stats.residentBytes = m_residentBytes;
+        stats.evictedBytes = m_evictedBytes;
+        stats.residentCount = m_lru.size();
+        stats.evictedCount = m_evictedCount;
+        stats.evictions = m_evictions;
+        stats.evictionBytes = m_evictionBytes;
+        stats.pageIns = m_pageIns;
+        stats.pageInBytes = m_pageInBytes;
+        stats.discards = m_discards;
+        return stats;
+    }
+
+  private:
+    struct Entry
+    {
+        uint64_t bytes = 0;
+        uint64_t lastUseFenceValue = 0;
+        uint32_t pins = 0;
+        bool resident = true;
+        std::list<TensorHandle>::iterator position; // In m_lru while resident.
+    };
+
+    Entry &Require(TensorHandle tensor)
+    {
+        auto it = m_entries.find(tensor);
+        if (it == m_entries.end())
+        {
+            throw std::logic_error("Tensor is not tracked for residency.");
+        }
+        return it->second;
+    }
+
+    uint64_t m_budget;
+    std::list<TensorHandle> m_lru; // Resident tensors, most recently used first.
+    std::unordered_map<TensorHandle, Entry> m_entries;
+    uint64_t m_residentBytes = 0;
+    uint64_t m_evictedBytes = 0;
+    size_t m_evictedCount = 0;
+
+    uint64_t m_evictions = 0;
+    uint64_t m_evictionBytes = 0;
+    uint64_t m_pageIns = 0;
+    uint64_t m_pageInBytes = 0;
+    uint64_t m_discards = 0;
+};
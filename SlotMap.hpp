@@ -0,0 +1,202 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Index of a slot plus the generation the slot had when the handle was made. Erasing a slot bumps its generation, so
+// handles to erased objects are detected instead of aliasing whatever reuses the slot. Generation 0 is never used,
+// which makes a value-initialized handle null.
+struct SlotHandle
+{
+    uint32_t index = 0;
+    uint32_t generation = 0;
+
+    explicit operator bool() const
+    {
+        return generation != 0;
+    }
+    bool operator==(const SlotHandle &other) const
+    {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const SlotHandle &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+namespace std
+{
+template <> struct hash<SlotHandle>
+{
+    size_t operator()(const SlotHandle &handle) const
+    {
+        return hash<uint64_t>()(uint64_t(handle.generation) << 32 | handle.index);
+    }
+};
+} // namespace std
+
+// Objects addressed by generational handles. Lookup is an index and a generation compare, with no hashing. Slots are
+// allocated in chunks that never move, so an object stays at the same address until it is erased, and freed slots
+// are reused most recently freed first.
+//
+// Emplace, Erase, Clear and ForEach must be serialized by the caller, but Get may run on other threads at the same
+// time: chunks and generations are published atomically, so a lookup never needs the caller's lock. Looking up an
+// object while it is being erased is the caller's race to avoid.
+template <typename T> class SlotMap
+{
+  public:
+    SlotMap() : m_chunks(new std::atomic<Chunk *>[c_maxChunks])
+    {
+        for (size_t i = 0; i < c_maxChunks; ++i)
+        {
+            m_chunks[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+    ~SlotMap()
+    {
+        Clear();
+        for (size_t i = 0; i < c_maxChunks; ++i)
+        {
+            delete m_chunks[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    SlotMap(const SlotMap &) = delete;
+    SlotMap &operator=(const SlotMap &) = delete;
+
+    template <typename... Args> SlotHandle Emplace(Args &&...args)
+    {
+        uint32_t index;
+        bool newSlot = m_free.empty();
+        if (!newSlot)
+        {
+            index = m_free.back();
+        }
+        else
+        {
+            index = m_slotCount.load(std::memory_order_relaxed);
+            if (index == c_maxChunks * c_chunkSize)
+            {
+                throw std::length_error("SlotMap is full.");
+            }
+            if (index % c_chunkSize == 0)
+            {
+                m_chunks[index / c_chunkSize].store(new Chunk, std::memory_order_release);
+            }
+        }
+
+        Slot &slot = SlotAt(index);
+        slot.value.emplace(std::forward<Args>(args)...);
+        if (newSlot)
+        {
+            m_slotCount.store(index + 1, std::memory_order_release);
+        }
+        else
+        {
+            m_free.pop_back();
+        }
+        ++m_size;
+        return {index, slot.generation.load(std::memory_order_relaxed)};
+    }
+
+    // Null if handle is null or its object has been erased.
+    T *Get(SlotHandle handle) const
+    {
+        if (handle.index >= m_slotCount.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        Slot &slot = SlotAt(handle.index);
+        // Generations of free slots never match a handle that was handed out, so a match means the slot is live.
+        return slot.generation.load(std::memory_order_acquire) == handle.generation ? &*slot.value : nullptr;
+    }
+
+    // Moves the object out and invalidates every handle to it.
+    std::optional<T> Erase(SlotHandle handle)
+    {
+        T *value = Get(handle);
+        if (!value)
+        {
+            return std::nullopt;
+        }
+        std::optional<T> erased(std::move(*value));
+        Free(handle.index);
+        m_free.push_back(handle.index);
+        --m_size;
+        return erased;
+    }
+
+    // Calls function(handle, object) for every object in slot order.
+    template <typename Function> void ForEach(Function &&function) const
+    {
+        uint32_t slotCount = m_slotCount.load(std::memory_order_relaxed);
+        for (uint32_t i = 0; i < slotCount; ++i)
+        {
+            Slot &slot = SlotAt(i);
+            if (slot.value)
+            {
+                function(SlotHandle{i, slot.generation.load(std::memory_order_relaxed)}, *slot.value);
+            }
+        }
+    }
+
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+    // Erases every object but keeps the chunks. Generations keep counting, so handles from before stay invalid.
+    void Clear()
+    {
+        m_free.clear();
+        for (uint32_t i = m_slotCount.load(std::memory_order_relaxed); i-- > 0;)
+        {
+            if (SlotAt(i).value)
+            {
+                Free(i);
+            }
+            m_free.push_back(i);
+        }
+        m_size = 0;
+    }
+
+  private:
+    static constexpr size_t c_chunkSize = 256;
+    static constexpr size_t c_maxChunks = 4096;
+
+    struct Slot
+    {
+        std::atomic<uint32_t> generation{1};
+        std::optional<T> value;
+    };
+    struct Chunk
+    {
+        Slot slots[c_chunkSize];
+    };
+
+    Slot &SlotAt(uint32_t index) const
+    {
+        return m_chunks[index / c_chunkSize].load(std::memory_order_acquire)->slots[index % c_chunkSize];
+    }
+
+    void Free(uint32_t index)
+    {
+        Slot &slot = SlotAt(index);
+        uint32_t generation = slot.generation.load(std::memory_order_relaxed);
+        slot.generation.store(generation == UINT32_MAX ? 1 : generation + 1, std::memory_order_release);
+        slot.value.reset();
+    }
+
+    std::unique_ptr<std::atomic<Chunk *>[]> m_chunks;
+    std::atomic<uint32_t> m_slotCount{0};
+    std::vector<uint32_t> m_free;
+    size_t m_size = 0;
+};
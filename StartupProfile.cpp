@@ -0,0 +1,358 @@
+#include "StartupProfile.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <system_error>
+
+// One record per line:
+//
+//     hello_dml-startup-profile <version>
+//     adapter <filter> <description> <driverVersion> <luidHigh> <luidLow> <featureLevel> <float16> <int8>
+//     operator <kind> <dataType> <flags> <signature> <inputs> <outputs> <variant> <outputNames>
+//
+// where strings are quoted, a list of tensors is a count followed by each rank and its sizes, and the variant is
+// "op activation alpha scale" for an element-wise operator, the node count, each node as "op inputCount inputs...
+// inputIndex axis alpha", and the output node count and ids for a graph, "transposeA transposeB alpha beta" for a
+// GEMM, or "op axis" for a reduction.
+
+namespace
+{
+constexpr const char *c_magic = "hello_dml-startup-profile";
+
+// Bounds on what a damaged file could otherwise make Load allocate.
+constexpr uint32_t c_maxRank = 8;
+constexpr uint32_t c_maxTensors = 1024;
+constexpr uint32_t c_maxNodes = 4096;
+
+void WriteFloat(std::ostream &out, float value)
+{
+    out << ' ' << std::hexfloat << value << std::defaultfloat;
+}
+
+// operator>> does not read hexadecimal floats on every standard library, strtof does.
+bool ReadFloat(std::istream &in, float &value)
+{
+    std::string token;
+    if (!(in >> token))
+    {
+        return false;
+    }
+    char *end = nullptr;
+    value = std::strtof(token.c_str(), &end);
+    return end == token.c_str() + token.size();
+}
+
+template <typename T> bool ReadCount(std::istream &in, T &count, uint32_t limit)
+{
+    return static_cast<bool>(in >> count) && count <= limit;
+}
+
+void WriteTensors(std::ostream &out, const std::vector<std::vector<uint32_t>> &tensors)
+{
+    out << ' ' << tensors.size();
+    for (const auto &dimensions : tensors)
+    {
+        out << ' ' << dimensions.size();
+        for (uint32_t size : dimensions)
+        {
+            out << ' ' << size;
+        }
+    }
+}
+
+bool ReadTensors(std::istream &in, std::vector<std::vector<uint32_t>> &tensors)
+{
+    uint32_t count = 0;
+    if (!ReadCount(in, count, c_maxTensors))
+    {
+        return false;
+    }
+    tensors.assign(count, {});
+    for (auto &dimensions : tensors)
+    {
+        uint32_t rank = 0;
+        if (!ReadCount(in, rank, c_maxRank))
+        {
+            return false;
+        }
+        dimensions.resize(rank);
+        for (uint32_t &size : dimensions)
+        {
+            if (!(in >> size))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void WriteOperator(std::ostream &out, const OperatorRecipe &recipe)
+{
+    const OperatorKey &key = recipe.key;
+    out << "operator " << static_cast<uint32_t>(key.kind) << ' ' << key.dataType << ' ' << key.executionFlags << ' '
+        << std::quoted(key.signature);
+    WriteTensors(out, key.inputDimensions);
+    WriteTensors(out, key.outputDimensions);
+
+    if (key.kind == OperatorKind::ElementWise)
+    {
+        const ElementWiseDesc &desc = recipe.elementWise;
+        out << ' ' << static_cast<uint32_t>(desc.op) << ' ' << static_cast<uint32_t>(desc.activation);
+        WriteFloat(out, desc.alpha);
+        WriteFloat(out, desc.scale);
+    }
+    else if (key.kind == OperatorKind::Gemm)
+    {
+        out << ' ' << recipe.gemm.transposeA << ' ' << recipe.gemm.transposeB;
+        WriteFloat(out, recipe.gemm.alpha);
+        WriteFloat(out, recipe.gemm.beta);
+    }
+    else if (key.kind == OperatorKind::Reduce)
+    {
+        out << ' ' << static_cast<uint32_t>(recipe.reduce.op) << ' ' << recipe.reduce.axis;
+    }
+    else
+    {
+        out << ' ' << recipe.nodes.size();
+        for (const GraphNode &node : recipe.nodes)
+        {
+            out << ' ' << static_cast<uint32_t>(node.op) << ' ' << node.inputs.size();
+            for (uint32_t input : node.inputs)
+            {
+                out << ' ' << input;
+            }
+            out << ' ' << node.inputIndex << ' ' << node.axis;
+            WriteFloat(out, node.alpha);
+        }
+        out << ' ' << recipe.outputNodes.size();
+        for (uint32_t node : recipe.outputNodes)
+        {
+            out << ' ' << node;
+        }
+    }
+
+    out << ' ' << recipe.outputNames.size();
+    for (const std::string &name : recipe.outputNames)
+    {
+        out << ' ' << std::quoted(name);
+    }
+    out << '\n';
+}
+
+// Reads the fields after "operator" and checks that they describe an operator that can be compiled: every node has
+// as many operands as its op takes, and only refers to nodes before it and to inputs the key has a shape for.
+bool ReadOperator(std::istream &in, OperatorRecipe &recipe)
+{
+    OperatorKey &key = recipe.key;
+    uint32_t kind = 0;
+    if (!(in >> kind >> key.dataType >> key.executionFlags >> std::quoted(key.signature)) ||
+        !ReadTensors(in, key.inputDimensions) || !ReadTensors(in, key.outputDimensions))
+    {
+        return false;
+    }
+
+    if (kind == static_cast<uint32_t>(OperatorKind::ElementWise))
+    {
+        key.kind = OperatorKind::ElementWise;
+        uint32_t op = 0;
+        uint32_t activation = 0;
+        if (!(in >> op >> activation) || op > static_cast<uint32_t>(BinaryOp::Minimum) ||
+            activation > static_cast<uint32_t>(Activation::Gelu) || !ReadFloat(in, recipe.elementWise.alpha) ||
+            !ReadFloat(in, recipe.elementWise.scale) || key.inputDimensions.size() != 2 ||
+            key.outputDimensions.size() != 1)
+        {
+            return false;
+        }
+        recipe.elementWise.op = static_cast<BinaryOp>(op);
+        recipe.elementWise.activation = static_cast<Activation>(activation);
+    }
+    else if (kind == static_cast<uint32_t>(OperatorKind::Gemm))
+    {
+        key.kind = OperatorKind::Gemm;
+        if (!(in >> recipe.gemm.transposeA >> recipe.gemm.transposeB) || !ReadFloat(in, recipe.gemm.alpha) ||
+            !ReadFloat(in, recipe.gemm.beta) || key.inputDimensions.size() < 2 || key.inputDimensions.size() > 3 ||
+            key.outputDimensions.size() != 1)
+        {
+            return false;
+        }
+    }
+    else if (kind == static_cast<uint32_t>(OperatorKind::Reduce))
+    {
+        key.kind = OperatorKind::Reduce;
+        uint32_t op = 0;
+        if (!(in >> op >> recipe.reduce.axis) || op > static_cast<uint32_t>(ReduceOp::Max) ||
+            key.inputDimensions.size() != 1 || key.outputDimensions.size() != 1 ||
+            recipe.reduce.axis >= key.inputDimensions[0].size())
+        {
+            return false;
+        }
+        recipe.reduce.op = static_cast<ReduceOp>(op);
+    }
+    else if (kind == static_cast<uint32_t>(OperatorKind::Graph))
+    {
+        key.kind = OperatorKind::Graph;
+        uint32_t nodeCount = 0;
+        if (!ReadCount(in, nodeCount, c_maxNodes))
+        {
+            return false;
+        }
+        recipe.nodes.resize(nodeCount);
+        for (uint32_t i = 0; i < nodeCount; ++i)
+        {
+            GraphNode &node = recipe.nodes[i];
+            uint32_t op = 0;
+            uint32_t inputCount = 0;
+            if (!(in >> op) || op > static_cast<uint32_t>(GraphOp::ReduceMax) || !(in >> inputCount))
+            {
+                return false;
+            }
+            uint32_t arity = op == static_cast<uint32_t>(GraphOp::Input)     ? 0
+                             : op <= static_cast<uint32_t>(GraphOp::Minimum) ? 2
+                                                                             : 1;
+            if (inputCount != arity)
+            {
+                return false;
+            }
+            node.op = static_cast<GraphOp>(op);
+            node.inputs.resize(inputCount);
+            for (uint32_t &input : node.inputs)
+            {
+                if (!(in >> input) || input >= i)
+                {
+                    return false;
+                }
+            }
+            if (!(in >> node.inputIndex >> node.axis) || !ReadFloat(in, node.alpha) ||
+                (node.op == GraphOp::Input && node.inputIndex >= key.inputDimensions.size()))
+            {
+                return false;
+            }
+        }
+
+        uint32_t outputCount = 0;
+        if (!ReadCount(in, outputCount, c_maxTensors) || outputCount != key.outputDimensions.size())
+        {
+            return false;
+        }
+        recipe.outputNodes.resize(outputCount);
+        for (uint32_t &node : recipe.outputNodes)
+        {
+            if (!(in >> node) || node >= nodeCount)
+            {
+                return false;
+            }
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    uint32_t nameCount = 0;
+    if (!ReadCount(in, nameCount, c_maxTensors) || nameCount != key.outputDimensions.size())
+    {
+        return false;
+    }
+    recipe.outputNames.resize(nameCount);
+    for (std::string &name : recipe.outputNames)
+    {
+        if (!(in >> std::quoted(name)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+bool StartupProfile::Load(const std::string &path)
+{
+    Clear();
+    std::ifstream in(path);
+    std::string magic;
+    uint32_t version = 0;
+    if (!(in >> magic >> version) || magic != c_magic || version != c_version)
+    {
+        return false;
+    }
+
+    for (std::string line; std::getline(in, line);)
+    {
+        std::istringstream fields(line);
+        std::string record;
+        if (!(fields >> record))
+        {
+            continue;
+        }
+
+        bool valid = false;
+        if (record == "adapter")
+        {
+            AdapterProfile adapter;
+            valid = static_cast<bool>(fields >> std::quoted(adapter.nameFilter) >> std::quoted(adapter.description) >>
+                                      adapter.driverVersion >> adapter.luidHighPart >> adapter.luidLowPart >>
+                                      adapter.featureLevel >> adapter.float16Supported >> adapter.int8Supported);
+            m_adapter = adapter;
+        }
+        else if (record == "operator")
+        {
+            OperatorRecipe recipe;
+            valid = ReadOperator(fields, recipe);
+            if (valid)
+            {
+                AddOperator(std::move(recipe));
+            }
+        }
+
+        std::string trailing;
+        if (!valid || fields >> trailing)
+        {
+            Clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool StartupProfile::Save(const std::string &path) const
+{
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::trunc);
+        out << c_magic << ' ' << c_version << '\n';
+        if (m_adapter)
+        {
+            out << "adapter " << std::quoted(m_adapter->nameFilter) << ' ' << std::quoted(m_adapter->description)
+                << ' ' << m_adapter->driverVersion << ' ' << m_adapter->luidHighPart << ' ' << m_adapter->luidLowPart
+                << ' ' << m_adapter->featureLevel << ' ' << m_adapter->float16Supported << ' '
+                << m_adapter->int8Supported << '\n';
+        }
+        for (const OperatorRecipe &recipe : m_operators)
+        {
+            WriteOperator(out, recipe);
+        }
+        if (!out.flush())
+        {
+            return false;
+        }
+    }
+
+    // filesystem::rename replaces an existing file on every platform, unlike std::rename on Windows.
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    return !error;
+}
+
+bool StartupProfile::AddOperator(OperatorRecipe recipe)
+{
+    if (m_operators.size() >= m_maxOperators || !m_keys.insert(recipe.key).second)
+    {
+        return false;
+    }
+    m_operators.push_back(std::move(recipe));
+    return true;
+}
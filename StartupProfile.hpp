@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "ElementWise.hpp"
+#include "MatrixOps.hpp"
+#include "OperatorCache.hpp"
+#include "TensorGraph.hpp"
+
+// The adapter a processor ran on and what it supports, so the next start can open it by LUID instead of enumerating
+// and sorting every adapter, and can skip the feature queries.
+struct AdapterProfile
+{
+    std::string nameFilter; // The filter the adapter was selected with; a different filter selects afresh.
+    std::string description;
+    uint64_t driverVersion = 0; // Capabilities can change with the driver, so an update selects afresh.
+    int32_t luidHighPart = 0;
+    uint32_t luidLowPart = 0;
+    uint32_t featureLevel = 0; // D3D_FEATURE_LEVEL
+    bool float16Supported = false;
+    bool int8Supported = false;
+};
+
+// Everything needed to compile an operator again without the tensors it was first compiled for: its cache key, which
+// holds the data type and the shape of every tensor, plus the description the key's signature was made from.
+struct OperatorRecipe
+{
+    OperatorKey key;
+    ElementWiseDesc elementWise;          // OperatorKind::ElementWise
+    GemmDesc gemm;                        // OperatorKind::Gemm
+    ReduceDesc reduce;                    // OperatorKind::Reduce
+    std::vector<GraphNode> nodes;         // OperatorKind::Graph
+    std::vector<uint32_t> outputNodes;    // OperatorKind::Graph
+    std::vector<std::string> outputNames; // Tensors the operator first wrote, for trace spans and errors.
+};
+
+// What one run learned about its device, kept on disk so the next run starts warm: the selected adapter with its
+// capabilities, and a manifest of the operators it compiled, in the order they were first used. Floats are written as
+// hexadecimal literals, so recipes reproduce their keys exactly.
+//
+// Like the other bookkeeping classes this does not depend on D3D12. Callers synchronize access themselves.
+class StartupProfile
+{
+  public:
+    explicit StartupProfile(size_t maxOperators = 256) : m_maxOperators(maxOperators)
+    {
+    }
+
+    // Replaces the contents with the profile at path. Returns false, leaving the profile empty, if the file is
+    // missing, from another version or damaged; a stale profile only costs the warm start.
+    bool Load(const std::string &path);
+
+    // Writes to a temporary file next to path and renames it over path, so a crash never leaves a truncated profile
+    // behind. Returns false if the file could not be written.
+    bool Save(const std::string &path) const;
+
+    const std::optional<AdapterProfile> &Adapter() const
+    {
+        return m_adapter;
+    }
+    void SetAdapter(const AdapterProfile &adapter)
+    {
+        m_adapter = adapter;
+    }
+
+    const std::vector<OperatorRecipe> &Operators() const
+    {
+        return m_operators;
+    }
+
+    // Adds recipe unless its key is already recorded or the profile is full. Returns whether it was added.
+    bool AddOperator(OperatorRecipe recipe);
+
+    bool Contains(const OperatorKey &key) const
+    {
+        return m_keys.count(key) != 0;
+    }
+
+    void Clear()
+    {
+        m_adapter.reset();
+        m_operators.clear();
+        m_keys.clear();
+    }
+
+  private:
+    static constexpr uint32_t c_version = 1;
+
+    size_t m_maxOperators;
+    std::optional<AdapterProfile> m_adapter;
+    std::vector<OperatorRecipe> m_operators;
+    std::unordered_set<OperatorKey, OperatorKeyHash> m_keys;
+};
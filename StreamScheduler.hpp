@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The stages every streamed chunk goes through, in order.
+enum class StreamStage : uint32_t
+{
+    Upload,   // Host arrays into the chunk's input buffers.
+    Compute,  // The op, from the input buffers into the output buffer.
+    Readback, // The output buffer back towards the host array.
+};
+
+// One chunk of a streamed job: elements [offset, offset + count) of the host arrays, processed in buffer set slot.
+struct StreamChunk
+{
+    uint64_t index = 0;
+    uint64_t offset = 0;
+    uint64_t count = 0;
+    uint32_t slot = 0;
+};
+
+// Marks the end of one stage: the fence value the queue it was submitted to signals once it has finished. A default
+// constructed event has nothing to wait for.
+struct StreamEvent
+{
+    uint32_t queue = 0;
+    uint64_t fenceValue = 0;
+};
+
+// Executes the stages of a streamed job, on a device or on a model of one.
+class StreamStages
+{
+  public:
+    virtual ~StreamStages() = default;
+
+    // Starts stage on chunk without waiting for it to finish. The device holds the stage back until every event in
+    // waits has finished.
+    virtual StreamEvent Run(StreamStage stage, const StreamChunk &chunk, const std::vector<StreamEvent> &waits) = 0;
+
+    // Blocks the host until event has finished.
+    virtual void Wait(const StreamEvent &event) = 0;
+
+    // Called in chunk order once the readback of chunk has finished, to move its results out of the slot's
+    // readback buffer.
+    virtual void Finish(const StreamChunk &chunk) = 0;
+};
+
+// Splits a job over count elements into chunks and pipelines them through bufferCount sets of buffers, so the
+// upload of one chunk, the compute of the one before it and the readback of the one before that are in flight at
+// once. Chunk n uses set n % bufferCount, and a stage only overwrites a buffer once the previous chunk in the set
+// has finished with it:
+//   Upload(n)    after Compute(n - bufferCount) has consumed the inputs. The host also waits for
+//                Upload(n - bufferCount) before staging into the same upload buffer.
+//   Compute(n)   after Upload(n), and after Readback(n - bufferCount) has drained the output.
+//   Readback(n)  after Compute(n), and after Finish(n - bufferCount) has emptied the readback buffer.
+// With one buffer set the chunks run one after another. Two let the transfers of one chunk overlap the compute of
+// its neighbours; a third absorbs jitter between the stages.
+//
+// Like the other bookkeeping classes this does not depend on D3D12, so a schedule can be run against
+// SimulatedStreamStages.
+class StreamScheduler
+{
+  public:
+    StreamScheduler(uint64_t count, uint64_t chunkElements, uint32_t bufferCount)
+        : m_count(count), m_chunkElements(chunkElements), m_bufferCount(bufferCount)
+    {
+        if (chunkElements == 0 || bufferCount == 0)
+        {
+            throw std::invalid_argument("Streaming needs a chunk size and at least one buffer set.");
+        }
+    }
+
+    uint64_t ChunkCount() const
+    {
+        return (m_count + m_chunkElements - 1) / m_chunkElements;
+    }
+
+    StreamChunk Chunk(uint64_t index) const
+    {
+        uint64_t offset = index * m_chunkElements;
+        return {index, offset, std::min(m_chunkElements, m_count - offset),
+                static_cast<uint32_t>(index % m_bufferCount)};
+    }
+
+    // Issues every stage of every chunk and returns once the last chunk has been finished.
+    void Run(StreamStages &stages) const
+    {
+        uint64_t chunkCount = ChunkCount();
+        uint64_t sets = m_bufferCount;
+        std::vector<StreamEvent> uploaded(chunkCount), computed(chunkCount), readBack(chunkCount);
+
+        uint64_t finished = 0;
+        auto finishBefore = [&](uint64_t end) {
+            for (; finished < end; ++finished)
+            {
+                stages.Wait(readBack[finished]);
+                stages.Finish(Chunk(finished));
+            }
+        };
+
+        // Step s issues Upload(s), Compute(s - lag) and Readback(s - 2 lag). A single buffer set makes every stage
+        // wait for the one before, so the stages of a chunk are issued together.
+        uint64_t lag = sets > 1 ? 1 : 0;
+        for (uint64_t step = 0; step < chunkCount + 2 * lag; ++step)
+        {
+            if (step < chunkCount)
+            {
+                uint64_t n = step;
+                std::vector<StreamEvent> waits;
+                if (n >= sets)
+                {
+                    stages.Wait(uploaded[n - sets]);
+                    waits.push_back(computed[n - sets]);
+                }
+                uploaded[n] = stages.Run(StreamStage::Upload, Chunk(n), waits);
+            }
+            if (step >= lag && step - lag < chunkCount)
+            {
+                uint64_t n = step - lag;
+                std::vector<StreamEvent> waits{uploaded[n]};
+                if (n >= sets)
+                {
+                    waits.push_back(readBack[n - sets]);
+                }
+                computed[n] = stages.Run(StreamStage::Compute, Chunk(n), waits);
+            }
+            if (step >= 2 * lag && step - 2 * lag < chunkCount)
+            {
+                uint64_t n = step - 2 * lag;
+                if (n >= sets)
+                {
+                    finishBefore(n - sets + 1);
+                }
+                readBack[n] = stages.Run(StreamStage::Readback, Chunk(n), {computed[n]});
+            }
+        }
+        finishBefore(chunkCount);
+    }
+
+  private:
+    uint64_t m_count;
+    uint64_t m_chunkElements;
+    uint32_t m_bufferCount;
+};
+
+// A model of a device to run a schedule against, to predict how long a job takes with a given buffer count and queue
+// layout, or to check the ordering of a schedule on machines without a device. Every stage costs a fixed time per
+// element, and each queue runs its work in submission order, an item starting once the queue is free and its waits
+// have finished. Run and Finish throw std::logic_error if a stage would reuse a buffer before the previous chunk in
+// its set has finished with it.
+class SimulatedStreamStages : public StreamStages
+{
+  public:
+    struct Costs
+    {
+        double uploadSecondsPerElement = 0.0;
+        double computeSecondsPerElement = 0.0;
+        double readbackSecondsPerElement = 0.0;
+        // Host time to stage one element of an upload and to copy one element out when a chunk is finished.
+        double hostSecondsPerElement = 0.0;
+        // Without a copy queue, transfers run on the compute queue in between the dispatches.
+        bool copyQueue = true;
+    };
+
+    SimulatedStreamStages(const Costs &costs, uint32_t bufferCount) : m_costs(costs), m_slots(bufferCount)
+    {
+    }
+
+    StreamEvent Run(StreamStage stage, const StreamChunk &chunk, const std::vector<StreamEvent> &waits) override
+    {
+        Slot &slot = m_slots.at(chunk.slot);
+        int64_t index = static_cast<int64_t>(chunk.index);
+        int64_t previous = chunk.index >= m_slots.size() ? index - static_cast<int64_t>(m_slots.size()) : -1;
+
+        double ready = m_hostTime;
+        for (const StreamEvent &wait : waits)
+        {
+            ready = std::max(ready, EndTime(wait));
+        }
+
+        double secondsPerElement = 0.0;
+        StageTime *time = nullptr;
+        switch (stage)
+        {
+        case StreamStage::Upload:
+            Check(slot.upload.chunk == previous && m_hostTime >= slot.upload.end, "staged into a busy upload buffer");
+            m_hostTime += m_costs.hostSecondsPerElement * static_cast<double>(chunk.count);
+            ready = std::max(ready, m_hostTime);
+            Check(slot.compute.chunk == previous && ready >= slot.compute.end, "uploaded over unconsumed inputs");
+            secondsPerElement = m_costs.uploadSecondsPerElement;
+            time = &slot.upload;
+            break;
+        case StreamStage::Compute:
+            Check(slot.upload.chunk == index && ready >= slot.upload.end, "computed before its upload");
+            Check(slot.readback.chunk == previous && ready >= slot.readback.end, "computed over an undrained output");
+            secondsPerElement = m_costs.computeSecondsPerElement;
+            time = &slot.compute;
+            break;
+        case StreamStage::Readback:
+            Check(slot.compute.chunk == index && ready >= slot.compute.end, "read back before its compute");
+            Check(slot.finish.chunk == previous && ready >= slot.finish.end, "read back into an unfinished buffer");
+            secondsPerElement = m_costs.readbackSecondsPerElement;
+            time = &slot.readback;
+            break;
+        }
+
+        uint32_t queue = stage != StreamStage::Compute && m_costs.copyQueue ? 1 : 0;
+        Queue &target = m_queues[queue];
+        double start = std::max(ready, target.freeAt);
+        target.freeAt = start + secondsPerElement * static_cast<double>(chunk.count);
+        target.ends.push_back(target.freeAt);
+        *time = {index, target.freeAt};
+        return {queue, target.ends.size()};
+    }
+
+    void Wait(const StreamEvent &event) override
+    {
+        m_hostTime = std::max(m_hostTime, EndTime(event));
+    }
+
+    void Finish(const StreamChunk &chunk) override
+    {
+        Slot &slot = m_slots.at(chunk.slot);
+        Check(chunk.index == m_finishedCount, "finished out of order");
+        Check(slot.readback.chunk == static_cast<int64_t>(chunk.index) && m_hostTime >= slot.readback.end,
+              "finished before its readback");
+        m_hostTime += m_costs.hostSecondsPerElement * static_cast<double>(chunk.count);
+        slot.finish = {static_cast<int64_t>(chunk.index), m_hostTime};
+        ++m_finishedCount;
+    }
+
+    uint64_t FinishedCount() const
+    {
+        return m_finishedCount;
+    }
+
+    // Time from the first stage until the last chunk was finished and every queue had drained.
+    double Seconds() const
+    {
+        return std::max({m_hostTime, m_queues[0].freeAt, m_queues[1].freeAt});
+    }
+
+  private:
+    // The chunk that last used a buffer for a stage, and when that stage ended.
+    struct StageTime
+    {
+        int64_t chunk = -1;
+        double end = 0.0;
+    };
+    struct Slot
+    {
+        StageTime upload;
+        StageTime compute;
+        StageTime readback;
+        StageTime finish;
+    };
+    struct Queue
+    {
+        double freeAt = 0.0;
+        std::vector<double> ends; // End of the work that signalled fence value i + 1.
+    };
+
+    static void Check(bool condition, const char *what)
+    {
+        if (!condition)
+        {
+            throw std::logic_error(std::string("Stream schedule ") + what + ".");
+        }
+    }
+
+    double EndTime(const StreamEvent &event) const
+    {
+        return event.fenceValue == 0 ? 0.0 : m_queues[event.queue].ends.at(event.fenceValue - 1);
+    }
+
+    Costs m_costs;
+    std::vector<Slot> m_slots;
+    Queue m_queues[2];
+    double m_hostTime = 0.0;
+    uint64_t m_finishedCount = 0;
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Identifies one submission on a queue's fence timeline. The submission has completed once the fence reaches
+// fenceValue. A default constructed ticket refers to no work and is always complete.
+struct SubmissionTicket
+{
+    uint64_t fenceValue = 0;
+
+    bool IsValid() const
+    {
+        return fenceValue != 0;
+    }
+};
+
+// Bookkeeping for one queue with a persistent, monotonically increasing fence. The timeline only tracks fence values;
+// signalling and waiting on the real fence is left to the owner, which keeps this class independent of D3D12 so it
+// can be driven by a simulated queue. The command allocators each command list records into are tracked separately
+// by an AllocatorRing, so several command lists can submit to the same timeline.
+//
+// Typical use by the owner:
+//   SubmissionTicket ticket = timeline.Advance();     // after Signal(fence, timeline.NextFenceValue())
+//   ring.Rotate(ticket.fenceValue);                    // for the allocator the submission was recorded into
+//   wait until ring.CurrentRetireValue() completed, then reset the allocator
+//   run timeline.Retire(fence->GetCompletedValue());  // whenever the completed value is observed
+//
+// The timeline itself is not synchronized; an owner that submits from several threads guards it with a lock.
+class SubmissionTimeline
+{
+  public:
+    // The fence value the next submission will signal.
+    uint64_t NextFenceValue() const
+    {
+        return m_lastSubmitted + 1;
+    }
+
+    uint64_t LastSubmittedValue() const
+    {
+        return m_lastSubmitted;
+    }
+
+    uint64_t LastCompletedValue() const
+    {
+        return m_lastCompleted;
+    }
+
+    bool IsComplete(const SubmissionTicket &ticket) const
+    {
+        return ticket.fenceValue <= m_lastCompleted;
+    }
+
+    // Keeps object alive until the next submission retires.
+    void KeepAlive(std::shared_ptr<void> object)
+    {
+        m_keepAlive.push_back({NextFenceValue(), std::move(object)});
+    }
+
+    // Queues continuation to be returned by Retire() once ticket has completed. Runs it immediately if it already has.
+    void Then(const SubmissionTicket &ticket, std::function<void()> continuation)
+    {
+        if (IsComplete(ticket))
+        {
+            continuation();
+            return;
+        }
+        m_continuations.push_back({ticket.fenceValue, std::move(continuation)});
+    }
+
+    SubmissionTicket Advance()
+    {
+        return SubmissionTicket{++m_lastSubmitted};
+    }
+
+    // Releases everything whose fence value has completed and returns the continuations that became due, in the
+    // order Then() was called. The owner runs them, after releasing any lock it holds around the timeline so they can
+    // call back into it.
+    std::vector<std::function<void()>> Retire(uint64_t completedValue)
+    {
+        std::vector<std::function<void()>> due;
+        if (completedValue <= m_lastCompleted)
+        {
+            return due;
+        }
+        m_lastCompleted = completedValue;
+
+        while (!m_keepAlive.empty() && m_keepAlive.front().first <= completedValue)
+        {
+            m_keepAlive.pop_front();
+        }
+
+        // Continuations are queued in the order Then() was called, which need not be fence order.
+        for (auto it = m_continuations.begin(); it != m_continuations.end();)
+        {
+            if (it->first <= completedValue)
+            {
+                due.push_back(std::move(it->second));
+                it = m_continuations.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        return due;
+    }
+
+  private:
+    uint64_t m_lastSubmitted = 0;
+    uint64_t m_lastCompleted = 0;
+
+    std::deque<std::pair<uint64_t, std::shared_ptr<void>>> m_keepAlive;
+    std::deque<std::pair<uint64_t, std::function<void()>>> m_continuations;
+};
+
+// A ring of command allocators for one command list, so several of its submissions can be in flight while the next
+// one is recorded. An allocator may only be reset once the last submission recorded into it has completed.
+template <typename Allocator> class AllocatorRing
+{
+  public:
+    void Add(Allocator allocator)
+    {
+        m_slots.push_back({std::move(allocator), 0});
+    }
+
+    size_t Count() const
+    {
+        return m_slots.size();
+    }
+
+    size_t CurrentIndex() const
+    {
+        return m_current;
+    }
+
+    Allocator &Current()
+    {
+        return m_slots.at(m_current).allocator;
+    }
+
+    // The fence value that must complete before the allocator at index may be reset.
+    uint64_t RetireValue(size_t index) const
+    {
+        return m_slots.at(index).fenceValue;
+    }
+    uint64_t CurrentRetireValue() const
+    {
+        return RetireValue(m_current);
+    }
+
+    // Marks the current allocator as used by the submission that signals fenceValue and moves on to the next one.
+    void Rotate(uint64_t fenceValue)
+    {
+        if (m_slots.empty())
+        {
+            throw std::logic_error("AllocatorRing has no command allocators.");
+        }
+        m_slots[m_current].fenceValue = fenceValue;
+        m_current = (m_current + 1) % m_slots.size();
+    }
+
+  private:
+    struct Slot
+    {
+        Allocator allocator;
+        uint64_t fenceValue;
+    };
+
+    std::vector<Slot> m_slots;
+    size_t m_current = 0;
+};
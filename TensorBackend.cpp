@@ -0,0 +1,276 @@
+#include "TensorBackend.hpp"
+
+#include "CpuBackend.hpp"
+#include "ExecutionPlan.hpp"
+#include "MultiDeviceBackend.hpp"
+#include "TensorFile.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#include "DirectMLProcessor.hpp"
+#endif
+
+namespace
+{
+// Streams through a backend's own tensor calls, with two input tensors and an output tensor of one chunk per buffer
+// set. Uploads and readbacks copy before they return, so only compute can still be running on the device.
+class BackendStreamStages : public StreamStages
+{
+  public:
+    BackendStreamStages(TensorBackend &backend, const ElementWiseDesc &desc, const float *a, const float *b,
+                        float *out, uint64_t chunkElements, uint32_t bufferCount)
+        : m_backend(backend), m_desc(desc), m_a(a), m_b(b), m_out(out)
+    {
+        TensorShape shape{static_cast<uint32_t>(chunkElements)};
+        for (uint32_t i = 0; i < bufferCount; ++i)
+        {
+            Slot slot;
+            slot.a = UniqueTensor(backend, backend.CreateTensor("", shape, TensorDataType::Float32));
+            slot.b = UniqueTensor(backend, backend.CreateTensor("", shape, TensorDataType::Float32));
+            slot.out = UniqueTensor(backend, backend.CreateTensor("", shape, TensorDataType::Float32));
+            m_slots.push_back(std::move(slot));
+        }
+    }
+
+    StreamEvent Run(StreamStage stage, const StreamChunk &chunk, const std::vector<StreamEvent> &) override
+    {
+        // The last chunk may be shorter; the elements past it are computed on stale data and never read back.
+        Slot &slot = m_slots[chunk.slot];
+        size_t bytes = static_cast<size_t>(chunk.count * sizeof(float));
+        switch (stage)
+        {
+        case StreamStage::Upload:
+            m_backend.SetTensorData(slot.a, m_a + chunk.offset, bytes);
+            m_backend.SetTensorData(slot.b, m_b + chunk.offset, bytes);
+            return {};
+        case StreamStage::Compute:
+            return {0, m_backend.ElementWise(m_desc, slot.a.Get(), slot.b.Get(), slot.out.Get()).fenceValue};
+        default:
+            m_backend.GetTensorData(slot.out, {}, TensorDataType::Float32, m_out + chunk.offset, bytes);
+            return {};
+        }
+    }
+
+    void Wait(const StreamEvent &event) override
+    {
+        m_backend.Wait(SubmissionTicket{event.fenceValue});
+    }
+
+    void Finish(const StreamChunk &) override
+    {
+    }
+
+  private:
+    struct Slot
+    {
+        UniqueTensor a;
+        UniqueTensor b;
+        UniqueTensor out;
+    };
+
+    TensorBackend &m_backend;
+    const ElementWiseDesc &m_desc;
+    const float *m_a;
+    const float *m_b;
+    float *m_out;
+    std::vector<Slot> m_slots;
+};
+
+// Replays a plan through the backend's own calls, with the tensors resolved at capture. Uploads and readbacks copy
+// before they return, so once the last readback has there is nothing left to wait for.
+class BackendExecutionPlan : public ExecutionPlan
+{
+  public:
+    BackendExecutionPlan(TensorBackend &backend, const PlanCapture &capture)
+        : ExecutionPlan(capture), m_backend(backend)
+    {
+    }
+
+  protected:
+    std::shared_future<void> Run(const std::vector<const void *> &inputs, const std::vector<void *> &outputs) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        TRACE_SPAN("ReplayPlan");
+        SubmissionTicket last;
+        for (const PlanStep &step : Steps())
+        {
+            switch (step.kind)
+            {
+            case PlanStepKind::Upload:
+                m_backend.SetTensorData(step.writes[0], inputs[step.slot], step.size);
+                break;
+            case PlanStepKind::ElementWise:
+                last = m_backend.ElementWise(step.elementWise, step.reads[0], step.reads[1], step.writes[0]);
+                break;
+            case PlanStepKind::Gemm: {
+                TensorHandle bias = step.reads.size() > 2 ? step.reads[2] : TensorHandle();
+                last = m_backend.Gemm(step.gemm, step.reads[0], step.reads[1], bias, step.writes[0]);
+                break;
+            }
+            case PlanStepKind::Reduce:
+                last = m_backend.Reduce(step.reduce, step.reads[0], step.writes[0]);
+                break;
+            case PlanStepKind::Graph:
+                last = m_backend.ExecuteGraph(*step.graph);
+                break;
+            case PlanStepKind::Readback:
+                m_backend.GetTensorData(step.reads[0], {}, step.type, outputs[step.slot], step.size);
+                break;
+            }
+        }
+        // A plan that ends in an op rather than a readback is done once the op is.
+        m_backend.Wait(last);
+
+        std::promise<void> done;
+        done.set_value();
+        return done.get_future().share();
+    }
+
+  private:
+    TensorBackend &m_backend;
+    std::mutex m_mutex;
+};
+
+// The backend adapterNameFilter names, or null if it cannot be opened.
+std::unique_ptr<TensorBackend> OpenBackend(const std::string &adapterNameFilter, const std::string &startupProfilePath)
+{
+    if (adapterNameFilter == "CPU")
+    {
+        return std::make_unique<CpuBackend>();
+    }
+#ifdef _WIN32
+    try
+    {
+        DirectMLProcessorOptions options;
+        options.startupProfilePath = startupProfilePath;
+        return std::make_unique<DirectMLProcessor>(adapterNameFilter, options);
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << "DirectML is not available (" << e.what() << ").\n";
+    }
+#else
+    // Only DirectML loads a startup profile.
+    (void)startupProfilePath;
+    std::cout << "DirectML is not available on this platform.\n";
+#endif
+    return nullptr;
+}
+} // namespace
+
+void TensorBackend::StreamElementWise(const ElementWiseDesc &desc, const float *a, const float *b, float *out,
+                                      uint64_t count, const StreamOptions &options)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    uint64_t chunkElements = StreamChunkElements(count, options);
+    TRACE_SPAN("Stream", {}, count * sizeof(float));
+    StreamScheduler scheduler(count, chunkElements, options.bufferCount);
+    BackendStreamStages stages(*this, desc, a, b, out, chunkElements, options.bufferCount);
+    scheduler.Run(stages);
+}
+
+std::vector<TensorHandle> TensorBackend::LoadTensors(const std::string &path, const std::string &prefix)
+{
+    TensorFile file(path);
+    std::vector<TensorHandle> tensors;
+    for (const TensorFileEntry &entry : file.Entries())
+    {
+        TRACE_SPAN("LoadTensor", prefix + entry.name, entry.size);
+        file.Mapping()->AdviseSequential(entry.offset, entry.size);
+        tensors.push_back(LoadTensor(prefix + entry.name, file, entry));
+    }
+    return tensors;
+}
+
+TensorHandle TensorBackend::LoadTensor(const std::string &name, const TensorFile &file, const TensorFileEntry &entry)
+{
+    // SetTensorData streams large tensors through the upload ring in chunks, so pages are read in as they are copied.
+    TensorHandle tensor = CreateTensor(name, entry.shape, entry.type);
+    SetTensorData(tensor, file.Data(entry), static_cast<size_t>(entry.size));
+    return tensor;
+}
+
+void TensorBackend::SaveTensors(const std::string &path, const std::vector<std::string> &names)
+{
+    std::vector<TensorHandle> tensors;
+    std::vector<TensorFileEntry> entries;
+    for (const std::string &name : names)
+    {
+        TensorHandle tensor = RequireTensor(name);
+        tensors.push_back(tensor);
+        TensorFileEntry entry;
+        entry.name = name;
+        entry.shape = GetTensorShape(tensor);
+        entry.type = GetTensorType(tensor);
+        entries.push_back(std::move(entry));
+    }
+
+    TensorFileWriter writer(path, std::move(entries));
+    for (size_t i = 0; i < tensors.size(); ++i)
+    {
+        const TensorFileEntry &entry = writer.Entries()[i];
+        TRACE_SPAN("SaveTensor", entry.name, entry.size);
+        GetTensorData(tensors[i], {}, entry.type, writer.Data(entry), static_cast<size_t>(entry.size));
+    }
+}
+
+std::unique_ptr<ExecutionPlan> TensorBackend::CreateExecutionPlan(const PlanCapture &capture)
+{
+    if (&capture.Backend() != this)
+    {
+        throw std::invalid_argument("The plan was captured on another backend.");
+    }
+    return std::make_unique<BackendExecutionPlan>(*this, capture);
+}
+
+uint64_t TensorBackend::StreamChunkElements(uint64_t count, const StreamOptions &options)
+{
+    uint64_t chunkElements = std::min(options.chunkElements, count);
+    if (chunkElements > UINT32_MAX)
+    {
+        throw std::invalid_argument("Stream chunks must have fewer than 2^32 elements.");
+    }
+    return chunkElements;
+}
+
+std::unique_ptr<TensorBackend> CreateTensorBackend(const std::string &adapterNameFilter,
+                                                   const std::string &startupProfilePath)
+{
+    if (adapterNameFilter.find(',') != std::string::npos)
+    {
+        auto multiDevice = std::make_unique<MultiDeviceBackend>();
+        std::istringstream filters(adapterNameFilter);
+        for (std::string filter; std::getline(filters, filter, ',');)
+        {
+            // Every device keeps a profile of its own.
+            std::string devicePath = startupProfilePath.empty() ? std::string() : startupProfilePath + "." + filter;
+            if (std::unique_ptr<TensorBackend> device = OpenBackend(filter, devicePath))
+            {
+                multiDevice->AddDevice(std::move(device));
+            }
+        }
+        if (multiDevice->DeviceCount() == 0)
+        {
+            std::cout << "No device could be opened. Falling back to the CPU backend.\n";
+            return std::make_unique<CpuBackend>();
+        }
+        multiDevice->Calibrate();
+        return multiDevice;
+    }
+
+    if (std::unique_ptr<TensorBackend> backend = OpenBackend(adapterNameFilter, startupProfilePath))
+    {
+        return backend;
+    }
+    std::cout << "Falling back to the CPU backend.\n";
+    return std::make_unique<CpuBackend>();
+}
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "BroadcastShape.hpp"
+#include "ElementWise.hpp"
+#include "ExecutionPlan.hpp"
+#include "MatrixOps.hpp"
+#include "PhaseTimes.hpp"
+#include "StreamScheduler.hpp"
+#include "SubmissionTimeline.hpp"
+#include "TensorGraph.hpp"
+#include "TensorTable.hpp"
+
+class TensorFile;
+struct TensorFileEntry;
+
+// Element types of tensors. The values match DML_TENSOR_DATA_TYPE so the DirectML backend can cast between them.
+enum class TensorDataType : uint32_t
+{
+    Unknown = 0,
+    Float32 = 1,
+    Float16 = 2,
+    UInt32 = 3,
+    UInt16 = 4,
+    UInt8 = 5,
+    Int32 = 6,
+    Int16 = 7,
+    Int8 = 8,
+    Float64 = 9,
+    UInt64 = 10,
+    Int64 = 11,
+};
+
+inline size_t DataTypeSize(TensorDataType type)
+{
+    switch (type)
+    {
+    case TensorDataType::Float64:
+    case TensorDataType::UInt64:
+    case TensorDataType::Int64:
+        return 8;
+    case TensorDataType::Float32:
+    case TensorDataType::UInt32:
+    case TensorDataType::Int32:
+        return 4;
+    case TensorDataType::Float16:
+    case TensorDataType::UInt16:
+    case TensorDataType::Int16:
+        return 2;
+    case TensorDataType::UInt8:
+    case TensorDataType::Int8:
+        return 1;
+    default:
+        throw std::invalid_argument("Unknown tensor data type.");
+    }
+}
+
+// How float32 tensors are stored. The reduced-precision modes convert on SetTensorData and back on GetTensorData,
+// cutting memory and transfer traffic in exchange for the rounding error each adds to an element x:
+//   Float16   |error| <= 2^-11 |x| for normal halves; values beyond 65504 become infinity
+//   BFloat16  |error| <= 2^-8 |x| over the float32 range
+//   Int8      |error| <= scale / 2 with a per-tensor scale of max|x| / 127
+enum class StoragePrecision : uint32_t
+{
+    Float32,
+    Float16,
+    BFloat16,
+    Int8,
+};
+
+inline size_t StoragePrecisionSize(StoragePrecision precision)
+{
+    switch (precision)
+    {
+    case StoragePrecision::Float16:
+    case StoragePrecision::BFloat16:
+        return 2;
+    case StoragePrecision::Int8:
+        return 1;
+    default:
+        return 4;
+    }
+}
+
+inline const char *StoragePrecisionName(StoragePrecision precision)
+{
+    switch (precision)
+    {
+    case StoragePrecision::Float16:
+        return "float16";
+    case StoragePrecision::BFloat16:
+        return "bfloat16";
+    case StoragePrecision::Int8:
+        return "int8";
+    default:
+        return "float32";
+    }
+}
+
+struct StreamOptions
+{
+    // Elements per chunk. Every buffer set holds one chunk of each input and of the output.
+    uint64_t chunkElements = 1 << 20;
+
+    // Buffer sets chunks rotate through. One runs the chunks one after another, two overlap the transfers of a chunk
+    // with the compute of its neighbours, three also absorb jitter between the stages.
+    uint32_t bufferCount = 2;
+};
+
+// The tensor and operator surface shared by the DirectML processor and the CPU backend. Ops read and write existing
+// tensors. Backends that execute synchronously return empty tickets.
+//
+// Tensors are addressed by TensorHandle, a generational index that is resolved without hashing; a handle to a released
+// tensor is rejected rather than reaching whatever reuses its slot. Names are interned to handles when a tensor is
+// created, and the name-based overloads look them up on every call, so hot loops should resolve names once. A
+// backend owns its tensors and frees them with itself; UniqueTensor releases one earlier.
+class TensorBackend
+{
+  public:
+    virtual ~TensorBackend() = default;
+
+    // Human-readable description of the device in use.
+    virtual std::string Name() const = 0;
+
+    // Creates a tensor of the given shape, rank 1 to 8, and returns its handle. If name is already taken its tensor is
+    // returned instead, reshaped to the new shape and type; its contents are then undefined until written. The CPU
+    // and DirectML backends keep the storage while the new shape fits (see CapacityPolicy), so tensors whose size
+    // varies from request to request rarely allocate. An empty name creates an anonymous tensor.
+    virtual TensorHandle CreateTensor(const std::string &name, const TensorShape &shape, TensorDataType type) = 0;
+
+    // Null if no tensor is called name.
+    virtual TensorHandle FindTensor(const std::string &name) const = 0;
+
+    // The shape and type the tensor was last created with.
+    virtual TensorShape GetTensorShape(TensorHandle tensor) const = 0;
+    virtual TensorDataType GetTensorType(TensorHandle tensor) const = 0;
+
+    // Frees the tensor once work already submitted on it has finished. Its handle and name become invalid.
+    virtual void ReleaseTensor(TensorHandle tensor) = 0;
+
+    virtual void SetTensorData(TensorHandle tensor, const void *data, size_t size) = 0;
+
+    // An empty shape skips the shape check.
+    virtual void GetTensorData(TensorHandle tensor, const TensorShape &shape, TensorDataType type, void *data,
+                               size_t size) = 0;
+
+    // dst = desc.scale * desc.activation(desc.op(src0, src1)) with NumPy broadcasting of src0 and src1.
+    virtual SubmissionTicket ElementWise(const ElementWiseDesc &desc, TensorHandle src0, TensorHandle src1,
+                                         TensorHandle dst) = 0;
+    SubmissionTicket ElementWiseAddBcast(TensorHandle src0, TensorHandle src1, TensorHandle dst)
+    {
+        return ElementWise(ElementWiseDesc{}, src0, src1, dst);
+    }
+
+    // dst = desc.alpha * op(a) op(b) + desc.beta * bias, see GemmDesc. bias may be null; dst must be a tensor of its
+    // own rather than one of the operands.
+    virtual SubmissionTicket Gemm(const GemmDesc &desc, TensorHandle a, TensorHandle b, TensorHandle bias,
+                                  TensorHandle dst) = 0;
+
+    // dst = desc.op of src along desc.axis, which dst keeps with size 1.
+    virtual SubmissionTicket Reduce(const ReduceDesc &desc, TensorHandle src, TensorHandle dst) = 0;
+
+    // Name-based forms of the calls above. SetTensorData creates the tensor if needed. The uint32_t* overloads take a
+    // rank-4 shape.
+    void SetTensorData(const std::string &name, const TensorShape &shape, TensorDataType type, const void *data,
+                       size_t size)
+    {
+        SetTensorData(CreateTensor(name, shape, type), data, size);
+    }
+    void SetTensorData(const std::string &name, uint32_t *shapes, TensorDataType type, const void *data, size_t size)
+    {
+        SetTensorData(name, TensorShape(shapes, shapes + 4), type, data, size);
+    }
+
+    // A null shape skips the shape check.
+    void GetTensorData(const std::string &name, const TensorShape &shape, TensorDataType type, void *data,
+                       size_t size)
+    {
+        GetTensorData(RequireTensor(name), shape, type, data, size);
+    }
+    void GetTensorData(const std::string &name, uint32_t *shapes, TensorDataType type, void *data, size_t size)
+    {
+        GetTensorData(name, shapes ? TensorShape(shapes, shapes + 4) : TensorShape(), type, data, size);
+    }
+
+    SubmissionTicket ElementWise(const ElementWiseDesc &desc, const std::string &src0, const std::string &src1,
+                                 const std::string &dst)
+    {
+        return ElementWise(desc, RequireTensor(src0), RequireTensor(src1), RequireTensor(dst));
+    }
+    SubmissionTicket ElementWiseAddBcast(const std::string &src0, const std::string &src1, const std::string &dst)
+    {
+        return ElementWise(ElementWiseDesc{}, src0, src1, dst);
+    }
+
+    // An empty bias name means no bias.
+    SubmissionTicket Gemm(const GemmDesc &desc, const std::string &a, const std::string &b, const std::string &bias,
+                          const std::string &dst)
+    {
+        return Gemm(desc, RequireTensor(a), RequireTensor(b), bias.empty() ? TensorHandle() : RequireTensor(bias),
+                    RequireTensor(dst));
+    }
+    SubmissionTicket Reduce(const ReduceDesc &desc, const std::string &src, const std::string &dst)
+    {
+        return Reduce(desc, RequireTensor(src), RequireTensor(dst));
+    }
+
+    // Throws if no tensor is called name.
+    TensorHandle RequireTensor(const std::string &name) const
+    {
+        TensorHandle tensor = FindTensor(name);
+        if (!tensor)
+        {
+            throw std::invalid_argument("Tensor " + name + " not found.");
+        }
+        return tensor;
+    }
+
+    // out = desc.scale * desc.activation(desc.op(a, b)) over count float32 elements of host memory, without
+    // broadcasting. The arrays are streamed through the device in chunks (see StreamScheduler), so they need not fit
+    // in device memory. Returns once out has been written. out may alias a or b.
+    virtual void StreamElementWise(const ElementWiseDesc &desc, const float *a, const float *b, float *out,
+                                   uint64_t count, const StreamOptions &options);
+
+    // Creates, or reshapes, a tensor called prefix + name for every tensor in the .npy or safetensors file at path (see
+    // TensorFile), with the shape and type its header gives, and returns their handles in file order. A .npy tensor is
+    // named after the file's stem. The file is memory-mapped and each tensor uploaded straight from the mapped pages,
+    // so its contents pass through host memory once, in the page cache. The CPU backend keeps tensors stored as the
+    // file stores them as views of the pages until they are first written.
+    std::vector<TensorHandle> LoadTensors(const std::string &path, const std::string &prefix = {});
+
+    // Writes the tensors called names to path, a .npy file for a single tensor or a safetensors file, reading each
+    // back straight into the mapped output file.
+    void SaveTensors(const std::string &path, const std::vector<std::string> &names);
+
+    // Runs the whole graph. Every input and output tensor must already exist.
+    virtual SubmissionTicket ExecuteGraph(const TensorGraph &graph) = 0;
+
+    // Compiles a sequence of calls captured on this backend into a plan that replays them with new host buffers (see
+    // ExecutionPlan). By default the plan makes the same calls with the tensors it resolved at capture; the DirectML
+    // processor records a command list once and resubmits it.
+    virtual std::unique_ptr<ExecutionPlan> CreateExecutionPlan(const PlanCapture &capture);
+
+    virtual void FreeResources() = 0;
+
+    // True if ops return before the device has finished them, so work on other devices can overlap with them.
+    virtual bool ExecutesAsynchronously() const
+    {
+        return false;
+    }
+
+    // True if uploads, ops and readbacks may be called from several threads at once. Concurrent calls must not use a
+    // tensor that another of them writes or releases, and storage precision and FreeResources are not to be changed
+    // meanwhile.
+    virtual bool SupportsConcurrentCalls() const
+    {
+        return false;
+    }
+
+    // Blocks until the work behind ticket has finished. Synchronous backends have nothing to wait for.
+    virtual void Wait(const SubmissionTicket &)
+    {
+    }
+
+    // Storage of float32 tensors created after the call, for every tensor or for the one called name. Tensors of other
+    // types are stored as given.
+    void SetStoragePrecision(StoragePrecision precision)
+    {
+        m_defaultPrecision = precision;
+    }
+    void SetStoragePrecision(const std::string &name, StoragePrecision precision)
+    {
+        m_tensorPrecisions[name] = precision;
+    }
+
+    // The precision a float32 tensor called name is created with, after the backend has substituted what it supports.
+    StoragePrecision GetStoragePrecision(const std::string &name) const
+    {
+        auto it = m_tensorPrecisions.find(name);
+        return ResolveStoragePrecision(it == m_tensorPrecisions.end() ? m_defaultPrecision : it->second);
+    }
+
+    PhaseTimes GetPhaseTimes() const
+    {
+        return m_phaseTimes.Snapshot();
+    }
+    void ResetPhaseTimes()
+    {
+        m_phaseTimes.Reset();
+    }
+
+  protected:
+    // The chunk size a stream over count elements runs with: options.chunkElements, capped at count.
+    static uint64_t StreamChunkElements(uint64_t count, const StreamOptions &options);
+
+    // Creates the tensor called name for entry of file and fills it. By default through CreateTensor and
+    // SetTensorData on the mapped contents.
+    virtual TensorHandle LoadTensor(const std::string &name, const TensorFile &file, const TensorFileEntry &entry);
+
+    // The closest precision the backend can store and compute with.
+    virtual StoragePrecision ResolveStoragePrecision(StoragePrecision requested) const
+    {
+        return requested;
+    }
+
+    PhaseAccumulator m_phaseTimes;
+
+  private:
+    StoragePrecision m_defaultPrecision = StoragePrecision::Float32;
+    std::unordered_map<std::string, StoragePrecision> m_tensorPrecisions;
+};
+
+// Owns one tensor of a backend and releases it when destroyed, for tensors that live shorter than the backend.
+class UniqueTensor
+{
+  public:
+    UniqueTensor() = default;
+    UniqueTensor(TensorBackend &backend, TensorHandle tensor) : m_backend(&backend), m_tensor(tensor)
+    {
+    }
+    UniqueTensor(UniqueTensor &&other) noexcept
+        : m_backend(std::exchange(other.m_backend, nullptr)), m_tensor(std::exchange(other.m_tensor, {}))
+    {
+    }
+    UniqueTensor &operator=(UniqueTensor &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            m_backend = std::exchange(other.m_backend, nullptr);
+            m_tensor = std::exchange(other.m_tensor, {});
+        }
+        return *this;
+    }
+    ~UniqueTensor()
+    {
+        Reset();
+    }
+
+    TensorHandle Get() const
+    {
+        return m_tensor;
+    }
+    operator TensorHandle() const
+    {
+        return m_tensor;
+    }
+
+    // Gives up ownership without releasing the tensor.
+    TensorHandle Detach()
+    {
+        m_backend = nullptr;
+        return std::exchange(m_tensor, {});
+    }
+
+    void Reset()
+    {
+        if (m_backend && m_tensor)
+        {
+            try
+            {
+                m_backend->ReleaseTensor(m_tensor);
+            }
+            catch (...)
+            {
+            }
+        }
+        m_backend = nullptr;
+        m_tensor = {};
+    }
+
+  private:
+    TensorBackend *m_backend = nullptr;
+    TensorHandle m_tensor;
+};
+
+// Returns the DirectML processor for the first adapter whose description contains adapterNameFilter, or the CPU
+// backend if the filter is "CPU", DirectML is not available on this platform, or no adapter can be used. A
+// comma-separated list such as "NPU,GPU,CPU" opens every device it names in a calibrated MultiDeviceBackend.
+// startupProfilePath, if not empty, is where DirectML processors keep their startup profile (see
+// DirectMLProcessorOptions); each device of a list gets the path with its filter appended.
+std::unique_ptr<TensorBackend> CreateTensorBackend(const std::string &adapterNameFilter,
+                                                   const std::string &startupProfilePath = {});
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "BroadcastShape.hpp"
+
+// Storage of a tensor is sized separately from its logical shape, so a tensor reshaped from one request to the next
+// keeps its storage as long as the new shape fits. Backends read and write the logical elements as a prefix of the
+// storage.
+struct CapacityPolicy
+{
+    // A tensor that outgrows its storage gets at least this multiple of the old capacity, so a run of growing
+    // reshapes reallocates a logarithmic number of times.
+    double growthFactor = 1.5;
+
+    // Storage is given back once shrinkAfter reshapes in a row have needed at most 1 / shrinkRatio of it. A single
+    // small request between large ones keeps the storage.
+    uint32_t shrinkRatio = 4;
+    uint32_t shrinkAfter = 8;
+};
+
+// Byte capacity of one tensor's storage under a CapacityPolicy. The first Reserve sizes the storage exactly, so
+// tensors that are never reshaped cost nothing extra.
+//
+// Like the other bookkeeping classes this does not depend on D3D12, so the policy can be checked without a device.
+class TensorCapacity
+{
+  public:
+    uint64_t Bytes() const
+    {
+        return m_bytes;
+    }
+
+    // Makes room for required bytes. Returns true if the storage has to be reallocated to Bytes(), false if the
+    // current storage is kept.
+    bool Reserve(uint64_t required, const CapacityPolicy &policy)
+    {
+        if (m_bytes == 0)
+        {
+            m_bytes = required;
+            return true;
+        }
+        if (required > m_bytes)
+        {
+            m_bytes = std::max(required, Scale(m_bytes, policy.growthFactor));
+            m_smallCount = 0;
+            return true;
+        }
+        if (policy.shrinkRatio == 0 || required > m_bytes / policy.shrinkRatio)
+        {
+            m_smallCount = 0;
+            return false;
+        }
+        if (++m_smallCount < policy.shrinkAfter)
+        {
+            return false;
+        }
+        // Shrunk storage keeps headroom, so the next slightly larger request does not grow it straight back.
+        m_bytes = std::min(m_bytes, std::max(required, Scale(required, policy.growthFactor)));
+        m_smallCount = 0;
+        return true;
+    }
+
+  private:
+    static uint64_t Scale(uint64_t bytes, double factor)
+    {
+        return static_cast<uint64_t>(static_cast<double>(bytes) * std::max(factor, 1.0));
+    }
+
+    uint64_t m_bytes = 0;
+    uint32_t m_smallCount = 0; // Consecutive reshapes that needed at most 1 / shrinkRatio of the capacity.
+};
+
+// Rounds size up to the next of 1, 2, ..., 8, 10, 12, 14, 16, 20, 24, 28, 32, 40, ...: four buckets per doubling, so
+// padding adds less than 25%. Sizes whose bucket would not fit in 32 bits are kept as they are.
+inline uint32_t ShapeBucket(uint32_t size)
+{
+    if (size <= 8)
+    {
+        return size;
+    }
+    uint32_t log2 = 0;
+    while ((uint64_t(size) >> (log2 + 1)) != 0)
+    {
+        ++log2;
+    }
+    uint64_t step = uint64_t(1) << (log2 - 2);
+    uint64_t bucket = (size + step - 1) / step * step;
+    return bucket > UINT32_MAX ? size : static_cast<uint32_t>(bucket);
+}
+
+// Shapes that element-wise operators are compiled for, so that requests whose sizes vary share a few compiled
+// operators. Only the first dimension of the output that is not 1 is padded: every operand is 1 along the dimensions
+// before it, so padding appends elements after the logical ones, which keep their offsets. Operands broadcast along
+// that dimension stay 1, which keeps them broadcastable. The padded elements are computed from whatever the storage
+// holds past the logical ones and never read back.
+//
+// The axis is counted from the right, like broadcasting aligns shapes; an output with a single element has none.
+inline size_t PaddingAxisFromRight(const TensorShape &output)
+{
+    for (size_t i = 0; i < output.size(); ++i)
+    {
+        if (output[i] != 1)
+        {
+            return output.size() - i;
+        }
+    }
+    return 0;
+}
+
+// shape with the dimension axisFromRight places from the right rounded up to its bucket, unless it is 1.
+inline TensorShape PadShape(TensorShape shape, size_t axisFromRight)
+{
+    if (axisFromRight != 0 && axisFromRight <= shape.size())
+    {
+        uint32_t &size = shape[shape.size() - axisFromRight];
+        size = ShapeBucket(size);
+    }
+    return shape;
+}
+
+// The largest shape any operator pads shape to, which its storage has to hold.
+inline TensorShape PaddedShape(const TensorShape &shape)
+{
+    return PadShape(shape, PaddingAxisFromRight(shape));
+}
@@ -0,0 +1,835 @@
+#include "TensorFile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Both formats store contents little-endian; like the rest of the backends this assumes a little-endian host.
+//
+//   .npy          "\x93NUMPY", major and minor version, a little-endian header length (2 bytes in version 1, 4 in
+//                 versions 2 and 3), then a Python dict literal such as
+//                 {'descr': '<f4', 'fortran_order': False, 'shape': (2, 3), }
+//                 padded so the contents start 64-byte aligned.
+//   .safetensors  An 8-byte little-endian header length, then a JSON object such as
+//                 {"w": {"dtype": "F32", "shape": [2, 3], "data_offsets": [0, 24]}, "__metadata__": {...}}
+//                 whose offsets are relative to the end of the header.
+
+namespace
+{
+constexpr char c_npyMagic[] = "\x93NUMPY";
+constexpr size_t c_npyMagicSize = 6;
+constexpr size_t c_npyAlignment = 64;
+constexpr size_t c_safetensorsAlignment = 8;
+
+[[noreturn]] void Fail(const std::string &path, const std::string &what)
+{
+    throw std::runtime_error(path + ": " + what);
+}
+
+// Type names in both formats. Element size is implied by the TensorDataType.
+struct TypeName
+{
+    TensorDataType type;
+    const char *npy; // Without the byte order character.
+    const char *safetensors;
+};
+
+constexpr TypeName c_typeNames[] = {
+    {TensorDataType::Float64, "f8", "F64"}, {TensorDataType::Float32, "f4", "F32"},
+    {TensorDataType::Float16, "f2", "F16"}, {TensorDataType::Int64, "i8", "I64"},
+    {TensorDataType::Int32, "i4", "I32"},   {TensorDataType::Int16, "i2", "I16"},
+    {TensorDataType::Int8, "i1", "I8"},     {TensorDataType::UInt64, "u8", "U64"},
+    {TensorDataType::UInt32, "u4", "U32"},  {TensorDataType::UInt16, "u2", "U16"},
+    {TensorDataType::UInt8, "u1", "U8"},
+};
+
+const TypeName &NameOf(TensorDataType type)
+{
+    for (const TypeName &name : c_typeNames)
+    {
+        if (name.type == type)
+        {
+            return name;
+        }
+    }
+    throw std::invalid_argument("Tensor files cannot store tensors of this data type.");
+}
+
+uint64_t ReadLittleEndian(const uint8_t *data, size_t bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        value |= uint64_t(data[i]) << (8 * i);
+    }
+    return value;
+}
+
+void WriteLittleEndian(uint8_t *data, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        data[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+// Checks a parsed entry against the contents that follow the header: its size must match its shape and type and it
+// must lie within the file.
+void CheckEntry(const std::string &path, const TensorFileEntry &entry, uint64_t fileSize)
+{
+    uint64_t elements = 1;
+    for (uint32_t size : entry.shape)
+    {
+        if (size != 0 && elements > UINT64_MAX / size)
+        {
+            Fail(path, "tensor " + entry.name + " is too large.");
+        }
+        elements *= size;
+    }
+    if (elements > UINT64_MAX / DataTypeSize(entry.type) || elements * DataTypeSize(entry.type) != entry.size)
+    {
+        Fail(path, "the size of tensor " + entry.name + " does not match its shape.");
+    }
+    if (entry.offset > fileSize || entry.size > fileSize - entry.offset)
+    {
+        Fail(path, "tensor " + entry.name + " extends past the end of the file.");
+    }
+}
+
+// Reads the small subsets of Python literals and JSON the two headers are written in.
+class HeaderReader
+{
+  public:
+    HeaderReader(const std::string &path, const char *text, size_t size)
+        : m_path(path), m_text(text), m_end(text + size)
+    {
+    }
+
+    void SkipSpace()
+    {
+        while (m_text != m_end && (*m_text == ' ' || *m_text == '\t' || *m_text == '\n' || *m_text == '\r'))
+        {
+            ++m_text;
+        }
+    }
+
+    // Skips white space and consumes c if it comes next.
+    bool Accept(char c)
+    {
+        SkipSpace();
+        if (m_text != m_end && *m_text == c)
+        {
+            ++m_text;
+            return true;
+        }
+        return false;
+    }
+
+    void Expect(char c)
+    {
+        if (!Accept(c))
+        {
+            Fail(m_path, std::string("malformed header, expected '") + c + "'.");
+        }
+    }
+
+    bool AcceptWord(const char *word)
+    {
+        SkipSpace();
+        size_t length = strlen(word);
+        if (static_cast<size_t>(m_end - m_text) >= length && memcmp(m_text, word, length) == 0)
+        {
+            m_text += length;
+            return true;
+        }
+        return false;
+    }
+
+    // A string in single or double quotes. JSON escapes are decoded except \u, which is kept as written; the keys
+    // and type names this reads are ASCII.
+    std::string String()
+    {
+        SkipSpace();
+        if (m_text == m_end || (*m_text != '"' && *m_text != '\''))
+        {
+            Fail(m_path, "malformed header, expected a string.");
+        }
+        char quote = *m_text++;
+        std::string value;
+        while (m_text != m_end && *m_text != quote)
+        {
+            char c = *m_text++;
+            if (c == '\\' && m_text != m_end)
+            {
+                c = *m_text++;
+                switch (c)
+                {
+                case 'n':
+                    c = '\n';
+                    break;
+                case 't':
+                    c = '\t';
+                    break;
+                case 'r':
+                    c = '\r';
+                    break;
+                case 'b':
+                    c = '\b';
+                    break;
+                case 'f':
+                    c = '\f';
+                    break;
+                case 'u':
+                    value += '\\';
+                    break;
+                default:
+                    break;
+                }
+            }
+            value += c;
+        }
+        if (m_text == m_end)
+        {
+            Fail(m_path, "malformed header, unterminated string.");
+        }
+        ++m_text;
+        return value;
+    }
+
+    uint64_t Unsigned()
+    {
+        SkipSpace();
+        if (m_text == m_end || *m_text < '0' || *m_text > '9')
+        {
+            Fail(m_path, "malformed header, expected a number.");
+        }
+        uint64_t value = 0;
+        for (; m_text != m_end && *m_text >= '0' && *m_text <= '9'; ++m_text)
+        {
+            uint64_t digit = static_cast<uint64_t>(*m_text - '0');
+            if (value > (UINT64_MAX - digit) / 10)
+            {
+                Fail(m_path, "malformed header, number out of range.");
+            }
+            value = value * 10 + digit;
+        }
+        return value;
+    }
+
+    // A sequence of unsigned numbers between open and close, with an optional trailing comma as Python writes
+    // one-element tuples.
+    std::vector<uint64_t> Numbers(char open, char close)
+    {
+        std::vector<uint64_t> values;
+        Expect(open);
+        while (!Accept(close))
+        {
+            values.push_back(Unsigned());
+            if (!Accept(','))
+            {
+                Expect(close);
+                break;
+            }
+        }
+        return values;
+    }
+
+    // Skips any JSON value, for keys this does not use.
+    void SkipValue(uint32_t depth = 0)
+    {
+        if (depth > 64)
+        {
+            Fail(m_path, "malformed header, nested too deeply.");
+        }
+        SkipSpace();
+        if (m_text == m_end)
+        {
+            Fail(m_path, "malformed header, expected a value.");
+        }
+        if (*m_text == '"')
+        {
+            String();
+        }
+        else if (Accept('{'))
+        {
+            while (!Accept('}'))
+            {
+                String();
+                Expect(':');
+                SkipValue(depth + 1);
+                if (!Accept(','))
+                {
+                    Expect('}');
+                    break;
+                }
+            }
+        }
+        else if (Accept('['))
+        {
+            while (!Accept(']'))
+            {
+                SkipValue(depth + 1);
+                if (!Accept(','))
+                {
+                    Expect(']');
+                    break;
+                }
+            }
+        }
+        else
+        {
+            // Numbers and literals.
+            while (m_text != m_end && strchr(",}] \t\r\n", *m_text) == nullptr)
+            {
+                ++m_text;
+            }
+        }
+    }
+
+    bool AtEnd()
+    {
+        SkipSpace();
+        return m_text == m_end;
+    }
+
+  private:
+    const std::string &m_path;
+    const char *m_text;
+    const char *m_end;
+};
+
+TensorShape ToShape(const std::string &path, const std::vector<uint64_t> &dimensions)
+{
+    if (dimensions.size() > c_maxTensorRank)
+    {
+        Fail(path, "tensors of rank above " + std::to_string(c_maxTensorRank) + " are not supported.");
+    }
+    TensorShape shape;
+    for (uint64_t size : dimensions)
+    {
+        if (size > UINT32_MAX)
+        {
+            Fail(path, "tensor dimensions must fit in 32 bits.");
+        }
+        shape.push_back(static_cast<uint32_t>(size));
+    }
+    if (shape.empty())
+    {
+        shape.push_back(1);
+    }
+    return shape;
+}
+
+TensorFileEntry ParseNpy(const std::string &path, const MappedFile &file)
+{
+    const uint8_t *data = file.Data();
+    if (file.Size() < c_npyMagicSize + 4 || memcmp(data, c_npyMagic, c_npyMagicSize) != 0)
+    {
+        Fail(path, "not a .npy file.");
+    }
+    uint8_t major = data[c_npyMagicSize];
+    size_t lengthBytes = major == 1 ? 2 : 4;
+    if (major < 1 || major > 3 || file.Size() < c_npyMagicSize + 2 + lengthBytes)
+    {
+        Fail(path, "unsupported .npy version " + std::to_string(major) + ".");
+    }
+    uint64_t headerOffset = c_npyMagicSize + 2 + lengthBytes;
+    uint64_t headerLength = ReadLittleEndian(data + c_npyMagicSize + 2, lengthBytes);
+    if (headerLength > file.Size() - headerOffset)
+    {
+        Fail(path, "header extends past the end of the file.");
+    }
+
+    TensorFileEntry entry;
+    entry.name = std::filesystem::path(path).stem().string();
+    entry.offset = headerOffset + headerLength;
+
+    HeaderReader reader(path, reinterpret_cast<const char *>(data + headerOffset), static_cast<size_t>(headerLength));
+    bool haveDescr = false;
+    bool haveShape = false;
+    reader.Expect('{');
+    while (!reader.Accept('}'))
+    {
+        std::string key = reader.String();
+        reader.Expect(':');
+        if (key == "descr")
+        {
+            std::string descr = reader.String();
+            char order = descr.empty() ? '?' : descr[0];
+            std::string code = descr.empty() ? descr : descr.substr(1);
+            auto name = std::find_if(std::begin(c_typeNames), std::end(c_typeNames),
+                                     [&](const TypeName &n) { return code == n.npy; });
+            if (name == std::end(c_typeNames) || (order != '<' && order != '|' && order != '='))
+            {
+                Fail(path, "unsupported dtype " + descr + ".");
+            }
+            entry.type = name->type;
+            haveDescr = true;
+        }
+        else if (key == "fortran_order")
+        {
+            if (reader.AcceptWord("True"))
+            {
+                Fail(path, "Fortran-ordered arrays are not supported.");
+            }
+            if (!reader.AcceptWord("False"))
+            {
+                Fail(path, "malformed header, expected True or False.");
+            }
+        }
+        else if (key == "shape")
+        {
+            entry.shape = ToShape(path, reader.Numbers('(', ')'));
+            haveShape = true;
+        }
+        else
+        {
+            Fail(path, "unknown header key " + key + ".");
+        }
+        if (!reader.Accept(','))
+        {
+            reader.Expect('}');
+            break;
+        }
+    }
+    if (!haveDescr || !haveShape)
+    {
+        Fail(path, "header lacks descr or shape.");
+    }
+
+    entry.size = ElementCount(entry.shape) * DataTypeSize(entry.type);
+    CheckEntry(path, entry, file.Size());
+    return entry;
+}
+
+std::vector<TensorFileEntry> ParseSafetensors(const std::string &path, const MappedFile &file)
+{
+    if (file.Size() < 8)
+    {
+        Fail(path, "not a safetensors file.");
+    }
+    uint64_t headerLength = ReadLittleEndian(file.Data(), 8);
+    if (headerLength > file.Size() - 8)
+    {
+        Fail(path, "header extends past the end of the file.");
+    }
+    uint64_t dataOffset = 8 + headerLength;
+
+    std::vector<TensorFileEntry> entries;
+    HeaderReader reader(path, reinterpret_cast<const char *>(file.Data() + 8), static_cast<size_t>(headerLength));
+    reader.Expect('{');
+    while (!reader.Accept('}'))
+    {
+        std::string name = reader.String();
+        reader.Expect(':');
+        if (name == "__metadata__")
+        {
+            reader.SkipValue();
+        }
+        else
+        {
+            TensorFileEntry entry;
+            entry.name = name;
+            std::vector<uint64_t> offsets;
+            bool haveDtype = false;
+            bool haveShape = false;
+            reader.Expect('{');
+            while (!reader.Accept('}'))
+            {
+                std::string key = reader.String();
+                reader.Expect(':');
+                if (key == "dtype")
+                {
+                    std::string dtype = reader.String();
+                    auto type = std::find_if(std::begin(c_typeNames), std::end(c_typeNames),
+                                             [&](const TypeName &n) { return dtype == n.safetensors; });
+                    if (type == std::end(c_typeNames))
+                    {
+                        Fail(path, "unsupported dtype " + dtype + " of tensor " + name + ".");
+                    }
+                    entry.type = type->type;
+                    haveDtype = true;
+                }
+                else if (key == "shape")
+                {
+                    entry.shape = ToShape(path, reader.Numbers('[', ']'));
+                    haveShape = true;
+                }
+                else if (key == "data_offsets")
+                {
+                    offsets = reader.Numbers('[', ']');
+                }
+                else
+                {
+                    reader.SkipValue();
+                }
+                if (!reader.Accept(','))
+                {
+                    reader.Expect('}');
+                    break;
+                }
+            }
+            if (!haveDtype || !haveShape || offsets.size() != 2 || offsets[1] < offsets[0] ||
+                offsets[0] > UINT64_MAX - dataOffset)
+            {
+                Fail(path, "tensor " + name + " lacks a dtype, shape or valid data_offsets.");
+            }
+            entry.offset = dataOffset + offsets[0];
+            entry.size = offsets[1] - offsets[0];
+            CheckEntry(path, entry, file.Size());
+            entries.push_back(std::move(entry));
+        }
+        if (!reader.Accept(','))
+        {
+            reader.Expect('}');
+            break;
+        }
+    }
+    if (!reader.AtEnd())
+    {
+        Fail(path, "malformed header, trailing characters.");
+    }
+    return entries;
+}
+
+std::string NpyHeader(const TensorFileEntry &entry)
+{
+    std::string header = "{'descr': '<" + std::string(NameOf(entry.type).npy) + "', 'fortran_order': False, 'shape': (";
+    for (uint32_t size : entry.shape)
+    {
+        header += std::to_string(size) + ", ";
+    }
+    if (entry.shape.size() > 1)
+    {
+        // Python writes a one-element tuple with a trailing comma, and longer ones without.
+        header.resize(header.size() - 2);
+    }
+    else
+    {
+        header.pop_back();
+    }
+    header += "), }";
+    // Padded with spaces and a final newline so the contents start aligned.
+    size_t prefix = c_npyMagicSize + 2 + 2;
+    size_t padded = (prefix + header.size() + 1 + c_npyAlignment - 1) / c_npyAlignment * c_npyAlignment;
+    header.append(padded - prefix - header.size() - 1, ' ');
+    header += '\n';
+    return header;
+}
+
+std::string JsonQuoted(const std::string &text)
+{
+    std::string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            quoted += escaped;
+        }
+        else
+        {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+} // namespace
+
+std::shared_ptr<MappedFile> MappedFile::Open(const std::string &path)
+{
+    std::shared_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        Fail(path, "cannot open file.");
+    }
+    LARGE_INTEGER size{};
+    GetFileSizeEx(handle, &size);
+    file->m_size = static_cast<uint64_t>(size.QuadPart);
+    if (file->m_size != 0)
+    {
+        // The view keeps the mapping alive, so both handles can be closed once it exists.
+        HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+        {
+            file->m_data = static_cast<uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(handle);
+#else
+    int descriptor = open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+    {
+        Fail(path, "cannot open file.");
+    }
+    struct stat status{};
+    fstat(descriptor, &status);
+    file->m_size = static_cast<uint64_t>(status.st_size);
+    if (file->m_size != 0)
+    {
+        // The mapping holds its own reference to the file.
+        void *data = mmap(nullptr, static_cast<size_t>(file->m_size), PROT_READ, MAP_SHARED, descriptor, 0);
+        file->m_data = data == MAP_FAILED ? nullptr : static_cast<uint8_t *>(data);
+    }
+    close(descriptor);
+#endif
+    if (file->m_size != 0 && !file->m_data)
+    {
+        Fail(path, "cannot map file.");
+    }
+    return file;
+}
+
+std::shared_ptr<MappedFile> MappedFile::Create(const std::string &path, uint64_t size)
+{
+    std::shared_ptr<MappedFile> file(new MappedFile());
+    file->m_size = size;
+    file->m_writable = true;
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        Fail(path, "cannot create file.");
+    }
+    if (size != 0)
+    {
+        // Mapping a file with a maximum size beyond its end extends the file to that size.
+        HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+                                           static_cast<DWORD>(size), nullptr);
+        if (mapping)
+        {
+            file->m_data = static_cast<uint8_t *>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(handle);
+#else
+    int descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (descriptor < 0)
+    {
+        Fail(path, "cannot create file.");
+    }
+    if (size != 0 && ftruncate(descriptor, static_cast<off_t>(size)) == 0)
+    {
+        void *data = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+        file->m_data = data == MAP_FAILED ? nullptr : static_cast<uint8_t *>(data);
+    }
+    close(descriptor);
+#endif
+    if (size != 0 && !file->m_data)
+    {
+        Fail(path, "cannot map file for writing.");
+    }
+    return file;
+}
+
+std::shared_ptr<MappedFile> MappedFile::CreateTemporary(const std::string &directory, uint64_t size)
+{
+#ifdef _WIN32
+    // GetTempFileName creates the file under a unique name. A mapped file cannot be deleted on Windows, so it goes
+    // when the view is unmapped.
+    char path[MAX_PATH];
+    if (GetTempFileNameA(directory.c_str(), "dml", 0, path) == 0)
+    {
+        Fail(directory, "cannot create a temporary file.");
+    }
+    std::shared_ptr<MappedFile> file = Create(path, size);
+    file->m_deleteOnUnmap = path;
+    return file;
+#else
+    // The name is unlinked as soon as the file is mapped; the mapping keeps the file itself until it is unmapped.
+    std::string pattern = (std::filesystem::path(directory) / "hello_dml_XXXXXX").string();
+    int descriptor = mkstemp(pattern.data());
+    if (descriptor < 0)
+    {
+        Fail(directory, "cannot create a temporary file.");
+    }
+    close(descriptor);
+    std::shared_ptr<MappedFile> file;
+    try
+    {
+        file = Create(pattern, size);
+    }
+    catch (...)
+    {
+        unlink(pattern.c_str());
+        throw;
+    }
+    unlink(pattern.c_str());
+    return file;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+#else
+        munmap(m_data, static_cast<size_t>(m_size));
+#endif
+    }
+    if (!m_deleteOnUnmap.empty())
+    {
+        std::error_code error;
+        std::filesystem::remove(m_deleteOnUnmap, error);
+    }
+}
+
+void MappedFile::AdviseSequential(uint64_t offset, uint64_t size) const
+{
+#ifndef _WIN32
+    // madvise takes page-aligned ranges.
+    uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t begin = offset / pageSize * pageSize;
+    if (m_data && begin < m_size)
+    {
+        size_t length = static_cast<size_t>(std::min(offset + size, m_size) - begin);
+        madvise(m_data + begin, length, MADV_SEQUENTIAL);
+        madvise(m_data + begin, length, MADV_WILLNEED);
+    }
+#else
+    // FILE_FLAG_SEQUENTIAL_SCAN on the file already asks for read-ahead.
+    (void)offset;
+    (void)size;
+#endif
+}
+
+TensorFileFormat TensorFileFormatFor(const std::string &path)
+{
+    std::string extension = std::filesystem::path(path).extension().string();
+    if (extension == ".npy")
+    {
+        return TensorFileFormat::Npy;
+    }
+    if (extension == ".safetensors")
+    {
+        return TensorFileFormat::Safetensors;
+    }
+    throw std::invalid_argument(path + ": tensor files must end in .npy or .safetensors.");
+}
+
+TensorFile::TensorFile(const std::string &path)
+{
+    TensorFileFormat format = TensorFileFormatFor(path);
+    m_file = MappedFile::Open(path);
+    if (format == TensorFileFormat::Npy)
+    {
+        m_entries.push_back(ParseNpy(path, *m_file));
+    }
+    else
+    {
+        m_entries = ParseSafetensors(path, *m_file);
+    }
+}
+
+TensorFileWriter::TensorFileWriter(const std::string &path, std::vector<TensorFileEntry> entries)
+    : m_entries(std::move(entries))
+{
+    TensorFileFormat format = TensorFileFormatFor(path);
+    for (TensorFileEntry &entry : m_entries)
+    {
+        NameOf(entry.type);
+        entry.size = ElementCount(entry.shape) * DataTypeSize(entry.type);
+    }
+
+    std::string header;
+    uint64_t dataOffset = 0;
+    if (format == TensorFileFormat::Npy)
+    {
+        if (m_entries.size() != 1)
+        {
+            throw std::invalid_argument(path + ": a .npy file holds exactly one tensor.");
+        }
+        header = NpyHeader(m_entries[0]);
+        if (header.size() > UINT16_MAX)
+        {
+            throw std::invalid_argument(path + ": .npy header too long.");
+        }
+        m_entries[0].offset = c_npyMagicSize + 2 + 2 + header.size();
+    }
+    else
+    {
+        // Packed largest elements first, so every tensor starts aligned to its element size.
+        std::vector<size_t> order(m_entries.size());
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return DataTypeSize(m_entries[a].type) > DataTypeSize(m_entries[b].type);
+        });
+        uint64_t offset = 0;
+        for (size_t index : order)
+        {
+            m_entries[index].offset = offset;
+            offset += m_entries[index].size;
+        }
+
+        header = "{";
+        for (const TensorFileEntry &entry : m_entries)
+        {
+            header += (header.size() == 1 ? "" : ",") + JsonQuoted(entry.name) + ":{\"dtype\":\"" +
+                      NameOf(entry.type).safetensors + "\",\"shape\":[";
+            for (size_t i = 0; i < entry.shape.size(); ++i)
+            {
+                header += (i == 0 ? "" : ",") + std::to_string(entry.shape[i]);
+            }
+            header += "],\"data_offsets\":[" + std::to_string(entry.offset) + "," +
+                      std::to_string(entry.offset + entry.size) + "]}";
+        }
+        header += "}";
+        // Padded with spaces, which the format allows, so the contents start 8-byte aligned.
+        header.append((c_safetensorsAlignment - (8 + header.size()) % c_safetensorsAlignment) % c_safetensorsAlignment,
+                      ' ');
+        dataOffset = 8 + header.size();
+        for (TensorFileEntry &entry : m_entries)
+        {
+            entry.offset += dataOffset;
+        }
+    }
+
+    uint64_t fileSize = 0;
+    for (const TensorFileEntry &entry : m_entries)
+    {
+        fileSize = std::max(fileSize, entry.offset + entry.size);
+    }
+    m_file = MappedFile::Create(path, fileSize);
+    uint8_t *data = m_file->MutableData();
+    if (format == TensorFileFormat::Npy)
+    {
+        memcpy(data, c_npyMagic, c_npyMagicSize);
+        data[c_npyMagicSize] = 1;
+        data[c_npyMagicSize + 1] = 0;
+        WriteLittleEndian(data + c_npyMagicSize + 2, header.size(), 2);
+        memcpy(data + c_npyMagicSize + 4, header.data(), header.size());
+    }
+    else
+    {
+        WriteLittleEndian(data, header.size(), 8);
+        memcpy(data + 8, header.data(), header.size());
+    }
+}
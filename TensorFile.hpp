@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "BroadcastShape.hpp"
+#include "TensorBackend.hpp"
+
+// A whole file mapped into memory, read-only or, for a file created with a size, writable. Pages are read in from the
+// file when first touched, so mapping a multi-GB file costs nothing until its tensors are used, and the page cache
+// is the only host copy.
+class MappedFile
+{
+  public:
+    // Throws std::runtime_error if path cannot be opened or mapped.
+    static std::shared_ptr<MappedFile> Open(const std::string &path);
+    // Creates or truncates path to size bytes and maps it for writing. Writes reach the file through the page cache.
+    static std::shared_ptr<MappedFile> Create(const std::string &path, uint64_t size);
+    // Maps a new file of size bytes with a unique name in directory for writing, for contents spilled out of memory.
+    // The file is deleted once it is unmapped, or right away where an open mapping keeps it alive.
+    static std::shared_ptr<MappedFile> CreateTemporary(const std::string &directory, uint64_t size);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const uint8_t *Data() const
+    {
+        return m_data;
+    }
+    uint8_t *MutableData() const
+    {
+        return m_writable ? m_data : nullptr;
+    }
+    uint64_t Size() const
+    {
+        return m_size;
+    }
+
+    // Tells the kernel that [offset, offset + size) is about to be read once front to back, so it reads ahead in
+    // large chunks. Only a hint; does nothing where it is not supported.
+    void AdviseSequential(uint64_t offset, uint64_t size) const;
+
+  private:
+    MappedFile() = default;
+
+    uint8_t *m_data = nullptr;
+    uint64_t m_size = 0;
+    bool m_writable = false;
+    std::string m_deleteOnUnmap;
+};
+
+// One tensor stored in a file: its name, shape and type from the header, and where its little-endian, row-major
+// contents are within the file.
+struct TensorFileEntry
+{
+    std::string name;
+    TensorShape shape;
+    TensorDataType type = TensorDataType::Unknown;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+enum class TensorFileFormat
+{
+    Npy,         // A single tensor, named after the file's stem.
+    Safetensors, // Any number of named tensors.
+};
+
+// The format path names by its extension, .npy or .safetensors. Throws std::invalid_argument for any other.
+TensorFileFormat TensorFileFormatFor(const std::string &path);
+
+// A mapped .npy or safetensors file with its header parsed. Types without a TensorDataType, such as bfloat16 and
+// bool, big-endian and Fortran-ordered arrays, and headers whose entries do not fit in the file are rejected with a
+// std::runtime_error naming the file. A scalar is read as a tensor of shape {1}.
+class TensorFile
+{
+  public:
+    explicit TensorFile(const std::string &path);
+
+    const std::vector<TensorFileEntry> &Entries() const
+    {
+        return m_entries;
+    }
+
+    const uint8_t *Data(const TensorFileEntry &entry) const
+    {
+        return m_file->Data() + entry.offset;
+    }
+
+    // Shared with whatever keeps views of the mapped pages, such as CPU tensors.
+    const std::shared_ptr<MappedFile> &Mapping() const
+    {
+        return m_file;
+    }
+
+  private:
+    std::shared_ptr<MappedFile> m_file;
+    std::vector<TensorFileEntry> m_entries;
+};
+
+// Lays out a .npy or safetensors file for the given entries, whose name, shape and type are set, writes the header
+// and maps the file so the contents of each entry can be written in place. A .npy file takes exactly one entry.
+// Safetensors contents are packed by descending element size, so every tensor is aligned to its element size.
+class TensorFileWriter
+{
+  public:
+    TensorFileWriter(const std::string &path, std::vector<TensorFileEntry> entries);
+
+    // Entries with their offset and size filled in, in the order given.
+    const std::vector<TensorFileEntry> &Entries() const
+    {
+        return m_entries;
+    }
+
+    uint8_t *Data(const TensorFileEntry &entry) const
+    {
+        return m_file->MutableData() + entry.offset;
+    }
+
+  private:
+    std::shared_ptr<MappedFile> m_file;
+    std::vector<TensorFileEntry> m_entries;
+};
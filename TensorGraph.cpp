@@ -0,0 +1,310 @@
+#include "TensorGraph.hpp"
+
+#include "BroadcastShape.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+TensorGraph::NodeId TensorGraph::AddNode(GraphNode node)
+{
+    for (NodeId input : node.inputs)
+    {
+        if (input >= m_nodes.size())
+        {
+            throw std::invalid_argument("TensorGraph node refers to an unknown input node.");
+        }
+    }
+    m_nodes.push_back(std::move(node));
+    return static_cast<NodeId>(m_nodes.size() - 1);
+}
+
+TensorGraph::NodeId TensorGraph::Input(const std::string &tensor)
+{
+    // Referencing the same tensor twice yields the same input node.
+    auto it = m_inputNodes.find(tensor);
+    if (it != m_inputNodes.end())
+    {
+        return it->second;
+    }
+
+    GraphNode node;
+    node.op = GraphOp::Input;
+    node.inputIndex = static_cast<uint32_t>(m_inputNames.size());
+    NodeId id = AddNode(node);
+    m_inputNames.push_back(tensor);
+    m_inputNodes.emplace(tensor, id);
+    return id;
+}
+
+TensorGraph::NodeId TensorGraph::AddNode(GraphOp op, std::vector<NodeId> inputs, uint32_t axis, float alpha)
+{
+    GraphNode node;
+    node.op = op;
+    node.inputs = std::move(inputs);
+    node.axis = axis;
+    node.alpha = alpha;
+    return AddNode(std::move(node));
+}
+
+TensorGraph::NodeId TensorGraph::Add(NodeId a, NodeId b)
+{
+    return AddNode(GraphOp::Add, {a, b});
+}
+
+TensorGraph::NodeId TensorGraph::Subtract(NodeId a, NodeId b)
+{
+    return AddNode(GraphOp::Subtract, {a, b});
+}
+
+TensorGraph::NodeId TensorGraph::Multiply(NodeId a, NodeId b)
+{
+    return AddNode(GraphOp::Multiply, {a, b});
+}
+
+TensorGraph::NodeId TensorGraph::Divide(NodeId a, NodeId b)
+{
+    return AddNode(GraphOp::Divide, {a, b});
+}
+
+TensorGraph::NodeId TensorGraph::Maximum(NodeId a, NodeId b)
+{
+    return AddNode(GraphOp::Maximum, {a, b});
+}
+
+TensorGraph::NodeId TensorGraph::Minimum(NodeId a, NodeId b)
+{
+    return AddNode(GraphOp::Minimum, {a, b});
+}
+
+TensorGraph::NodeId TensorGraph::Relu(NodeId x)
+{
+    return AddNode(GraphOp::Relu, {x});
+}
+
+TensorGraph::NodeId TensorGraph::Sigmoid(NodeId x)
+{
+    return AddNode(GraphOp::Sigmoid, {x});
+}
+
+TensorGraph::NodeId TensorGraph::Tanh(NodeId x)
+{
+    return AddNode(GraphOp::Tanh, {x});
+}
+
+TensorGraph::NodeId TensorGraph::LeakyRelu(NodeId x, float alpha)
+{
+    return AddNode(GraphOp::LeakyRelu, {x}, 0, alpha);
+}
+
+TensorGraph::NodeId TensorGraph::ReduceSum(NodeId x, uint32_t axis)
+{
+    return AddNode(GraphOp::ReduceSum, {x}, axis);
+}
+
+TensorGraph::NodeId TensorGraph::ReduceMean(NodeId x, uint32_t axis)
+{
+    return AddNode(GraphOp::ReduceMean, {x}, axis);
+}
+
+TensorGraph::NodeId TensorGraph::ReduceMax(NodeId x, uint32_t axis)
+{
+    return AddNode(GraphOp::ReduceMax, {x}, axis);
+}
+
+void TensorGraph::Output(NodeId node, const std::string &tensor)
+{
+    if (node >= m_nodes.size())
+    {
+        throw std::invalid_argument("TensorGraph output refers to an unknown node.");
+    }
+    m_outputNodes.push_back(node);
+    m_outputNames.push_back(tensor);
+}
+
+std::string TensorGraph::Signature() const
+{
+    std::ostringstream signature;
+    for (const GraphNode &node : m_nodes)
+    {
+        signature << static_cast<uint32_t>(node.op);
+        for (NodeId input : node.inputs)
+        {
+            signature << ',' << input;
+        }
+        signature << ':' << node.inputIndex << ':' << node.axis << ':' << std::hexfloat << node.alpha << ';';
+    }
+    signature << '>';
+    for (NodeId output : m_outputNodes)
+    {
+        signature << output << ';';
+    }
+    return signature.str();
+}
+
+namespace
+{
+HostTensor Binary(const HostTensor &a, const HostTensor &b, const std::function<float(float, float)> &function)
+{
+    HostTensor result;
+    result.shape = BroadcastShapes(a.shape, b.shape);
+    result.data.resize(ElementCount(result.shape));
+
+    std::vector<uint32_t> stridesA = BroadcastStrides(a.shape, result.shape);
+    std::vector<uint32_t> stridesB = BroadcastStrides(b.shape, result.shape);
+    std::vector<uint32_t> index(result.shape.size(), 0);
+    size_t offsetA = 0, offsetB = 0;
+
+    for (size_t i = 0; i < result.data.size(); ++i)
+    {
+        result.data[i] = function(a.data[offsetA], b.data[offsetB]);
+
+        // Advance the multi-dimensional index, innermost dimension first.
+        for (size_t d = result.shape.size(); d-- > 0;)
+        {
+            offsetA += stridesA[d];
+            offsetB += stridesB[d];
+            if (++index[d] < result.shape[d])
+            {
+                break;
+            }
+            offsetA -= size_t(stridesA[d]) * index[d];
+            offsetB -= size_t(stridesB[d]) * index[d];
+            index[d] = 0;
+        }
+    }
+    return result;
+}
+
+HostTensor Unary(HostTensor x, const std::function<float(float)> &function)
+{
+    for (float &value : x.data)
+    {
+        value = function(value);
+    }
+    return x;
+}
+
+HostTensor Reduce(const HostTensor &x, uint32_t axis, GraphOp op)
+{
+    if (axis >= x.shape.size())
+    {
+        throw std::invalid_argument("TensorGraph reduction axis is out of range.");
+    }
+
+    size_t outer = 1, inner = 1;
+    for (uint32_t d = 0; d < axis; ++d)
+    {
+        outer *= x.shape[d];
+    }
+    for (size_t d = axis + 1; d < x.shape.size(); ++d)
+    {
+        inner *= x.shape[d];
+    }
+    size_t reduced = x.shape[axis];
+
+    HostTensor result;
+    result.shape = x.shape;
+    result.shape[axis] = 1;
+    result.data.assign(outer * inner,
+                       op == GraphOp::ReduceMax ? -std::numeric_limits<float>::infinity() : 0.0f);
+
+    for (size_t o = 0; o < outer; ++o)
+    {
+        for (size_t r = 0; r < reduced; ++r)
+        {
+            const float *source = x.data.data() + (o * reduced + r) * inner;
+            float *destination = result.data.data() + o * inner;
+            for (size_t i = 0; i < inner; ++i)
+            {
+                destination[i] = op == GraphOp::ReduceMax ? std::max(destination[i], source[i])
+                                                          : destination[i] + source[i];
+            }
+        }
+    }
+
+    if (op == GraphOp::ReduceMean && reduced != 0)
+    {
+        for (float &value : result.data)
+        {
+            value /= static_cast<float>(reduced);
+        }
+    }
+    return result;
+}
+} // namespace
+
+void RunGraphOnCpu(const TensorGraph &graph, std::unordered_map<std::string, HostTensor> &tensors)
+{
+    const auto &nodes = graph.Nodes();
+    std::vector<HostTensor> values(nodes.size());
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        const GraphNode &node = nodes[i];
+        auto input = [&](size_t n) -> const HostTensor & { return values[node.inputs[n]]; };
+
+        switch (node.op)
+        {
+        case GraphOp::Input: {
+            const std::string &name = graph.InputNames()[node.inputIndex];
+            auto it = tensors.find(name);
+            if (it == tensors.end())
+            {
+                throw std::invalid_argument("Tensor " + name + " not found.");
+            }
+            if (it->second.data.size() != ElementCount(it->second.shape))
+            {
+                throw std::invalid_argument("Tensor " + name + " data does not match its shape.");
+            }
+            values[i] = it->second;
+            break;
+        }
+        case GraphOp::Add:
+            values[i] = Binary(input(0), input(1), [](float a, float b) { return a + b; });
+            break;
+        case GraphOp::Subtract:
+            values[i] = Binary(input(0), input(1), [](float a, float b) { return a - b; });
+            break;
+        case GraphOp::Multiply:
+            values[i] = Binary(input(0), input(1), [](float a, float b) { return a * b; });
+            break;
+        case GraphOp::Divide:
+            values[i] = Binary(input(0), input(1), [](float a, float b) { return a / b; });
+            break;
+        case GraphOp::Maximum:
+            values[i] = Binary(input(0), input(1), [](float a, float b) { return std::max(a, b); });
+            break;
+        case GraphOp::Minimum:
+            values[i] = Binary(input(0), input(1), [](float a, float b) { return std::min(a, b); });
+            break;
+        case GraphOp::Relu:
+            values[i] = Unary(input(0), [](float x) { return std::max(x, 0.0f); });
+            break;
+        case GraphOp::LeakyRelu: {
+            float alpha = node.alpha;
+            values[i] = Unary(input(0), [alpha](float x) { return x < 0.0f ? alpha * x : x; });
+            break;
+        }
+        case GraphOp::Sigmoid:
+            values[i] = Unary(input(0), [](float x) { return 1.0f / (1.0f + std::exp(-x)); });
+            break;
+        case GraphOp::Tanh:
+            values[i] = Unary(input(0), [](float x) { return std::tanh(x); });
+            break;
+        case GraphOp::ReduceSum:
+        case GraphOp::ReduceMean:
+        case GraphOp::ReduceMax:
+            values[i] = Reduce(input(0), node.axis, node.op);
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < graph.OutputNodes().size(); ++i)
+    {
+        tensors[graph.OutputNames()[i]] = values[graph.OutputNodes()[i]];
+    }
+}
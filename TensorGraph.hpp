@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Backend-independent description of a subgraph over named tensors. DirectMLProcessor compiles it into a single
+// DirectML operator; RunGraphOnCpu evaluates the same description on the host so graphs can be checked without a
+// device.
+enum class GraphOp : uint32_t
+{
+    Input,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Maximum,
+    Minimum,
+    Relu,
+    LeakyRelu,
+    Sigmoid,
+    Tanh,
+    ReduceSum,
+    ReduceMean,
+    ReduceMax,
+};
+
+struct GraphNode
+{
+    GraphOp op = GraphOp::Input;
+    std::vector<uint32_t> inputs;
+    uint32_t inputIndex = 0; // GraphOp::Input: index into TensorGraph::InputNames()
+    uint32_t axis = 0;       // Reductions; the reduced dimension is kept with size 1.
+    float alpha = 0.0f;      // LeakyRelu
+};
+
+class TensorGraph
+{
+  public:
+    using NodeId = uint32_t;
+
+    NodeId Input(const std::string &tensor);
+
+    NodeId Add(NodeId a, NodeId b);
+    NodeId Subtract(NodeId a, NodeId b);
+    NodeId Multiply(NodeId a, NodeId b);
+    NodeId Divide(NodeId a, NodeId b);
+    NodeId Maximum(NodeId a, NodeId b);
+    NodeId Minimum(NodeId a, NodeId b);
+
+    NodeId Relu(NodeId x);
+    NodeId LeakyRelu(NodeId x, float alpha);
+    NodeId Sigmoid(NodeId x);
+    NodeId Tanh(NodeId x);
+
+    NodeId ReduceSum(NodeId x, uint32_t axis);
+    NodeId ReduceMean(NodeId x, uint32_t axis);
+    NodeId ReduceMax(NodeId x, uint32_t axis);
+
+    // Marks node as a result that is written to the named tensor. Only outputs are ever materialized.
+    void Output(NodeId node, const std::string &tensor);
+
+    const std::vector<GraphNode> &Nodes() const
+    {
+        return m_nodes;
+    }
+    const std::vector<std::string> &InputNames() const
+    {
+        return m_inputNames;
+    }
+    const std::vector<std::string> &OutputNames() const
+    {
+        return m_outputNames;
+    }
+    const std::vector<NodeId> &OutputNodes() const
+    {
+        return m_outputNodes;
+    }
+
+    // Structure of the graph without tensor names, used as part of the compiled operator cache key.
+    std::string Signature() const;
+
+  private:
+    NodeId AddNode(GraphNode node);
+    NodeId AddNode(GraphOp op, std::vector<NodeId> inputs, uint32_t axis = 0, float alpha = 0.0f);
+
+    std::vector<GraphNode> m_nodes;
+    std::vector<std::string> m_inputNames;
+    std::unordered_map<std::string, NodeId> m_inputNodes;
+    std::vector<std::string> m_outputNames;
+    std::vector<NodeId> m_outputNodes;
+};
+
+struct HostTensor
+{
+    std::vector<uint32_t> shape;
+    std::vector<float> data;
+};
+
+// Reference interpreter for float32 graphs. Reads the graph inputs from tensors and stores each output into it.
+void RunGraphOnCpu(const TensorGraph &graph, std::unordered_map<std::string, HostTensor> &tensors);
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "SlotMap.hpp"
+
+using TensorHandle = SlotHandle;
+
+// A backend's tensors: a SlotMap addressed by TensorHandle, plus names interned to handles for the name-based API.
+// Calls from several threads may look tensors up and create them at once. Handle lookups take no lock; a
+// reader-writer lock guards the names and serializes creation and erasure. A tensor stays at the same address until
+// it is erased, so callers keep using it without holding anything. Callers synchronize access to the tensors
+// themselves.
+//
+// Like the other bookkeeping classes this does not depend on D3D12.
+template <typename T> class TensorTable
+{
+  public:
+    TensorTable() = default;
+    TensorTable(const TensorTable &) = delete;
+    TensorTable &operator=(const TensorTable &) = delete;
+
+    // Null if handle is null or its tensor has been erased.
+    T *Find(TensorHandle handle)
+    {
+        Entry *entry = m_entries.Get(handle);
+        return entry ? &entry->value : nullptr;
+    }
+
+    const T *Find(TensorHandle handle) const
+    {
+        const Entry *entry = m_entries.Get(handle);
+        return entry ? &entry->value : nullptr;
+    }
+
+    T &Get(TensorHandle handle)
+    {
+        return const_cast<T &>(static_cast<const TensorTable *>(this)->Get(handle));
+    }
+    const T &Get(TensorHandle handle) const
+    {
+        if (const T *tensor = Find(handle))
+        {
+            return *tensor;
+        }
+        throw std::invalid_argument(handle ? "Tensor handle refers to a released tensor." : "Null tensor handle.");
+    }
+
+    // Null if no tensor is called name.
+    TensorHandle Find(const std::string &name) const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        auto it = m_names.find(name);
+        return it == m_names.end() ? TensorHandle{} : it->second;
+    }
+
+    // Returns the tensor called name, calling create() for its value if there is none. create runs under the
+    // exclusive lock, so two threads creating the same name never both create it. An empty name always creates an
+    // anonymous tensor, reachable only through its handle.
+    template <typename Create> std::pair<TensorHandle, T *> FindOrCreate(const std::string &name, Create &&create)
+    {
+        if (!name.empty())
+        {
+            std::shared_lock<std::shared_mutex> lock(m_mutex);
+            auto it = m_names.find(name);
+            if (it != m_names.end())
+            {
+                return {it->second, &m_entries.Get(it->second)->value};
+            }
+        }
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        if (!name.empty())
+        {
+            auto it = m_names.find(name);
+            if (it != m_names.end())
+            {
+                return {it->second, &m_entries.Get(it->second)->value};
+            }
+        }
+        TensorHandle handle = m_entries.Emplace(Entry{name, create()});
+        if (!name.empty())
+        {
+            m_names.emplace(name, handle);
+        }
+        return {handle, &m_entries.Get(handle)->value};
+    }
+
+    // Moves the tensor out, unbinds its name and invalidates every handle to it.
+    std::optional<T> Erase(TensorHandle handle)
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        std::optional<Entry> erased = m_entries.Erase(handle);
+        if (!erased)
+        {
+            return std::nullopt;
+        }
+        if (!erased->name.empty())
+        {
+            m_names.erase(erased->name);
+        }
+        return std::move(erased->value);
+    }
+
+    // Calls function(handle, tensor) for every tensor in slot order. Holds the shared lock, which keeps tensors from
+    // being created or erased meanwhile.
+    template <typename Function> void ForEach(Function &&function)
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        m_entries.ForEach([&](TensorHandle handle, Entry &entry) { function(handle, entry.value); });
+    }
+    template <typename Function> void ForEach(Function &&function) const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        m_entries.ForEach([&](TensorHandle handle, const Entry &entry) { function(handle, entry.value); });
+    }
+
+    size_t Size() const
+    {
+        std::shared_lock<std::shared_mutex> lock(m_mutex);
+        return m_entries.Size();
+    }
+
+    void Clear()
+    {
+        std::unique_lock<std::shared_mutex> lock(m_mutex);
+        m_entries.Clear();
+        m_names.clear();
+    }
+
+  private:
+    struct Entry
+    {
+        std::string name;
+        T value;
+    };
+
+    mutable std::shared_mutex m_mutex;
+    SlotMap<Entry> m_entries;
+    std::unordered_map<std::string, TensorHandle> m_names;
+};
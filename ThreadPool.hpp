@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops. The calling thread takes part in every ParallelFor, so a pool
+// of one thread runs everything inline. Only one ParallelFor runs at a time.
+class ThreadPool
+{
+  public:
+    // threadCount includes the calling thread; 0 uses every hardware thread.
+    explicit ThreadPool(size_t threadCount = 0)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (size_t i = 1; i < threadCount; ++i)
+        {
+            m_workers.emplace_back([this]() { WorkerLoop(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for (std::thread &worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t ThreadCount() const
+    {
+        return m_workers.size() + 1;
+    }
+
+    // Splits [0, count) into chunks of at least grain items and calls body(begin, end) for each, on all threads.
+    // Returns once every chunk is done; the first exception thrown by body is rethrown here.
+    void ParallelFor(uint64_t count, uint64_t grain, const std::function<void(uint64_t, uint64_t)> &body)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        grain = std::max<uint64_t>(grain, 1);
+        uint64_t chunkCount = std::min<uint64_t>((count + grain - 1) / grain, ThreadCount() * 4);
+        if (chunkCount <= 1 || m_workers.empty())
+        {
+            body(0, count);
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_body = &body;
+        m_count = count;
+        m_chunkSize = (count + chunkCount - 1) / chunkCount;
+        m_chunkCount = (count + m_chunkSize - 1) / m_chunkSize;
+        m_nextChunk = 0;
+        m_pendingChunks = m_chunkCount;
+        m_error = nullptr;
+        ++m_generation;
+        lock.unlock();
+        m_wake.notify_all();
+
+        RunChunks();
+
+        lock.lock();
+        m_done.wait(lock, [this]() { return m_pendingChunks == 0 && m_activeWorkers == 0; });
+        m_body = nullptr;
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+  private:
+    void WorkerLoop()
+    {
+        uint64_t seenGeneration = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_wake.wait(lock, [&]() { return m_stopping || m_generation != seenGeneration; });
+            if (m_stopping)
+            {
+                return;
+            }
+            seenGeneration = m_generation;
+            ++m_activeWorkers;
+            lock.unlock();
+
+            RunChunks();
+
+            lock.lock();
+            if (--m_activeWorkers == 0 && m_pendingChunks == 0)
+            {
+                m_done.notify_all();
+            }
+        }
+    }
+
+    void RunChunks()
+    {
+        while (true)
+        {
+            uint64_t chunk = m_nextChunk.fetch_add(1);
+            if (chunk >= m_chunkCount)
+            {
+                return;
+            }
+            uint64_t begin = chunk * m_chunkSize;
+            uint64_t end = std::min(begin + m_chunkSize, m_count);
+            try
+            {
+                (*m_body)(begin, end);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_error)
+                {
+                    m_error = std::current_exception();
+                }
+            }
+            if (m_pendingChunks.fetch_sub(1) == 1)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    bool m_stopping = false;
+    uint64_t m_generation = 0;
+    size_t m_activeWorkers = 0;
+
+    // The loop being run. Written under m_mutex before m_generation is bumped.
+    const std::function<void(uint64_t, uint64_t)> *m_body = nullptr;
+    uint64_t m_count = 0;
+    uint64_t m_chunkSize = 0;
+    uint64_t m_chunkCount = 0;
+    std::atomic<uint64_t> m_nextChunk{0};
+    std::atomic<uint64_t> m_pendingChunks{0};
+    std::exception_ptr m_error;
+};
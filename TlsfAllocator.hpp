@@ -0,0 +1,331 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+// Two-level segregated fit (TLSF) allocator over a range of offsets. It manages offsets only, so it can back any
+// kind of memory (D3D12 heaps here) and can be exercised without a device. Allocation and free are O(1); adjacent
+// free blocks are coalesced on free.
+class TlsfAllocator
+{
+  public:
+    struct Allocation
+    {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+        uint32_t node = c_invalidNode;
+
+        bool IsValid() const
+        {
+            return node != c_invalidNode;
+        }
+    };
+
+    struct Stats
+    {
+        uint64_t capacity = 0;
+        uint64_t usedBytes = 0;
+        uint64_t freeBytes = 0;
+        uint64_t largestFreeBlock = 0;
+        uint32_t allocationCount = 0;
+        uint32_t freeBlockCount = 0;
+
+        // 0 when all free space is one block, approaching 1 as it splinters.
+        double Fragmentation() const
+        {
+            return freeBytes == 0 ? 0.0 : 1.0 - static_cast<double>(largestFreeBlock) / static_cast<double>(freeBytes);
+        }
+    };
+
+    // Every offset and size is a multiple of granularity, which must be a power of two.
+    explicit TlsfAllocator(uint64_t capacity = 0, uint64_t granularity = 256)
+        : m_granularity(granularity)
+    {
+        if (granularity == 0 || (granularity & (granularity - 1)) != 0)
+        {
+            throw std::invalid_argument("TlsfAllocator granularity must be a power of two.");
+        }
+        m_capacityUnits = capacity / granularity;
+        for (auto &heads : m_freeHeads)
+        {
+            for (uint32_t &head : heads)
+            {
+                head = c_invalidNode;
+            }
+        }
+        if (m_capacityUnits != 0)
+        {
+            uint32_t node = NewNode(0, m_capacityUnits);
+            InsertFree(node);
+        }
+    }
+
+    uint64_t Capacity() const
+    {
+        return m_capacityUnits * m_granularity;
+    }
+
+    std::optional<Allocation> Allocate(uint64_t size)
+    {
+        if (size == 0)
+        {
+            return std::nullopt;
+        }
+        uint64_t units = (size + m_granularity - 1) / m_granularity;
+        if (units > m_capacityUnits)
+        {
+            return std::nullopt;
+        }
+
+        uint32_t node = FindSuitable(units);
+        if (node == c_invalidNode)
+        {
+            return std::nullopt;
+        }
+        RemoveFree(node);
+
+        // Return the tail of the block to the free lists.
+        if (m_nodes[node].size > units)
+        {
+            uint32_t remainder = NewNode(m_nodes[node].offset + units, m_nodes[node].size - units);
+            m_nodes[remainder].prevPhysical = node;
+            m_nodes[remainder].nextPhysical = m_nodes[node].nextPhysical;
+            if (m_nodes[node].nextPhysical != c_invalidNode)
+            {
+                m_nodes[m_nodes[node].nextPhysical].prevPhysical = remainder;
+            }
+            m_nodes[node].nextPhysical = remainder;
+            m_nodes[node].size = units;
+            InsertFree(remainder);
+        }
+
+        m_usedUnits += units;
+        ++m_allocationCount;
+        return Allocation{m_nodes[node].offset * m_granularity, units * m_granularity, node};
+    }
+
+    void Free(const Allocation &allocation)
+    {
+        uint32_t node = allocation.node;
+        if (node >= m_nodes.size() || m_nodes[node].isFree || !m_nodes[node].inUse)
+        {
+            throw std::invalid_argument("TlsfAllocator::Free called with an invalid allocation.");
+        }
+        m_usedUnits -= m_nodes[node].size;
+        --m_allocationCount;
+
+        uint32_t next = m_nodes[node].nextPhysical;
+        if (next != c_invalidNode && m_nodes[next].isFree)
+        {
+            RemoveFree(next);
+            Merge(node, next);
+        }
+        uint32_t prev = m_nodes[node].prevPhysical;
+        if (prev != c_invalidNode && m_nodes[prev].isFree)
+        {
+            RemoveFree(prev);
+            Merge(prev, node);
+            node = prev;
+        }
+        InsertFree(node);
+    }
+
+    bool Empty() const
+    {
+        return m_allocationCount == 0;
+    }
+
+    Stats GetStats() const
+    {
+        Stats stats;
+        stats.capacity = Capacity();
+        stats.usedBytes = m_usedUnits * m_granularity;
+        stats.freeBytes = stats.capacity - stats.usedBytes;
+        stats.allocationCount = m_allocationCount;
+        for (uint32_t fl = 0; fl < c_firstLevelCount; ++fl)
+        {
+            for (uint32_t sl = 0; sl < c_secondLevelCount; ++sl)
+            {
+                for (uint32_t node = m_freeHeads[fl][sl]; node != c_invalidNode; node = m_nodes[node].nextFree)
+                {
+                    ++stats.freeBlockCount;
+                    if (m_nodes[node].size * m_granularity > stats.largestFreeBlock)
+                    {
+                        stats.largestFreeBlock = m_nodes[node].size * m_granularity;
+                    }
+                }
+            }
+        }
+        return stats;
+    }
+
+  private:
+    static constexpr uint32_t c_invalidNode = ~0u;
+    static constexpr uint32_t c_secondLevelLog2 = 4;
+    static constexpr uint32_t c_secondLevelCount = 1u << c_secondLevelLog2;
+    static constexpr uint32_t c_firstLevelCount = 64 - c_secondLevelLog2 + 1;
+
+    struct Node
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t prevPhysical;
+        uint32_t nextPhysical;
+        uint32_t prevFree;
+        uint32_t nextFree;
+        bool isFree;
+        bool inUse;
+    };
+
+    static uint32_t Log2(uint64_t value)
+    {
+        uint32_t result = 0;
+        while (value >>= 1)
+        {
+            ++result;
+        }
+        return result;
+    }
+
+    static uint32_t LowestBit(uint64_t value)
+    {
+        uint32_t result = 0;
+        while ((value & 1) == 0)
+        {
+            value >>= 1;
+            ++result;
+        }
+        return result;
+    }
+
+    // Sizes below c_secondLevelCount units map linearly into first level 0; larger sizes split each power of two
+    // into c_secondLevelCount classes.
+    static void Mapping(uint64_t units, uint32_t &fl, uint32_t &sl)
+    {
+        if (units < c_secondLevelCount)
+        {
+            fl = 0;
+            sl = static_cast<uint32_t>(units);
+            return;
+        }
+        uint32_t log2 = Log2(units);
+        fl = log2 - c_secondLevelLog2 + 1;
+        sl = static_cast<uint32_t>((units >> (log2 - c_secondLevelLog2)) - c_secondLevelCount);
+    }
+
+    uint32_t FindSuitable(uint64_t units) const
+    {
+        // Round up to the next size class so any block in the class found is large enough.
+        if (units >= c_secondLevelCount)
+        {
+            units += (uint64_t(1) << (Log2(units) - c_secondLevelLog2)) - 1;
+        }
+        uint32_t fl, sl;
+        Mapping(units, fl, sl);
+        if (fl >= c_firstLevelCount)
+        {
+            return c_invalidNode;
+        }
+
+        uint64_t secondLevelMap = m_secondLevelBitmaps[fl] & (~uint64_t(0) << sl);
+        if (secondLevelMap == 0)
+        {
+            uint64_t firstLevelMap = fl + 1 < 64 ? m_firstLevelBitmap & (~uint64_t(0) << (fl + 1)) : 0;
+            if (firstLevelMap == 0)
+            {
+                return c_invalidNode;
+            }
+            fl = LowestBit(firstLevelMap);
+            secondLevelMap = m_secondLevelBitmaps[fl];
+        }
+        sl = LowestBit(secondLevelMap);
+        return m_freeHeads[fl][sl];
+    }
+
+    uint32_t NewNode(uint64_t offset, uint64_t size)
+    {
+        Node node{offset, size, c_invalidNode, c_invalidNode, c_invalidNode, c_invalidNode, false, true};
+        if (!m_unusedNodes.empty())
+        {
+            uint32_t index = m_unusedNodes.back();
+            m_unusedNodes.pop_back();
+            m_nodes[index] = node;
+            return index;
+        }
+        m_nodes.push_back(node);
+        return static_cast<uint32_t>(m_nodes.size() - 1);
+    }
+
+    void InsertFree(uint32_t node)
+    {
+        uint32_t fl, sl;
+        Mapping(m_nodes[node].size, fl, sl);
+        m_nodes[node].isFree = true;
+        m_nodes[node].prevFree = c_invalidNode;
+        m_nodes[node].nextFree = m_freeHeads[fl][sl];
+        if (m_freeHeads[fl][sl] != c_invalidNode)
+        {
+            m_nodes[m_freeHeads[fl][sl]].prevFree = node;
+        }
+        m_freeHeads[fl][sl] = node;
+        m_firstLevelBitmap |= uint64_t(1) << fl;
+        m_secondLevelBitmaps[fl] |= uint64_t(1) << sl;
+    }
+
+    void RemoveFree(uint32_t node)
+    {
+        uint32_t fl, sl;
+        Mapping(m_nodes[node].size, fl, sl);
+        Node &n = m_nodes[node];
+        if (n.prevFree != c_invalidNode)
+        {
+            m_nodes[n.prevFree].nextFree = n.nextFree;
+        }
+        else
+        {
+            m_freeHeads[fl][sl] = n.nextFree;
+        }
+        if (n.nextFree != c_invalidNode)
+        {
+            m_nodes[n.nextFree].prevFree = n.prevFree;
+        }
+        n.isFree = false;
+
+        if (m_freeHeads[fl][sl] == c_invalidNode)
+        {
+            m_secondLevelBitmaps[fl] &= ~(uint64_t(1) << sl);
+            if (m_secondLevelBitmaps[fl] == 0)
+            {
+                m_firstLevelBitmap &= ~(uint64_t(1) << fl);
+            }
+        }
+    }
+
+    // Absorbs second, the physical successor of first, into first.
+    void Merge(uint32_t first, uint32_t second)
+    {
+        m_nodes[first].size += m_nodes[second].size;
+        m_nodes[first].nextPhysical = m_nodes[second].nextPhysical;
+        if (m_nodes[second].nextPhysical != c_invalidNode)
+        {
+            m_nodes[m_nodes[second].nextPhysical].prevPhysical = first;
+        }
+        m_nodes[second].inUse = false;
+        m_unusedNodes.push_back(second);
+    }
+
+    uint64_t m_granularity;
+    uint64_t m_capacityUnits;
+    uint64_t m_usedUnits = 0;
+    uint32_t m_allocationCount = 0;
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_unusedNodes;
+
+    uint64_t m_firstLevelBitmap = 0;
+    uint64_t m_secondLevelBitmaps[c_firstLevelCount] = {};
+    uint32_t m_freeHeads[c_firstLevelCount][c_secondLevelCount];
+};
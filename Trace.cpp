@@ -0,0 +1,194 @@
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+// Written only by its owning thread. count is published with release semantics so a reader sees complete events.
+struct ThreadBuffer
+{
+    std::unique_ptr<TraceEvent[]> events{new TraceEvent[Tracer::c_eventsPerThread]};
+    std::atomic<size_t> count{0};
+    std::atomic<uint64_t> dropped{0};
+    uint32_t threadId = 0;
+};
+
+// Buffers are owned by the registry rather than by their threads so events survive thread exit. The mutex is only
+// taken when a thread records its first event and by readers.
+struct BufferRegistry
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+BufferRegistry &Registry()
+{
+    static BufferRegistry registry;
+    return registry;
+}
+
+ThreadBuffer &CurrentThreadBuffer()
+{
+    thread_local std::shared_ptr<ThreadBuffer> buffer = []() {
+        auto created = std::make_shared<ThreadBuffer>();
+        BufferRegistry &registry = Registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        created->threadId = static_cast<uint32_t>(registry.buffers.size() + 1);
+        registry.buffers.push_back(created);
+        return created;
+    }();
+    return *buffer;
+}
+
+void Append(const TraceEvent &event)
+{
+    ThreadBuffer &buffer = CurrentThreadBuffer();
+    size_t index = buffer.count.load(std::memory_order_relaxed);
+    if (index >= Tracer::c_eventsPerThread)
+    {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer.events[index] = event;
+    buffer.events[index].threadId = buffer.threadId;
+    buffer.count.store(index + 1, std::memory_order_release);
+}
+
+void CopyTensorName(TraceEvent &event, const char *tensor)
+{
+    size_t i = 0;
+    for (; tensor && tensor[i] != '\0' && i + 1 < sizeof(event.tensor); ++i)
+    {
+        event.tensor[i] = tensor[i];
+    }
+    event.tensor[i] = '\0';
+}
+
+void WriteJsonString(std::ostream &out, const char *text)
+{
+    out << '"';
+    for (const char *c = text; *c != '\0'; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+        {
+            out << '\\' << *c;
+        }
+        else if (static_cast<unsigned char>(*c) >= 0x20)
+        {
+            out << *c;
+        }
+    }
+    out << '"';
+}
+} // namespace
+
+uint64_t Tracer::Now()
+{
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+void Tracer::RecordSpan(const char *name, const char *tensor, uint64_t bytes, uint64_t startNs, uint64_t endNs,
+                        TraceTrack track)
+{
+    TraceEvent event;
+    event.name = name;
+    CopyTensorName(event, tensor);
+    event.startNs = startNs;
+    event.durationNs = endNs > startNs ? endNs - startNs : 0;
+    event.bytes = bytes;
+    event.track = track;
+    Append(event);
+}
+
+void Tracer::RecordInstant(const char *name, const std::string &tensor, uint64_t bytes)
+{
+    TraceEvent event;
+    event.name = name;
+    CopyTensorName(event, tensor.c_str());
+    event.startNs = Now();
+    event.bytes = bytes;
+    event.instant = true;
+    Append(event);
+}
+
+std::vector<TraceEvent> Tracer::Collect()
+{
+    std::vector<TraceEvent> events;
+    BufferRegistry &registry = Registry();
+    {
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (const auto &buffer : registry.buffers)
+        {
+            size_t count = buffer->count.load(std::memory_order_acquire);
+            events.insert(events.end(), buffer->events.get(), buffer->events.get() + count);
+        }
+    }
+    std::stable_sort(events.begin(), events.end(),
+                     [](const TraceEvent &a, const TraceEvent &b) { return a.startNs < b.startNs; });
+    return events;
+}
+
+uint64_t Tracer::DroppedCount()
+{
+    uint64_t dropped = 0;
+    BufferRegistry &registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const auto &buffer : registry.buffers)
+    {
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+void Tracer::Clear()
+{
+    BufferRegistry &registry = Registry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const auto &buffer : registry.buffers)
+    {
+        buffer->count.store(0, std::memory_order_release);
+        buffer->dropped.store(0, std::memory_order_relaxed);
+    }
+}
+
+bool Tracer::ExportChromeTrace(const std::string &path)
+{
+    std::vector<TraceEvent> events = Collect();
+    uint64_t origin = events.empty() ? 0 : events.front().startNs;
+
+    // CPU threads appear as threads of process 1, GPU work as a single thread of process 2.
+    std::ofstream out(path);
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n"
+        << "{\"ph\": \"M\", \"pid\": 1, \"name\": \"process_name\", \"args\": {\"name\": \"CPU\"}},\n"
+        << "{\"ph\": \"M\", \"pid\": 2, \"name\": \"process_name\", \"args\": {\"name\": \"GPU\"}}";
+    out.precision(3);
+    out << std::fixed;
+    for (const TraceEvent &event : events)
+    {
+        bool gpu = event.track == TraceTrack::Gpu;
+        out << ",\n{\"name\": ";
+        WriteJsonString(out, event.name ? event.name : "");
+        out << ", \"cat\": \"" << (gpu ? "gpu" : "cpu") << "\", \"ph\": \"" << (event.instant ? "i" : "X")
+            << "\", \"pid\": " << (gpu ? 2 : 1) << ", \"tid\": " << (gpu ? 0 : event.threadId)
+            << ", \"ts\": " << static_cast<double>(event.startNs - origin) / 1e3;
+        if (event.instant)
+        {
+            out << ", \"s\": \"t\"";
+        }
+        else
+        {
+            out << ", \"dur\": " << static_cast<double>(event.durationNs) / 1e3;
+        }
+        out << ", \"args\": {\"tensor\": ";
+        WriteJsonString(out, event.tensor);
+        out << ", \"bytes\": " << event.bytes << "}}";
+    }
+    out << "\n]}\n";
+    return static_cast<bool>(out);
+}
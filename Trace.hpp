@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Lightweight tracing of scoped spans and instant events, exported as Chrome trace JSON (chrome://tracing, Perfetto).
+//
+// HELLO_DML_TRACE_LEVEL selects what is compiled in:
+//   0  nothing; every TRACE_* macro expands to nothing
+//   1  spans for uploads, compiles, submits, fence waits, readbacks and dispatches
+//   2  additionally per-chunk CPU work and diagnostic instant events
+//
+// Compiled-in events are only recorded while Tracer::SetEnabled(true) is in effect. Each thread appends to a buffer
+// of its own without locking; events beyond a buffer's capacity are counted as dropped.
+
+#ifndef HELLO_DML_TRACE_LEVEL
+#define HELLO_DML_TRACE_LEVEL 1
+#endif
+
+enum class TraceTrack : uint8_t
+{
+    Cpu,
+    Gpu,
+};
+
+struct TraceEvent
+{
+    const char *name = nullptr; // Must be a string literal or otherwise outlive the tracer.
+    char tensor[48] = {};       // Truncated tensor name, empty if none.
+    uint64_t startNs = 0;
+    uint64_t durationNs = 0; // 0 with instant set for instant events.
+    uint64_t bytes = 0;
+    uint32_t threadId = 0;
+    TraceTrack track = TraceTrack::Cpu;
+    bool instant = false;
+};
+
+class Tracer
+{
+  public:
+    static void SetEnabled(bool enabled)
+    {
+        s_enabled.store(enabled, std::memory_order_relaxed);
+    }
+    static bool IsEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    // Nanoseconds on std::chrono::steady_clock, the time base of every event.
+    static uint64_t Now();
+
+    static void RecordSpan(const char *name, const char *tensor, uint64_t bytes, uint64_t startNs, uint64_t endNs,
+                           TraceTrack track = TraceTrack::Cpu);
+    static void RecordInstant(const char *name, const std::string &tensor, uint64_t bytes = 0);
+
+    // Snapshot of every buffer, ordered by start time. Collect, Clear and export must not race with threads that
+    // are still recording.
+    static std::vector<TraceEvent> Collect();
+    static uint64_t DroppedCount();
+    static void Clear();
+    static bool ExportChromeTrace(const std::string &path);
+
+    static constexpr size_t c_eventsPerThread = 1 << 16;
+
+  private:
+    static inline std::atomic<bool> s_enabled{false};
+};
+
+// Records the lifetime of the object as a span. Construct through TRACE_SPAN so it compiles out with the level.
+class TraceSpan
+{
+  public:
+    TraceSpan(const char *name, const std::string &tensor = {}, uint64_t bytes = 0)
+        : m_name(name), m_bytes(bytes), m_enabled(Tracer::IsEnabled())
+    {
+        if (m_enabled)
+        {
+            // Copied now because tensor may be a temporary.
+            size_t length = tensor.copy(m_tensor, sizeof(m_tensor) - 1);
+            m_tensor[length] = '\0';
+            m_startNs = Tracer::Now();
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (m_enabled)
+        {
+            Tracer::RecordSpan(m_name, m_tensor, m_bytes, m_startNs, Tracer::Now());
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+  private:
+    const char *m_name;
+    uint64_t m_bytes;
+    bool m_enabled;
+    uint64_t m_startNs = 0;
+    char m_tensor[sizeof(TraceEvent::tensor)];
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if HELLO_DML_TRACE_LEVEL >= 1
+#define TRACE_SPAN(...) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(__VA_ARGS__)
+#else
+#define TRACE_SPAN(...)
+#endif
+
+#if HELLO_DML_TRACE_LEVEL >= 2
+#define TRACE_VERBOSE_SPAN(...) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(__VA_ARGS__)
+#define TRACE_VERBOSE_INSTANT(...)                                                                                     \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (Tracer::IsEnabled())                                                                                       \
+        {                                                                                                              \
+            Tracer::RecordInstant(__VA_ARGS__);                                                                        \
+        }                                                                                                              \
+    } while (false)
+#else
+#define TRACE_VERBOSE_SPAN(...)
+#define TRACE_VERBOSE_INSTANT(...)                                                                                     \
+    do                                                                                                                 \
+    {                                                                                                                  \
+    } while (false)
+#endif
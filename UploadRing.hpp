@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <stdexcept>
+
+// Bookkeeping for a ring buffer that upload staging data is suballocated from. Allocations are made at the head and
+// reclaimed from the tail once the fence value they were committed with has completed. The class only hands out
+// offsets; the owner maps the actual buffer.
+class UploadRing
+{
+  public:
+    explicit UploadRing(uint64_t capacity = 0) : m_capacity(capacity)
+    {
+    }
+
+    uint64_t Capacity() const
+    {
+        return m_capacity;
+    }
+
+    // Bytes that are allocated or lost to alignment and wrap-around padding and not yet reclaimed.
+    uint64_t UsedBytes() const
+    {
+        return m_used;
+    }
+
+    bool HasUncommitted() const
+    {
+        return m_uncommitted != 0;
+    }
+
+    // Fence value of the oldest committed region, or 0 if nothing is waiting to retire.
+    uint64_t OldestPendingFenceValue() const
+    {
+        return m_pending.empty() ? 0 : m_pending.front().fenceValue;
+    }
+
+    // Returns the offset of size bytes aligned to alignment (a power of two), or nothing if the ring has no room
+    // until older regions retire.
+    std::optional<uint64_t> Allocate(uint64_t size, uint64_t alignment)
+    {
+        if (size == 0 || size > m_capacity || m_used == m_capacity)
+        {
+            return std::nullopt;
+        }
+        if (m_used == 0)
+        {
+            // Start over at the beginning so the whole capacity is available as one contiguous range.
+            m_head = m_tail = 0;
+        }
+
+        uint64_t aligned = AlignUp(m_head, alignment);
+        if (m_head >= m_tail)
+        {
+            if (aligned + size <= m_capacity)
+            {
+                return Take(aligned, aligned + size, aligned + size - m_head);
+            }
+            // Wrap around and waste the remainder at the end of the buffer.
+            if (size <= m_tail)
+            {
+                return Take(0, size, m_capacity - m_head + size);
+            }
+            return std::nullopt;
+        }
+
+        if (aligned + size <= m_tail)
+        {
+            return Take(aligned, aligned + size, aligned + size - m_head);
+        }
+        return std::nullopt;
+    }
+
+    // Everything allocated since the previous commit is released once fenceValue completes.
+    void Commit(uint64_t fenceValue)
+    {
+        if (m_uncommitted == 0)
+        {
+            return;
+        }
+        if (!m_pending.empty() && fenceValue < m_pending.back().fenceValue)
+        {
+            throw std::logic_error("UploadRing fence values must not decrease.");
+        }
+        m_pending.push_back({fenceValue, m_head, m_uncommitted});
+        m_uncommitted = 0;
+    }
+
+    void Retire(uint64_t completedValue)
+    {
+        while (!m_pending.empty() && m_pending.front().fenceValue <= completedValue)
+        {
+            m_tail = m_pending.front().end;
+            m_used -= m_pending.front().bytes;
+            m_pending.pop_front();
+        }
+    }
+
+  private:
+    static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Moves the head to end and accounts for consumed bytes, including any padding skipped to get there.
+    uint64_t Take(uint64_t offset, uint64_t end, uint64_t consumed)
+    {
+        m_head = end;
+        m_used += consumed;
+        m_uncommitted += consumed;
+        return offset;
+    }
+
+    struct Region
+    {
+        uint64_t fenceValue;
+        uint64_t end;
+        uint64_t bytes;
+    };
+
+    uint64_t m_capacity;
+    uint64_t m_head = 0;
+    uint64_t m_tail = 0;
+    uint64_t m_used = 0;
+    uint64_t m_uncommitted = 0;
+    std::deque<Region> m_pending;
+};
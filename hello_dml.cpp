@@ -1,21 +1,27 @@
-#include "DirectMLProcessor.hpp"
+#include "TensorBackend.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
 
 int main(int argc, char const *argv[])
 {
     std::string adapterNameFilter = (argc > 1) ? argv[1] : "NPU";
-    DirectMLProcessor helloDML(adapterNameFilter);
+    std::unique_ptr<TensorBackend> helloDML = CreateTensorBackend(adapterNameFilter);
+    printf("Backend: %s\n", helloDML->Name().c_str());
     uint32_t shapes[] = {1, 1, 8, 1};
     float data0[] = {0.0202845, 0.704157, 0.12591, 0.101374, 0.863722, -0.915456, 0.333993, -0.123652};
     float data1[] = {-0.29151, -0.623414, -0.913637, -0.737006, 0.144149, -0.834521, -0.509416, 0.899506};
     float zeroArray[8] = {0.0f};
 
-    helloDML.SetTensorData("add0", shapes, DML_TENSOR_DATA_TYPE_FLOAT32, data0, sizeof(data0));
-    helloDML.SetTensorData("add1", shapes, DML_TENSOR_DATA_TYPE_FLOAT32, data1, sizeof(data1));
-    helloDML.SetTensorData("dst", shapes, DML_TENSOR_DATA_TYPE_FLOAT32, zeroArray, sizeof(zeroArray));
-    helloDML.ElementWiseAddBcast("add0", "add1", "dst");
+    helloDML->SetTensorData("add0", shapes, TensorDataType::Float32, data0, sizeof(data0));
+    helloDML->SetTensorData("add1", shapes, TensorDataType::Float32, data1, sizeof(data1));
+    helloDML->SetTensorData("dst", shapes, TensorDataType::Float32, zeroArray, sizeof(zeroArray));
+    helloDML->ElementWiseAddBcast("add0", "add1", "dst");
 
     float result[8];
-    helloDML.GetTensorData("dst", shapes, DML_TENSOR_DATA_TYPE_FLOAT32, result, sizeof(result));
+    helloDML->GetTensorData("dst", shapes, TensorDataType::Float32, result, sizeof(result));
     for (int i = 0; i < 8; i++)
     {
         printf("%f\n", result[i]);
@@ -31,9 +37,9 @@ int main(int argc, char const *argv[])
     for (float i = 0.0f; i < 1024.0f; i++)
         data2[(int)i] = i;
     uint32_t shapes2[] = {1, 1, 1024, 1};
-    helloDML.SetTensorData("sent0", shapes2, DML_TENSOR_DATA_TYPE_FLOAT32, data2, sizeof(data2));
+    helloDML->SetTensorData("sent0", shapes2, TensorDataType::Float32, data2, sizeof(data2));
     float result2[1024] = {0.0f};
-    helloDML.GetTensorData("sent0", shapes2, DML_TENSOR_DATA_TYPE_FLOAT32, result2, sizeof(result2));
+    helloDML->GetTensorData("sent0", shapes2, TensorDataType::Float32, result2, sizeof(result2));
     for (int i = 0; i < 1024; i++)
     {
         if (result2[i] != data2[i])
@@ -47,10 +53,10 @@ int main(int argc, char const *argv[])
 
     float data3[1] = {1.0f};
     uint32_t shapes3[] = {1, 1, 1, 1};
-    helloDML.SetTensorData("add2", shapes3, DML_TENSOR_DATA_TYPE_FLOAT32, data3, sizeof(data3));
-    helloDML.ElementWiseAddBcast("add0", "add2", "dst");
+    helloDML->SetTensorData("add2", shapes3, TensorDataType::Float32, data3, sizeof(data3));
+    helloDML->ElementWiseAddBcast("add0", "add2", "dst");
 
-    helloDML.GetTensorData("dst", shapes, DML_TENSOR_DATA_TYPE_FLOAT32, result, sizeof(result));
+    helloDML->GetTensorData("dst", shapes, TensorDataType::Float32, result, sizeof(result));
     for (int i = 0; i < 8; i++)
     {
         printf("%f\n", result[i]);
@@ -62,7 +68,131 @@ int main(int argc, char const *argv[])
     }
     printf("broadcast add is equal to result\n");
 
-    helloDML.FreeResources();
+    ElementWiseDesc fused;
+    fused.op = BinaryOp::Multiply;
+    fused.activation = Activation::Relu;
+    fused.scale = 0.5f;
+    helloDML->ElementWise(fused, "add0", "add1", "dst");
+
+    helloDML->GetTensorData("dst", shapes, TensorDataType::Float32, result, sizeof(result));
+    HostTensor expected =
+        RunElementWiseOnCpu(fused, {{1, 1, 8, 1}, {data0, data0 + 8}}, {{1, 1, 8, 1}, {data1, data1 + 8}});
+    for (int i = 0; i < 8; i++)
+    {
+        printf("%f\n", result[i]);
+        if (fabs(result[i] - expected.data[i]) > 1e-3f)
+        {
+            printf("Error: %f != %f\n", result[i], expected.data[i]);
+            return 1;
+        }
+    }
+    printf("fused multiply + relu is equal to result\n");
+
+    // Tensors round-trip through a safetensors file, loaded back under other names.
+    std::string savedPath = (std::filesystem::temp_directory_path() / "hello_dml.safetensors").string();
+    helloDML->SaveTensors(savedPath, {"add0", "add1"});
+    helloDML->LoadTensors(savedPath, "saved_");
+    helloDML->ElementWiseAddBcast("saved_add0", "saved_add1", "dst");
+    helloDML->GetTensorData("dst", shapes, TensorDataType::Float32, result, sizeof(result));
+    std::filesystem::remove(savedPath);
+    for (int i = 0; i < 8; i++)
+    {
+        if (result[i] != data0[i] + data1[i])
+        {
+            printf("Error: %f != %f\n", result[i], data0[i] + data1[i]);
+            return 1;
+        }
+    }
+    printf("add of saved and loaded tensors is equal to result\n");
+
+    // A 2x4 by 4x2 product, with b given transposed, plus a bias per column; then the mean of each row of a.
+    GemmDesc gemm;
+    gemm.transposeB = true;
+    gemm.alpha = 2.0f;
+    HostTensor matrix0{{2, 4}, {data0, data0 + 8}};
+    HostTensor matrix1{{2, 4}, {data1, data1 + 8}};
+    HostTensor bias{{1, 2}, {0.25f, -0.5f}};
+    helloDML->SetTensorData("mat0", matrix0.shape, TensorDataType::Float32, data0, sizeof(data0));
+    helloDML->SetTensorData("mat1", matrix1.shape, TensorDataType::Float32, data1, sizeof(data1));
+    helloDML->SetTensorData("bias", bias.shape, TensorDataType::Float32, bias.data.data(), 2 * sizeof(float));
+    helloDML->CreateTensor("product", {2, 2}, TensorDataType::Float32);
+    helloDML->Gemm(gemm, "mat0", "mat1", "bias", "product");
+    ReduceDesc rowMean{ReduceOp::Mean, 1};
+    helloDML->CreateTensor("rowMean", {2, 1}, TensorDataType::Float32);
+    helloDML->Reduce(rowMean, "mat0", "rowMean");
+
+    HostTensor expectedProduct = RunGemmOnCpu(gemm, matrix0, matrix1, &bias);
+    HostTensor expectedMean = RunReduceOnCpu(rowMean, matrix0);
+    float product[4];
+    float mean[2];
+    helloDML->GetTensorData("product", {2, 2}, TensorDataType::Float32, product, sizeof(product));
+    helloDML->GetTensorData("rowMean", {2, 1}, TensorDataType::Float32, mean, sizeof(mean));
+    for (int i = 0; i < 4; i++)
+    {
+        printf("%f\n", product[i]);
+        if (fabs(product[i] - expectedProduct.data[i]) > 1e-3f)
+        {
+            printf("Error: %f != %f\n", product[i], expectedProduct.data[i]);
+            return 1;
+        }
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (fabs(mean[i] - expectedMean.data[i]) > 1e-3f)
+        {
+            printf("Error: %f != %f\n", mean[i], expectedMean.data[i]);
+            return 1;
+        }
+    }
+    printf("gemm with bias and row mean are equal to result\n");
+
+    // Upload, multiply and read back captured once as a plan, then replayed with new inputs.
+    PlanCapture capture(*helloDML);
+    TensorHandle planA = helloDML->RequireTensor("add0");
+    TensorHandle planB = helloDML->RequireTensor("add1");
+    TensorHandle planDst = helloDML->RequireTensor("dst");
+    capture.SetTensorData(planA, sizeof(data0));
+    capture.SetTensorData(planB, sizeof(data1));
+    capture.ElementWise(fused, planA, planB, planDst);
+    capture.GetTensorData(planDst, sizeof(result));
+    std::unique_ptr<ExecutionPlan> plan = helloDML->CreateExecutionPlan(capture);
+    for (int replay = 0; replay < 2; replay++)
+    {
+        const float *first = replay == 0 ? data0 : data1;
+        const float *second = replay == 0 ? data1 : data0;
+        plan->Replay({first, second}, {result});
+        HostTensor expectedReplay =
+            RunElementWiseOnCpu(fused, {{1, 1, 8, 1}, {first, first + 8}}, {{1, 1, 8, 1}, {second, second + 8}});
+        for (int i = 0; i < 8; i++)
+        {
+            if (fabs(result[i] - expectedReplay.data[i]) > 1e-3f)
+            {
+                printf("Error: %f != %f\n", result[i], expectedReplay.data[i]);
+                return 1;
+            }
+        }
+    }
+    plan.reset();
+    printf("replayed plan is equal to result\n");
+
+    // The same addition with float16 storage, where the backend supports it, is exact to about 2^-11 per operand.
+    helloDML->SetStoragePrecision(StoragePrecision::Float16);
+    helloDML->SetTensorData("half0", shapes, TensorDataType::Float32, data0, sizeof(data0));
+    helloDML->SetTensorData("half1", shapes, TensorDataType::Float32, data1, sizeof(data1));
+    helloDML->SetTensorData("halfDst", shapes, TensorDataType::Float32, zeroArray, sizeof(zeroArray));
+    helloDML->ElementWiseAddBcast("half0", "half1", "halfDst");
+    helloDML->GetTensorData("halfDst", shapes, TensorDataType::Float32, result, sizeof(result));
+    for (int i = 0; i < 8; i++)
+    {
+        if (fabs(result[i] - (data0[i] + data1[i])) > 4e-3f)
+        {
+            printf("Error: %f != %f\n", result[i], data0[i] + data1[i]);
+            return 1;
+        }
+    }
+    printf("%s storage add is equal to result\n", StoragePrecisionName(helloDML->GetStoragePrecision("halfDst")));
+
+    helloDML->FreeResources();
 
     return 0;
 }
@@ -0,0 +1,1336 @@
+#include "ElementWiseBatcher.hpp"
+#include "StreamScheduler.hpp"
+#include "TensorBackend.hpp"
+#include "TensorTable.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Sweeps broadcast additions over tensor sizes, data types and broadcast patterns on one backend and reports where
+// the time goes, using the phase times the backend accumulates.
+//
+// --trace writes every traced span of the run as a Chrome trace, viewable in chrome://tracing or Perfetto.
+// --threads N additionally measures request throughput with 1, 2, 4, ... up to N threads calling at once, on
+// backends that support concurrent calls.
+// --lookups compares finding tensors by name in a string-keyed map, as every call used to, with TensorHandle lookups,
+// both on their own and as the overhead of an op on a tiny tensor.
+// --stream N streams an add over N float32 elements of host memory with 1, 2 and 3 buffer sets, next to what a
+// model of the pipeline predicts from the cost of each stage on its own. Backends that run every stage on the calling
+// thread cannot overlap them, so there only the model shows what a copy queue would gain.
+// --profile path keeps a DirectML startup profile at path. Run twice: the second run opens the adapter the first one
+// selected and compiles the operators it used in the background, so its compile and init columns drop to what the
+// sweep still has to wait for.
+// --batch N has N threads submit adds on 8 elements, each waiting for its result before the next, straight to the
+// backend and through an ElementWiseBatcher with deadlines from 0 to 1000 us, trading latency for throughput. A CPU
+// call costs little more than its arithmetic, so there batching only adds the handoff to the worker; it pays off on
+// devices where every op carries a fixed cost of submits, fence waits and readbacks.
+// --gemm N times square float32 GEMMs with a bias row from 64 up to N, and sum and max reductions of an N x N matrix
+// along either axis, in GFLOP/s and GB/s. Sizes up to 256 are checked against the plain reference loops, whose speed
+// is reported next to the backend's.
+// --plan N times a request of two uploads, two element-wise ops and a readback on 8 up to N float32 elements, made
+// call by call and replayed from an ExecutionPlan captured once, and checks that both give the same result.
+//
+// Usage: hello_dml_bench [adapterNameFilter] [--max-bytes N] [--iterations N] [--json path] [--trace path]
+//                        [--storage float32|float16|bfloat16|int8] [--threads N] [--lookups] [--stream N]
+//                        [--profile path] [--batch N] [--gemm N] [--plan N]
+
+namespace
+{
+enum class BroadcastPattern
+{
+    Same,   // b has the shape of a.
+    Row,    // b is one row broadcast over every row of a.
+    Scalar, // b is a single element.
+};
+
+const char *PatternName(BroadcastPattern pattern)
+{
+    switch (pattern)
+    {
+    case BroadcastPattern::Same:
+        return "same";
+    case BroadcastPattern::Row:
+        return "row";
+    default:
+        return "scalar";
+    }
+}
+
+const char *DataTypeName(TensorDataType type)
+{
+    return type == TensorDataType::Float16 ? "float16" : "float32";
+}
+
+struct BenchOptions
+{
+    std::string adapterNameFilter = "NPU";
+    uint64_t maxTensorBytes = 256ull << 20;
+    uint32_t iterations = 0; // 0 picks a count from the tensor size.
+    std::string jsonPath;
+    std::string tracePath;
+    StoragePrecision storage = StoragePrecision::Float32; // Applies to the float32 cases.
+    uint32_t threads = 0;                                  // 0 skips the throughput sweep.
+    bool lookups = false;
+    uint64_t streamElements = 0; // 0 skips the streaming runs.
+    std::string profilePath;
+    uint32_t batchCallers = 0; // 0 skips the batching runs.
+    uint32_t gemmSize = 0;     // 0 skips the GEMM and reduction runs.
+    uint64_t planElements = 0; // 0 skips the plan replay runs.
+};
+
+struct Percentiles
+{
+    double p50 = 0.0;
+    double p99 = 0.0;
+    double mean = 0.0;
+};
+
+Percentiles Summarize(std::vector<double> samples)
+{
+    Percentiles result;
+    if (samples.empty())
+    {
+        return result;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto rank = [&](double percentile) {
+        size_t index = static_cast<size_t>(percentile * static_cast<double>(samples.size() - 1) + 0.5);
+        return samples[std::min(index, samples.size() - 1)];
+    };
+    result.p50 = rank(0.50);
+    result.p99 = rank(0.99);
+    for (double sample : samples)
+    {
+        result.mean += sample;
+    }
+    result.mean /= static_cast<double>(samples.size());
+    return result;
+}
+
+struct BenchResult
+{
+    TensorDataType type = TensorDataType::Float32;
+    BroadcastPattern pattern = BroadcastPattern::Same;
+    uint64_t elements = 0;
+    uint64_t bytesMoved = 0; // Both inputs and the output, once.
+    uint32_t iterations = 0;
+    std::string status = "ok";
+
+    // The first run compiles and initializes the operator; it is reported separately and left out of the
+    // percentiles.
+    PhaseTimes firstRun;
+    double firstRunTotal = 0.0;
+    Percentiles phases[c_phaseCount];
+    Percentiles total;
+    double gigabytesPerSecond = 0.0;
+    double elementsPerSecond = 0.0;
+};
+
+// Rows of at most 1024 elements, so the row pattern broadcasts over a realistic inner dimension.
+TensorShape ShapeFor(uint64_t elements)
+{
+    uint32_t columns = static_cast<uint32_t>(std::min<uint64_t>(elements, 1024));
+    return {static_cast<uint32_t>(elements / columns), columns};
+}
+
+TensorShape BroadcastOperandShape(BroadcastPattern pattern, const TensorShape &shape)
+{
+    switch (pattern)
+    {
+    case BroadcastPattern::Same:
+        return shape;
+    case BroadcastPattern::Row:
+        return {1, shape[1]};
+    default:
+        return {1};
+    }
+}
+
+std::vector<uint8_t> MakeData(TensorDataType type, uint64_t elements)
+{
+    std::vector<uint8_t> data(static_cast<size_t>(elements * DataTypeSize(type)));
+    if (type == TensorDataType::Float16)
+    {
+        const uint16_t one = 0x3c00;
+        for (size_t i = 0; i < data.size(); i += sizeof(one))
+        {
+            memcpy(data.data() + i, &one, sizeof(one));
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < data.size() / sizeof(float); ++i)
+        {
+            float value = static_cast<float>(i % 251) * 0.25f;
+            memcpy(data.data() + i * sizeof(float), &value, sizeof(value));
+        }
+    }
+    return data;
+}
+
+BenchResult RunCase(TensorBackend &backend, TensorDataType type, BroadcastPattern pattern, uint64_t elements,
+                    uint32_t iterations)
+{
+    BenchResult result;
+    result.type = type;
+    result.pattern = pattern;
+    result.elements = elements;
+
+    TensorShape shapeA = ShapeFor(elements);
+    TensorShape shapeB = BroadcastOperandShape(pattern, shapeA);
+    std::vector<uint8_t> dataA = MakeData(type, ElementCount(shapeA));
+    std::vector<uint8_t> dataB = MakeData(type, ElementCount(shapeB));
+    std::vector<uint8_t> dataC(dataA.size());
+    result.bytesMoved = dataA.size() + dataB.size() + dataC.size();
+    result.iterations = iterations != 0
+                            ? iterations
+                            : static_cast<uint32_t>(std::clamp<uint64_t>((4ull << 30) / result.bytesMoved, 5, 200));
+
+    std::vector<double> phaseSamples[c_phaseCount];
+    std::vector<double> totalSamples;
+    try
+    {
+        backend.FreeResources();
+        backend.SetTensorData("bench_c", shapeA, type, dataC.data(), dataC.size());
+
+        for (uint32_t iteration = 0; iteration <= result.iterations; ++iteration)
+        {
+            PhaseTimes before = backend.GetPhaseTimes();
+            auto start = std::chrono::steady_clock::now();
+
+            backend.SetTensorData("bench_a", shapeA, type, dataA.data(), dataA.size());
+            backend.SetTensorData("bench_b", shapeB, type, dataB.data(), dataB.size());
+            backend.Wait(backend.ElementWiseAddBcast("bench_a", "bench_b", "bench_c"));
+            backend.GetTensorData("bench_c", shapeA, type, dataC.data(), dataC.size());
+
+            double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            PhaseTimes phases = backend.GetPhaseTimes() - before;
+            if (iteration == 0)
+            {
+                result.firstRun = phases;
+                result.firstRunTotal = total;
+                continue;
+            }
+            for (size_t i = 0; i < c_phaseCount; ++i)
+            {
+                phaseSamples[i].push_back(phases.seconds[i]);
+            }
+            totalSamples.push_back(total);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        result.status = e.what();
+        result.iterations = 0;
+        return result;
+    }
+
+    for (size_t i = 0; i < c_phaseCount; ++i)
+    {
+        result.phases[i] = Summarize(phaseSamples[i]);
+    }
+    result.total = Summarize(totalSamples);
+    double dispatch = result.phases[static_cast<size_t>(Phase::Dispatch)].p50;
+    if (dispatch > 0.0)
+    {
+        result.gigabytesPerSecond = static_cast<double>(result.bytesMoved) / dispatch / 1e9;
+        result.elementsPerSecond = static_cast<double>(elements) / dispatch;
+    }
+    return result;
+}
+
+// One request is an upload of both operands, the addition and the readback of the result, the same sequence RunCase
+// times. Every thread works on tensors of its own.
+struct ThroughputResult
+{
+    uint32_t threads = 0;
+    uint64_t elements = 0;
+    uint64_t requests = 0;
+    std::string status = "ok";
+    double requestsPerSecond = 0.0;
+};
+
+ThroughputResult RunThroughput(TensorBackend &backend, uint32_t threads, uint64_t elements, uint32_t iterations)
+{
+    ThroughputResult result;
+    result.threads = threads;
+    result.elements = elements;
+
+    TensorShape shape = ShapeFor(elements);
+    std::vector<uint8_t> data = MakeData(TensorDataType::Float32, ElementCount(shape));
+    uint32_t requestsPerThread =
+        iterations != 0 ? iterations
+                        : static_cast<uint32_t>(std::clamp<uint64_t>((1ull << 30) / (data.size() * 3), 20, 2000));
+    std::vector<std::string> errors(threads);
+
+    auto request = [&](uint32_t thread, std::vector<uint8_t> &output) {
+        std::string prefix = "bench_t" + std::to_string(thread) + "_";
+        backend.SetTensorData(prefix + "a", shape, TensorDataType::Float32, data.data(), data.size());
+        backend.SetTensorData(prefix + "b", shape, TensorDataType::Float32, data.data(), data.size());
+        backend.Wait(backend.ElementWiseAddBcast(prefix + "a", prefix + "b", prefix + "c"));
+        backend.GetTensorData(prefix + "c", shape, TensorDataType::Float32, output.data(), output.size());
+    };
+
+    try
+    {
+        // Tensors are created and the operator compiled before timing starts.
+        backend.FreeResources();
+        std::vector<uint8_t> output(data.size());
+        for (uint32_t thread = 0; thread < threads; ++thread)
+        {
+            std::string name = "bench_t" + std::to_string(thread) + "_c";
+            backend.SetTensorData(name, shape, TensorDataType::Float32, output.data(), output.size());
+            request(thread, output);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        result.status = e.what();
+        return result;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (uint32_t thread = 0; thread < threads; ++thread)
+    {
+        workers.emplace_back([&, thread]() {
+            try
+            {
+                std::vector<uint8_t> output(data.size());
+                for (uint32_t i = 0; i < requestsPerThread; ++i)
+                {
+                    request(thread, output);
+                }
+            }
+            catch (const std::exception &e)
+            {
+                errors[thread] = e.what();
+            }
+        });
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const std::string &error : errors)
+    {
+        if (!error.empty())
+        {
+            result.status = error;
+            return result;
+        }
+    }
+    result.requests = uint64_t(requestsPerThread) * threads;
+    result.requestsPerSecond = static_cast<double>(result.requests) / seconds;
+    return result;
+}
+
+struct LookupResult
+{
+    std::string status = "ok";
+    uint64_t tensors = 0;
+    double nameLookupNs = 0.0;   // std::string taken by value and hashed into an unordered_map.
+    double handleLookupNs = 0.0; // TensorTable::Get.
+    double nameOpNs = 0.0;       // ElementWiseAddBcast on 8-element tensors, by name.
+    double handleOpNs = 0.0;     // The same op by handle.
+};
+
+template <typename F> double NanosecondsPerCall(uint64_t calls, F &&function)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < calls; ++i)
+    {
+        function(i);
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+}
+
+LookupResult RunLookups(TensorBackend &backend, uint32_t iterations)
+{
+    LookupResult result;
+    result.tensors = 256;
+    uint64_t lookups = iterations != 0 ? uint64_t(iterations) * 1000 : 4000000;
+
+    // Names shaped like a model's, so hashing costs what it would in practice.
+    std::vector<std::string> names;
+    for (uint64_t i = 0; i < result.tensors; ++i)
+    {
+        names.push_back("model.layers." + std::to_string(i / 4) + ".attention.weight_" + std::to_string(i % 4));
+    }
+
+    struct Entry
+    {
+        uint64_t value = 0;
+    };
+    std::unordered_map<std::string, Entry *> map;
+    std::vector<Entry> entries(names.size());
+    TensorTable<Entry> table;
+    std::vector<TensorHandle> handles;
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        map[names[i]] = &entries[i];
+        handles.push_back(table.FindOrCreate(names[i], []() { return Entry{}; }).first);
+    }
+
+    uint64_t sink = 0;
+    auto findByName = [&](std::string name) { return map.find(name)->second; };
+    result.nameLookupNs = NanosecondsPerCall(lookups, [&](uint64_t i) {
+        sink += findByName(names[i % names.size()])->value++;
+    });
+    result.handleLookupNs = NanosecondsPerCall(lookups, [&](uint64_t i) {
+        sink += table.Get(handles[i % handles.size()]).value++;
+    });
+    if (sink == UINT64_MAX)
+    {
+        printf("%llu\n", static_cast<unsigned long long>(sink));
+    }
+
+    try
+    {
+        backend.FreeResources();
+        TensorShape shape = ShapeFor(8);
+        std::vector<uint8_t> data = MakeData(TensorDataType::Float32, 8);
+        for (const char *name : {"lookup_a", "lookup_b", "lookup_c"})
+        {
+            backend.SetTensorData(name, shape, TensorDataType::Float32, data.data(), data.size());
+        }
+        TensorHandle a = backend.RequireTensor("lookup_a");
+        TensorHandle b = backend.RequireTensor("lookup_b");
+        TensorHandle c = backend.RequireTensor("lookup_c");
+        backend.Wait(backend.ElementWiseAddBcast(a, b, c));
+
+        uint64_t ops = std::max<uint64_t>(lookups / 100, 100);
+        SubmissionTicket ticket;
+        result.nameOpNs = NanosecondsPerCall(
+            ops, [&](uint64_t) { ticket = backend.ElementWiseAddBcast("lookup_a", "lookup_b", "lookup_c"); });
+        backend.Wait(ticket);
+        result.handleOpNs = NanosecondsPerCall(ops, [&](uint64_t) { ticket = backend.ElementWiseAddBcast(a, b, c); });
+        backend.Wait(ticket);
+    }
+    catch (const std::exception &e)
+    {
+        result.status = e.what();
+    }
+    return result;
+}
+
+struct StreamResult
+{
+    uint32_t bufferCount = 0;
+    uint64_t elements = 0;
+    uint64_t chunkElements = 0;
+    std::string status = "ok";
+    double seconds = 0.0;
+    double gigabytesPerSecond = 0.0; // Both inputs and the output, once.
+    double modelledSeconds = 0.0;    // SimulatedStreamStages with the stage costs measured one chunk at a time.
+};
+
+// Per-element cost of each stage, timed on one chunk with nothing else in flight.
+SimulatedStreamStages::Costs MeasureStageCosts(TensorBackend &backend, const float *a, const float *b, float *out,
+                                               uint64_t chunkElements)
+{
+    TensorShape shape{static_cast<uint32_t>(chunkElements)};
+    UniqueTensor x(backend, backend.CreateTensor("", shape, TensorDataType::Float32));
+    UniqueTensor y(backend, backend.CreateTensor("", shape, TensorDataType::Float32));
+    UniqueTensor z(backend, backend.CreateTensor("", shape, TensorDataType::Float32));
+    size_t bytes = static_cast<size_t>(chunkElements * sizeof(float));
+    backend.Wait(backend.ElementWiseAddBcast(x, y, z)); // Compiles the operator outside the timing.
+
+    auto secondsPerElement = [&](auto &&stage) {
+        auto start = std::chrono::steady_clock::now();
+        stage();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return seconds / static_cast<double>(chunkElements);
+    };
+    SimulatedStreamStages::Costs costs;
+    costs.uploadSecondsPerElement = secondsPerElement([&]() {
+        backend.SetTensorData(x, a, bytes);
+        backend.SetTensorData(y, b, bytes);
+    });
+    costs.computeSecondsPerElement = secondsPerElement([&]() { backend.Wait(backend.ElementWiseAddBcast(x, y, z)); });
+    costs.readbackSecondsPerElement =
+        secondsPerElement([&]() { backend.GetTensorData(z, {}, TensorDataType::Float32, out, bytes); });
+    return costs;
+}
+
+std::vector<StreamResult> RunStreaming(TensorBackend &backend, uint64_t elements)
+{
+    std::vector<float> a(static_cast<size_t>(elements));
+    std::vector<float> b(static_cast<size_t>(elements), 1.0f);
+    std::vector<float> out(static_cast<size_t>(elements));
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        a[i] = static_cast<float>(i % 1024) * 0.5f;
+    }
+
+    // At least eight chunks, so there is a pipeline to fill.
+    StreamOptions options;
+    options.chunkElements = std::max<uint64_t>(1, std::min<uint64_t>(options.chunkElements, elements / 8));
+
+    std::vector<StreamResult> results;
+    SimulatedStreamStages::Costs costs;
+    try
+    {
+        costs = MeasureStageCosts(backend, a.data(), b.data(), out.data(), options.chunkElements);
+    }
+    catch (const std::exception &e)
+    {
+        StreamResult result;
+        result.elements = elements;
+        result.status = e.what();
+        results.push_back(result);
+        return results;
+    }
+
+    for (uint32_t bufferCount : {1u, 2u, 3u})
+    {
+        StreamResult result;
+        result.bufferCount = bufferCount;
+        result.elements = elements;
+        result.chunkElements = options.chunkElements;
+        options.bufferCount = bufferCount;
+
+        SimulatedStreamStages model(costs, bufferCount);
+        StreamScheduler(elements, options.chunkElements, bufferCount).Run(model);
+        result.modelledSeconds = model.Seconds();
+
+        try
+        {
+            std::fill(out.begin(), out.end(), 0.0f);
+            auto start = std::chrono::steady_clock::now();
+            backend.StreamElementWise(ElementWiseDesc{}, a.data(), b.data(), out.data(), elements, options);
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            result.gigabytesPerSecond = 3.0 * static_cast<double>(elements * sizeof(float)) / result.seconds / 1e9;
+
+            // Reduced-precision storage rounds the sums, so only float32 storage is checked exactly.
+            if (backend.GetStoragePrecision({}) == StoragePrecision::Float32)
+            {
+                for (size_t i = 0; i < out.size(); ++i)
+                {
+                    if (out[i] != a[i] + 1.0f)
+                    {
+                        result.status = "mismatch at element " + std::to_string(i);
+                        break;
+                    }
+                }
+            }
+        }
+        catch (const std::exception &e)
+        {
+            result.status = e.what();
+        }
+        results.push_back(result);
+    }
+    return results;
+}
+
+// Closed-loop callers that each submit an add on c_batchRequestElements elements and wait for its result before
+// submitting the next, either straight to the backend or through an ElementWiseBatcher with a given deadline.
+constexpr uint64_t c_batchRequestElements = 8;
+
+struct BatchingResult
+{
+    int64_t delayMicroseconds = -1; // -1 calls the backend directly, one request at a time.
+    uint32_t callers = 0;
+    uint64_t requests = 0;
+    std::string status = "ok";
+    double requestsPerSecond = 0.0;
+    double requestsPerBatch = 1.0;
+    Percentiles latency; // Seconds from submitting a request to having its result.
+};
+
+// Runs request(caller, a, b, out) requestsPerCaller times on each of callers threads at once. Reduced-precision
+// storage rounds the sums, so results are only checked with exact set.
+template <typename F> void TimeCallers(BatchingResult &result, uint32_t requestsPerCaller, bool exact, F &&request)
+{
+    std::vector<std::vector<double>> latencies(result.callers);
+    std::vector<std::string> errors(result.callers);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (uint32_t caller = 0; caller < result.callers; ++caller)
+    {
+        workers.emplace_back([&, caller]() {
+            std::vector<float> a(c_batchRequestElements), b(c_batchRequestElements, 1.0f), out(c_batchRequestElements);
+            try
+            {
+                for (uint32_t i = 0; i < requestsPerCaller; ++i)
+                {
+                    for (size_t e = 0; e < a.size(); ++e)
+                    {
+                        a[e] = static_cast<float>(caller + e + i % 16);
+                    }
+                    auto requestStart = std::chrono::steady_clock::now();
+                    request(caller, a.data(), b.data(), out.data());
+                    latencies[caller].push_back(
+                        std::chrono::duration<double>(std::chrono::steady_clock::now() - requestStart).count());
+                    for (size_t e = 0; exact && e < a.size(); ++e)
+                    {
+                        if (out[e] != a[e] + 1.0f)
+                        {
+                            throw std::runtime_error("mismatch at element " + std::to_string(e));
+                        }
+                    }
+                }
+            }
+            catch (const std::exception &e)
+            {
+                errors[caller] = e.what();
+            }
+        });
+    }
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    for (const std::string &error : errors)
+    {
+        if (!error.empty())
+        {
+            result.status = error;
+            return;
+        }
+    }
+    std::vector<double> all;
+    for (const std::vector<double> &samples : latencies)
+    {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    result.requests = all.size();
+    result.requestsPerSecond = static_cast<double>(result.requests) / seconds;
+    result.latency = Summarize(std::move(all));
+}
+
+std::vector<BatchingResult> RunBatching(TensorBackend &backend, uint32_t callers, uint32_t iterations)
+{
+    uint32_t requestsPerCaller = iterations != 0 ? iterations : 2000;
+    bool exact = backend.GetStoragePrecision({}) == StoragePrecision::Float32;
+    std::vector<BatchingResult> results;
+
+    // Unbatched: every request uploads, adds and reads back on tensors of its caller's own, one request at a time
+    // unless the backend takes concurrent calls.
+    {
+        BatchingResult result;
+        result.callers = callers;
+        try
+        {
+            TensorShape shape{static_cast<uint32_t>(c_batchRequestElements)};
+            size_t bytes = c_batchRequestElements * sizeof(float);
+            std::vector<UniqueTensor> tensors;
+            for (uint32_t i = 0; i < 3 * callers; ++i)
+            {
+                tensors.emplace_back(backend, backend.CreateTensor("", shape, TensorDataType::Float32));
+            }
+            backend.Wait(backend.ElementWiseAddBcast(tensors[0], tensors[1], tensors[2]));
+            std::mutex backendMutex;
+            bool serialize = !backend.SupportsConcurrentCalls();
+            auto request = [&](uint32_t caller, const float *a, const float *b, float *out) {
+                std::unique_lock<std::mutex> lock(backendMutex, std::defer_lock);
+                if (serialize)
+                {
+                    lock.lock();
+                }
+                TensorHandle x = tensors[3 * caller], y = tensors[3 * caller + 1], z = tensors[3 * caller + 2];
+                backend.SetTensorData(x, a, bytes);
+                backend.SetTensorData(y, b, bytes);
+                backend.Wait(backend.ElementWiseAddBcast(x, y, z));
+                backend.GetTensorData(z, {}, TensorDataType::Float32, out, bytes);
+            };
+            TimeCallers(result, requestsPerCaller, exact, request);
+        }
+        catch (const std::exception &e)
+        {
+            result.status = e.what();
+        }
+        results.push_back(result);
+    }
+
+    for (int64_t delay : {0, 50, 200, 1000})
+    {
+        BatchingResult result;
+        result.delayMicroseconds = delay;
+        result.callers = callers;
+        try
+        {
+            BatchingOptions options;
+            options.maxDelay = std::chrono::microseconds(delay);
+            ElementWiseBatcher batcher(backend, options);
+            TimeCallers(result, requestsPerCaller, exact, [&](uint32_t, const float *a, const float *b, float *out) {
+                batcher.Submit(ElementWiseDesc{}, a, b, out, c_batchRequestElements).get();
+            });
+            BatchingStats stats = batcher.GetStats();
+            result.requestsPerBatch =
+                stats.batches == 0 ? 0.0 : static_cast<double>(stats.requests) / static_cast<double>(stats.batches);
+        }
+        catch (const std::exception &e)
+        {
+            result.status = e.what();
+        }
+        results.push_back(result);
+    }
+    return results;
+}
+
+// Square GEMMs and reductions on tensors uploaded once, so only the op itself is timed.
+constexpr uint32_t c_maxCheckedGemmSize = 256;
+
+struct MatrixResult
+{
+    std::string op; // "gemm", "reduce_sum" or "reduce_max".
+    uint32_t size = 0;
+    uint32_t axis = 0; // Reductions only.
+    uint32_t iterations = 0;
+    double seconds = 0.0; // Median of one op.
+    double gflops = 0.0;
+    double gigabytesPerSecond = 0.0; // Inputs and output, once.
+    double referenceGflops = 0.0;    // The reference loops; 0 where they were not run.
+    std::string status = "ok";
+};
+
+template <typename F> double MedianSeconds(uint32_t iterations, F &&op)
+{
+    op(); // Compiles the operator and warms the caches outside the timing.
+    std::vector<double> samples;
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        op();
+        samples.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return Summarize(std::move(samples)).p50;
+}
+
+HostTensor PatternMatrix(uint32_t rows, uint32_t columns, uint32_t seed)
+{
+    HostTensor matrix{{rows, columns}, std::vector<float>(size_t(rows) * columns)};
+    for (size_t i = 0; i < matrix.data.size(); ++i)
+    {
+        matrix.data[i] = static_cast<float>((i * 7 + seed) % 17) / 8.0f - 1.0f;
+    }
+    return matrix;
+}
+
+// The largest difference from the reference, or -1 if any element differs by more than tolerance.
+double Compare(TensorBackend &backend, TensorHandle tensor, const HostTensor &expected, double tolerance)
+{
+    std::vector<float> actual(expected.data.size());
+    backend.GetTensorData(tensor, expected.shape, TensorDataType::Float32, actual.data(),
+                          actual.size() * sizeof(float));
+    double worst = 0.0;
+    for (size_t i = 0; i < actual.size(); ++i)
+    {
+        worst = std::max(worst, static_cast<double>(std::abs(actual[i] - expected.data[i])));
+    }
+    return worst > tolerance ? -1.0 : worst;
+}
+
+std::vector<MatrixResult> RunMatrixOps(TensorBackend &backend, uint32_t maxSize, uint32_t iterations)
+{
+    bool exact = backend.GetStoragePrecision({}) == StoragePrecision::Float32;
+    std::vector<MatrixResult> results;
+    for (uint32_t size = 64; size <= maxSize; size *= 2)
+    {
+        MatrixResult result;
+        result.op = "gemm";
+        result.size = size;
+        try
+        {
+            GemmDesc desc;
+            HostTensor a = PatternMatrix(size, size, 1);
+            HostTensor b = PatternMatrix(size, size, 2);
+            HostTensor bias = PatternMatrix(1, size, 3);
+            UniqueTensor x(backend, backend.CreateTensor("", a.shape, TensorDataType::Float32));
+            UniqueTensor y(backend, backend.CreateTensor("", b.shape, TensorDataType::Float32));
+            UniqueTensor z(backend, backend.CreateTensor("", bias.shape, TensorDataType::Float32));
+            UniqueTensor out(backend, backend.CreateTensor("", a.shape, TensorDataType::Float32));
+            backend.SetTensorData(x, a.data.data(), a.data.size() * sizeof(float));
+            backend.SetTensorData(y, b.data.data(), b.data.size() * sizeof(float));
+            backend.SetTensorData(z, bias.data.data(), bias.data.size() * sizeof(float));
+
+            double flops = 2.0 * size * size * size;
+            // About two GFLOP per size, so the small sizes are not timed on a handful of microseconds.
+            result.iterations =
+                iterations != 0 ? iterations : static_cast<uint32_t>(std::clamp(2e9 / flops, 3.0, 200.0));
+            result.seconds =
+                MedianSeconds(result.iterations, [&]() { backend.Wait(backend.Gemm(desc, x, y, z, out)); });
+            result.gflops = flops / result.seconds / 1e9;
+            result.gigabytesPerSecond = 3.0 * size * size * sizeof(float) / result.seconds / 1e9;
+
+            if (size <= c_maxCheckedGemmSize)
+            {
+                HostTensor expected;
+                double referenceSeconds = MedianSeconds(1, [&]() { expected = RunGemmOnCpu(desc, a, b, &bias); });
+                result.referenceGflops = flops / referenceSeconds / 1e9;
+                // Float32 sums of size products, each term below 1, drift from the double-precision reference by a
+                // few ulps per term.
+                if (exact && Compare(backend, out, expected, 1e-5 * size) < 0.0)
+                {
+                    result.status = "mismatch against the reference";
+                }
+            }
+        }
+        catch (const std::exception &e)
+        {
+            result.status = e.what();
+        }
+        results.push_back(result);
+    }
+
+    for (ReduceOp op : {ReduceOp::Sum, ReduceOp::Max})
+    {
+        for (uint32_t axis : {0u, 1u})
+        {
+            MatrixResult result;
+            result.op = op == ReduceOp::Sum ? "reduce_sum" : "reduce_max";
+            result.size = maxSize;
+            result.axis = axis;
+            try
+            {
+                ReduceDesc desc{op, axis};
+                HostTensor matrix = PatternMatrix(maxSize, maxSize, 4);
+                UniqueTensor x(backend, backend.CreateTensor("", matrix.shape, TensorDataType::Float32));
+                UniqueTensor out(backend, backend.CreateTensor("", ReduceOutputShape(desc, matrix.shape),
+                                                               TensorDataType::Float32));
+                backend.SetTensorData(x, matrix.data.data(), matrix.data.size() * sizeof(float));
+
+                double bytes = (double(maxSize) * maxSize + maxSize) * sizeof(float);
+                result.iterations = iterations != 0 ? iterations : 50;
+                result.seconds =
+                    MedianSeconds(result.iterations, [&]() { backend.Wait(backend.Reduce(desc, x, out)); });
+                result.gflops = double(maxSize) * maxSize / result.seconds / 1e9;
+                result.gigabytesPerSecond = bytes / result.seconds / 1e9;
+                if (exact && Compare(backend, out, RunReduceOnCpu(desc, matrix), 1e-6 * maxSize) < 0.0)
+                {
+                    result.status = "mismatch against the reference";
+                }
+            }
+            catch (const std::exception &e)
+            {
+                result.status = e.what();
+            }
+            results.push_back(result);
+        }
+    }
+    return results;
+}
+
+// One request, c = a + b and d = relu(c * b), on tensors of its own, made call by call and replayed from a plan.
+struct PlanResult
+{
+    uint64_t elements = 0;
+    uint32_t iterations = 0;
+    double directSeconds = 0.0; // Medians of one request.
+    double replaySeconds = 0.0;
+    std::string status = "ok";
+};
+
+std::vector<PlanResult> RunPlans(TensorBackend &backend, uint64_t maxElements, uint32_t iterations)
+{
+    ElementWiseDesc multiplyRelu;
+    multiplyRelu.op = BinaryOp::Multiply;
+    multiplyRelu.activation = Activation::Relu;
+
+    std::vector<PlanResult> results;
+    for (uint64_t elements = 8; elements <= maxElements; elements *= 16)
+    {
+        PlanResult result;
+        result.elements = elements;
+        try
+        {
+            TensorShape shape{static_cast<uint32_t>(elements)};
+            size_t bytes = static_cast<size_t>(elements * sizeof(float));
+            UniqueTensor a(backend, backend.CreateTensor("", shape, TensorDataType::Float32));
+            UniqueTensor b(backend, backend.CreateTensor("", shape, TensorDataType::Float32));
+            UniqueTensor c(backend, backend.CreateTensor("", shape, TensorDataType::Float32));
+            UniqueTensor d(backend, backend.CreateTensor("", shape, TensorDataType::Float32));
+            std::vector<float> x(elements);
+            std::vector<float> y(elements);
+            for (size_t i = 0; i < x.size(); ++i)
+            {
+                x[i] = static_cast<float>(i % 13) - 6.0f;
+                y[i] = static_cast<float>(i % 5) - 2.0f;
+            }
+            std::vector<float> direct(elements);
+            std::vector<float> replayed(elements);
+
+            result.iterations = iterations != 0 ? iterations : static_cast<uint32_t>(std::clamp<uint64_t>(
+                                                                   (64ull << 20) / bytes, 10, 2000));
+            result.directSeconds = MedianSeconds(result.iterations, [&]() {
+                backend.SetTensorData(a, x.data(), bytes);
+                backend.SetTensorData(b, y.data(), bytes);
+                backend.ElementWiseAddBcast(a, b, c);
+                backend.ElementWise(multiplyRelu, c, b, d);
+                backend.GetTensorData(d, {}, TensorDataType::Float32, direct.data(), bytes);
+            });
+
+            PlanCapture capture(backend);
+            capture.SetTensorData(a, bytes);
+            capture.SetTensorData(b, bytes);
+            capture.ElementWise(ElementWiseDesc{}, a, b, c);
+            capture.ElementWise(multiplyRelu, c, b, d);
+            capture.GetTensorData(d, bytes);
+            std::unique_ptr<ExecutionPlan> plan = backend.CreateExecutionPlan(capture);
+            result.replaySeconds =
+                MedianSeconds(result.iterations, [&]() { plan->Replay({x.data(), y.data()}, {replayed.data()}); });
+
+            if (direct != replayed)
+            {
+                result.status = "replay differs from the direct calls";
+            }
+        }
+        catch (const std::exception &e)
+        {
+            result.status = e.what();
+        }
+        results.push_back(result);
+    }
+    return results;
+}
+
+std::string JsonString(const std::string &text)
+{
+    std::string escaped = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped + "\"";
+}
+
+std::string ToJson(const std::string &backendName, StoragePrecision storage, const std::vector<BenchResult> &results,
+                   const std::vector<ThroughputResult> &throughput, const LookupResult *lookups,
+                   const std::vector<StreamResult> &streaming, const std::vector<BatchingResult> &batching,
+                   const std::vector<MatrixResult> &matrixOps, const std::vector<PlanResult> &plans)
+{
+    auto percentiles = [](const Percentiles &p) {
+        std::ostringstream out;
+        out << "{\"p50_ms\": " << p.p50 * 1e3 << ", \"p99_ms\": " << p.p99 * 1e3 << ", \"mean_ms\": " << p.mean * 1e3
+            << "}";
+        return out.str();
+    };
+
+    std::ostringstream json;
+    json << "{\n  \"backend\": " << JsonString(backendName) << ",\n  \"storage\": \"" << StoragePrecisionName(storage)
+         << "\",\n  \"results\": [";
+    for (size_t r = 0; r < results.size(); ++r)
+    {
+        const BenchResult &result = results[r];
+        json << (r == 0 ? "\n" : ",\n") << "    {\"dtype\": \"" << DataTypeName(result.type) << "\", \"pattern\": \""
+             << PatternName(result.pattern) << "\", \"elements\": " << result.elements
+             << ", \"bytes_moved\": " << result.bytesMoved << ", \"iterations\": " << result.iterations
+             << ", \"status\": " << JsonString(result.status) << ",\n     \"first_run_ms\": {";
+        for (size_t i = 0; i < c_phaseCount; ++i)
+        {
+            json << "\"" << PhaseName(static_cast<Phase>(i)) << "\": " << result.firstRun.seconds[i] * 1e3 << ", ";
+        }
+        json << "\"total\": " << result.firstRunTotal * 1e3 << "},\n     \"phases\": {";
+        for (size_t i = 0; i < c_phaseCount; ++i)
+        {
+            json << (i == 0 ? "" : ", ") << "\"" << PhaseName(static_cast<Phase>(i))
+                 << "\": " << percentiles(result.phases[i]);
+        }
+        json << "},\n     \"total\": " << percentiles(result.total)
+             << ", \"dispatch_gb_per_second\": " << result.gigabytesPerSecond
+             << ", \"dispatch_elements_per_second\": " << result.elementsPerSecond << "}";
+    }
+    json << "\n  ],\n  \"throughput\": [";
+    for (size_t r = 0; r < throughput.size(); ++r)
+    {
+        const ThroughputResult &result = throughput[r];
+        json << (r == 0 ? "\n" : ",\n") << "    {\"threads\": " << result.threads
+             << ", \"elements\": " << result.elements << ", \"requests\": " << result.requests
+             << ", \"status\": " << JsonString(result.status)
+             << ", \"requests_per_second\": " << result.requestsPerSecond << "}";
+    }
+    json << "\n  ]";
+    if (lookups)
+    {
+        json << ",\n  \"lookups\": {\"status\": " << JsonString(lookups->status)
+             << ", \"tensors\": " << lookups->tensors << ", \"name_lookup_ns\": " << lookups->nameLookupNs
+             << ", \"handle_lookup_ns\": " << lookups->handleLookupNs << ", \"name_op_ns\": " << lookups->nameOpNs
+             << ", \"handle_op_ns\": " << lookups->handleOpNs << "}";
+    }
+    if (!streaming.empty())
+    {
+        json << ",\n  \"streaming\": [";
+        for (size_t r = 0; r < streaming.size(); ++r)
+        {
+            const StreamResult &result = streaming[r];
+            json << (r == 0 ? "\n" : ",\n") << "    {\"buffers\": " << result.bufferCount
+                 << ", \"elements\": " << result.elements << ", \"chunk_elements\": " << result.chunkElements
+                 << ", \"status\": " << JsonString(result.status) << ", \"ms\": " << result.seconds * 1e3
+                 << ", \"gb_per_second\": " << result.gigabytesPerSecond
+                 << ", \"model_ms\": " << result.modelledSeconds * 1e3 << "}";
+        }
+        json << "\n  ]";
+    }
+    if (!batching.empty())
+    {
+        json << ",\n  \"batching\": [";
+        for (size_t r = 0; r < batching.size(); ++r)
+        {
+            const BatchingResult &result = batching[r];
+            json << (r == 0 ? "\n" : ",\n") << "    {\"delay_us\": " << result.delayMicroseconds
+                 << ", \"callers\": " << result.callers << ", \"requests\": " << result.requests
+                 << ", \"status\": " << JsonString(result.status)
+                 << ", \"requests_per_second\": " << result.requestsPerSecond
+                 << ", \"requests_per_batch\": " << result.requestsPerBatch
+                 << ", \"latency\": " << percentiles(result.latency) << "}";
+        }
+        json << "\n  ]";
+    }
+    if (!matrixOps.empty())
+    {
+        json << ",\n  \"matrix_ops\": [";
+        for (size_t r = 0; r < matrixOps.size(); ++r)
+        {
+            const MatrixResult &result = matrixOps[r];
+            json << (r == 0 ? "\n" : ",\n") << "    {\"op\": \"" << result.op << "\", \"size\": " << result.size
+                 << ", \"axis\": " << result.axis << ", \"status\": " << JsonString(result.status)
+                 << ", \"iterations\": " << result.iterations << ", \"ms\": " << result.seconds * 1e3
+                 << ", \"gflops\": " << result.gflops << ", \"gb_per_s\": " << result.gigabytesPerSecond
+                 << ", \"reference_gflops\": " << result.referenceGflops << "}";
+        }
+        json << "\n  ]";
+    }
+    if (!plans.empty())
+    {
+        json << ",\n  \"plans\": [";
+        for (size_t r = 0; r < plans.size(); ++r)
+        {
+            const PlanResult &result = plans[r];
+            json << (r == 0 ? "\n" : ",\n") << "    {\"elements\": " << result.elements
+                 << ", \"status\": " << JsonString(result.status) << ", \"iterations\": " << result.iterations
+                 << ", \"direct_us\": " << result.directSeconds * 1e6
+                 << ", \"replay_us\": " << result.replaySeconds * 1e6 << "}";
+        }
+        json << "\n  ]";
+    }
+    json << "\n}\n";
+    return json.str();
+}
+
+void PrintResult(const BenchResult &result)
+{
+    if (result.status != "ok")
+    {
+        printf("%-8s %-7s %12llu  skipped: %s\n", DataTypeName(result.type), PatternName(result.pattern),
+               static_cast<unsigned long long>(result.elements), result.status.c_str());
+        return;
+    }
+    auto p50 = [&](Phase phase) { return result.phases[static_cast<size_t>(phase)].p50 * 1e3; };
+    printf("%-8s %-7s %12llu %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %9.2f\n",
+           DataTypeName(result.type), PatternName(result.pattern), static_cast<unsigned long long>(result.elements),
+           result.firstRun[Phase::Compile] * 1e3, result.firstRun[Phase::Initialize] * 1e3, p50(Phase::Upload),
+           p50(Phase::Dispatch), p50(Phase::Readback), p50(Phase::HostCopy), result.total.p50 * 1e3,
+           result.total.p99 * 1e3, result.gigabytesPerSecond);
+}
+
+constexpr StoragePrecision c_storagePrecisions[] = {StoragePrecision::Float32, StoragePrecision::Float16,
+                                                    StoragePrecision::BFloat16, StoragePrecision::Int8};
+
+BenchOptions ParseOptions(int argc, char const *argv[])
+{
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--max-bytes" && hasValue)
+        {
+            options.maxTensorBytes = std::stoull(argv[++i]);
+        }
+        else if (argument == "--iterations" && hasValue)
+        {
+            options.iterations = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (argument == "--json" && hasValue)
+        {
+            options.jsonPath = argv[++i];
+        }
+        else if (argument == "--trace" && hasValue)
+        {
+            options.tracePath = argv[++i];
+        }
+        else if (argument == "--storage" && hasValue)
+        {
+            std::string name = argv[++i];
+            auto precision = std::find_if(std::begin(c_storagePrecisions), std::end(c_storagePrecisions),
+                                          [&](StoragePrecision p) { return name == StoragePrecisionName(p); });
+            if (precision == std::end(c_storagePrecisions))
+            {
+                throw std::invalid_argument("Unknown storage precision " + name + ".");
+            }
+            options.storage = *precision;
+        }
+        else if (argument == "--threads" && hasValue)
+        {
+            options.threads = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (argument == "--lookups")
+        {
+            options.lookups = true;
+        }
+        else if (argument == "--stream" && hasValue)
+        {
+            options.streamElements = std::stoull(argv[++i]);
+        }
+        else if (argument == "--profile" && hasValue)
+        {
+            options.profilePath = argv[++i];
+        }
+        else if (argument == "--batch" && hasValue)
+        {
+            options.batchCallers = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (argument == "--gemm" && hasValue)
+        {
+            options.gemmSize = static_cast<uint32_t>(std::stoul(argv[++i]));
+        }
+        else if (argument == "--plan" && hasValue)
+        {
+            options.planElements = std::stoull(argv[++i]);
+        }
+        else if (argument.rfind("--", 0) == 0)
+        {
+            throw std::invalid_argument("Unknown option " + argument + ".");
+        }
+        else
+        {
+            options.adapterNameFilter = argument;
+        }
+    }
+    return options;
+}
+} // namespace
+
+int main(int argc, char const *argv[])
+{
+    BenchOptions options;
+    try
+    {
+        options = ParseOptions(argc, argv);
+    }
+    catch (const std::exception &e)
+    {
+        printf("%s\nUsage: hello_dml_bench [adapterNameFilter] [--max-bytes N] [--iterations N] [--json path] "
+               "[--trace path] [--storage float32|float16|bfloat16|int8] [--threads N] [--lookups] [--stream N] "
+               "[--profile path] [--batch N] [--gemm N] [--plan N]\n",
+               e.what());
+        return 2;
+    }
+
+    Tracer::SetEnabled(!options.tracePath.empty());
+    std::unique_ptr<TensorBackend> backend = CreateTensorBackend(options.adapterNameFilter, options.profilePath);
+    backend->SetStoragePrecision(options.storage);
+    printf("Backend: %s, float32 tensors stored as %s\n", backend->Name().c_str(),
+           StoragePrecisionName(backend->GetStoragePrecision({})));
+    printf("Times in ms: compile and init from the first run, other phases and totals over the remaining runs.\n");
+    printf("%-8s %-7s %12s %10s %10s %10s %10s %10s %10s %10s %10s %9s\n", "dtype", "pattern", "elements", "compile",
+           "init", "upload", "dispatch", "readback", "host_copy", "p50_total", "p99_total", "GB/s");
+
+    std::vector<BenchResult> results;
+    for (TensorDataType type : {TensorDataType::Float32, TensorDataType::Float16})
+    {
+        for (BroadcastPattern pattern : {BroadcastPattern::Same, BroadcastPattern::Row, BroadcastPattern::Scalar})
+        {
+            // Sizes grow by 4x from 8 elements up to the largest tensor that fits in maxTensorBytes.
+            for (uint64_t elements = 8; elements * DataTypeSize(type) <= options.maxTensorBytes; elements *= 4)
+            {
+                results.push_back(RunCase(*backend, type, pattern, elements, options.iterations));
+                PrintResult(results.back());
+                if (results.back().status != "ok")
+                {
+                    // Larger sizes of an unsupported combination would fail the same way.
+                    break;
+                }
+            }
+        }
+    }
+
+    std::vector<ThroughputResult> throughput;
+    if (options.threads != 0 && !backend->SupportsConcurrentCalls())
+    {
+        printf("Skipping the throughput sweep: the backend does not support concurrent calls.\n");
+    }
+    else if (options.threads != 0)
+    {
+        uint64_t elements = std::max<uint64_t>(8, std::min<uint64_t>(1 << 16, options.maxTensorBytes / sizeof(float)));
+        printf("\nThroughput of upload, add and readback requests on %llu float32 elements:\n",
+               static_cast<unsigned long long>(elements));
+        printf("%8s %12s %14s %8s\n", "threads", "requests", "requests/s", "speedup");
+        for (uint32_t threads = 1;; threads = std::min(threads * 2, options.threads))
+        {
+            throughput.push_back(RunThroughput(*backend, threads, elements, options.iterations));
+            const ThroughputResult &result = throughput.back();
+            if (result.status != "ok")
+            {
+                printf("%8u  skipped: %s\n", threads, result.status.c_str());
+                break;
+            }
+            printf("%8u %12llu %14.1f %8.2f\n", threads, static_cast<unsigned long long>(result.requests),
+                   result.requestsPerSecond, result.requestsPerSecond / throughput.front().requestsPerSecond);
+            if (threads == options.threads)
+            {
+                break;
+            }
+        }
+    }
+
+    LookupResult lookups;
+    if (options.lookups)
+    {
+        lookups = RunLookups(*backend, options.iterations);
+        printf("\nTensor lookup among %llu tensors: %.1f ns by name, %.1f ns by handle\n",
+               static_cast<unsigned long long>(lookups.tensors), lookups.nameLookupNs, lookups.handleLookupNs);
+        if (lookups.status == "ok")
+        {
+            printf("Add on 8 elements: %.0f ns by name, %.0f ns by handle\n", lookups.nameOpNs, lookups.handleOpNs);
+        }
+        else
+        {
+            printf("Add on 8 elements skipped: %s\n", lookups.status.c_str());
+        }
+    }
+
+    std::vector<StreamResult> streaming;
+    if (options.streamElements != 0)
+    {
+        streaming = RunStreaming(*backend, options.streamElements);
+        printf("\nStreamed add over %llu float32 elements in chunks of %llu:\n",
+               static_cast<unsigned long long>(options.streamElements),
+               static_cast<unsigned long long>(streaming.front().chunkElements));
+        printf("%8s %10s %10s %10s\n", "buffers", "ms", "GB/s", "model_ms");
+        for (const StreamResult &result : streaming)
+        {
+            if (result.status != "ok")
+            {
+                printf("%8u  failed: %s\n", result.bufferCount, result.status.c_str());
+                continue;
+            }
+            printf("%8u %10.3f %10.2f %10.3f\n", result.bufferCount, result.seconds * 1e3, result.gigabytesPerSecond,
+                   result.modelledSeconds * 1e3);
+        }
+    }
+
+    std::vector<BatchingResult> batching;
+    if (options.batchCallers != 0)
+    {
+        batching = RunBatching(*backend, options.batchCallers, options.iterations);
+        printf("\nAdds on %llu float32 elements from %u callers, unbatched and batched with a deadline:\n",
+               static_cast<unsigned long long>(c_batchRequestElements), options.batchCallers);
+        printf("%10s %14s %10s %10s %10s\n", "delay_us", "requests/s", "per_batch", "p50_ms", "p99_ms");
+        for (const BatchingResult &result : batching)
+        {
+            std::string delay = result.delayMicroseconds < 0 ? "unbatched" : std::to_string(result.delayMicroseconds);
+            if (result.status != "ok")
+            {
+                printf("%10s  failed: %s\n", delay.c_str(), result.status.c_str());
+                continue;
+            }
+            printf("%10s %14.1f %10.1f %10.3f %10.3f\n", delay.c_str(), result.requestsPerSecond,
+                   result.requestsPerBatch, result.latency.p50 * 1e3, result.latency.p99 * 1e3);
+        }
+    }
+
+    std::vector<MatrixResult> matrixOps;
+    if (options.gemmSize != 0)
+    {
+        matrixOps = RunMatrixOps(*backend, options.gemmSize, options.iterations);
+        printf("\nSquare float32 GEMMs with a bias row, and reductions of a %u x %u matrix (GFLOP/s counts one op per "
+               "element):\n",
+               options.gemmSize, options.gemmSize);
+        printf("%-10s %6s %5s %10s %10s %10s %14s\n", "op", "size", "axis", "ms", "GFLOP/s", "GB/s", "reference");
+        for (const MatrixResult &result : matrixOps)
+        {
+            if (result.status != "ok")
+            {
+                printf("%-10s %6u %5u  failed: %s\n", result.op.c_str(), result.size, result.axis,
+                       result.status.c_str());
+                continue;
+            }
+            char reference[32] = "-";
+            if (result.referenceGflops > 0.0)
+            {
+                snprintf(reference, sizeof(reference), "%.2f", result.referenceGflops);
+            }
+            printf("%-10s %6u %5u %10.3f %10.2f %10.2f %14s\n", result.op.c_str(), result.size, result.axis,
+                   result.seconds * 1e3, result.gflops, result.gigabytesPerSecond, reference);
+        }
+    }
+
+    std::vector<PlanResult> plans;
+    if (options.planElements != 0)
+    {
+        plans = RunPlans(*backend, options.planElements, options.iterations);
+        printf("\nUpload two tensors, add, multiply with ReLU and read back, call by call and replayed from a plan:\n");
+        printf("%12s %12s %12s %9s\n", "elements", "direct_us", "replay_us", "speedup");
+        for (const PlanResult &result : plans)
+        {
+            if (result.status != "ok")
+            {
+                printf("%12llu  failed: %s\n", static_cast<unsigned long long>(result.elements), result.status.c_str());
+                continue;
+            }
+            printf("%12llu %12.2f %12.2f %9.2f\n", static_cast<unsigned long long>(result.elements),
+                   result.directSeconds * 1e6, result.replaySeconds * 1e6, result.directSeconds / result.replaySeconds);
+        }
+    }
+
+    backend->FreeResources();
+    Tracer::SetEnabled(false);
+
+    if (!options.jsonPath.empty())
+    {
+        std::ofstream file(options.jsonPath);
+        file << ToJson(backend->Name(), backend->GetStoragePrecision({}), results, throughput,
+                       options.lookups ? &lookups : nullptr, streaming, batching, matrixOps, plans);
+        if (!file)
+        {
+            printf("Failed to write %s\n", options.jsonPath.c_str());
+            return 1;
+        }
+        printf("Wrote %s\n", options.jsonPath.c_str());
+    }
+    if (!options.tracePath.empty())
+    {
+        if (!Tracer::ExportChromeTrace(options.tracePath))
+        {
+            printf("Failed to write %s\n", options.tracePath.c_str());
+            return 1;
+        }
+        printf("Wrote %s (%llu events dropped)\n", options.tracePath.c_str(),
+               static_cast<unsigned long long>(Tracer::DroppedCount()));
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include "BroadcastShape.hpp"
+#include "TestHarness.hpp"
+
+TEST(RejectsMismatchedDimensions)
+{
+    // A size-2 dimension cannot broadcast against a size-4 one, although 4 is a multiple of 2.
+    CHECK(!TryBroadcastShapes({2}, {4}));
+    CHECK(!TryBroadcastShapes({1, 2, 3}, {4, 4, 3}));
+    CHECK_THROWS(BroadcastShapes({2, 3}, {4, 3}), std::invalid_argument);
+    CHECK_THROWS(BroadcastStrides({2}, {4}), std::invalid_argument);
+}
+
+TEST(BroadcastsSizeOneDimensions)
+{
+    CHECK(BroadcastShapes({4, 1}, {1, 5}) == TensorShape({4, 5}));
+    CHECK(BroadcastShapes({1, 1, 8, 1}, {1, 1, 1, 1}) == TensorShape({1, 1, 8, 1}));
+    CHECK(BroadcastShapes({3, 1, 2}, {3, 7, 1}) == TensorShape({3, 7, 2}));
+}
+
+TEST(BroadcastsMissingLeadingAxes)
+{
+    CHECK(BroadcastShapes({5}, {2, 3, 5}) == TensorShape({2, 3, 5}));
+    CHECK(BroadcastShapes({2, 3, 5}, {3, 1}) == TensorShape({2, 3, 5}));
+    CHECK(BroadcastShapes({1, 1, 1, 1, 1, 1, 1, 2}, {2}) == TensorShape({1, 1, 1, 1, 1, 1, 1, 2}));
+}
+
+TEST(ContiguousStridesAreRowMajor)
+{
+    CHECK(ContiguousStrides({2, 3, 4}) == std::vector<uint32_t>({12, 4, 1}));
+    CHECK(ContiguousStrides({7}) == std::vector<uint32_t>({1}));
+}
+
+TEST(BroadcastStridesAreZeroAlongBroadcastAxes)
+{
+    CHECK(BroadcastStrides({3, 1}, {2, 3, 4}) == std::vector<uint32_t>({0, 1, 0}));
+    CHECK(BroadcastStrides({4}, {2, 3, 4}) == std::vector<uint32_t>({0, 0, 1}));
+    CHECK(BroadcastStrides({2, 3, 4}, {2, 3, 4}) == std::vector<uint32_t>({12, 4, 1}));
+    CHECK(BroadcastStrides({1, 3, 1}, {2, 3, 4}) == std::vector<uint32_t>({0, 1, 0}));
+    CHECK_THROWS(BroadcastStrides({2, 3}, {3}), std::invalid_argument);
+}
+
+TEST(ValidatesRankAndZeroDimensions)
+{
+    CHECK_THROWS(ValidateShape({}), std::invalid_argument);
+    CHECK_THROWS(ValidateShape(TensorShape(c_maxTensorRank + 1, 1)), std::invalid_argument);
+    CHECK_THROWS(ValidateShape({2, 0}), std::invalid_argument);
+    ValidateShape(TensorShape(c_maxTensorRank, 1));
+}
+
+// Walks every output element through the plan's runs and checks the operand offsets against the full strides.
+static void CheckRuns(const TensorShape &a, const TensorShape &b, uint64_t begin, uint64_t end)
+{
+    TensorShape result = BroadcastShapes(a, b);
+    std::vector<uint32_t> stridesA = BroadcastStrides(a, result);
+    std::vector<uint32_t> stridesB = BroadcastStrides(b, result);
+    BroadcastPlan plan = PlanBroadcast(a, b, result);
+    CHECK_EQ(plan.elementCount, ElementCount(result));
+
+    uint64_t next = begin;
+    ForEachBroadcastRun(plan, begin, end, [&](size_t output, size_t offsetA, size_t offsetB, size_t count) {
+        CHECK_EQ(uint64_t(output), next);
+        for (size_t i = 0; i < count; ++i)
+        {
+            size_t expectedA = 0;
+            size_t expectedB = 0;
+            uint64_t remainder = output + i;
+            for (size_t d = result.size(); d-- > 0;)
+            {
+                expectedA += (remainder % result[d]) * stridesA[d];
+                expectedB += (remainder % result[d]) * stridesB[d];
+                remainder /= result[d];
+            }
+            CHECK_EQ(offsetA + i * plan.stridesA.back(), expectedA);
+            CHECK_EQ(offsetB + i * plan.stridesB.back(), expectedB);
+        }
+        next += count;
+    });
+    CHECK_EQ(next, end);
+}
+
+TEST(RunsVisitEveryElementWithTheRightOffsets)
+{
+    CheckRuns({2, 3, 4}, {2, 3, 4}, 0, 24);
+    CheckRuns({2, 3, 4}, {4}, 0, 24);
+    CheckRuns({2, 1, 4}, {1, 3, 1}, 0, 24);
+    CheckRuns({3, 1}, {1, 5}, 0, 15);
+    CheckRuns({1, 1, 8, 1}, {1, 1, 1, 1}, 0, 8);
+    // Ranges that start and end inside a run, as a worker thread's share would.
+    CheckRuns({2, 3, 4}, {3, 1}, 5, 19);
+    CheckRuns({4, 5}, {4, 1}, 7, 8);
+}
+
+TEST(PlanMergesContiguousDimensions)
+{
+    BroadcastPlan same = PlanBroadcast({2, 3, 4}, {2, 3, 4}, {2, 3, 4});
+    CHECK(same.sizes == std::vector<size_t>({24}));
+
+    BroadcastPlan row = PlanBroadcast({2, 3, 4}, {4}, {2, 3, 4});
+    CHECK(row.sizes == std::vector<size_t>({6, 4}));
+    CHECK(row.stridesB == std::vector<size_t>({0, 1}));
+
+    BroadcastPlan scalar = PlanBroadcast({1}, {1}, {1});
+    CHECK(scalar.sizes == std::vector<size_t>({1}));
+}
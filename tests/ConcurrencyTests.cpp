@@ -0,0 +1,180 @@
+#include "ContextPool.hpp"
+#include "CpuBackend.hpp"
+#include "TensorTable.hpp"
+#include "TestHarness.hpp"
+
+#include <atomic>
+#include <thread>
+
+// Stress tests of the paths several threads may take at once. They check results, but are mostly meant to run in a
+// build with -fsanitize=thread, which reports any race they provoke.
+
+constexpr int c_threadCount = 8;
+
+// Runs body(thread) on c_threadCount threads, started together, and rethrows the first failure.
+template <typename Body> void RunThreads(Body &&body)
+{
+    std::atomic<bool> go{false};
+    std::mutex failureMutex;
+    std::string failure;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < c_threadCount; ++t)
+    {
+        threads.emplace_back([&, t] {
+            while (!go.load())
+            {
+                std::this_thread::yield();
+            }
+            try
+            {
+                body(t);
+            }
+            catch (const std::exception &e)
+            {
+                std::lock_guard<std::mutex> lock(failureMutex);
+                failure = e.what();
+            }
+        });
+    }
+    go = true;
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    if (!failure.empty())
+    {
+        throw TestFailure(failure);
+    }
+}
+
+struct FakeContext
+{
+    std::atomic<int> users{0};
+    uint64_t uses = 0; // Only touched by the lease holder.
+};
+
+TEST(ContextPoolLeasesAreExclusive)
+{
+    std::atomic<int> created{0};
+    ContextPool<FakeContext> pool([&] {
+        ++created;
+        return std::make_unique<FakeContext>();
+    });
+    RunThreads([&](int) {
+        for (int i = 0; i < 2000; ++i)
+        {
+            auto lease = pool.Acquire();
+            CHECK_EQ(++lease->users, 1);
+            ++lease->uses;
+            CHECK_EQ(--lease->users, 0);
+        }
+    });
+    CHECK(created.load() <= c_threadCount);
+    CHECK_EQ(pool.Size(), static_cast<size_t>(created.load()));
+
+    uint64_t uses = 0;
+    pool.ForEachIdle([&](FakeContext &context) { uses += context.uses; });
+    CHECK_EQ(uses, uint64_t(c_threadCount) * 2000);
+}
+
+TEST(TensorTableCreatesEachNameOnce)
+{
+    TensorTable<int> table;
+    std::atomic<int> creations{0};
+    std::vector<std::vector<TensorHandle>> handles(c_threadCount);
+    RunThreads([&](int t) {
+        for (int i = 0; i < 500; ++i)
+        {
+            auto [handle, value] = table.FindOrCreate("shared" + std::to_string(i % 50), [&] { return ++creations; });
+            CHECK(value != nullptr);
+            handles[t].push_back(handle);
+
+            // Anonymous tensors are always new, and erasing one leaves the named ones alone.
+            auto anonymous = table.FindOrCreate("", [] { return 0; });
+            CHECK(table.Erase(anonymous.first).has_value());
+            CHECK(table.Find(anonymous.first) == nullptr);
+        }
+    });
+    CHECK_EQ(creations.load(), 50);
+    CHECK_EQ(table.Size(), 50u);
+    for (int t = 1; t < c_threadCount; ++t)
+    {
+        CHECK(handles[t] == handles[0]);
+    }
+}
+
+// Every thread creates, writes, computes on, reads back and releases tensors of its own, named and anonymous, while
+// reading tensors shared by all of them.
+TEST(CpuBackendCreateReleaseDispatch)
+{
+    CpuBackendOptions options;
+    options.threadCount = 4;
+    options.minParallelElements = 256; // Make larger ops contend for the thread pool.
+    CpuBackend backend(options);
+
+    const uint32_t size = 1024;
+    std::vector<float> ones(size, 1.0f);
+    TensorHandle shared = backend.CreateTensor("shared", {size}, TensorDataType::Float32);
+    backend.SetTensorData(shared, ones.data(), size * sizeof(float));
+    std::vector<float> identity(16 * 16, 0.0f);
+    for (int i = 0; i < 16; ++i)
+    {
+        identity[i * 17] = 1.0f;
+    }
+    TensorHandle weights = backend.CreateTensor("weights", {16, 16}, TensorDataType::Float32);
+    backend.SetTensorData(weights, identity.data(), identity.size() * sizeof(float));
+
+    RunThreads([&](int t) {
+        std::vector<float> input(size);
+        std::vector<float> output(size);
+        for (int i = 0; i < 100; ++i)
+        {
+            uint32_t elements = size >> (i % 4); // Reshaping named tensors grows and shrinks their storage.
+            std::string prefix = "t" + std::to_string(t) + "_";
+            for (uint32_t e = 0; e < elements; ++e)
+            {
+                input[e] = static_cast<float>(t * 1000 + i + e);
+            }
+
+            TensorHandle a = backend.CreateTensor(prefix + "a", {elements}, TensorDataType::Float32);
+            TensorHandle sum = backend.CreateTensor("", {elements}, TensorDataType::Float32);
+            backend.SetTensorData(a, input.data(), elements * sizeof(float));
+            TensorHandle slice = backend.CreateTensor("", {elements}, TensorDataType::Float32);
+            backend.SetTensorData(slice, ones.data(), elements * sizeof(float));
+            backend.Wait(backend.ElementWiseAddBcast(a, slice, sum));
+            CHECK(backend.FindTensor(prefix + "a") == a);
+            CHECK(backend.FindTensor("shared") == shared);
+
+            backend.GetTensorData(sum, {elements}, TensorDataType::Float32, output.data(), elements * sizeof(float));
+            for (uint32_t e = 0; e < elements; ++e)
+            {
+                CHECK_EQ(output[e], input[e] + 1.0f);
+            }
+
+            // A GEMM against the shared weights, which returns its input.
+            TensorHandle x = backend.CreateTensor("", {16, 16}, TensorDataType::Float32);
+            TensorHandle y = backend.CreateTensor(prefix + "y", {16, 16}, TensorDataType::Float32);
+            backend.SetTensorData(x, input.data(), 256 * sizeof(float));
+            backend.Wait(backend.Gemm(GemmDesc{}, x, weights, TensorHandle(), y));
+            backend.GetTensorData(y, {16, 16}, TensorDataType::Float32, output.data(), 256 * sizeof(float));
+            for (uint32_t e = 0; e < 256; ++e)
+            {
+                CHECK_EQ(output[e], input[e]);
+            }
+
+            backend.ReleaseTensor(sum);
+            backend.ReleaseTensor(slice);
+            backend.ReleaseTensor(x);
+            if (i % 2 == 1)
+            {
+                backend.ReleaseTensor(a);
+                backend.ReleaseTensor(y);
+                CHECK(!backend.FindTensor(prefix + "a"));
+            }
+        }
+    });
+
+    std::vector<float> check(size);
+    backend.GetTensorData(shared, {size}, TensorDataType::Float32, check.data(), size * sizeof(float));
+    CHECK(check == ones);
+}
@@ -0,0 +1,249 @@
+#include "CpuBackend.hpp"
+#include "CpuKernels.hpp"
+#include "TestHarness.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <random>
+
+// Every instruction set this host can run, narrowest first. Levels the build lacks fall back to narrower kernels.
+static std::vector<SimdLevel> HostSimdLevels()
+{
+    std::vector<SimdLevel> levels;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Neon, SimdLevel::Avx2, SimdLevel::Avx512})
+    {
+        if (level <= DetectSimdLevel())
+        {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
+
+static uint32_t Bits(float x)
+{
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+// Finite values across every exponent, both signs, the half and bfloat16 subnormal ranges and the specials, in a
+// count that leaves a tail after the widest vector.
+static std::vector<float> SampleFloats()
+{
+    std::vector<float> values = {0.0f, -0.0f, 1.0f, -1.0f, 65504.0f, 65519.0f, 65520.0f, 1e-8f, -6e-8f, 6.1e-5f,
+                                 std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+                                 std::numeric_limits<float>::denorm_min(), std::numeric_limits<float>::max()};
+    std::mt19937 random(13);
+    std::uniform_real_distribution<float> mantissa(1.0f, 2.0f);
+    std::uniform_int_distribution<int> exponent(-30, 20);
+    while (values.size() < 4099)
+    {
+        float value = std::ldexp(mantissa(random), exponent(random));
+        values.push_back(random() & 1 ? value : -value);
+    }
+    return values;
+}
+
+static float ScalarHalfToFloat(uint16_t half)
+{
+    float value;
+    ScalarConversionKernels().halfToFloat(&half, &value, 1);
+    return value;
+}
+
+TEST(HalfRoundTripsEveryValue)
+{
+    std::vector<uint16_t> halves(65536);
+    for (uint32_t i = 0; i < halves.size(); ++i)
+    {
+        halves[i] = static_cast<uint16_t>(i);
+    }
+    for (SimdLevel level : HostSimdLevels())
+    {
+        const ConversionKernelTable &kernels = ConversionKernels(level);
+        std::vector<float> floats(halves.size());
+        std::vector<uint16_t> back(halves.size());
+        kernels.halfToFloat(halves.data(), floats.data(), halves.size());
+        kernels.floatToHalf(floats.data(), back.data(), floats.size());
+        for (uint32_t i = 0; i < halves.size(); ++i)
+        {
+            bool nan = (i & 0x7c00) == 0x7c00 && (i & 0x03ff) != 0;
+            if (nan)
+            {
+                CHECK(std::isnan(floats[i]));
+                CHECK((back[i] & 0x7c00) == 0x7c00 && (back[i] & 0x03ff) != 0);
+            }
+            else
+            {
+                CHECK_EQ(back[i], halves[i]);
+            }
+        }
+    }
+}
+
+TEST(BFloat16RoundTripsEveryValue)
+{
+    std::vector<uint16_t> values(65536);
+    for (uint32_t i = 0; i < values.size(); ++i)
+    {
+        values[i] = static_cast<uint16_t>(i);
+    }
+    for (SimdLevel level : HostSimdLevels())
+    {
+        const ConversionKernelTable &kernels = ConversionKernels(level);
+        std::vector<float> floats(values.size());
+        std::vector<uint16_t> back(values.size());
+        kernels.bfloat16ToFloat(values.data(), floats.data(), values.size());
+        kernels.floatToBFloat16(floats.data(), back.data(), floats.size());
+        for (uint32_t i = 0; i < values.size(); ++i)
+        {
+            CHECK_EQ(Bits(floats[i]), i << 16);
+            bool nan = (i & 0x7f80) == 0x7f80 && (i & 0x007f) != 0;
+            CHECK(nan ? (back[i] & 0x7f80) == 0x7f80 && (back[i] & 0x007f) != 0 : back[i] == values[i]);
+        }
+    }
+}
+
+TEST(VectorKernelsMatchScalar)
+{
+    std::vector<float> values = SampleFloats();
+    values.push_back(std::numeric_limits<float>::quiet_NaN());
+    const ConversionKernelTable &scalar = ScalarConversionKernels();
+    std::vector<uint16_t> expectedHalf(values.size());
+    std::vector<uint16_t> expectedBFloat16(values.size());
+    std::vector<int8_t> expectedInt8(values.size());
+    scalar.floatToHalf(values.data(), expectedHalf.data(), values.size());
+    scalar.floatToBFloat16(values.data(), expectedBFloat16.data(), values.size());
+    scalar.floatToInt8(values.data(), expectedInt8.data(), values.size(), 0.01f);
+
+    for (SimdLevel level : HostSimdLevels())
+    {
+        const ConversionKernelTable &kernels = ConversionKernels(level);
+        std::vector<uint16_t> half(values.size());
+        std::vector<uint16_t> bfloat16(values.size());
+        std::vector<int8_t> int8(values.size());
+        kernels.floatToHalf(values.data(), half.data(), values.size());
+        kernels.floatToBFloat16(values.data(), bfloat16.data(), values.size());
+        kernels.floatToInt8(values.data(), int8.data(), values.size(), 0.01f);
+        CHECK(half == expectedHalf);
+        CHECK(bfloat16 == expectedBFloat16);
+        CHECK(int8 == expectedInt8);
+
+        std::vector<float> finite(values.begin(), values.end() - 1);
+        finite.erase(std::remove_if(finite.begin(), finite.end(), [](float x) { return std::isinf(x); }),
+                     finite.end());
+        CHECK_EQ(kernels.maxAbs(finite.data(), finite.size()), scalar.maxAbs(finite.data(), finite.size()));
+    }
+}
+
+#if defined(__FLT16_MAX__)
+// Where the compiler has a native half type, its conversions are the reference for rounding.
+TEST(HalfMatchesTheCompilersConversion)
+{
+    std::vector<float> values = SampleFloats();
+    std::vector<uint16_t> half(values.size());
+    ConversionKernels(DetectSimdLevel()).floatToHalf(values.data(), half.data(), values.size());
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        _Float16 reference = static_cast<_Float16>(values[i]);
+        uint16_t bits;
+        memcpy(&bits, &reference, sizeof(bits));
+        CHECK_EQ(half[i], bits);
+    }
+}
+#endif
+
+// Each storage mode stays within half a unit in the last place of its format: a relative 2^-11 for float16 and 2^-8
+// for bfloat16 across their normal ranges, and half a quantization step, maxAbs / 254, for int8.
+TEST(ConversionErrorBounds)
+{
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> distribution(-1000.0f, 1000.0f);
+    std::vector<float> values(10007);
+    for (float &value : values)
+    {
+        value = distribution(random);
+    }
+
+    for (SimdLevel level : HostSimdLevels())
+    {
+        const ConversionKernelTable &kernels = ConversionKernels(level);
+        std::vector<uint16_t> narrow(values.size());
+        std::vector<float> back(values.size());
+
+        kernels.floatToHalf(values.data(), narrow.data(), values.size());
+        kernels.halfToFloat(narrow.data(), back.data(), values.size());
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            CHECK(std::fabs(back[i] - values[i]) <= std::ldexp(std::fabs(values[i]), -11) + std::ldexp(1.0f, -25));
+        }
+
+        kernels.floatToBFloat16(values.data(), narrow.data(), values.size());
+        kernels.bfloat16ToFloat(narrow.data(), back.data(), values.size());
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            CHECK(std::fabs(back[i] - values[i]) <= std::ldexp(std::fabs(values[i]), -8));
+        }
+
+        float scale = kernels.maxAbs(values.data(), values.size()) / 127.0f;
+        std::vector<int8_t> quantized(values.size());
+        kernels.floatToInt8(values.data(), quantized.data(), values.size(), scale);
+        kernels.int8ToFloat(quantized.data(), back.data(), values.size(), scale);
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            CHECK(quantized[i] >= -127);
+            CHECK(std::fabs(back[i] - values[i]) <= scale * 0.5f * (1.0f + 1e-5f));
+        }
+    }
+}
+
+TEST(HalfOverflowAndSubnormals)
+{
+    float values[] = {65504.0f, 65520.0f, 1e6f, -1e6f, std::ldexp(1.0f, -24), std::ldexp(1.0f, -26)};
+    uint16_t half[6];
+    ScalarConversionKernels().floatToHalf(values, half, 6);
+    CHECK_EQ(half[0], 0x7bffu);
+    CHECK_EQ(half[1], 0x7c00u); // Rounds up to infinity.
+    CHECK_EQ(half[2], 0x7c00u);
+    CHECK_EQ(half[3], 0xfc00u);
+    CHECK_EQ(half[4], 0x0001u); // The smallest subnormal.
+    CHECK_EQ(half[5], 0x0000u);
+    CHECK_EQ(ScalarHalfToFloat(0x0001), std::ldexp(1.0f, -24));
+}
+
+// End to end through the CPU backend's storage modes: what comes back is the stored format's rounding of what went in.
+TEST(BackendStorageModesRoundTrip)
+{
+    std::vector<float> values(1000);
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        values[i] = std::sin(static_cast<float>(i)) * 50.0f;
+    }
+    struct Mode
+    {
+        StoragePrecision precision;
+        double relative;
+        double absolute;
+    };
+    const Mode modes[] = {
+        {StoragePrecision::Float32, 0.0, 0.0},
+        {StoragePrecision::Float16, 1.0 / 2048, 1e-7},
+        {StoragePrecision::BFloat16, 1.0 / 256, 0.0},
+        {StoragePrecision::Int8, 0.0, 50.0 / 254 * 1.0001},
+    };
+    for (const Mode &mode : modes)
+    {
+        CpuBackend backend;
+        backend.SetStoragePrecision(mode.precision);
+        TensorHandle tensor = backend.CreateTensor("x", {10, 100}, TensorDataType::Float32);
+        backend.SetTensorData(tensor, values.data(), values.size() * sizeof(float));
+        std::vector<float> back(values.size());
+        backend.GetTensorData(tensor, {10, 100}, TensorDataType::Float32, back.data(), back.size() * sizeof(float));
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            CHECK_NEAR(back[i], values[i], std::fabs(values[i]) * mode.relative + mode.absolute);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#include "DeferredStream.hpp"
+#include "TestHarness.hpp"
+
+#include <string>
+
+// Each command appends its name to the trace when the stream is replayed.
+struct StreamTrace
+{
+    DeferredStream stream;
+    std::string recorded;
+
+    void Upload(TensorHandle tensor, bool whole, char name)
+    {
+        stream.Upload(tensor, whole, [this, name] { recorded += name; });
+    }
+    void Dispatch(const std::vector<TensorHandle> &reads, const std::vector<TensorHandle> &writes, char name)
+    {
+        stream.Dispatch(reads, writes, [this, name] { recorded += name; });
+    }
+};
+
+static const TensorHandle c_a{0, 1};
+static const TensorHandle c_b{1, 1};
+static const TensorHandle c_c{2, 1};
+
+TEST(WholeUploadReplacesUnreadUpload)
+{
+    StreamTrace trace;
+    trace.Upload(c_a, true, '1');
+    trace.Upload(c_a, true, '2');
+    trace.Dispatch({c_a}, {c_b}, 'x');
+    trace.stream.Replay();
+    CHECK_EQ(trace.recorded, std::string("2x"));
+    CHECK_EQ(trace.stream.DroppedCount(), 1u);
+}
+
+TEST(PartialUploadKeepsEarlierUpload)
+{
+    StreamTrace trace;
+    trace.Upload(c_a, true, '1');
+    trace.Upload(c_a, false, '2');
+    trace.Dispatch({c_a}, {c_b}, 'x');
+    trace.stream.Replay();
+    CHECK_EQ(trace.recorded, std::string("12x"));
+    CHECK_EQ(trace.stream.DroppedCount(), 0u);
+}
+
+TEST(WholeUploadDropsEveryUnreadPartialUpload)
+{
+    StreamTrace trace;
+    trace.Upload(c_a, false, '1');
+    trace.Upload(c_a, false, '2');
+    trace.Upload(c_a, true, '3');
+    trace.stream.Replay();
+    CHECK_EQ(trace.recorded, std::string("3"));
+    CHECK_EQ(trace.stream.DroppedCount(), 2u);
+}
+
+TEST(ReadUploadIsKept)
+{
+    StreamTrace trace;
+    trace.Upload(c_a, true, '1');
+    trace.Dispatch({c_a}, {c_b}, 'x');
+    trace.Upload(c_a, true, '2');
+    trace.Upload(c_a, true, '3');
+    trace.stream.Replay();
+    CHECK_EQ(trace.recorded, std::string("1x3"));
+}
+
+TEST(DispatchOutputDropsUnreadUploads)
+{
+    StreamTrace trace;
+    trace.Upload(c_a, true, '1');
+    trace.Upload(c_b, false, '2');
+    trace.Upload(c_c, true, '3');
+    trace.Dispatch({c_a, c_b}, {c_c}, 'x');
+    trace.Dispatch({c_c}, {c_c}, 'y'); // Reads its output, so the dispatch before it stays.
+    trace.stream.Replay();
+    CHECK_EQ(trace.recorded, std::string("12xy"));
+    CHECK_EQ(trace.stream.DroppedCount(), 1u);
+}
+
+TEST(ReplayClearsTheStream)
+{
+    StreamTrace trace;
+    trace.Upload(c_a, true, '1');
+    CHECK_EQ(trace.stream.PendingCount(), 1u);
+    trace.stream.Replay();
+    CHECK(trace.stream.Empty());
+
+    // Uploads from before the replay are recorded already and cannot be dropped any more.
+    trace.Upload(c_a, true, '2');
+    trace.stream.Replay();
+    CHECK_EQ(trace.recorded, std::string("12"));
+    CHECK_EQ(trace.stream.DroppedCount(), 0u);
+}
@@ -0,0 +1,203 @@
+#include "CpuBackend.hpp"
+#include "DeviceRouter.hpp"
+#include "MultiDeviceBackend.hpp"
+#include "TestHarness.hpp"
+
+// Simulated adapters: an NPU that dispatches slowly but computes fast, a GPU in between, and the CPU, which
+// dispatches at once but computes slowly.
+static const DeviceProfile c_npu{200e-6, 100e9, 10e9};
+static const DeviceProfile c_gpu{50e-6, 40e9, 10e9};
+static const DeviceProfile c_cpu{1e-6, 5e9, 1e12};
+
+static DeviceRouter ThreeDevices()
+{
+    DeviceRouter router;
+    router.AddDevice(c_npu);
+    router.AddDevice(c_gpu);
+    router.AddDevice(c_cpu);
+    return router;
+}
+
+TEST(SmallOpsGoToTheFastestDispatch)
+{
+    DeviceRouter router = ThreeDevices();
+    Route route = router.RouteOp(4096, {0, 0, 0});
+    CHECK_EQ(route.shards.size(), 1u);
+    CHECK_EQ(route.shards[0].device, 2u);
+}
+
+TEST(LargeOpsGoToTheFastestCompute)
+{
+    DeviceRouter router = ThreeDevices();
+    Route route = router.RouteOp(1ull << 30, {0, 0, 0});
+    CHECK_EQ(route.shards.size(), 1u);
+    CHECK_EQ(route.shards[0].device, 0u);
+    CHECK_NEAR(route.estimatedSeconds, router.EstimateSeconds(0, 1ull << 30, 0), 1e-12);
+}
+
+TEST(TransfersKeepOpsWhereTheirOperandsAre)
+{
+    DeviceRouter router = ThreeDevices();
+    // 64 MB of operands live on the GPU; moving them to the NPU costs more than its faster compute saves.
+    uint64_t bytes = 64ull << 20;
+    Route route = router.RouteOp(bytes, {bytes, 0, bytes});
+    CHECK_EQ(route.shards[0].device, 1u);
+}
+
+TEST(ShardsSplitRowsSoDevicesFinishTogether)
+{
+    DeviceRouter router;
+    router.AddDevice({10e-6, 10e9, 10e9});
+    router.AddDevice({10e-6, 30e9, 10e9});
+    uint64_t bytes = 1ull << 30;
+    Route route = router.RouteOp(bytes, {0, 0}, 1000);
+    CHECK_EQ(route.shards.size(), 2u);
+
+    // The shards cover every row once, in order, and the faster device takes three quarters of them.
+    CHECK_EQ(route.shards[0].begin, 0u);
+    CHECK_EQ(route.shards[0].end, route.shards[1].begin);
+    CHECK_EQ(route.shards[1].end, 1000u);
+    CHECK_NEAR(static_cast<double>(route.shards[1].end - route.shards[1].begin), 750.0, 2.0);
+    CHECK(route.estimatedSeconds < router.EstimateSeconds(1, bytes, 0));
+}
+
+TEST(ShardingRespectsTheMinimumShardSize)
+{
+    DeviceRouter router;
+    router.AddDevice({10e-6, 10e9, 10e9});
+    router.AddDevice({10e-6, 10e9, 10e9});
+    uint64_t bytes = 8ull << 20;
+    CHECK_EQ(router.RouteOp(bytes, {0, 0}, 64, 1 << 20).shards.size(), 2u);
+    CHECK_EQ(router.RouteOp(bytes, {0, 0}, 64, 16 << 20).shards.size(), 1u);
+    // A single row cannot be split.
+    CHECK_EQ(router.RouteOp(bytes, {0, 0}, 1).shards.size(), 1u);
+}
+
+TEST(SlowDevicesAreDroppedFromShards)
+{
+    DeviceRouter router;
+    router.AddDevice({10e-6, 40e9, 10e9});
+    router.AddDevice({10e-6, 40e9, 10e9});
+    router.AddDevice({10e-6, 0.1e9, 10e9});
+    Route route = router.RouteOp(1ull << 30, {0, 0, 0}, 4096, 64 << 20);
+    CHECK_EQ(route.shards.size(), 2u);
+    for (const RouteShard &shard : route.shards)
+    {
+        CHECK(shard.device != 2);
+    }
+}
+
+TEST(RouterRejectsBadInput)
+{
+    DeviceRouter empty;
+    CHECK_THROWS(empty.RouteOp(1, {}), std::invalid_argument);
+    DeviceRouter router = ThreeDevices();
+    CHECK_THROWS(router.RouteOp(1, {0, 0}), std::invalid_argument);
+}
+
+// Two CPU backends stand in for adapters, with profiles that make the routing decisions predictable.
+static std::unique_ptr<MultiDeviceBackend> TwoCpuDevices(const DeviceProfile &first, const DeviceProfile &second,
+                                                         uint64_t minShardBytes)
+{
+    MultiDeviceOptions options;
+    options.minShardBytes = minShardBytes;
+    auto backend = std::make_unique<MultiDeviceBackend>(options);
+    CpuBackendOptions cpu;
+    cpu.threadCount = 1;
+    backend->AddDevice(std::make_unique<CpuBackend>(cpu), first);
+    backend->AddDevice(std::make_unique<CpuBackend>(cpu), second);
+    return backend;
+}
+
+static std::vector<float> Iota(size_t count, float start)
+{
+    std::vector<float> values(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        values[i] = start + static_cast<float>(i);
+    }
+    return values;
+}
+
+TEST(BackendRoutesWholeOpsToTheCheapestDevice)
+{
+    auto backend = TwoCpuDevices({1.0, 10e9, 10e9}, {1e-6, 10e9, 10e9}, 1 << 20);
+    std::vector<float> a = Iota(64, 0.0f);
+    std::vector<float> b = Iota(64, 100.0f);
+    backend->SetTensorData("a", {8, 8}, TensorDataType::Float32, a.data(), a.size() * sizeof(float));
+    backend->SetTensorData("b", {8, 8}, TensorDataType::Float32, b.data(), b.size() * sizeof(float));
+    backend->CreateTensor("c", {8, 8}, TensorDataType::Float32);
+    backend->ElementWiseAddBcast("a", "b", "c");
+
+    std::vector<float> c(64);
+    backend->GetTensorData("c", {8, 8}, TensorDataType::Float32, c.data(), c.size() * sizeof(float));
+    for (size_t i = 0; i < c.size(); ++i)
+    {
+        CHECK_EQ(c[i], a[i] + b[i]);
+    }
+    const MultiDeviceStats &stats = backend->GetStats();
+    CHECK_EQ(stats.opsPerDevice[0], 0u);
+    CHECK_EQ(stats.opsPerDevice[1], 1u);
+    CHECK_EQ(stats.shardedOps, 0u);
+}
+
+TEST(BackendShardsLargeOpsAndGathersTheResult)
+{
+    auto backend = TwoCpuDevices({1e-6, 10e9, 1e12}, {1e-6, 10e9, 1e12}, 1024);
+    const uint32_t rows = 64;
+    const uint32_t columns = 256;
+    std::vector<float> a = Iota(rows * columns, 0.0f);
+    std::vector<float> bias = Iota(columns, -50.0f);
+    backend->SetTensorData("a", {rows, columns}, TensorDataType::Float32, a.data(), a.size() * sizeof(float));
+    backend->SetTensorData("bias", {1, columns}, TensorDataType::Float32, bias.data(), bias.size() * sizeof(float));
+    backend->CreateTensor("sum", {rows, columns}, TensorDataType::Float32);
+    backend->CreateTensor("twice", {rows, columns}, TensorDataType::Float32);
+    backend->ElementWiseAddBcast("a", "bias", "sum");
+    // The second op reads the sharded output where it already is.
+    backend->ElementWiseAddBcast("sum", "sum", "twice");
+
+    std::vector<float> twice(rows * columns);
+    backend->GetTensorData("twice", {rows, columns}, TensorDataType::Float32, twice.data(),
+                           twice.size() * sizeof(float));
+    for (size_t i = 0; i < twice.size(); ++i)
+    {
+        CHECK_EQ(twice[i], 2.0f * (a[i] + bias[i % columns]));
+    }
+    const MultiDeviceStats &stats = backend->GetStats();
+    CHECK_EQ(stats.shardedOps, 2u);
+    CHECK_EQ(stats.opsPerDevice[0], 2u);
+    CHECK_EQ(stats.opsPerDevice[1], 2u);
+}
+
+TEST(BackendMovesOperandsBetweenDevices)
+{
+    // Everything runs on device 0 until its profile is made slow, then the tensors it wrote move to device 1.
+    auto backend = TwoCpuDevices({1e-6, 10e9, 10e9}, {1e-3, 10e9, 10e9}, 1 << 30);
+    std::vector<float> a = Iota(16, 1.0f);
+    backend->SetTensorData("a", {16}, TensorDataType::Float32, a.data(), a.size() * sizeof(float));
+    backend->CreateTensor("b", {16}, TensorDataType::Float32);
+    backend->CreateTensor("c", {16}, TensorDataType::Float32);
+    backend->ElementWiseAddBcast("a", "a", "b");
+    CHECK_EQ(backend->GetStats().opsPerDevice[0], 1u);
+
+    backend->GetRouter().Profile(0).dispatchSeconds = 1.0;
+    uint64_t transferred = backend->GetStats().transferredBytes;
+    backend->ElementWiseAddBcast("b", "a", "c");
+    CHECK_EQ(backend->GetStats().opsPerDevice[1], 1u);
+    CHECK(backend->GetStats().transferredBytes > transferred);
+
+    std::vector<float> c(16);
+    backend->GetTensorData("c", {16}, TensorDataType::Float32, c.data(), c.size() * sizeof(float));
+    for (size_t i = 0; i < c.size(); ++i)
+    {
+        CHECK_EQ(c[i], 3.0f * a[i]);
+    }
+}
+
+TEST(DevicesMustBeAddedFirst)
+{
+    auto backend = TwoCpuDevices({}, {}, 1 << 20);
+    backend->CreateTensor("a", {4}, TensorDataType::Float32);
+    CHECK_THROWS(backend->AddDevice(std::make_unique<CpuBackend>()), std::runtime_error);
+    CHECK_THROWS(MultiDeviceBackend().CreateTensor("a", {4}, TensorDataType::Float32), std::runtime_error);
+}
@@ -0,0 +1,244 @@
+#include "CpuBackend.hpp"
+#include "ElementWiseBatcher.hpp"
+#include "TestHarness.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+// A CPU backend that logs the signature and size of every element-wise op the batcher dispatches. Only the worker
+// thread writes the log, and a test reads it once the futures it waited on are ready.
+class RecordingBackend : public CpuBackend
+{
+  public:
+    RecordingBackend() : CpuBackend(Options())
+    {
+    }
+
+    SubmissionTicket ElementWise(const ElementWiseDesc &desc, TensorHandle src0, TensorHandle src1,
+                                 TensorHandle dst) override
+    {
+        signatures.push_back(desc.Signature());
+        sizes.push_back(GetTensorShape(dst)[0]);
+        return CpuBackend::ElementWise(desc, src0, src1, dst);
+    }
+
+    std::vector<std::string> signatures;
+    std::vector<uint32_t> sizes;
+
+  private:
+    static CpuBackendOptions Options()
+    {
+        CpuBackendOptions options;
+        options.threadCount = 1;
+        return options;
+    }
+};
+
+struct Operands
+{
+    Operands(uint64_t count, uint32_t seed) : a(count), b(count), out(count)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> distribution(-2.0f, 2.0f);
+        for (size_t i = 0; i < count; ++i)
+        {
+            a[i] = distribution(random);
+            b[i] = distribution(random) + (distribution(random) < 0 ? -3.0f : 3.0f); // Away from zero for Divide.
+        }
+    }
+
+    // The same request run on its own, unbatched.
+    void CheckAgainstUnbatched(const ElementWiseDesc &desc) const
+    {
+        TensorShape shape{static_cast<uint32_t>(a.size())};
+        HostTensor expected = RunElementWiseOnCpu(desc, HostTensor{shape, a}, HostTensor{shape, b});
+        for (size_t i = 0; i < out.size(); ++i)
+        {
+            CHECK_NEAR(out[i], expected.data[i], 1e-6 * (1.0 + std::abs(expected.data[i])));
+        }
+    }
+
+    std::future<void> Submit(ElementWiseBatcher &batcher, const ElementWiseDesc &desc)
+    {
+        return batcher.Submit(desc, a.data(), b.data(), out.data(), a.size());
+    }
+
+    std::vector<float> a;
+    std::vector<float> b;
+    std::vector<float> out;
+};
+
+// Long enough that a test never reaches it by accident.
+constexpr std::chrono::hours c_never{1};
+
+bool IsReady(std::future<void> &future, std::chrono::milliseconds timeout = std::chrono::milliseconds(0))
+{
+    return future.wait_for(timeout) == std::future_status::ready;
+}
+} // namespace
+
+TEST(BatchedResultsMatchUnbatched)
+{
+    RecordingBackend backend;
+    BatchingOptions options;
+    options.maxDelay = c_never;
+    ElementWiseBatcher batcher(backend, options);
+
+    ElementWiseDesc desc;
+    desc.op = BinaryOp::Divide;
+    desc.activation = Activation::LeakyRelu;
+    desc.alpha = 0.1f;
+    desc.scale = -0.5f;
+
+    std::vector<Operands> requests;
+    for (uint64_t count : {1u, 7u, 100u, 3u, 1000u, 33u})
+    {
+        requests.emplace_back(count, static_cast<uint32_t>(count));
+    }
+    std::vector<std::future<void>> results;
+    for (Operands &request : requests)
+    {
+        results.push_back(request.Submit(batcher, desc));
+    }
+    batcher.Flush();
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        results[i].get();
+        requests[i].CheckAgainstUnbatched(desc);
+    }
+
+    // One op over the packed requests, rounded up to its bucket; the stats count it before the futures are ready.
+    CHECK_EQ(backend.sizes.size(), 1u);
+    CHECK_EQ(backend.sizes[0], 1280u);
+    BatchingStats stats = batcher.GetStats();
+    CHECK_EQ(stats.batches, 1u);
+    CHECK_EQ(stats.requests, 6u);
+    CHECK_EQ(stats.elements, 1144u);
+    CHECK_EQ(stats.paddedElements, 1280u);
+    CHECK_EQ(stats.fullBatches, 0u);
+}
+
+TEST(BatchIsDispatchedAtItsDeadline)
+{
+    RecordingBackend backend;
+    BatchingOptions options;
+    options.maxDelay = std::chrono::milliseconds(1);
+    ElementWiseBatcher batcher(backend, options);
+
+    Operands first(10, 1), second(20, 2);
+    std::future<void> firstResult = first.Submit(batcher, ElementWiseDesc{});
+    std::future<void> secondResult = second.Submit(batcher, ElementWiseDesc{});
+
+    // No flush and no limit reached: only the deadline sends the batch.
+    CHECK(IsReady(firstResult, std::chrono::seconds(10)));
+    CHECK(IsReady(secondResult, std::chrono::seconds(10)));
+    first.CheckAgainstUnbatched(ElementWiseDesc{});
+    second.CheckAgainstUnbatched(ElementWiseDesc{});
+    CHECK_EQ(batcher.GetStats().fullBatches, 0u);
+    CHECK(batcher.GetStats().batches >= 1u);
+}
+
+TEST(BatchIsDispatchedAtItsSizeLimits)
+{
+    RecordingBackend backend;
+    BatchingOptions options;
+    options.maxBatchElements = 64;
+    options.maxBatchRequests = 3;
+    options.maxDelay = c_never;
+    std::vector<Operands> requests;
+    for (uint64_t count : {40u, 30u, 1u, 1u, 1u, 100u})
+    {
+        requests.emplace_back(count, static_cast<uint32_t>(count));
+    }
+    std::vector<std::future<void>> results;
+    {
+        ElementWiseBatcher batcher(backend, options);
+
+        // 40 + 30 would pass 64 elements, so the second request closes the first batch.
+        results.push_back(requests[0].Submit(batcher, ElementWiseDesc{}));
+        results.push_back(requests[1].Submit(batcher, ElementWiseDesc{}));
+        CHECK(IsReady(results[0], std::chrono::seconds(10)));
+        CHECK(!IsReady(results[1], std::chrono::milliseconds(20)));
+
+        // Three requests fill a batch; the 30 is still open, so it takes two more.
+        results.push_back(requests[2].Submit(batcher, ElementWiseDesc{}));
+        results.push_back(requests[3].Submit(batcher, ElementWiseDesc{}));
+        CHECK(IsReady(results[1], std::chrono::seconds(10)));
+        CHECK(IsReady(results[3], std::chrono::seconds(10)));
+
+        // A request over the element limit closes the open batch and runs on its own at once.
+        results.push_back(requests[4].Submit(batcher, ElementWiseDesc{}));
+        results.push_back(requests[5].Submit(batcher, ElementWiseDesc{}));
+        CHECK(IsReady(results[4], std::chrono::seconds(10)));
+        CHECK(IsReady(results[5], std::chrono::seconds(10)));
+        CHECK_EQ(batcher.GetStats().fullBatches, 4u);
+    }
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        results[i].get();
+        requests[i].CheckAgainstUnbatched(ElementWiseDesc{});
+    }
+    CHECK(backend.sizes == std::vector<uint32_t>({40, 32, 1, 112}));
+}
+
+TEST(DestructorDispatchesPendingRequests)
+{
+    RecordingBackend backend;
+    BatchingOptions options;
+    options.maxDelay = c_never;
+    Operands request(5, 5);
+    std::future<void> result;
+    {
+        ElementWiseBatcher batcher(backend, options);
+        result = request.Submit(batcher, ElementWiseDesc{});
+    }
+    CHECK(IsReady(result));
+    request.CheckAgainstUnbatched(ElementWiseDesc{});
+}
+
+TEST(DifferentSignaturesNeverShareABatch)
+{
+    RecordingBackend backend;
+    BatchingOptions options;
+    options.maxDelay = c_never;
+    ElementWiseBatcher batcher(backend, options);
+
+    // Scales that only differ past the sixth decimal, and a different op.
+    std::vector<ElementWiseDesc> descs(3);
+    descs[0].scale = 1e-7f;
+    descs[1].scale = 2e-7f;
+    descs[2].op = BinaryOp::Maximum;
+    descs[2].activation = Activation::Tanh;
+
+    // Interleaved, so each open batch sees requests of the others arrive in between.
+    std::vector<Operands> requests;
+    for (uint32_t i = 0; i < 12; ++i)
+    {
+        requests.emplace_back(5 + i, i);
+    }
+    std::vector<std::future<void>> results;
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        results.push_back(requests[i].Submit(batcher, descs[i % descs.size()]));
+    }
+    batcher.Flush();
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        results[i].get();
+        requests[i].CheckAgainstUnbatched(descs[i % descs.size()]);
+    }
+
+    CHECK_EQ(backend.signatures.size(), 3u);
+    for (const ElementWiseDesc &desc : descs)
+    {
+        CHECK_EQ(std::count(backend.signatures.begin(), backend.signatures.end(), desc.Signature()), 1);
+    }
+    CHECK_EQ(batcher.GetStats().batches, 3u);
+}
@@ -0,0 +1,301 @@
+#include "CpuBackend.hpp"
+#include "ElementWise.hpp"
+#include "TestHarness.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+const BinaryOp c_ops[] = {BinaryOp::Add,    BinaryOp::Subtract, BinaryOp::Multiply,
+                          BinaryOp::Divide, BinaryOp::Maximum,  BinaryOp::Minimum};
+const Activation c_activations[] = {Activation::None,    Activation::Relu, Activation::LeakyRelu,
+                                    Activation::Sigmoid, Activation::Tanh, Activation::Gelu};
+
+// Every op and activation, each with a scale other than one.
+std::vector<ElementWiseDesc> AllDescs()
+{
+    std::vector<ElementWiseDesc> descs;
+    for (BinaryOp op : c_ops)
+    {
+        for (Activation activation : c_activations)
+        {
+            ElementWiseDesc desc;
+            desc.op = op;
+            desc.activation = activation;
+            desc.alpha = 0.2f;
+            desc.scale = -1.5f;
+            descs.push_back(desc);
+        }
+    }
+    return descs;
+}
+
+// scale * act(op(a, b)), written out independently of the kernels and in double precision.
+double Reference(const ElementWiseDesc &desc, double a, double b)
+{
+    double x = 0.0;
+    switch (desc.op)
+    {
+    case BinaryOp::Add:
+        x = a + b;
+        break;
+    case BinaryOp::Subtract:
+        x = a - b;
+        break;
+    case BinaryOp::Multiply:
+        x = a * b;
+        break;
+    case BinaryOp::Divide:
+        x = a / b;
+        break;
+    case BinaryOp::Maximum:
+        x = std::max(a, b);
+        break;
+    case BinaryOp::Minimum:
+        x = std::min(a, b);
+        break;
+    }
+    switch (desc.activation)
+    {
+    case Activation::None:
+        break;
+    case Activation::Relu:
+        x = std::max(x, 0.0);
+        break;
+    case Activation::LeakyRelu:
+        x = x < 0.0 ? double(desc.alpha) * x : x;
+        break;
+    case Activation::Sigmoid:
+        x = 1.0 / (1.0 + std::exp(-x));
+        break;
+    case Activation::Tanh:
+        x = std::tanh(x);
+        break;
+    case Activation::Gelu:
+        x = 0.5 * x * (1.0 + std::erf(x / std::sqrt(2.0)));
+        break;
+    }
+    return desc.scale * x;
+}
+
+double Tolerance(double expected)
+{
+    return 1e-5 * (1.0 + std::abs(expected));
+}
+
+// Values in [-3, 3]; the second operand is kept at least 0.5 away from zero so Divide stays well conditioned.
+std::vector<float> RandomValues(uint64_t count, uint32_t seed, bool awayFromZero = false)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> distribution(-3.0f, 3.0f);
+    std::vector<float> values(static_cast<size_t>(count));
+    for (float &value : values)
+    {
+        value = distribution(random);
+        if (awayFromZero && std::abs(value) < 0.5f)
+        {
+            value += value < 0.0f ? -0.5f : 0.5f;
+        }
+    }
+    return values;
+}
+
+// Expected output of a and b broadcast against each other, element by element.
+std::vector<double> BroadcastReference(const ElementWiseDesc &desc, const TensorShape &shapeA,
+                                       const std::vector<float> &a, const TensorShape &shapeB,
+                                       const std::vector<float> &b)
+{
+    TensorShape shape = BroadcastShapes(shapeA, shapeB);
+    std::vector<uint32_t> stridesA = BroadcastStrides(shapeA, shape);
+    std::vector<uint32_t> stridesB = BroadcastStrides(shapeB, shape);
+    std::vector<double> expected(static_cast<size_t>(ElementCount(shape)));
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        size_t offsetA = 0, offsetB = 0, remainder = i;
+        for (size_t d = shape.size(); d-- > 0;)
+        {
+            size_t index = remainder % shape[d];
+            remainder /= shape[d];
+            offsetA += index * stridesA[d];
+            offsetB += index * stridesB[d];
+        }
+        expected[i] = Reference(desc, a[offsetA], b[offsetB]);
+    }
+    return expected;
+}
+
+struct ShapePair
+{
+    TensorShape a;
+    TensorShape b;
+};
+
+// Equal shapes, then a scalar, a row and a column broadcast, and both operands broadcast at once.
+const ShapePair c_shapes[] = {
+    {{37}, {37}}, {{3, 41}, {1}}, {{4, 37}, {37}}, {{4, 37}, {4, 1}}, {{3, 1, 37}, {5, 37}}, {{2, 5, 1}, {1, 33}},
+};
+
+std::vector<SimdLevel> HostSimdLevels()
+{
+    std::vector<SimdLevel> levels;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Neon, SimdLevel::Avx2, SimdLevel::Avx512})
+    {
+        if (level <= DetectSimdLevel())
+        {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
+} // namespace
+
+TEST(SignaturesTellApartTinyScales)
+{
+    ElementWiseDesc a;
+    ElementWiseDesc b;
+    a.scale = 1e-7f;
+    b.scale = 2e-7f;
+    CHECK(a.Signature() != b.Signature());
+
+    a.scale = b.scale;
+    a.activation = b.activation = Activation::LeakyRelu;
+    a.alpha = 1e-7f;
+    b.alpha = 2e-7f;
+    CHECK(a.Signature() != b.Signature());
+
+    b.alpha = a.alpha;
+    CHECK_EQ(a.Signature(), b.Signature());
+}
+
+TEST(VisitorPicksTheMatchingInstantiation)
+{
+    for (const ElementWiseDesc &desc : AllDescs())
+    {
+        bool matches = VisitElementWise(desc, [&](auto op, auto activation) {
+            return decltype(op)::value == desc.op && decltype(activation)::value == desc.activation;
+        });
+        CHECK(matches);
+    }
+
+    ElementWiseDesc unknown;
+    unknown.activation = static_cast<Activation>(99);
+    CHECK_THROWS(VisitElementWise(unknown, [](auto, auto) { return 0; }), std::invalid_argument);
+    unknown = ElementWiseDesc{};
+    unknown.op = static_cast<BinaryOp>(99);
+    CHECK_THROWS(VisitElementWise(unknown, [](auto, auto) { return 0; }), std::invalid_argument);
+}
+
+TEST(FusedRunsMatchScalarReference)
+{
+    constexpr size_t c_count = 37;
+    std::vector<float> a = RandomValues(c_count, 1);
+    std::vector<float> b = RandomValues(c_count, 2, true);
+    for (const ElementWiseDesc &desc : AllDescs())
+    {
+        // Packed operands, then either one read as a single broadcast value.
+        std::vector<float> packed(c_count), broadcastA(c_count), broadcastB(c_count);
+        VisitElementWise(desc, [&](auto op, auto activation) {
+            constexpr BinaryOp Op = decltype(op)::value;
+            constexpr Activation Act = decltype(activation)::value;
+            FusedElementWiseRun<Op, Act, 1, 1>(a.data(), b.data(), packed.data(), c_count, desc.alpha, desc.scale);
+            FusedElementWiseRun<Op, Act, 0, 1>(a.data(), b.data(), broadcastA.data(), c_count, desc.alpha,
+                                               desc.scale);
+            FusedElementWiseRun<Op, Act, 1, 0>(a.data(), b.data(), broadcastB.data(), c_count, desc.alpha,
+                                               desc.scale);
+        });
+        for (size_t i = 0; i < c_count; ++i)
+        {
+            double expected = Reference(desc, a[i], b[i]);
+            CHECK_NEAR(packed[i], expected, Tolerance(expected));
+            expected = Reference(desc, a[0], b[i]);
+            CHECK_NEAR(broadcastA[i], expected, Tolerance(expected));
+            expected = Reference(desc, a[i], b[0]);
+            CHECK_NEAR(broadcastB[i], expected, Tolerance(expected));
+        }
+    }
+}
+
+TEST(HostReferenceBroadcastsLikeNumPy)
+{
+    for (const ShapePair &shapes : c_shapes)
+    {
+        std::vector<float> a = RandomValues(ElementCount(shapes.a), 3);
+        std::vector<float> b = RandomValues(ElementCount(shapes.b), 4, true);
+        for (const ElementWiseDesc &desc : AllDescs())
+        {
+            HostTensor result = RunElementWiseOnCpu(desc, HostTensor{shapes.a, a}, HostTensor{shapes.b, b});
+            std::vector<double> expected = BroadcastReference(desc, shapes.a, a, shapes.b, b);
+            CHECK(result.shape == BroadcastShapes(shapes.a, shapes.b));
+            CHECK_EQ(result.data.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i)
+            {
+                CHECK_NEAR(result.data[i], expected[i], Tolerance(expected[i]));
+            }
+        }
+    }
+}
+
+TEST(CpuBackendMatchesScalarReference)
+{
+    for (SimdLevel level : HostSimdLevels())
+    {
+        CpuBackendOptions options;
+        options.threadCount = 1;
+        options.maxSimdLevel = level;
+        CpuBackend backend(options);
+        for (const ShapePair &shapes : c_shapes)
+        {
+            std::vector<float> a = RandomValues(ElementCount(shapes.a), 5);
+            std::vector<float> b = RandomValues(ElementCount(shapes.b), 6, true);
+            TensorShape shape = BroadcastShapes(shapes.a, shapes.b);
+            TensorHandle handleA = backend.CreateTensor("", shapes.a, TensorDataType::Float32);
+            TensorHandle handleB = backend.CreateTensor("", shapes.b, TensorDataType::Float32);
+            TensorHandle handleC = backend.CreateTensor("", shape, TensorDataType::Float32);
+            backend.SetTensorData(handleA, a.data(), a.size() * sizeof(float));
+            backend.SetTensorData(handleB, b.data(), b.size() * sizeof(float));
+
+            for (const ElementWiseDesc &desc : AllDescs())
+            {
+                backend.ElementWise(desc, handleA, handleB, handleC);
+                std::vector<float> c(static_cast<size_t>(ElementCount(shape)));
+                backend.GetTensorData(handleC, shape, TensorDataType::Float32, c.data(), c.size() * sizeof(float));
+                std::vector<double> expected = BroadcastReference(desc, shapes.a, a, shapes.b, b);
+                for (size_t i = 0; i < expected.size(); ++i)
+                {
+                    CHECK_NEAR(c[i], expected[i], Tolerance(expected[i]));
+                }
+            }
+        }
+    }
+}
+
+TEST(TrafficCountsEachSeparatePass)
+{
+    // 4 + 8 input elements broadcast to 32 output elements of 4 bytes.
+    ElementWiseDesc desc;
+    ElementWiseTraffic traffic = EstimateElementWiseTraffic(desc, {4, 1}, {1, 8}, 4);
+    CHECK_EQ(traffic.fusedBytes, 176u);
+    CHECK_EQ(traffic.unfusedBytes, 176u);
+
+    // The activation and the scale each read and write the output once more when run on their own.
+    desc.activation = Activation::Gelu;
+    traffic = EstimateElementWiseTraffic(desc, {4, 1}, {1, 8}, 4);
+    CHECK_EQ(traffic.fusedBytes, 176u);
+    CHECK_EQ(traffic.unfusedBytes, 432u);
+    desc.scale = 0.5f;
+    traffic = EstimateElementWiseTraffic(desc, {4, 1}, {1, 8}, 4);
+    CHECK_EQ(traffic.unfusedBytes, 688u);
+    desc.activation = Activation::None;
+    traffic = EstimateElementWiseTraffic(desc, {4, 1}, {1, 8}, 4);
+    CHECK_EQ(traffic.unfusedBytes, 432u);
+
+    // Equal shapes at 2 bytes an element.
+    traffic = EstimateElementWiseTraffic(desc, {10, 10}, {10, 10}, 2);
+    CHECK_EQ(traffic.fusedBytes, 600u);
+    CHECK_EQ(traffic.unfusedBytes, 1000u);
+    CHECK_THROWS(EstimateElementWiseTraffic(desc, {3}, {4}, 4), std::invalid_argument);
+}
@@ -0,0 +1,205 @@
+#include "CpuBackend.hpp"
+#include "ExecutionPlan.hpp"
+#include "TestHarness.hpp"
+
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+// A CPU backend that logs every call a replay makes, in order.
+class RecordingBackend : public CpuBackend
+{
+  public:
+    RecordingBackend() : CpuBackend(Options())
+    {
+    }
+
+    using CpuBackend::GetTensorData;
+    using CpuBackend::SetTensorData;
+
+    void SetTensorData(TensorHandle tensor, const void *data, size_t size) override
+    {
+        calls.push_back("SetTensorData");
+        CpuBackend::SetTensorData(tensor, data, size);
+    }
+
+    void GetTensorData(TensorHandle tensor, const TensorShape &shape, TensorDataType type, void *data,
+                       size_t size) override
+    {
+        calls.push_back("GetTensorData");
+        CpuBackend::GetTensorData(tensor, shape, type, data, size);
+    }
+
+    SubmissionTicket ElementWise(const ElementWiseDesc &desc, TensorHandle src0, TensorHandle src1,
+                                 TensorHandle dst) override
+    {
+        calls.push_back("ElementWise");
+        return CpuBackend::ElementWise(desc, src0, src1, dst);
+    }
+
+    SubmissionTicket Gemm(const GemmDesc &desc, TensorHandle a, TensorHandle b, TensorHandle bias,
+                          TensorHandle dst) override
+    {
+        calls.push_back("Gemm");
+        return CpuBackend::Gemm(desc, a, b, bias, dst);
+    }
+
+    SubmissionTicket Reduce(const ReduceDesc &desc, TensorHandle src, TensorHandle dst) override
+    {
+        calls.push_back("Reduce");
+        return CpuBackend::Reduce(desc, src, dst);
+    }
+
+    std::vector<std::string> calls;
+
+  private:
+    static CpuBackendOptions Options()
+    {
+        CpuBackendOptions options;
+        options.threadCount = 1;
+        return options;
+    }
+};
+
+// Multiplies x of shape {2, 3} by w of shape {3, 2}, doubles the product and sums its rows, then reads back the
+// product and the row sums.
+struct Plan
+{
+    explicit Plan(RecordingBackend &backend) : backend(backend), capture(backend)
+    {
+        x = backend.CreateTensor("x", {2, 3}, TensorDataType::Float32);
+        w = backend.CreateTensor("w", {3, 2}, TensorDataType::Float32);
+        product = backend.CreateTensor("product", {2, 2}, TensorDataType::Float32);
+        sum = backend.CreateTensor("sum", {2, 2}, TensorDataType::Float32);
+        reduced = backend.CreateTensor("reduced", {2, 1}, TensorDataType::Float32);
+
+        capture.SetTensorData(x, 6 * sizeof(float));
+        capture.SetTensorData(w, 6 * sizeof(float));
+        capture.Gemm(GemmDesc{}, x, w, TensorHandle(), product);
+        capture.ElementWise(ElementWiseDesc{}, product, product, sum);
+        ReduceDesc rows;
+        rows.axis = 1;
+        capture.Reduce(rows, sum, reduced);
+        capture.GetTensorData(product, 4 * sizeof(float));
+        capture.GetTensorData(reduced, 2 * sizeof(float));
+    }
+
+    RecordingBackend &backend;
+    PlanCapture capture;
+    TensorHandle x, w, product, sum, reduced;
+};
+} // namespace
+
+TEST(CaptureAssignsSlotsInOrder)
+{
+    RecordingBackend backend;
+    Plan plan(backend);
+    CHECK_EQ(plan.capture.Steps().size(), 7u);
+    CHECK(plan.capture.InputSizes() == std::vector<size_t>({24, 24}));
+    CHECK(plan.capture.OutputSizes() == std::vector<size_t>({16, 8}));
+    CHECK_EQ(plan.capture.Steps()[1].slot, 1u);
+    CHECK_EQ(plan.capture.Steps()[6].slot, 1u);
+
+    // Capturing runs nothing.
+    CHECK(backend.calls.empty());
+}
+
+TEST(CaptureRejectsWhatTheBackendWould)
+{
+    RecordingBackend backend;
+    TensorHandle a = backend.CreateTensor("a", {2, 3}, TensorDataType::Float32);
+    TensorHandle b = backend.CreateTensor("b", {4, 3}, TensorDataType::Float32);
+    TensorHandle c = backend.CreateTensor("c", {2, 3}, TensorDataType::Float32);
+    TensorHandle d = backend.CreateTensor("d", {2, 4}, TensorDataType::Float32);
+    PlanCapture capture(backend);
+
+    CHECK_THROWS(capture.SetTensorData(a, 6 * sizeof(float) + 1), std::invalid_argument);
+    CHECK_THROWS(capture.GetTensorData(a, 7 * sizeof(float)), std::invalid_argument);
+    CHECK_THROWS(capture.ElementWise(ElementWiseDesc{}, a, b, c), std::invalid_argument);
+    CHECK_THROWS(capture.ElementWise(ElementWiseDesc{}, a, a, d), std::invalid_argument);
+    CHECK_THROWS(capture.Gemm(GemmDesc{}, a, b, TensorHandle(), d), std::invalid_argument);
+    CHECK_THROWS(capture.Gemm(GemmDesc{}, a, b, TensorHandle(), a), std::invalid_argument);
+    ReduceDesc reduce;
+    reduce.axis = 1;
+    CHECK_THROWS(capture.Reduce(reduce, a, c), std::invalid_argument);
+    CHECK_THROWS(capture.Reduce(reduce, a, a), std::invalid_argument);
+    reduce.axis = 2;
+    CHECK_THROWS(capture.Reduce(reduce, a, c), std::invalid_argument);
+    CHECK_THROWS(capture.ExecuteGraph(TensorGraph()), std::invalid_argument);
+
+    // Nothing that failed was captured, and what passes is.
+    CHECK(capture.Steps().empty());
+    GemmDesc transposed;
+    transposed.transposeB = true;
+    capture.Gemm(transposed, a, b, TensorHandle(), d);
+    capture.SetTensorData(a, 6 * sizeof(float));
+    CHECK_EQ(capture.Steps().size(), 2u);
+}
+
+TEST(ReplayRunsTheCapturedCalls)
+{
+    RecordingBackend backend;
+    Plan plan(backend);
+    std::unique_ptr<ExecutionPlan> executionPlan = backend.CreateExecutionPlan(plan.capture);
+    CHECK_EQ(executionPlan->InputCount(), 2u);
+    CHECK_EQ(executionPlan->OutputCount(), 2u);
+
+    for (float scale : {1.0f, -2.0f})
+    {
+        backend.calls.clear();
+        std::vector<float> x{1, 2, 3, 4, 5, 6};
+        std::vector<float> w{scale, 0, 0, scale, scale, scale};
+        std::vector<float> product(4);
+        std::vector<float> reduced(2);
+        executionPlan->Replay({x.data(), w.data()}, {product.data(), reduced.data()});
+
+        CHECK(backend.calls == std::vector<std::string>({"SetTensorData", "SetTensorData", "Gemm", "ElementWise",
+                                                          "Reduce", "GetTensorData", "GetTensorData"}));
+        CHECK(product == std::vector<float>({4 * scale, 5 * scale, 10 * scale, 11 * scale}));
+        CHECK(reduced == std::vector<float>({18 * scale, 42 * scale}));
+    }
+}
+
+TEST(ReplayWritesTheOutputsBeforeReturning)
+{
+    RecordingBackend backend;
+    Plan plan(backend);
+    std::unique_ptr<ExecutionPlan> executionPlan = backend.CreateExecutionPlan(plan.capture);
+
+    std::vector<float> x{1, 1, 1, 1, 1, 1};
+    std::vector<float> w{1, 1, 1, 1, 1, 1};
+    auto product = std::make_unique<float[]>(4);
+    auto reduced = std::make_unique<float[]>(2);
+    std::shared_future<void> replay = executionPlan->ReplayAsync({x.data(), w.data()}, {product.get(), reduced.get()});
+
+    // The outputs are in place once the future is ready, and nothing writes them after, so they can be freed.
+    CHECK(replay.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    CHECK_EQ(product[3], 3.0f);
+    CHECK_EQ(reduced[1], 12.0f);
+    product.reset();
+    reduced.reset();
+    replay.get();
+
+    // The plan keeps nothing from the last replay's buffers.
+    std::vector<float> product2(4), reduced2(2);
+    executionPlan->Replay({x.data(), w.data()}, {product2.data(), reduced2.data()});
+    CHECK_EQ(reduced2[0], 12.0f);
+}
+
+TEST(ReplayChecksItsBuffers)
+{
+    RecordingBackend backend;
+    Plan plan(backend);
+    std::unique_ptr<ExecutionPlan> executionPlan = backend.CreateExecutionPlan(plan.capture);
+    std::vector<float> x(6), w(6), product(4), reduced(2);
+
+    CHECK_THROWS(executionPlan->Replay({x.data()}, {product.data(), reduced.data()}), std::invalid_argument);
+    CHECK_THROWS(executionPlan->Replay({x.data(), w.data()}, {product.data()}), std::invalid_argument);
+    CHECK_THROWS(executionPlan->Replay({x.data(), nullptr}, {product.data(), reduced.data()}), std::invalid_argument);
+    CHECK_THROWS(executionPlan->Replay({x.data(), w.data()}, {nullptr, reduced.data()}), std::invalid_argument);
+    CHECK(backend.calls.empty());
+}
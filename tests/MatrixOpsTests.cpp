@@ -0,0 +1,289 @@
+#include "CpuBackend.hpp"
+#include "TestHarness.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+std::vector<SimdLevel> HostSimdLevels()
+{
+    std::vector<SimdLevel> levels;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Neon, SimdLevel::Avx2, SimdLevel::Avx512})
+    {
+        if (level <= DetectSimdLevel())
+        {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
+
+std::vector<float> RandomValues(uint64_t count, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    std::vector<float> values(static_cast<size_t>(count));
+    for (float &value : values)
+    {
+        value = distribution(random);
+    }
+    return values;
+}
+
+CpuBackendOptions Options(SimdLevel level)
+{
+    // Small ops are split across the pool too, so the chunked paths are exercised at test sizes.
+    CpuBackendOptions options;
+    options.threadCount = 4;
+    options.maxSimdLevel = level;
+    options.minParallelElements = 1;
+    return options;
+}
+
+TensorHandle Upload(CpuBackend &backend, const TensorShape &shape, const std::vector<float> &values)
+{
+    TensorHandle tensor = backend.CreateTensor("", shape, TensorDataType::Float32);
+    backend.SetTensorData(tensor, values.data(), values.size() * sizeof(float));
+    return tensor;
+}
+
+std::vector<float> Download(CpuBackend &backend, TensorHandle tensor)
+{
+    std::vector<float> values(static_cast<size_t>(ElementCount(backend.GetTensorShape(tensor))));
+    backend.GetTensorData(tensor, {}, TensorDataType::Float32, values.data(), values.size() * sizeof(float));
+    return values;
+}
+
+struct GemmCase
+{
+    uint32_t batch;
+    uint32_t rows;
+    uint32_t columns;
+    uint32_t depth;
+};
+
+// c[m][i][j] = alpha * sum_k op(a)[m][i][k] op(b)[m][k][j] + beta * bias[i][j], with a bias of one row per matrix if
+// biasRows is 1.
+std::vector<double> NaiveGemm(const GemmDesc &desc, const GemmCase &shape, const std::vector<float> &a,
+                              const std::vector<float> &b, const std::vector<float> *bias, uint32_t biasRows)
+{
+    std::vector<double> c(size_t(shape.batch) * shape.rows * shape.columns);
+    for (size_t m = 0; m < shape.batch; ++m)
+    {
+        const float *matrixA = a.data() + m * shape.rows * shape.depth;
+        const float *matrixB = b.data() + m * shape.depth * shape.columns;
+        for (size_t i = 0; i < shape.rows; ++i)
+        {
+            for (size_t j = 0; j < shape.columns; ++j)
+            {
+                double sum = 0.0;
+                for (size_t k = 0; k < shape.depth; ++k)
+                {
+                    double x = desc.transposeA ? matrixA[k * shape.rows + i] : matrixA[i * shape.depth + k];
+                    double y = desc.transposeB ? matrixB[j * shape.depth + k] : matrixB[k * shape.columns + j];
+                    sum += x * y;
+                }
+                double value = desc.alpha * sum;
+                if (bias)
+                {
+                    value += desc.beta * (*bias)[(biasRows == 1 ? 0 : i) * shape.columns + j];
+                }
+                c[(m * shape.rows + i) * shape.columns + j] = value;
+            }
+        }
+    }
+    return c;
+}
+
+void CheckGemm(SimdLevel level, const GemmDesc &desc, const GemmCase &shape, bool withBias, uint32_t biasRows = 1)
+{
+    CpuBackend backend(Options(level));
+    uint32_t seed = shape.rows * 7919 + shape.columns * 31 + shape.depth;
+    std::vector<float> a = RandomValues(uint64_t(shape.batch) * shape.rows * shape.depth, seed);
+    std::vector<float> b = RandomValues(uint64_t(shape.batch) * shape.depth * shape.columns, seed + 1);
+    std::vector<float> bias = RandomValues(uint64_t(biasRows) * shape.columns, seed + 2);
+
+    TensorShape shapeA = desc.transposeA ? TensorShape{shape.depth, shape.rows} : TensorShape{shape.rows, shape.depth};
+    TensorShape shapeB =
+        desc.transposeB ? TensorShape{shape.columns, shape.depth} : TensorShape{shape.depth, shape.columns};
+    TensorShape shapeC{shape.rows, shape.columns};
+    if (shape.batch != 1)
+    {
+        shapeA.insert(shapeA.begin(), shape.batch);
+        shapeB.insert(shapeB.begin(), shape.batch);
+        shapeC.insert(shapeC.begin(), shape.batch);
+    }
+
+    TensorHandle handleA = Upload(backend, shapeA, a);
+    TensorHandle handleB = Upload(backend, shapeB, b);
+    TensorHandle handleBias = withBias ? Upload(backend, {biasRows, shape.columns}, bias) : TensorHandle();
+    TensorHandle handleC = backend.CreateTensor("", shapeC, TensorDataType::Float32);
+    backend.Gemm(desc, handleA, handleB, handleBias, handleC);
+
+    std::vector<float> c = Download(backend, handleC);
+    std::vector<double> expected = NaiveGemm(desc, shape, a, b, withBias ? &bias : nullptr, biasRows);
+    CHECK_EQ(c.size(), expected.size());
+
+    // Float32 accumulation of depth products of magnitude at most one.
+    double tolerance = 4e-7 * (shape.depth + 4);
+    for (size_t i = 0; i < c.size(); ++i)
+    {
+        CHECK_NEAR(c[i], expected[i], tolerance);
+    }
+}
+
+std::vector<double> NaiveReduce(ReduceOp op, const TensorShape &shape, uint32_t axis, const std::vector<float> &x)
+{
+    size_t outer = 1;
+    size_t inner = 1;
+    for (uint32_t d = 0; d < axis; ++d)
+    {
+        outer *= shape[d];
+    }
+    for (size_t d = axis + 1; d < shape.size(); ++d)
+    {
+        inner *= shape[d];
+    }
+    size_t reduced = shape[axis];
+
+    std::vector<double> y(outer * inner);
+    for (size_t o = 0; o < outer; ++o)
+    {
+        for (size_t i = 0; i < inner; ++i)
+        {
+            double value = op == ReduceOp::Max ? -INFINITY : 0.0;
+            for (size_t r = 0; r < reduced; ++r)
+            {
+                double element = x[(o * reduced + r) * inner + i];
+                value = op == ReduceOp::Max ? std::max(value, element) : value + element;
+            }
+            y[o * inner + i] = op == ReduceOp::Mean ? value / static_cast<double>(reduced) : value;
+        }
+    }
+    return y;
+}
+
+void CheckReduce(SimdLevel level, ReduceOp op, const TensorShape &shape, uint32_t axis)
+{
+    CpuBackend backend(Options(level));
+    std::vector<float> x = RandomValues(ElementCount(shape), static_cast<uint32_t>(ElementCount(shape)) + axis);
+    ReduceDesc desc;
+    desc.op = op;
+    desc.axis = axis;
+
+    TensorHandle handleX = Upload(backend, shape, x);
+    TensorHandle handleY = backend.CreateTensor("", ReduceOutputShape(desc, shape), TensorDataType::Float32);
+    backend.Reduce(desc, handleX, handleY);
+
+    std::vector<float> y = Download(backend, handleY);
+    std::vector<double> expected = NaiveReduce(op, shape, axis, x);
+    CHECK_EQ(y.size(), expected.size());
+    double tolerance = op == ReduceOp::Max ? 0.0 : 4e-7 * (shape[axis] + 4);
+    for (size_t i = 0; i < y.size(); ++i)
+    {
+        CHECK_NEAR(y[i], expected[i], tolerance);
+    }
+}
+} // namespace
+
+TEST(GemmMatchesNaiveLoopsOnEdgeTiles)
+{
+    // Sizes around the micro-kernel tiles and around the 96-row, 512-column and 256-deep cache blocks, none of them
+    // multiples of the tiles.
+    const GemmCase cases[] = {
+        {1, 1, 1, 1}, {1, 3, 5, 7}, {1, 13, 17, 9}, {1, 95, 33, 255}, {1, 97, 513, 257}, {1, 193, 45, 600},
+    };
+    for (SimdLevel level : HostSimdLevels())
+    {
+        for (const GemmCase &shape : cases)
+        {
+            CheckGemm(level, GemmDesc{}, shape, false);
+        }
+    }
+}
+
+TEST(GemmMatchesNaiveLoopsTransposed)
+{
+    for (SimdLevel level : HostSimdLevels())
+    {
+        for (bool transposeA : {false, true})
+        {
+            for (bool transposeB : {false, true})
+            {
+                GemmDesc desc;
+                desc.transposeA = transposeA;
+                desc.transposeB = transposeB;
+                CheckGemm(level, desc, {1, 37, 29, 300}, false);
+                CheckGemm(level, desc, {1, 101, 7, 3}, false);
+            }
+        }
+    }
+}
+
+TEST(GemmScalesAndAddsTheBias)
+{
+    GemmDesc desc;
+    desc.alpha = 0.5f;
+    desc.beta = -2.0f;
+    for (SimdLevel level : HostSimdLevels())
+    {
+        CheckGemm(level, desc, {1, 19, 23, 11}, true, 1);
+        CheckGemm(level, desc, {1, 19, 23, 11}, true, 19);
+        CheckGemm(level, desc, {3, 10, 21, 34}, true, 1);
+    }
+}
+
+TEST(GemmRunsEachMatrixOfABatch)
+{
+    GemmDesc desc;
+    desc.transposeB = true;
+    for (SimdLevel level : HostSimdLevels())
+    {
+        CheckGemm(level, desc, {5, 9, 14, 70}, false);
+    }
+}
+
+TEST(GemmRejectsMismatchedOperands)
+{
+    CpuBackend backend(Options(SimdLevel::Scalar));
+    TensorHandle a = backend.CreateTensor("", {4, 3}, TensorDataType::Float32);
+    TensorHandle b = backend.CreateTensor("", {4, 5}, TensorDataType::Float32);
+    TensorHandle c = backend.CreateTensor("", {4, 5}, TensorDataType::Float32);
+    CHECK_THROWS(backend.Gemm(GemmDesc{}, a, b, TensorHandle(), c), std::invalid_argument);
+    CHECK_THROWS(backend.Gemm(GemmDesc{}, a, a, TensorHandle(), a), std::invalid_argument);
+}
+
+TEST(ReduceMatchesNaiveLoopsOnEveryAxis)
+{
+    const TensorShape shapes[] = {{1}, {7}, {5003}, {3, 4, 5}, {2, 4099, 3}, {3, 2, 4101}};
+    for (SimdLevel level : HostSimdLevels())
+    {
+        for (ReduceOp op : {ReduceOp::Sum, ReduceOp::Mean, ReduceOp::Max})
+        {
+            for (const TensorShape &shape : shapes)
+            {
+                for (uint32_t axis = 0; axis < shape.size(); ++axis)
+                {
+                    CheckReduce(level, op, shape, axis);
+                }
+            }
+        }
+    }
+}
+
+TEST(ReduceRejectsBadAxisAndShape)
+{
+    CpuBackend backend(Options(SimdLevel::Scalar));
+    TensorHandle x = backend.CreateTensor("", {3, 4}, TensorDataType::Float32);
+    TensorHandle y = backend.CreateTensor("", {3, 4}, TensorDataType::Float32);
+    ReduceDesc desc;
+    desc.axis = 2;
+    CHECK_THROWS(backend.Reduce(desc, x, y), std::invalid_argument);
+    desc.axis = 1;
+    CHECK_THROWS(backend.Reduce(desc, x, y), std::invalid_argument);
+    CHECK_THROWS(backend.Reduce(desc, x, x), std::invalid_argument);
+}
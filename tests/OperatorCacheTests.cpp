@@ -0,0 +1,173 @@
+#include "OperatorCache.hpp"
+#include "TestHarness.hpp"
+
+// Stands in for compiling a DirectML operator: counts compilations and tags each result with its key's shape.
+struct FakeOperator
+{
+    uint32_t size;
+};
+
+struct FakeCompiler
+{
+    int compilations = 0;
+
+    std::shared_ptr<FakeOperator> operator()(const OperatorKey &key)
+    {
+        ++compilations;
+        return std::make_shared<FakeOperator>(FakeOperator{key.inputDimensions[0][0]});
+    }
+};
+
+static OperatorKey KeyForSize(uint32_t size)
+{
+    OperatorKey key;
+    key.inputDimensions = {{size, 1, 1, 1}, {size, 1, 1, 1}};
+    key.outputDimensions = {{size, 1, 1, 1}};
+    return key;
+}
+
+TEST(MissCompilesAndHitReuses)
+{
+    OperatorCache<FakeOperator> cache(4);
+    FakeCompiler compiler;
+    OperatorKey key = KeyForSize(8);
+
+    auto first = cache.GetOrCreate(key, [&] { return compiler(key); });
+    auto second = cache.GetOrCreate(key, [&] { return compiler(key); });
+    CHECK(first == second);
+    CHECK_EQ(first->size, 8u);
+    CHECK_EQ(compiler.compilations, 1);
+
+    OperatorCacheStats stats = cache.GetStats();
+    CHECK_EQ(stats.hits, 1u);
+    CHECK_EQ(stats.misses, 1u);
+    CHECK_EQ(stats.evictions, 0u);
+    CHECK_EQ(stats.size, 1u);
+}
+
+TEST(EveryKeyFieldSeparatesEntries)
+{
+    OperatorCache<FakeOperator> cache(16);
+    FakeCompiler compiler;
+    OperatorKey base = KeyForSize(8);
+
+    std::vector<OperatorKey> keys(6, base);
+    keys[1].kind = OperatorKind::Gemm;
+    keys[2].dataType = 1;
+    keys[3].executionFlags = 1;
+    keys[4].outputDimensions = {{8, 1, 1, 2}};
+    keys[5].signature = "relu";
+    for (const OperatorKey &key : keys)
+    {
+        cache.GetOrCreate(key, [&] { return compiler(key); });
+    }
+    CHECK_EQ(compiler.compilations, 6);
+    CHECK_EQ(cache.GetStats().size, 6u);
+    for (size_t i = 1; i < keys.size(); ++i)
+    {
+        CHECK(keys[i] != base);
+        CHECK(cache.Contains(keys[i]));
+    }
+}
+
+TEST(EvictsLeastRecentlyUsed)
+{
+    OperatorCache<FakeOperator> cache(2);
+    FakeCompiler compiler;
+    OperatorKey a = KeyForSize(1);
+    OperatorKey b = KeyForSize(2);
+    OperatorKey c = KeyForSize(3);
+
+    cache.GetOrCreate(a, [&] { return compiler(a); });
+    cache.GetOrCreate(b, [&] { return compiler(b); });
+    cache.GetOrCreate(a, [&] { return compiler(a); }); // a is now the most recently used.
+    cache.GetOrCreate(c, [&] { return compiler(c); });
+
+    CHECK(cache.Contains(a));
+    CHECK(!cache.Contains(b));
+    CHECK(cache.Contains(c));
+    CHECK_EQ(cache.GetStats().evictions, 1u);
+
+    cache.GetOrCreate(b, [&] { return compiler(b); });
+    CHECK_EQ(compiler.compilations, 4);
+    CHECK(!cache.Contains(a));
+}
+
+TEST(EvictedEntryStaysAliveWhileHeld)
+{
+    OperatorCache<FakeOperator> cache(1);
+    FakeCompiler compiler;
+    OperatorKey a = KeyForSize(1);
+    OperatorKey b = KeyForSize(2);
+
+    std::shared_ptr<FakeOperator> inFlight = cache.GetOrCreate(a, [&] { return compiler(a); });
+    std::weak_ptr<FakeOperator> watch = inFlight;
+    cache.GetOrCreate(b, [&] { return compiler(b); });
+    CHECK(!cache.Contains(a));
+    CHECK(!watch.expired());
+    CHECK_EQ(inFlight->size, 1u);
+
+    inFlight.reset();
+    CHECK(watch.expired());
+}
+
+TEST(FindCountsWithoutCreating)
+{
+    OperatorCache<FakeOperator> cache(4);
+    FakeCompiler compiler;
+    OperatorKey key = KeyForSize(4);
+
+    CHECK(cache.Find(key) == nullptr);
+    cache.Insert(key, compiler(key));
+    CHECK(cache.Find(key) != nullptr);
+
+    OperatorCacheStats stats = cache.GetStats();
+    CHECK_EQ(stats.misses, 1u);
+    CHECK_EQ(stats.hits, 1u);
+}
+
+TEST(InsertReplacesExistingEntry)
+{
+    OperatorCache<FakeOperator> cache(4);
+    OperatorKey key = KeyForSize(4);
+
+    cache.Insert(key, std::make_shared<FakeOperator>(FakeOperator{1}));
+    cache.Insert(key, std::make_shared<FakeOperator>(FakeOperator{2}));
+    CHECK_EQ(cache.GetStats().size, 1u);
+    CHECK_EQ(cache.Find(key)->size, 2u);
+}
+
+TEST(FailedFactoryLeavesCacheUnchanged)
+{
+    OperatorCache<FakeOperator> cache(4);
+    OperatorKey key = KeyForSize(4);
+
+    CHECK_THROWS(cache.GetOrCreate(key, []() -> std::shared_ptr<FakeOperator> { throw std::runtime_error("compile"); }),
+                 std::runtime_error);
+    CHECK(!cache.Contains(key));
+    CHECK_EQ(cache.GetStats().size, 0u);
+}
+
+TEST(ShrinkingCapacityEvicts)
+{
+    OperatorCache<FakeOperator> cache(4);
+    FakeCompiler compiler;
+    for (uint32_t size = 1; size <= 4; ++size)
+    {
+        OperatorKey key = KeyForSize(size);
+        cache.GetOrCreate(key, [&] { return compiler(key); });
+    }
+    cache.SetCapacity(1);
+
+    OperatorCacheStats stats = cache.GetStats();
+    CHECK_EQ(stats.size, 1u);
+    CHECK_EQ(stats.capacity, 1u);
+    CHECK_EQ(stats.evictions, 3u);
+    CHECK(cache.Contains(KeyForSize(4)));
+
+    cache.ResetStats();
+    cache.Clear();
+    stats = cache.GetStats();
+    CHECK_EQ(stats.size, 0u);
+    CHECK_EQ(stats.hits + stats.misses + stats.evictions, 0u);
+}
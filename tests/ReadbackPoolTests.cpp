@@ -0,0 +1,193 @@
+#include "ReadbackPool.hpp"
+#include "TestHarness.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace
+{
+// Plain host memory in place of a mapped READBACK resource. A vector keeps its storage when moved, so data() tells
+// buffers apart.
+using HostBuffer = std::vector<uint8_t>;
+using HostPool = ReadbackPool<HostBuffer>;
+
+HostPool MakePool(uint64_t minBucketSize = 64, uint64_t maxCachedBytes = 1 << 20)
+{
+    return HostPool([](uint64_t capacity) { return HostBuffer(static_cast<size_t>(capacity)); }, minBucketSize,
+                    maxCachedBytes);
+}
+
+// The owner's side, the way DirectMLProcessor reads tensors back: a buffer is the target of a copy in a submission
+// and only goes back to the pool once that submission's fence has been reached.
+class SimulatedQueue
+{
+  public:
+    explicit SimulatedQueue(HostPool &pool) : m_pool(pool)
+    {
+    }
+
+    // Acquires a buffer and fills it, as the copy signalling fenceValue would once it runs.
+    const uint8_t *Readback(uint64_t size, uint64_t fenceValue, uint8_t contents)
+    {
+        HostPool::Entry entry = m_pool.Acquire(size);
+        const uint8_t *data = entry.buffer.data();
+        if (inFlight.count(data) != 0)
+        {
+            ++reusedInFlight;
+        }
+        inFlight.insert(data);
+        std::fill_n(entry.buffer.begin(), size, contents);
+        m_pending.push_back({fenceValue, std::move(entry)});
+        return data;
+    }
+
+    // Returns the buffers of every submission up to completedValue to the pool.
+    void Retire(uint64_t completedValue)
+    {
+        while (!m_pending.empty() && m_pending.front().first <= completedValue)
+        {
+            inFlight.erase(m_pending.front().second.buffer.data());
+            m_pool.Release(std::move(m_pending.front().second));
+            m_pending.pop_front();
+        }
+    }
+
+    std::set<const uint8_t *> inFlight;
+    uint32_t reusedInFlight = 0;
+
+  private:
+    HostPool &m_pool;
+    std::deque<std::pair<uint64_t, HostPool::Entry>> m_pending;
+};
+} // namespace
+
+TEST(BucketsArePowersOfTwoFromTheMinimum)
+{
+    HostPool pool = MakePool(64);
+    CHECK_EQ(pool.BucketSize(0), 64u);
+    CHECK_EQ(pool.BucketSize(1), 64u);
+    CHECK_EQ(pool.BucketSize(64), 64u);
+    CHECK_EQ(pool.BucketSize(65), 128u);
+    CHECK_EQ(pool.BucketSize(1000), 1024u);
+}
+
+TEST(ReleasedBufferIsReused)
+{
+    HostPool pool = MakePool();
+    HostPool::Entry entry = pool.Acquire(100);
+    CHECK_EQ(entry.capacity, 128u);
+    CHECK_EQ(entry.buffer.size(), 128u);
+    const uint8_t *data = entry.buffer.data();
+    pool.Release(std::move(entry));
+    CHECK_EQ(pool.GetStats().cachedBytes, 128u);
+
+    // Any size in the same bucket gets the same buffer back.
+    entry = pool.Acquire(65);
+    CHECK(entry.buffer.data() == data);
+    HostPool::Stats stats = pool.GetStats();
+    CHECK_EQ(stats.allocations, 1u);
+    CHECK_EQ(stats.reuses, 1u);
+    CHECK_EQ(stats.cachedBytes, 0u);
+}
+
+TEST(LargerRequestGrowsIntoANewBucket)
+{
+    HostPool pool = MakePool();
+    HostPool::Entry small = pool.Acquire(100);
+    const uint8_t *smallData = small.buffer.data();
+    pool.Release(std::move(small));
+
+    // The cached buffer is too small, so a new one is made and the small one stays cached.
+    HostPool::Entry large = pool.Acquire(3000);
+    CHECK_EQ(large.capacity, 4096u);
+    CHECK(large.buffer.size() >= 3000u);
+    CHECK(large.buffer.data() != smallData);
+    CHECK_EQ(pool.GetStats().allocations, 2u);
+    CHECK_EQ(pool.GetStats().cachedBytes, 128u);
+
+    // Both are reused afterwards.
+    pool.Release(std::move(large));
+    CHECK(pool.Acquire(2049).capacity == 4096u);
+    CHECK(pool.Acquire(100).buffer.data() == smallData);
+    CHECK_EQ(pool.GetStats().allocations, 2u);
+    CHECK_EQ(pool.GetStats().reuses, 2u);
+}
+
+TEST(InFlightBufferIsNeverHandedOutAgain)
+{
+    HostPool pool = MakePool();
+    SimulatedQueue queue(pool);
+
+    // Three readbacks in flight in the same bucket each get a buffer of their own.
+    const uint8_t *first = queue.Readback(100, 1, 'a');
+    const uint8_t *second = queue.Readback(100, 2, 'b');
+    const uint8_t *third = queue.Readback(120, 3, 'c');
+    CHECK(first != second && second != third && first != third);
+    CHECK_EQ(pool.GetStats().allocations, 3u);
+
+    // Once fence 1 is reached only the first comes back, and a new readback takes it while the others keep their
+    // contents.
+    queue.Retire(1);
+    CHECK(queue.Readback(100, 4, 'd') == first);
+    CHECK_EQ(second[0], 'b');
+    CHECK_EQ(third[0], 'c');
+
+    // Many readbacks with the fence lagging a few submissions behind.
+    for (uint64_t fenceValue = 5; fenceValue < 200; ++fenceValue)
+    {
+        queue.Readback(1 + fenceValue % 300, fenceValue, static_cast<uint8_t>(fenceValue));
+        queue.Retire(fenceValue - 3);
+    }
+    CHECK_EQ(queue.reusedInFlight, 0u);
+    CHECK(pool.GetStats().reuses > 100u);
+    queue.Retire(200);
+    CHECK(queue.inFlight.empty());
+}
+
+TEST(CacheLimitDropsTheLargestBuffersFirst)
+{
+    HostPool pool = MakePool(64, 1024);
+    HostPool::Entry small = pool.Acquire(64);
+    HostPool::Entry medium = pool.Acquire(512);
+    HostPool::Entry large = pool.Acquire(1024);
+    pool.Release(std::move(small));
+    pool.Release(std::move(medium));
+    pool.Release(std::move(large));
+
+    // 64 + 512 + 1024 is over the limit; dropping the 1024 buffer is enough.
+    HostPool::Stats stats = pool.GetStats();
+    CHECK_EQ(stats.trims, 1u);
+    CHECK_EQ(stats.cachedBytes, 576u);
+    pool.Acquire(1024);
+    CHECK_EQ(pool.GetStats().allocations, 4u);
+
+    pool.Clear();
+    CHECK_EQ(pool.GetStats().cachedBytes, 0u);
+    pool.Acquire(64);
+    CHECK_EQ(pool.GetStats().allocations, 5u);
+}
+
+TEST(ViewKeepsItsBufferUntilReleased)
+{
+    HostPool pool = MakePool();
+    auto entry = std::make_shared<HostPool::Entry>(pool.Acquire(16));
+    std::memcpy(entry->buffer.data(), "readback", 8);
+    const uint8_t *data = entry->buffer.data();
+
+    // Like MapTensorData: the lease hands the buffer back when the view is dropped.
+    TensorView view(data, 8, ReadbackLease([&pool, entry]() { pool.Release(std::move(*entry)); }));
+    CHECK(pool.Acquire(16).buffer.data() != data);
+    CHECK_EQ(view.As<char>()[0], 'r');
+    CHECK_EQ(view.SizeInBytes(), 8u);
+
+    TensorView moved = std::move(view);
+    CHECK_EQ(pool.GetStats().cachedBytes, 0u);
+    moved.Release();
+    CHECK(moved.Data() == nullptr);
+    CHECK(pool.Acquire(16).buffer.data() == data);
+}
@@ -0,0 +1,297 @@
+#include "CpuBackend.hpp"
+#include "ResidencyManager.hpp"
+#include "TestHarness.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+TensorHandle Handle(uint32_t index)
+{
+    return TensorHandle{index, 1};
+}
+
+// The owner's side of the policy, the way the DirectML processor drives it: a call pins its tensors, makes room for
+// the evicted ones and pages them in, then unpins them with the fence value of its submission. Evictions are recorded
+// in order instead of moving contents, and the fence is assumed to have passed whatever a plan waits for.
+class SimulatedDevice
+{
+  public:
+    explicit SimulatedDevice(uint64_t budget) : residency(budget)
+    {
+    }
+
+    void Create(TensorHandle tensor, uint64_t bytes)
+    {
+        MakeRoom(bytes);
+        residency.Add(tensor, bytes);
+        Track();
+    }
+
+    void Use(const std::vector<TensorHandle> &tensors, uint64_t fenceValue)
+    {
+        std::vector<TensorHandle> evicted = residency.Pin(tensors);
+        uint64_t incoming = 0;
+        for (TensorHandle tensor : evicted)
+        {
+            incoming += residency.Bytes(tensor);
+        }
+        MakeRoom(incoming);
+        for (TensorHandle tensor : evicted)
+        {
+            residency.MarkResident(tensor, true);
+        }
+        Track();
+        residency.Unpin(tensors, fenceValue);
+    }
+
+    void MakeRoom(uint64_t incoming)
+    {
+        ResidencyManager::EvictionPlan plan = residency.PlanEviction(incoming);
+        for (TensorHandle tensor : plan.victims)
+        {
+            residency.MarkEvicted(tensor);
+            evictions.push_back(tensor.index);
+        }
+    }
+
+    ResidencyManager residency;
+    std::vector<uint32_t> evictions;
+    uint64_t peakResidentBytes = 0;
+
+  private:
+    void Track()
+    {
+        peakResidentBytes = std::max(peakResidentBytes, residency.GetStats().residentBytes);
+    }
+};
+} // namespace
+
+TEST(EvictsLeastRecentlyUsedFirst)
+{
+    SimulatedDevice device(300);
+    for (uint32_t i = 1; i <= 3; ++i)
+    {
+        device.Create(Handle(i), 100);
+    }
+    CHECK(device.evictions.empty());
+
+    // Using 1 makes 2 the oldest, then 3.
+    device.Use({Handle(1)}, 1);
+    device.Create(Handle(4), 150);
+    CHECK(device.evictions == std::vector<uint32_t>({2, 3}));
+    CHECK(device.residency.IsResident(Handle(1)));
+    CHECK(!device.residency.IsResident(Handle(2)));
+
+    ResidencyStats stats = device.residency.GetStats();
+    CHECK_EQ(stats.residentBytes, 250u);
+    CHECK_EQ(stats.evictedBytes, 200u);
+    CHECK_EQ(stats.residentCount, 2u);
+    CHECK_EQ(stats.evictedCount, 2u);
+    CHECK_EQ(stats.evictions, 2u);
+}
+
+TEST(PagingInEvictsTheOldestOthers)
+{
+    SimulatedDevice device(200);
+    device.Create(Handle(1), 100);
+    device.Create(Handle(2), 100);
+    device.Create(Handle(3), 100);
+    CHECK(device.evictions == std::vector<uint32_t>({1}));
+
+    // 1 comes back in over 2, the oldest resident; then 2 over 3.
+    device.Use({Handle(1)}, 1);
+    device.Use({Handle(2)}, 2);
+    CHECK(device.evictions == std::vector<uint32_t>({1, 2, 3}));
+    CHECK(device.residency.IsResident(Handle(1)));
+    CHECK(device.residency.IsResident(Handle(2)));
+    CHECK_EQ(device.peakResidentBytes, 200u);
+
+    ResidencyStats stats = device.residency.GetStats();
+    CHECK_EQ(stats.pageIns, 2u);
+    CHECK_EQ(stats.pageInBytes, 200u);
+}
+
+TEST(RoundRobinOverABudgetEvictsEveryTime)
+{
+    // Cycling through more tensors than fit is LRU's worst case: each use evicts the tensor used next.
+    SimulatedDevice device(300);
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        device.Create(Handle(i), 100);
+    }
+    for (uint64_t step = 0; step < 40; ++step)
+    {
+        device.Use({Handle(static_cast<uint32_t>(step % 4))}, step + 1);
+        CHECK(device.residency.GetStats().residentBytes <= 300u);
+    }
+    CHECK_EQ(device.residency.GetStats().evictions, 41u);
+    CHECK_EQ(device.peakResidentBytes, 300u);
+}
+
+TEST(PlanWaitsForTheLatestUseOfItsVictims)
+{
+    SimulatedDevice device(300);
+    device.Create(Handle(1), 100);
+    device.Create(Handle(2), 100);
+    device.Create(Handle(3), 100);
+    device.Use({Handle(1)}, 7);
+    device.Use({Handle(2)}, 5);
+
+    // 3 and 1 are the oldest; the plan waits for fence 7, when 1 was last used.
+    ResidencyManager::EvictionPlan plan = device.residency.PlanEviction(150);
+    CHECK_EQ(plan.victims.size(), 2u);
+    CHECK(plan.victims[0] == Handle(3));
+    CHECK(plan.victims[1] == Handle(1));
+    CHECK_EQ(plan.bytes, 200u);
+    CHECK_EQ(plan.fenceValue, 7u);
+
+    // A plan is only a proposal until the owner marks the victims evicted.
+    CHECK_EQ(device.residency.GetStats().evictions, 0u);
+}
+
+TEST(PinnedAndEmptyTensorsAreNeverChosen)
+{
+    ResidencyManager residency(200);
+    residency.Add(Handle(1), 100);
+    residency.Add(Handle(2), 0);
+    residency.Add(Handle(3), 100);
+    residency.Pin({Handle(1)});
+
+    ResidencyManager::EvictionPlan plan = residency.PlanEviction(100);
+    CHECK_EQ(plan.victims.size(), 1u);
+    CHECK(plan.victims[0] == Handle(3));
+    CHECK_THROWS(residency.MarkEvicted(Handle(1)), std::logic_error);
+
+    // Pinned twice needs unpinning twice.
+    residency.Pin({Handle(1)});
+    residency.Unpin({Handle(1)}, 1);
+    CHECK_EQ(residency.PlanEviction(100).victims.size(), 1u);
+    residency.Unpin({Handle(1)}, 1);
+    CHECK_EQ(residency.PlanEviction(200).victims.size(), 2u);
+}
+
+TEST(PinnedTensorsOvercommitTheBudget)
+{
+    SimulatedDevice device(250);
+    device.Create(Handle(1), 100);
+    device.Create(Handle(2), 100);
+    device.residency.Pin({Handle(1), Handle(2)});
+
+    // Nothing can be evicted, so the plan frees less than needed and the device runs over its budget.
+    ResidencyManager::EvictionPlan plan = device.residency.PlanEviction(200);
+    CHECK(plan.victims.empty());
+    CHECK_EQ(plan.bytes, 0u);
+    device.Create(Handle(3), 200);
+    CHECK_EQ(device.residency.GetStats().residentBytes, 400u);
+    CHECK_EQ(device.peakResidentBytes, 400u);
+
+    // Once unpinned, the next call brings the device back within budget.
+    device.residency.Unpin({Handle(1), Handle(2)}, 3);
+    device.Use({Handle(3)}, 4);
+    CHECK(device.evictions == std::vector<uint32_t>({1, 2}));
+    CHECK_EQ(device.residency.GetStats().residentBytes, 200u);
+}
+
+TEST(OneCallLargerThanTheBudgetEvictsEverythingElse)
+{
+    SimulatedDevice device(300);
+    device.Create(Handle(1), 100);
+    device.Create(Handle(2), 100);
+    device.Create(Handle(3), 250);
+    device.Create(Handle(4), 250);
+    device.Use({Handle(3), Handle(4)}, 1);
+
+    CHECK(device.residency.IsResident(Handle(3)));
+    CHECK(device.residency.IsResident(Handle(4)));
+    CHECK(!device.residency.IsResident(Handle(1)));
+    CHECK(!device.residency.IsResident(Handle(2)));
+    CHECK_EQ(device.peakResidentBytes, 500u);
+}
+
+TEST(ShrinkingTheBudgetEvictsOnTheNextCall)
+{
+    SimulatedDevice device(400);
+    for (uint32_t i = 1; i <= 4; ++i)
+    {
+        device.Create(Handle(i), 100);
+    }
+    device.residency.SetBudget(150);
+    device.MakeRoom(0);
+    CHECK(device.evictions == std::vector<uint32_t>({1, 2, 3}));
+    CHECK_EQ(device.residency.GetStats().residentBytes, 100u);
+}
+
+TEST(ResizeAndRemoveKeepTheTotals)
+{
+    ResidencyManager residency(1000);
+    residency.Add(Handle(1), 100);
+    residency.Add(Handle(2), 100);
+    CHECK_THROWS(residency.Add(Handle(1), 100), std::logic_error);
+
+    residency.Resize(Handle(1), 300);
+    CHECK_EQ(residency.GetStats().residentBytes, 400u);
+
+    // An evicted tensor that is reshaped comes back resident without its contents.
+    residency.MarkEvicted(Handle(2));
+    residency.Resize(Handle(2), 50);
+    CHECK(residency.IsResident(Handle(2)));
+    CHECK_EQ(residency.GetStats().discards, 1u);
+    CHECK_EQ(residency.GetStats().residentBytes, 350u);
+
+    residency.MarkEvicted(Handle(1));
+    residency.Remove(Handle(1));
+    residency.Remove(Handle(1));
+    ResidencyStats stats = residency.GetStats();
+    CHECK_EQ(stats.evictedBytes, 0u);
+    CHECK_EQ(stats.evictedCount, 0u);
+    CHECK_EQ(stats.residentBytes, 50u);
+    CHECK(!residency.Contains(Handle(1)));
+    CHECK_THROWS(residency.MarkEvicted(Handle(1)), std::logic_error);
+}
+
+TEST(CpuBackendSpillsOverItsBudget)
+{
+    CpuBackendOptions options;
+    options.threadCount = 1;
+    options.memoryBudget = 1000;
+    CpuBackend backend(options);
+
+    // Four tensors of 400 bytes against a 1000-byte budget: at most two stay in memory.
+    std::vector<TensorHandle> tensors;
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        std::vector<float> values(100, static_cast<float>(i));
+        tensors.push_back(backend.CreateTensor("t" + std::to_string(i), {100}, TensorDataType::Float32));
+        backend.SetTensorData(tensors.back(), values.data(), values.size() * sizeof(float));
+        CHECK(backend.GetResidencyStats().residentBytes <= 1000u);
+    }
+    ResidencyStats stats = backend.GetResidencyStats();
+    CHECK_EQ(stats.residentCount, 2u);
+    CHECK_EQ(stats.evictedCount, 2u);
+
+    // Spilled tensors come back with their contents, evicting the least recently used.
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        std::vector<float> values(100);
+        backend.GetTensorData(tensors[i], {}, TensorDataType::Float32, values.data(), values.size() * sizeof(float));
+        for (float value : values)
+        {
+            CHECK_EQ(value, static_cast<float>(i));
+        }
+    }
+    stats = backend.GetResidencyStats();
+    CHECK(stats.pageIns >= 2u);
+    CHECK(stats.residentBytes <= 1000u);
+
+    // A call on three tensors pins 1200 bytes at once, over the budget. It still runs, and the backend is back
+    // within the budget once the call has unpinned them.
+    TensorHandle sum = backend.CreateTensor("sum", {100}, TensorDataType::Float32);
+    backend.ElementWiseAddBcast(tensors[0], tensors[1], sum);
+    CHECK(backend.GetResidencyStats().residentBytes <= 1000u);
+    std::vector<float> values(100);
+    backend.GetTensorData(sum, {}, TensorDataType::Float32, values.data(), values.size() * sizeof(float));
+    CHECK_EQ(values[0], 1.0f);
+}
@@ -0,0 +1,174 @@
+#include "StreamScheduler.hpp"
+#include "TestHarness.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+// Every stage costs a second per element on its queue and the host work is free, so a chunk of one element takes
+// three seconds when nothing overlaps.
+SimulatedStreamStages::Costs UnitCosts()
+{
+    SimulatedStreamStages::Costs costs;
+    costs.uploadSecondsPerElement = 1.0;
+    costs.computeSecondsPerElement = 1.0;
+    costs.readbackSecondsPerElement = 1.0;
+    return costs;
+}
+
+double RunPipeline(uint64_t count, uint64_t chunkElements, uint32_t bufferCount,
+                   const SimulatedStreamStages::Costs &costs)
+{
+    StreamScheduler scheduler(count, chunkElements, bufferCount);
+    SimulatedStreamStages stages(costs, bufferCount);
+    scheduler.Run(stages);
+    CHECK_EQ(stages.FinishedCount(), scheduler.ChunkCount());
+    return stages.Seconds();
+}
+
+// Records the order the scheduler issues stages in, forwarding them to a simulation that checks buffer reuse.
+class RecordingStages : public StreamStages
+{
+  public:
+    struct Call
+    {
+        StreamStage stage;
+        uint64_t index;
+        uint32_t slot;
+    };
+
+    RecordingStages(uint32_t bufferCount) : m_simulated(UnitCosts(), bufferCount)
+    {
+    }
+
+    StreamEvent Run(StreamStage stage, const StreamChunk &chunk, const std::vector<StreamEvent> &waits) override
+    {
+        calls.push_back({stage, chunk.index, chunk.slot});
+        return m_simulated.Run(stage, chunk, waits);
+    }
+
+    void Wait(const StreamEvent &event) override
+    {
+        m_simulated.Wait(event);
+    }
+
+    void Finish(const StreamChunk &chunk) override
+    {
+        finished.push_back(chunk.index);
+        m_simulated.Finish(chunk);
+    }
+
+    std::vector<Call> calls;
+    std::vector<uint64_t> finished;
+
+  private:
+    SimulatedStreamStages m_simulated;
+};
+} // namespace
+
+TEST(SplitsIntoChunksWithAShortTail)
+{
+    StreamScheduler scheduler(10, 4, 2);
+    CHECK_EQ(scheduler.ChunkCount(), 3u);
+
+    StreamChunk last = scheduler.Chunk(2);
+    CHECK_EQ(last.offset, 8u);
+    CHECK_EQ(last.count, 2u);
+    CHECK_EQ(last.slot, 0u);
+    CHECK_EQ(scheduler.Chunk(1).slot, 1u);
+}
+
+TEST(RejectsEmptyChunksAndNoBuffers)
+{
+    CHECK_THROWS(StreamScheduler(10, 0, 2), std::invalid_argument);
+    CHECK_THROWS(StreamScheduler(10, 4, 0), std::invalid_argument);
+}
+
+TEST(RunsEveryStageOfEveryChunkInOrder)
+{
+    for (uint32_t bufferCount = 1; bufferCount <= 3; ++bufferCount)
+    {
+        StreamScheduler scheduler(23, 4, bufferCount);
+        RecordingStages stages(bufferCount);
+        scheduler.Run(stages);
+
+        uint64_t chunkCount = scheduler.ChunkCount();
+        CHECK_EQ(stages.calls.size(), static_cast<size_t>(chunkCount * 3));
+        CHECK_EQ(stages.finished.size(), static_cast<size_t>(chunkCount));
+        for (uint64_t i = 0; i < stages.finished.size(); ++i)
+        {
+            CHECK_EQ(stages.finished[i], i);
+        }
+
+        // Each stage sees the chunks in order, each on its chunk's buffer set.
+        uint64_t next[3] = {};
+        for (const auto &call : stages.calls)
+        {
+            uint32_t stage = static_cast<uint32_t>(call.stage);
+            CHECK_EQ(call.index, next[stage]);
+            CHECK_EQ(call.slot, static_cast<uint32_t>(call.index % bufferCount));
+            ++next[stage];
+        }
+    }
+}
+
+TEST(OneBufferSetRunsChunksBackToBack)
+{
+    // Eight chunks of three one-second stages with nothing overlapping.
+    CHECK_NEAR(RunPipeline(8, 1, 1, UnitCosts()), 24.0, 1e-9);
+}
+
+TEST(MoreBufferSetsOverlapTheStages)
+{
+    double one = RunPipeline(8, 1, 1, UnitCosts());
+    double two = RunPipeline(8, 1, 2, UnitCosts());
+    double three = RunPipeline(8, 1, 3, UnitCosts());
+
+    // Uploads and readbacks share the copy queue, so it is busy for at least 16 seconds.
+    CHECK(two < one);
+    CHECK(three <= two);
+    CHECK(three >= 16.0 - 1e-9);
+}
+
+TEST(ComputeBoundPipelineHidesTheTransfers)
+{
+    SimulatedStreamStages::Costs costs = UnitCosts();
+    costs.computeSecondsPerElement = 4.0;
+
+    // Once the first upload is in, the compute queue never waits: one upload, eight dispatches, one readback.
+    CHECK_NEAR(RunPipeline(8, 1, 2, costs), 1.0 + 32.0 + 1.0, 1e-9);
+}
+
+TEST(WithoutACopyQueueTheStagesSerialize)
+{
+    SimulatedStreamStages::Costs costs = UnitCosts();
+    costs.copyQueue = false;
+    CHECK_NEAR(RunPipeline(8, 1, 3, costs), 24.0, 1e-9);
+}
+
+TEST(TailChunkCostsOnlyItsElements)
+{
+    // Two chunks of four and one of two.
+    CHECK_NEAR(RunPipeline(10, 4, 1, UnitCosts()), 30.0, 1e-9);
+}
+
+TEST(SimulationRejectsBufferReuseHazards)
+{
+    StreamScheduler scheduler(4, 1, 1);
+    {
+        SimulatedStreamStages stages(UnitCosts(), 1);
+        CHECK_THROWS(stages.Run(StreamStage::Compute, scheduler.Chunk(0), {}), std::logic_error);
+    }
+    {
+        // The second chunk's upload would overwrite inputs the first chunk's dispatch has not consumed.
+        SimulatedStreamStages stages(UnitCosts(), 1);
+        StreamEvent uploaded = stages.Run(StreamStage::Upload, scheduler.Chunk(0), {});
+        stages.Wait(uploaded);
+        CHECK_THROWS(stages.Run(StreamStage::Upload, scheduler.Chunk(1), {}), std::logic_error);
+    }
+    {
+        SimulatedStreamStages stages(UnitCosts(), 1);
+        CHECK_THROWS(stages.Finish(scheduler.Chunk(0)), std::logic_error);
+    }
+}
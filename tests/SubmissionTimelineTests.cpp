@@ -0,0 +1,195 @@
+#include "SubmissionTimeline.hpp"
+#include "TestHarness.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+// Stands in for an ID3D12Fence: the completed value is advanced by another thread, as the GPU would.
+class FakeFence
+{
+  public:
+    uint64_t GetCompletedValue()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_completed;
+    }
+
+    void Complete(uint64_t value)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_completed = std::max(m_completed, value);
+        }
+        m_completedChanged.notify_all();
+    }
+
+    // Blocks until value has completed, like SetEventOnCompletion without an event. Returns whether it had to.
+    bool Wait(uint64_t value)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_completed >= value)
+        {
+            return false;
+        }
+        m_completedChanged.wait(lock, [&] { return m_completed >= value; });
+        return true;
+    }
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_completedChanged;
+    uint64_t m_completed = 0;
+};
+
+struct FakeAllocator
+{
+    uint64_t lastSubmission = 0;
+    uint32_t resets = 0;
+};
+
+// The owner's side, the way DirectMLProcessor::Submit drives it: signal the next value, rotate the ring, wait for the
+// allocator it lands on, then reset that allocator. Each reset checks that the allocator's last submission is done.
+class SimulatedQueue
+{
+  public:
+    explicit SimulatedQueue(size_t allocatorCount) : allocators(allocatorCount)
+    {
+        for (FakeAllocator &allocator : allocators)
+        {
+            ring.Add(&allocator);
+        }
+    }
+
+    SubmissionTicket Submit()
+    {
+        SubmissionTicket ticket = timeline.Advance();
+        ring.Current()->lastSubmission = ticket.fenceValue;
+        submitted = ticket.fenceValue;
+
+        ring.Rotate(ticket.fenceValue);
+        blockingWaits += fence.Wait(ring.CurrentRetireValue()) ? 1 : 0;
+        FakeAllocator &next = *ring.Current();
+        if (next.lastSubmission > fence.GetCompletedValue())
+        {
+            ++resetsInFlight;
+        }
+        ++next.resets;
+        return ticket;
+    }
+
+    FakeFence fence;
+    SubmissionTimeline timeline;
+    std::vector<FakeAllocator> allocators;
+    AllocatorRing<FakeAllocator *> ring;
+    std::atomic<uint64_t> submitted{0};
+    uint32_t blockingWaits = 0;
+    uint32_t resetsInFlight = 0;
+};
+} // namespace
+
+TEST(FirstPassOverTheRingNeverWaits)
+{
+    SimulatedQueue queue(3);
+    queue.Submit();
+    queue.Submit();
+    CHECK_EQ(queue.blockingWaits, 0u);
+    CHECK_EQ(queue.ring.CurrentIndex(), 2u);
+    CHECK_EQ(queue.ring.RetireValue(0), 1u);
+    CHECK_EQ(queue.ring.RetireValue(1), 2u);
+    CHECK_EQ(queue.ring.CurrentRetireValue(), 0u);
+}
+
+TEST(AllocatorIsReusedOnlyAfterItsFence)
+{
+    SimulatedQueue queue(3);
+    queue.Submit();
+    queue.Submit();
+
+    // The third submission comes back round to the first allocator, which fence 1 still holds.
+    std::atomic<bool> returned{false};
+    std::thread submitter([&] {
+        queue.Submit();
+        returned = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(!returned);
+    queue.fence.Complete(1);
+    submitter.join();
+
+    CHECK(returned);
+    CHECK_EQ(queue.blockingWaits, 1u);
+    CHECK_EQ(queue.resetsInFlight, 0u);
+    CHECK_EQ(queue.allocators[0].resets, 1u);
+}
+
+TEST(WaitingOnACompletedValueReturnsImmediately)
+{
+    FakeFence fence;
+    fence.Complete(5);
+    CHECK(!fence.Wait(0));
+    CHECK(!fence.Wait(3));
+    CHECK(!fence.Wait(5));
+
+    // A queue the GPU keeps up with never blocks.
+    SimulatedQueue queue(2);
+    for (int i = 0; i < 10; ++i)
+    {
+        SubmissionTicket ticket = queue.Submit();
+        queue.fence.Complete(ticket.fenceValue);
+    }
+    CHECK_EQ(queue.blockingWaits, 0u);
+}
+
+TEST(AllocatorsFollowAFenceAdvancedByAnotherThread)
+{
+    constexpr uint64_t c_submissions = 500;
+    SimulatedQueue queue(3);
+
+    // Completes one submission at a time, a little behind the submitter.
+    std::thread gpu([&] {
+        uint64_t completed = 0;
+        while (completed < c_submissions)
+        {
+            if (completed < queue.submitted)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+                queue.fence.Complete(++completed);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    std::vector<uint64_t> retired;
+    for (uint64_t i = 0; i < c_submissions; ++i)
+    {
+        SubmissionTicket ticket = queue.Submit();
+        queue.timeline.Then(ticket, [&retired, ticket] { retired.push_back(ticket.fenceValue); });
+        for (auto &continuation : queue.timeline.Retire(queue.fence.GetCompletedValue()))
+        {
+            continuation();
+        }
+    }
+    gpu.join();
+    for (auto &continuation : queue.timeline.Retire(queue.fence.GetCompletedValue()))
+    {
+        continuation();
+    }
+
+    CHECK_EQ(queue.resetsInFlight, 0u);
+    CHECK_EQ(retired.size(), size_t(c_submissions));
+    for (size_t i = 0; i < retired.size(); ++i)
+    {
+        CHECK_EQ(retired[i], i + 1);
+    }
+    CHECK_EQ(queue.timeline.LastCompletedValue(), c_submissions);
+}
@@ -0,0 +1,217 @@
+#include "CpuBackend.hpp"
+#include "TensorCapacity.hpp"
+#include "TestHarness.hpp"
+
+#include <vector>
+
+TEST(SmallSizesAreTheirOwnBucket)
+{
+    for (uint32_t size = 0; size <= 8; ++size)
+    {
+        CHECK_EQ(ShapeBucket(size), size);
+    }
+}
+
+TEST(BucketsStepFourTimesPerDoubling)
+{
+    CHECK_EQ(ShapeBucket(9), 10u);
+    CHECK_EQ(ShapeBucket(10), 10u);
+    CHECK_EQ(ShapeBucket(11), 12u);
+    CHECK_EQ(ShapeBucket(15), 16u);
+    CHECK_EQ(ShapeBucket(16), 16u);
+    CHECK_EQ(ShapeBucket(17), 20u);
+    CHECK_EQ(ShapeBucket(31), 32u);
+    CHECK_EQ(ShapeBucket(33), 40u);
+    CHECK_EQ(ShapeBucket(1000), 1024u);
+    CHECK_EQ(ShapeBucket(1025), 1280u);
+}
+
+TEST(BucketsAreStableAndPadLessThanAQuarter)
+{
+    uint32_t previous = 0;
+    for (uint32_t size = 1; size <= 1 << 16; ++size)
+    {
+        uint32_t bucket = ShapeBucket(size);
+        CHECK(bucket >= size);
+        CHECK(bucket >= previous);
+        CHECK(static_cast<uint64_t>(bucket) * 4 < static_cast<uint64_t>(size) * 5);
+        CHECK_EQ(ShapeBucket(bucket), bucket);
+        previous = bucket;
+    }
+}
+
+TEST(BucketsThatOverflowKeepTheSize)
+{
+    CHECK_EQ(ShapeBucket(0xE0000000u), 0xE0000000u);
+    CHECK_EQ(ShapeBucket(0xE0000001u), 0xE0000001u);
+    CHECK_EQ(ShapeBucket(UINT32_MAX), UINT32_MAX);
+    CHECK_EQ(ShapeBucket(0xC0000001u), 0xE0000000u);
+}
+
+TEST(PaddingAxisIsTheFirstDimensionThatIsNotOne)
+{
+    CHECK_EQ(PaddingAxisFromRight({}), 0u);
+    CHECK_EQ(PaddingAxisFromRight({1, 1, 1}), 0u);
+    CHECK_EQ(PaddingAxisFromRight({1, 9, 3}), 2u);
+    CHECK_EQ(PaddingAxisFromRight({5, 1, 3}), 3u);
+    CHECK_EQ(PaddingAxisFromRight({1, 1, 7}), 1u);
+}
+
+TEST(PadShapeRoundsOnlyTheAxis)
+{
+    CHECK(PadShape({1, 9, 3}, 2) == TensorShape({1, 10, 3}));
+    CHECK(PadShape({1, 9, 3}, 1) == TensorShape({1, 9, 3}));
+    CHECK(PadShape({1, 9, 17}, 1) == TensorShape({1, 9, 20}));
+
+    // No axis, an axis past the shape and a broadcast dimension are all left alone.
+    CHECK(PadShape({9, 9}, 0) == TensorShape({9, 9}));
+    CHECK(PadShape({9, 9}, 3) == TensorShape({9, 9}));
+    CHECK(PadShape({1, 9}, 2) == TensorShape({1, 9}));
+}
+
+TEST(PaddedShapeKeepsBroadcastOperandsBroadcastable)
+{
+    TensorShape output{1, 33, 4};
+    size_t axis = PaddingAxisFromRight(output);
+    CHECK(PaddedShape(output) == TensorShape({1, 40, 4}));
+
+    // An operand broadcast along the padded axis stays 1 and still broadcasts to the padded output.
+    TensorShape operand{1, 1, 4};
+    CHECK(PadShape(operand, axis) == operand);
+    CHECK(BroadcastShapes(PadShape(operand, axis), PadShape(output, axis)) == TensorShape({1, 40, 4}));
+}
+
+TEST(FirstReserveIsExact)
+{
+    TensorCapacity capacity;
+    CHECK_EQ(capacity.Bytes(), 0u);
+    CHECK(capacity.Reserve(100, {}));
+    CHECK_EQ(capacity.Bytes(), 100u);
+    CHECK(!capacity.Reserve(100, {}));
+}
+
+TEST(GrowthIsGeometric)
+{
+    CapacityPolicy policy;
+    TensorCapacity capacity;
+    capacity.Reserve(100, policy);
+
+    // Just past the capacity grows by the factor; far past it grows to the request.
+    CHECK(capacity.Reserve(101, policy));
+    CHECK_EQ(capacity.Bytes(), 150u);
+    CHECK(!capacity.Reserve(150, policy));
+    CHECK(capacity.Reserve(1000, policy));
+    CHECK_EQ(capacity.Bytes(), 1000u);
+
+    // Growing one element at a time from 100 to 10000 reallocates a logarithmic number of times.
+    TensorCapacity growing;
+    growing.Reserve(100, policy);
+    uint32_t reallocations = 0;
+    for (uint64_t bytes = 101; bytes <= 10000; ++bytes)
+    {
+        reallocations += growing.Reserve(bytes, policy) ? 1 : 0;
+        CHECK(growing.Bytes() >= bytes);
+    }
+    CHECK(reallocations <= 12u);
+}
+
+TEST(GrowthFactorBelowOneGrowsToTheRequest)
+{
+    CapacityPolicy policy;
+    policy.growthFactor = 0.5;
+    TensorCapacity capacity;
+    capacity.Reserve(100, policy);
+    CHECK(capacity.Reserve(101, policy));
+    CHECK_EQ(capacity.Bytes(), 101u);
+}
+
+TEST(SmallerShapesReuseTheStorage)
+{
+    CapacityPolicy policy;
+    TensorCapacity capacity;
+    capacity.Reserve(1000, policy);
+    for (uint64_t bytes : {999u, 500u, 251u, 1000u, 1u, 1000u})
+    {
+        CHECK(!capacity.Reserve(bytes, policy));
+        CHECK_EQ(capacity.Bytes(), 1000u);
+    }
+}
+
+TEST(ShrinksAfterARunOfSmallReshapes)
+{
+    CapacityPolicy policy;
+    TensorCapacity capacity;
+    capacity.Reserve(1000, policy);
+
+    // 250 is exactly a quarter, the largest request that counts as small.
+    for (uint32_t i = 1; i < policy.shrinkAfter; ++i)
+    {
+        CHECK(!capacity.Reserve(250, policy));
+    }
+    CHECK(capacity.Reserve(250, policy));
+    CHECK_EQ(capacity.Bytes(), 375u);
+}
+
+TEST(ALargeReshapeRestartsTheShrinkCount)
+{
+    CapacityPolicy policy;
+    TensorCapacity capacity;
+    capacity.Reserve(1000, policy);
+    for (uint32_t i = 1; i < policy.shrinkAfter; ++i)
+    {
+        CHECK(!capacity.Reserve(10, policy));
+    }
+    CHECK(!capacity.Reserve(251, policy));
+    for (uint32_t i = 1; i < policy.shrinkAfter; ++i)
+    {
+        CHECK(!capacity.Reserve(10, policy));
+    }
+    CHECK_EQ(capacity.Bytes(), 1000u);
+    CHECK(capacity.Reserve(10, policy));
+    CHECK_EQ(capacity.Bytes(), 15u);
+}
+
+TEST(ShrinkRatioZeroNeverShrinks)
+{
+    CapacityPolicy policy;
+    policy.shrinkRatio = 0;
+    TensorCapacity capacity;
+    capacity.Reserve(1000, policy);
+    for (int i = 0; i < 100; ++i)
+    {
+        CHECK(!capacity.Reserve(1, policy));
+    }
+    CHECK_EQ(capacity.Bytes(), 1000u);
+}
+
+TEST(CpuBackendReshapesWithinCapacity)
+{
+    // A budget makes the backend account for each tensor's capacity.
+    CpuBackendOptions options;
+    options.threadCount = 1;
+    options.memoryBudget = 1ull << 30;
+    CpuBackend backend(options);
+
+    TensorHandle tensor = backend.CreateTensor("t", {100}, TensorDataType::Float32);
+    CHECK_EQ(backend.GetResidencyStats().residentBytes, 400u);
+
+    // Growing takes the policy's headroom, and the shrunk shape keeps it.
+    CHECK(backend.CreateTensor("t", {101}, TensorDataType::Float32) == tensor);
+    CHECK_EQ(backend.GetResidencyStats().residentBytes, 600u);
+    backend.CreateTensor("t", {150}, TensorDataType::Float32);
+    CHECK_EQ(backend.GetResidencyStats().residentBytes, 600u);
+    backend.CreateTensor("t", {40}, TensorDataType::Float32);
+    CHECK_EQ(backend.GetResidencyStats().residentBytes, 600u);
+    CHECK(backend.GetTensorShape(tensor) == TensorShape({40}));
+
+    // The reused storage holds the new shape's elements, zeroed.
+    std::vector<float> values(40, 1.0f);
+    backend.SetTensorData(tensor, values.data(), values.size() * sizeof(float));
+    backend.CreateTensor("t", {60}, TensorDataType::Float32);
+    std::vector<float> read(60, -1.0f);
+    backend.GetTensorData(tensor, {}, TensorDataType::Float32, read.data(), read.size() * sizeof(float));
+    for (float value : read)
+    {
+        CHECK_EQ(value, 0.0f);
+    }
+}
@@ -0,0 +1,310 @@
+#include "CpuBackend.hpp"
+#include "TensorFile.hpp"
+#include "TestHarness.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+// A directory of its own under the system's temporary directory, removed with everything in it.
+class TemporaryDirectory
+{
+  public:
+    TemporaryDirectory()
+    {
+        std::random_device random;
+        m_path = std::filesystem::temp_directory_path() / ("hello_dml_tests_" + std::to_string(random()));
+        std::filesystem::create_directories(m_path);
+    }
+
+    ~TemporaryDirectory()
+    {
+        std::error_code error;
+        std::filesystem::remove_all(m_path, error);
+    }
+
+    std::string File(const std::string &name) const
+    {
+        return (m_path / name).string();
+    }
+
+  private:
+    std::filesystem::path m_path;
+};
+
+void WriteFile(const std::string &path, const std::string &contents)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+}
+
+// A version 1 .npy file with the given header dictionary and contents.
+std::string Npy(const std::string &header, const std::string &contents)
+{
+    std::string file("\x93NUMPY\x01\x00", 8);
+    file += static_cast<char>(header.size() & 0xFF);
+    file += static_cast<char>(header.size() >> 8);
+    return file + header + contents;
+}
+
+// A safetensors file with the given JSON header and contents.
+std::string Safetensors(const std::string &header, const std::string &contents)
+{
+    std::string file;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        file += static_cast<char>((uint64_t(header.size()) >> (8 * i)) & 0xFF);
+    }
+    return file + header + contents;
+}
+
+TensorFileEntry Entry(const std::string &name, const TensorShape &shape, TensorDataType type)
+{
+    TensorFileEntry entry;
+    entry.name = name;
+    entry.shape = shape;
+    entry.type = type;
+    return entry;
+}
+
+// Fills the entry's contents with bytes derived from seed.
+void FillContents(const TensorFileWriter &writer, const TensorFileEntry &entry, uint8_t seed)
+{
+    uint8_t *data = writer.Data(entry);
+    for (uint64_t i = 0; i < entry.size; ++i)
+    {
+        data[i] = static_cast<uint8_t>(seed + i * 7);
+    }
+}
+
+void CheckContents(const TensorFile &file, const TensorFileEntry &entry, uint8_t seed)
+{
+    const uint8_t *data = file.Data(entry);
+    for (uint64_t i = 0; i < entry.size; ++i)
+    {
+        CHECK_EQ(data[i], static_cast<uint8_t>(seed + i * 7));
+    }
+}
+} // namespace
+
+TEST(NpyRoundTrip)
+{
+    TemporaryDirectory directory;
+    std::string path = directory.File("weights.npy");
+    {
+        TensorFileWriter writer(path, {Entry("ignored", {2, 3, 5}, TensorDataType::Float32)});
+        CHECK_EQ(writer.Entries()[0].size, 120u);
+        CHECK_EQ(writer.Entries()[0].offset % 64, 0u);
+        FillContents(writer, writer.Entries()[0], 1);
+    }
+
+    TensorFile file(path);
+    CHECK_EQ(file.Entries().size(), 1u);
+    const TensorFileEntry &entry = file.Entries()[0];
+    CHECK_EQ(entry.name, std::string("weights"));
+    CHECK(entry.shape == TensorShape({2, 3, 5}));
+    CHECK(entry.type == TensorDataType::Float32);
+    CHECK_EQ(entry.size, 120u);
+    CheckContents(file, entry, 1);
+}
+
+TEST(NpyRoundTripsOneDimension)
+{
+    // Python writes a one-element shape tuple with a trailing comma.
+    TemporaryDirectory directory;
+    std::string path = directory.File("v.npy");
+    {
+        TensorFileWriter writer(path, {Entry("v", {7}, TensorDataType::Int16)});
+        FillContents(writer, writer.Entries()[0], 3);
+    }
+    TensorFile file(path);
+    CHECK(file.Entries()[0].shape == TensorShape({7}));
+    CHECK(file.Entries()[0].type == TensorDataType::Int16);
+    CheckContents(file, file.Entries()[0], 3);
+}
+
+TEST(SafetensorsRoundTrip)
+{
+    TemporaryDirectory directory;
+    std::string path = directory.File("model.safetensors");
+    std::vector<TensorFileEntry> entries{
+        Entry("bytes", {3}, TensorDataType::Int8),
+        Entry("weights", {4, 5}, TensorDataType::Float32),
+        Entry("quoted \"name\"", {2, 3}, TensorDataType::Float16),
+        Entry("indices", {3}, TensorDataType::Int64),
+    };
+    {
+        TensorFileWriter writer(path, entries);
+        CHECK_EQ(writer.Entries().size(), entries.size());
+        for (size_t i = 0; i < writer.Entries().size(); ++i)
+        {
+            const TensorFileEntry &entry = writer.Entries()[i];
+            CHECK_EQ(entry.name, entries[i].name);
+            CHECK_EQ(entry.offset % DataTypeSize(entry.type), 0u);
+            FillContents(writer, entry, static_cast<uint8_t>(i * 50));
+        }
+    }
+
+    TensorFile file(path);
+    CHECK_EQ(file.Entries().size(), entries.size());
+    for (size_t i = 0; i < file.Entries().size(); ++i)
+    {
+        const TensorFileEntry &entry = file.Entries()[i];
+        CHECK_EQ(entry.name, entries[i].name);
+        CHECK(entry.shape == entries[i].shape);
+        CHECK(entry.type == entries[i].type);
+        CHECK_EQ(entry.size, ElementCount(entries[i].shape) * DataTypeSize(entries[i].type));
+        CheckContents(file, entry, static_cast<uint8_t>(i * 50));
+    }
+}
+
+TEST(WriterRejectsWhatTheFormatsCannotHold)
+{
+    TemporaryDirectory directory;
+    CHECK_THROWS(TensorFileWriter(directory.File("two.npy"),
+                                  {Entry("a", {1}, TensorDataType::Float32), Entry("b", {1}, TensorDataType::Float32)}),
+                 std::invalid_argument);
+    CHECK_THROWS(TensorFileWriter(directory.File("t.bin"), {Entry("a", {1}, TensorDataType::Float32)}),
+                 std::invalid_argument);
+    CHECK_THROWS(TensorFileWriter(directory.File("t.safetensors"), {Entry("a", {1}, TensorDataType::Unknown)}),
+                 std::invalid_argument);
+}
+
+TEST(ScalarReadsAsOneElement)
+{
+    TemporaryDirectory directory;
+    std::string path = directory.File("scalar.npy");
+    WriteFile(path, Npy("{'descr': '<f4', 'fortran_order': False, 'shape': (), }\n", std::string(4, '\0')));
+    TensorFile file(path);
+    CHECK(file.Entries()[0].shape == TensorShape({1}));
+    CHECK_EQ(file.Entries()[0].size, 4u);
+}
+
+TEST(RejectsTruncatedNpy)
+{
+    TemporaryDirectory directory;
+    std::string path = directory.File("t.npy");
+    {
+        TensorFileWriter writer(path, {Entry("t", {4, 4}, TensorDataType::Float32)});
+    }
+    uint64_t size = std::filesystem::file_size(path);
+
+    // Cut in the contents, in the header and in the magic.
+    for (uint64_t cut : {size - 1, uint64_t(20), uint64_t(4)})
+    {
+        std::filesystem::resize_file(path, cut);
+        CHECK_THROWS(TensorFile{path}, std::runtime_error);
+    }
+}
+
+TEST(RejectsTruncatedSafetensors)
+{
+    TemporaryDirectory directory;
+    std::string path = directory.File("t.safetensors");
+    {
+        TensorFileWriter writer(path,
+                                {Entry("a", {8}, TensorDataType::Float32), Entry("b", {8}, TensorDataType::Int32)});
+    }
+    uint64_t size = std::filesystem::file_size(path);
+    for (uint64_t cut : {size - 1, uint64_t(16), uint64_t(5)})
+    {
+        std::filesystem::resize_file(path, cut);
+        CHECK_THROWS(TensorFile{path}, std::runtime_error);
+    }
+}
+
+TEST(RejectsBadDataOffsets)
+{
+    TemporaryDirectory directory;
+    std::string path = directory.File("t.safetensors");
+    std::string contents(16, '\0');
+    const char *headers[] = {
+        R"({"t":{"dtype":"F32","shape":[2],"data_offsets":[8,0]}})",     // End before start.
+        R"({"t":{"dtype":"F32","shape":[2],"data_offsets":[0,4]}})",     // Smaller than the shape.
+        R"({"t":{"dtype":"F32","shape":[2],"data_offsets":[0,12]}})",    // Larger than the shape.
+        R"({"t":{"dtype":"F32","shape":[2],"data_offsets":[12,20]}})",   // Past the end of the file.
+        R"({"t":{"dtype":"F32","shape":[2],"data_offsets":[0]}})",       // One offset.
+        R"({"t":{"dtype":"F32","shape":[2]}})",                          // None.
+        R"({"t":{"dtype":"F32","shape":[2],"data_offsets":[18446744073709551615,8]}})",
+    };
+    for (const char *header : headers)
+    {
+        WriteFile(path, Safetensors(header, contents));
+        CHECK_THROWS(TensorFile{path}, std::runtime_error);
+    }
+
+    // The same file with valid offsets loads.
+    WriteFile(path, Safetensors(R"({"t":{"dtype":"F32","shape":[2],"data_offsets":[8,16]}})", contents));
+    TensorFile file(path);
+    CHECK_EQ(file.Entries()[0].size, 8u);
+}
+
+TEST(RejectsBigEndianData)
+{
+    TemporaryDirectory directory;
+    std::string path = directory.File("t.npy");
+    WriteFile(path, Npy("{'descr': '>f4', 'fortran_order': False, 'shape': (2,), }\n", std::string(8, '\0')));
+    CHECK_THROWS(TensorFile{path}, std::runtime_error);
+
+    // Single-byte types have no byte order and load either way they are marked.
+    WriteFile(path, Npy("{'descr': '|u1', 'fortran_order': False, 'shape': (2,), }\n", std::string(2, '\0')));
+    CHECK(TensorFile(path).Entries()[0].type == TensorDataType::UInt8);
+}
+
+TEST(RejectsFortranOrder)
+{
+    TemporaryDirectory directory;
+    std::string path = directory.File("t.npy");
+    WriteFile(path, Npy("{'descr': '<f4', 'fortran_order': True, 'shape': (2, 2), }\n", std::string(16, '\0')));
+    CHECK_THROWS(TensorFile{path}, std::runtime_error);
+}
+
+TEST(RejectsBfloat16AndBool)
+{
+    TemporaryDirectory directory;
+    std::string path = directory.File("t.safetensors");
+    WriteFile(path, Safetensors(R"({"t":{"dtype":"BF16","shape":[4],"data_offsets":[0,8]}})", std::string(8, '\0')));
+    CHECK_THROWS(TensorFile{path}, std::runtime_error);
+    WriteFile(path, Safetensors(R"({"t":{"dtype":"BOOL","shape":[4],"data_offsets":[0,4]}})", std::string(4, '\0')));
+    CHECK_THROWS(TensorFile{path}, std::runtime_error);
+
+    std::string npyPath = directory.File("t.npy");
+    WriteFile(npyPath, Npy("{'descr': '|b1', 'fortran_order': False, 'shape': (4,), }\n", std::string(4, '\0')));
+    CHECK_THROWS(TensorFile{npyPath}, std::runtime_error);
+}
+
+TEST(BackendSavesAndLoadsTensors)
+{
+    TemporaryDirectory directory;
+    std::string path = directory.File("saved.safetensors");
+    CpuBackendOptions options;
+    options.threadCount = 1;
+    CpuBackend backend(options);
+
+    std::vector<float> a{1.0f, -2.0f, 3.5f, 0.25f, 8.0f, -0.5f};
+    std::vector<int32_t> b{7, -8, 9};
+    backend.SetTensorData("a", {2, 3}, TensorDataType::Float32, a.data(), a.size() * sizeof(float));
+    backend.SetTensorData("b", {3}, TensorDataType::Int32, b.data(), b.size() * sizeof(int32_t));
+    backend.SaveTensors(path, {"a", "b"});
+
+    std::vector<TensorHandle> loaded = backend.LoadTensors(path, "loaded_");
+    CHECK_EQ(loaded.size(), 2u);
+    CHECK(backend.FindTensor("loaded_a") == loaded[0]);
+    CHECK(backend.GetTensorShape(loaded[0]) == TensorShape({2, 3}));
+    CHECK(backend.GetTensorType(loaded[1]) == TensorDataType::Int32);
+
+    std::vector<float> readA(a.size());
+    backend.GetTensorData("loaded_a", TensorShape{2, 3}, TensorDataType::Float32, readA.data(),
+                          readA.size() * sizeof(float));
+    CHECK(readA == a);
+    std::vector<int32_t> readB(b.size());
+    backend.GetTensorData("loaded_b", TensorShape{3}, TensorDataType::Int32, readB.data(),
+                          readB.size() * sizeof(int32_t));
+    CHECK(readB == b);
+}
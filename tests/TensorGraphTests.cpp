@@ -0,0 +1,163 @@
+#include "CpuBackend.hpp"
+#include "TensorGraph.hpp"
+#include "TestHarness.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+// x {2, 3} plus y {1, 3} broadcast over the rows, through a LeakyRelu of alpha 0.5, summed along the rows and
+// averaged down the columns. The activation is an output too.
+TensorGraph SmallGraph(float alpha = 0.5f)
+{
+    TensorGraph graph;
+    TensorGraph::NodeId sum = graph.Add(graph.Input("x"), graph.Input("y"));
+    TensorGraph::NodeId activation = graph.LeakyRelu(sum, alpha);
+    graph.Output(activation, "activation");
+    graph.Output(graph.ReduceSum(activation, 1), "rows");
+    graph.Output(graph.ReduceMean(activation, 0), "columns");
+    return graph;
+}
+
+const std::vector<float> c_x{1, -2, 3, -4, 5, -6};
+const std::vector<float> c_y{1, 1, -1};
+
+// x + y is {2, -1, 2, -3, 6, -7}.
+const std::vector<float> c_activation{2, -0.5f, 2, -1.5f, 6, -3.5f};
+const std::vector<float> c_rows{3.5f, 1};
+const std::vector<float> c_columns{0.25f, 2.75f, -0.75f};
+
+TensorHandle Upload(CpuBackend &backend, const std::string &name, const TensorShape &shape,
+                    const std::vector<float> &values)
+{
+    TensorHandle tensor = backend.CreateTensor(name, shape, TensorDataType::Float32);
+    backend.SetTensorData(tensor, values.data(), values.size() * sizeof(float));
+    return tensor;
+}
+
+std::vector<float> Download(CpuBackend &backend, const std::string &name, const TensorShape &shape)
+{
+    std::vector<float> values(static_cast<size_t>(ElementCount(shape)));
+    backend.GetTensorData(name, shape, TensorDataType::Float32, values.data(), values.size() * sizeof(float));
+    return values;
+}
+
+CpuBackendOptions Options()
+{
+    CpuBackendOptions options;
+    options.threadCount = 1;
+    return options;
+}
+} // namespace
+
+TEST(ReferenceInterpreterComputesEveryOutput)
+{
+    std::unordered_map<std::string, HostTensor> tensors;
+    tensors["x"] = HostTensor{{2, 3}, c_x};
+    tensors["y"] = HostTensor{{1, 3}, c_y};
+    RunGraphOnCpu(SmallGraph(), tensors);
+
+    CHECK(tensors["activation"].shape == std::vector<uint32_t>({2, 3}));
+    CHECK(tensors["activation"].data == c_activation);
+    CHECK(tensors["rows"].shape == std::vector<uint32_t>({2, 1}));
+    CHECK(tensors["rows"].data == c_rows);
+    CHECK(tensors["columns"].shape == std::vector<uint32_t>({1, 3}));
+    CHECK(tensors["columns"].data == c_columns);
+
+    // Inputs are read, never written.
+    CHECK(tensors["x"].data == c_x);
+}
+
+TEST(ReferenceInterpreterReducesWithMax)
+{
+    TensorGraph graph;
+    TensorGraph::NodeId x = graph.Input("x");
+    graph.Output(graph.ReduceMax(graph.Relu(graph.Subtract(x, graph.Input("y"))), 0), "max");
+
+    std::unordered_map<std::string, HostTensor> tensors;
+    tensors["x"] = HostTensor{{2, 3}, c_x};
+    tensors["y"] = HostTensor{{1, 3}, c_y};
+    RunGraphOnCpu(graph, tensors);
+
+    // x - y is {0, -3, 4, -5, 4, -5}.
+    CHECK(tensors["max"].data == std::vector<float>({0, 4, 4}));
+}
+
+TEST(CpuBackendRunsTheGraph)
+{
+    CpuBackend backend(Options());
+    Upload(backend, "x", {2, 3}, c_x);
+    Upload(backend, "y", {1, 3}, c_y);
+    backend.CreateTensor("activation", {2, 3}, TensorDataType::Float32);
+    backend.CreateTensor("rows", {2, 1}, TensorDataType::Float32);
+    backend.CreateTensor("columns", {1, 3}, TensorDataType::Float32);
+    backend.ExecuteGraph(SmallGraph());
+
+    CHECK(Download(backend, "activation", {2, 3}) == c_activation);
+    CHECK(Download(backend, "rows", {2, 1}) == c_rows);
+    CHECK(Download(backend, "columns", {1, 3}) == c_columns);
+}
+
+TEST(CpuBackendRejectsMissingAndMisshapenTensors)
+{
+    CpuBackend backend(Options());
+    Upload(backend, "x", {2, 3}, c_x);
+    Upload(backend, "y", {1, 3}, c_y);
+    backend.CreateTensor("activation", {2, 3}, TensorDataType::Float32);
+    backend.CreateTensor("rows", {2, 1}, TensorDataType::Float32);
+    CHECK_THROWS(backend.ExecuteGraph(SmallGraph()), std::invalid_argument);
+
+    backend.CreateTensor("columns", {3}, TensorDataType::Float32);
+    CHECK_THROWS(backend.ExecuteGraph(SmallGraph()), std::invalid_argument);
+    CHECK_THROWS(backend.ExecuteGraph(TensorGraph()), std::invalid_argument);
+}
+
+TEST(InvalidReferencesThrow)
+{
+    TensorGraph graph;
+    TensorGraph::NodeId x = graph.Input("x");
+    CHECK_THROWS(graph.Add(x, x + 1), std::invalid_argument);
+    CHECK_THROWS(graph.Relu(7), std::invalid_argument);
+    CHECK_THROWS(graph.ReduceSum(x + 1, 0), std::invalid_argument);
+    CHECK_THROWS(graph.Output(x + 1, "y"), std::invalid_argument);
+
+    // Nothing that failed was added.
+    CHECK_EQ(graph.Nodes().size(), 1u);
+    CHECK(graph.OutputNodes().empty());
+
+    // Tensors the graph needs but is not given, or given with the wrong amount of data, and reductions past the
+    // rank fail when it runs.
+    graph.Output(graph.ReduceSum(x, 2), "y");
+    std::unordered_map<std::string, HostTensor> tensors;
+    CHECK_THROWS(RunGraphOnCpu(graph, tensors), std::invalid_argument);
+    tensors["x"] = HostTensor{{2, 3}, {1, 2, 3}};
+    CHECK_THROWS(RunGraphOnCpu(graph, tensors), std::invalid_argument);
+    tensors["x"] = HostTensor{{2, 3}, c_x};
+    CHECK_THROWS(RunGraphOnCpu(graph, tensors), std::invalid_argument);
+}
+
+TEST(SignaturesCoverStructureAndAlphaButNotNames)
+{
+    CHECK_EQ(SmallGraph().Signature(), SmallGraph().Signature());
+    CHECK(SmallGraph(0.5f).Signature() != SmallGraph(0.25f).Signature());
+    CHECK(SmallGraph(1e-7f).Signature() != SmallGraph(2e-7f).Signature());
+
+    TensorGraph renamed;
+    TensorGraph::NodeId sum = renamed.Add(renamed.Input("a"), renamed.Input("b"));
+    TensorGraph::NodeId activation = renamed.LeakyRelu(sum, 0.5f);
+    renamed.Output(activation, "c");
+    renamed.Output(renamed.ReduceSum(activation, 1), "d");
+    renamed.Output(renamed.ReduceMean(activation, 0), "e");
+    CHECK_EQ(renamed.Signature(), SmallGraph().Signature());
+
+    TensorGraph otherAxis;
+    sum = otherAxis.Add(otherAxis.Input("x"), otherAxis.Input("y"));
+    activation = otherAxis.LeakyRelu(sum, 0.5f);
+    otherAxis.Output(activation, "activation");
+    otherAxis.Output(otherAxis.ReduceSum(activation, 0), "rows");
+    otherAxis.Output(otherAxis.ReduceMean(activation, 0), "columns");
+    CHECK(otherAxis.Signature() != SmallGraph().Signature());
+}
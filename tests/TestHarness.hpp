@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// A minimal test registry, so the unit tests build with nothing but the standard library. Each test file is its own
+// executable registered with ctest; TEST defines a case, and the CHECK macros throw TestFailure, which ends the case
+// and marks the executable as failed.
+
+struct TestFailure : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+struct TestCase
+{
+    const char *name;
+    std::function<void()> run;
+};
+
+inline std::vector<TestCase> &TestCases()
+{
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+struct TestRegistrar
+{
+    TestRegistrar(const char *name, std::function<void()> run)
+    {
+        TestCases().push_back({name, std::move(run)});
+    }
+};
+
+inline std::string TestLocation(const char *file, int line)
+{
+    return std::string(file) + ":" + std::to_string(line) + ": ";
+}
+
+#define TEST(name)                                                                                                    \
+    static void name();                                                                                               \
+    static TestRegistrar name##Registrar(#name, name);                                                                \
+    static void name()
+
+#define CHECK(condition)                                                                                              \
+    do                                                                                                                \
+    {                                                                                                                 \
+        if (!(condition))                                                                                             \
+        {                                                                                                             \
+            throw TestFailure(TestLocation(__FILE__, __LINE__) + "CHECK(" #condition ") failed");                     \
+        }                                                                                                             \
+    } while (false)
+
+#define CHECK_EQ(actual, expected)                                                                                    \
+    do                                                                                                                \
+    {                                                                                                                 \
+        const auto actualValue = (actual);                                                                            \
+        const auto expectedValue = (expected);                                                                        \
+        if (!(actualValue == expectedValue))                                                                          \
+        {                                                                                                             \
+            std::ostringstream message;                                                                               \
+            message << TestLocation(__FILE__, __LINE__) << #actual " is " << actualValue << ", expected "             \
+                    << expectedValue;                                                                                 \
+            throw TestFailure(message.str());                                                                         \
+        }                                                                                                             \
+    } while (false)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                                                       \
+    do                                                                                                                \
+    {                                                                                                                 \
+        double actualValue = (actual);                                                                                \
+        double expectedValue = (expected);                                                                            \
+        if (!(std::fabs(actualValue - expectedValue) <= (tolerance)))                                                 \
+        {                                                                                                             \
+            std::ostringstream message;                                                                               \
+            message << TestLocation(__FILE__, __LINE__) << #actual " is " << actualValue << ", expected "             \
+                    << expectedValue << " within " << (tolerance);                                                    \
+            throw TestFailure(message.str());                                                                         \
+        }                                                                                                             \
+    } while (false)
+
+#define CHECK_THROWS(statement, exception)                                                                            \
+    do                                                                                                                \
+    {                                                                                                                 \
+        bool thrown = false;                                                                                          \
+        try                                                                                                           \
+        {                                                                                                             \
+            statement;                                                                                                \
+        }                                                                                                             \
+        catch (const exception &)                                                                                     \
+        {                                                                                                             \
+            thrown = true;                                                                                            \
+        }                                                                                                             \
+        if (!thrown)                                                                                                  \
+        {                                                                                                             \
+            throw TestFailure(TestLocation(__FILE__, __LINE__) + #statement " did not throw " #exception);            \
+        }                                                                                                             \
+    } while (false)
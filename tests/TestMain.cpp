@@ -0,0 +1,32 @@
+#include "TestHarness.hpp"
+
+#include <cstring>
+#include <exception>
+
+// Runs every registered case, or only those whose name contains argv[1].
+int main(int argc, char const *argv[])
+{
+    const char *filter = argc > 1 ? argv[1] : "";
+    int run = 0;
+    int failed = 0;
+    for (const TestCase &test : TestCases())
+    {
+        if (!strstr(test.name, filter))
+        {
+            continue;
+        }
+        ++run;
+        try
+        {
+            test.run();
+            printf("[ pass ] %s\n", test.name);
+        }
+        catch (const std::exception &e)
+        {
+            ++failed;
+            printf("[ FAIL ] %s\n         %s\n", test.name, e.what());
+        }
+    }
+    printf("%d of %d tests passed\n", run - failed, run);
+    return failed == 0 && run != 0 ? 0 : 1;
+}
@@ -0,0 +1,158 @@
+#include "TestHarness.hpp"
+#include "TlsfAllocator.hpp"
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+// Checks that the live allocations are disjoint, inside the capacity and accounted for in the stats.
+static void CheckConsistent(const TlsfAllocator &allocator, const std::vector<TlsfAllocator::Allocation> &live)
+{
+    std::map<uint64_t, uint64_t> ranges;
+    uint64_t used = 0;
+    for (const TlsfAllocator::Allocation &allocation : live)
+    {
+        CHECK(ranges.emplace(allocation.offset, allocation.size).second);
+        used += allocation.size;
+    }
+    uint64_t end = 0;
+    for (const auto &[offset, size] : ranges)
+    {
+        CHECK(offset >= end);
+        end = offset + size;
+    }
+    CHECK(end <= allocator.Capacity());
+
+    TlsfAllocator::Stats stats = allocator.GetStats();
+    CHECK_EQ(stats.usedBytes, used);
+    CHECK_EQ(stats.allocationCount, static_cast<uint32_t>(live.size()));
+    CHECK_EQ(stats.freeBytes, allocator.Capacity() - used);
+    CHECK(stats.largestFreeBlock <= stats.freeBytes);
+}
+
+static void CheckFullyCoalesced(const TlsfAllocator &allocator)
+{
+    TlsfAllocator::Stats stats = allocator.GetStats();
+    CHECK(allocator.Empty());
+    CHECK_EQ(stats.freeBlockCount, 1u);
+    CHECK_EQ(stats.largestFreeBlock, allocator.Capacity());
+    CHECK_EQ(stats.Fragmentation(), 0.0);
+}
+
+TEST(RoundsSizesUpToTheGranularity)
+{
+    TlsfAllocator allocator(1 << 20, 256);
+    auto allocation = allocator.Allocate(1);
+    CHECK(allocation.has_value());
+    CHECK_EQ(allocation->size, 256u);
+    CHECK_EQ(allocation->offset % 256, 0u);
+    CHECK(!allocator.Allocate(0));
+    CHECK(!allocator.Allocate((1 << 20) + 1));
+}
+
+TEST(RejectsGranularityThatIsNotAPowerOfTwo)
+{
+    CHECK_THROWS(TlsfAllocator(1024, 48), std::invalid_argument);
+    CHECK_THROWS(TlsfAllocator(1024, 0), std::invalid_argument);
+}
+
+TEST(FillsTheWholeCapacityExactly)
+{
+    TlsfAllocator allocator(64 * 256, 256);
+    std::vector<TlsfAllocator::Allocation> live;
+    while (auto allocation = allocator.Allocate(256))
+    {
+        live.push_back(*allocation);
+    }
+    CHECK_EQ(live.size(), 64u);
+    CheckConsistent(allocator, live);
+    CHECK_EQ(allocator.GetStats().freeBytes, 0u);
+
+    for (const TlsfAllocator::Allocation &allocation : live)
+    {
+        allocator.Free(allocation);
+    }
+    CheckFullyCoalesced(allocator);
+}
+
+TEST(CoalescesWithBothNeighbours)
+{
+    TlsfAllocator allocator(4 * 256, 256);
+    auto a = *allocator.Allocate(256);
+    auto b = *allocator.Allocate(256);
+    auto c = *allocator.Allocate(256);
+    auto d = *allocator.Allocate(256);
+    allocator.Free(a);
+    allocator.Free(c);
+    CHECK_EQ(allocator.GetStats().freeBlockCount, 2u);
+    CHECK(!allocator.Allocate(512));
+
+    allocator.Free(b); // Joins a and c.
+    CHECK_EQ(allocator.GetStats().freeBlockCount, 1u);
+    CHECK_EQ(allocator.GetStats().largestFreeBlock, 768u);
+    allocator.Free(d);
+    CheckFullyCoalesced(allocator);
+}
+
+TEST(DoubleFreeThrows)
+{
+    TlsfAllocator allocator(4 * 256, 256);
+    auto a = *allocator.Allocate(256);
+    allocator.Allocate(256);
+    allocator.Free(a);
+    CHECK_THROWS(allocator.Free(a), std::invalid_argument);
+    CHECK_THROWS(allocator.Free(TlsfAllocator::Allocation{}), std::invalid_argument);
+}
+
+// Random allocations and frees of mixed sizes, with the allocator's invariants checked after every step, then
+// everything freed in random order.
+TEST(RandomAllocateAndFree)
+{
+    for (uint32_t seed = 1; seed <= 8; ++seed)
+    {
+        std::mt19937 random(seed);
+        TlsfAllocator allocator(16ull << 20, 256);
+        std::vector<TlsfAllocator::Allocation> live;
+        std::uniform_int_distribution<int> action(0, 99);
+        std::uniform_int_distribution<uint32_t> sizeLog2(0, 20);
+
+        for (int step = 0; step < 4000; ++step)
+        {
+            if (live.empty() || action(random) < 55)
+            {
+                uint64_t size = (uint64_t(1) << sizeLog2(random)) + random() % 4096;
+                auto allocation = allocator.Allocate(size);
+                if (allocation)
+                {
+                    CHECK(allocation->size >= size);
+                    CHECK_EQ(allocation->offset % 256, 0u);
+                    live.push_back(*allocation);
+                }
+                else
+                {
+                    // A failure must mean no free block could hold the request, rounded to its size class.
+                    CHECK(allocator.GetStats().largestFreeBlock < size * 2);
+                }
+            }
+            else
+            {
+                size_t index = random() % live.size();
+                allocator.Free(live[index]);
+                live[index] = live.back();
+                live.pop_back();
+            }
+            if (step % 16 == 0)
+            {
+                CheckConsistent(allocator, live);
+            }
+        }
+
+        CheckConsistent(allocator, live);
+        std::shuffle(live.begin(), live.end(), random);
+        for (const TlsfAllocator::Allocation &allocation : live)
+        {
+            allocator.Free(allocation);
+        }
+        CheckFullyCoalesced(allocator);
+    }
+}
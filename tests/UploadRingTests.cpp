@@ -0,0 +1,110 @@
+#include "TestHarness.hpp"
+#include "UploadRing.hpp"
+
+TEST(AllocatesAlignedFromTheHead)
+{
+    UploadRing ring(1024);
+    CHECK_EQ(*ring.Allocate(100, 1), 0u);
+    CHECK_EQ(*ring.Allocate(100, 256), 256u);
+    // The padding between 100 and 256 counts as used until it retires.
+    CHECK_EQ(ring.UsedBytes(), 356u);
+    CHECK(ring.HasUncommitted());
+}
+
+TEST(RejectsEmptyAndOversizedAllocations)
+{
+    UploadRing ring(1024);
+    CHECK(!ring.Allocate(0, 1));
+    CHECK(!ring.Allocate(1025, 1));
+    CHECK_EQ(ring.UsedBytes(), 0u);
+}
+
+TEST(FullRingWaitsForRetire)
+{
+    UploadRing ring(1024);
+    CHECK(ring.Allocate(512, 1).has_value());
+    CHECK(ring.Allocate(512, 1).has_value());
+    CHECK(!ring.Allocate(1, 1));
+    CHECK_EQ(ring.OldestPendingFenceValue(), 0u);
+
+    ring.Commit(1);
+    CHECK_EQ(ring.OldestPendingFenceValue(), 1u);
+    CHECK(!ring.HasUncommitted());
+    CHECK(!ring.Allocate(1, 1));
+
+    ring.Retire(0);
+    CHECK(!ring.Allocate(1, 1));
+    ring.Retire(1);
+    CHECK_EQ(ring.UsedBytes(), 0u);
+    // An empty ring starts over at offset 0, with all of its capacity contiguous.
+    CHECK_EQ(*ring.Allocate(1024, 1), 0u);
+}
+
+TEST(RetiresRegionsInFenceOrder)
+{
+    UploadRing ring(1024);
+    ring.Allocate(256, 1);
+    ring.Commit(1);
+    ring.Allocate(256, 1);
+    ring.Commit(2);
+    ring.Allocate(256, 1);
+    ring.Commit(3);
+    CHECK_EQ(ring.UsedBytes(), 768u);
+
+    ring.Retire(2);
+    CHECK_EQ(ring.UsedBytes(), 256u);
+    CHECK_EQ(ring.OldestPendingFenceValue(), 3u);
+    ring.Retire(3);
+    CHECK_EQ(ring.UsedBytes(), 0u);
+    CHECK_EQ(ring.OldestPendingFenceValue(), 0u);
+}
+
+TEST(WrapsAroundAndWastesTheRemainder)
+{
+    UploadRing ring(1024);
+    ring.Allocate(400, 1);
+    ring.Commit(1);
+    ring.Allocate(400, 1); // [400, 800)
+    ring.Commit(2);
+    ring.Retire(1);        // The tail moves to 400.
+
+    // 300 bytes do not fit in [800, 1024), so they wrap to the start, and the 224 bytes at the end count as used.
+    CHECK_EQ(*ring.Allocate(300, 1), 0u);
+    CHECK_EQ(ring.UsedBytes(), 400u + 224u + 300u);
+    // Only [300, 400) is left before the tail.
+    CHECK(!ring.Allocate(101, 1));
+    CHECK_EQ(*ring.Allocate(100, 1), 300u);
+    ring.Commit(3);
+
+    ring.Retire(3);
+    CHECK_EQ(ring.UsedBytes(), 0u);
+}
+
+TEST(WrapFailsWhenTheStartIsBusy)
+{
+    UploadRing ring(1024);
+    ring.Allocate(200, 1);
+    ring.Commit(1);
+    ring.Allocate(700, 1); // [200, 900)
+    ring.Commit(2);
+    ring.Retire(1);        // The tail moves to 200.
+
+    CHECK(!ring.Allocate(201, 1));
+    CHECK_EQ(*ring.Allocate(200, 1), 0u);
+}
+
+TEST(FenceValuesMustNotDecrease)
+{
+    UploadRing ring(1024);
+    ring.Allocate(16, 1);
+    ring.Commit(5);
+    ring.Allocate(16, 1);
+    CHECK_THROWS(ring.Commit(4), std::logic_error);
+}
+
+TEST(CommitWithoutAllocationsIsIgnored)
+{
+    UploadRing ring(1024);
+    ring.Commit(7);
+    CHECK_EQ(ring.OldestPendingFenceValue(), 0u);
+}